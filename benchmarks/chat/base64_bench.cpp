@@ -0,0 +1,74 @@
+#include <benchmark/benchmark.h>
+#include <random>
+#include <string>
+#include <vector>
+#include "codec/base64.h"
+
+namespace {
+
+std::vector<uint8_t> randomBytes(size_t size) {
+    std::mt19937 rng(11);
+    std::vector<uint8_t> bytes(size);
+    for (auto& b : bytes) b = static_cast<uint8_t>(rng());
+    return bytes;
+}
+
+// Switch to impl for the duration of one benchmark run
+class ScopedImplementation {
+public:
+    explicit ScopedImplementation(base64::Implementation impl)
+        : previous_(base64::activeImplementation()), ok_(base64::useImplementation(impl)) {}
+    ~ScopedImplementation() { base64::useImplementation(previous_); }
+    bool ok() const { return ok_; }
+
+private:
+    base64::Implementation previous_;
+    bool ok_;
+};
+
+void BM_Base64Encode(benchmark::State& state, base64::Implementation impl) {
+    ScopedImplementation scoped(impl);
+    if (!scoped.ok()) {
+        state.SkipWithError("implementation not supported on this CPU");
+        return;
+    }
+    std::vector<uint8_t> input = randomBytes(state.range(0));
+    std::string out(base64::encodedSize(input.size()), '\0');
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(base64::encode(input.data(), input.size(), out.data()));
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * input.size());
+}
+
+void BM_Base64Decode(benchmark::State& state, base64::Implementation impl) {
+    ScopedImplementation scoped(impl);
+    if (!scoped.ok()) {
+        state.SkipWithError("implementation not supported on this CPU");
+        return;
+    }
+    std::vector<uint8_t> input = randomBytes(state.range(0));
+    std::string encoded(base64::encodedSize(input.size()), '\0');
+    base64::encode(input.data(), input.size(), encoded.data());
+    std::vector<uint8_t> out(base64::decodedMaxSize(encoded.size()));
+    size_t size = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(base64::decode(encoded.data(), encoded.size(), out.data(), size));
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * input.size());
+}
+
+// 64 B up to 1 MiB of raw bytes
+void payloadSizes(benchmark::internal::Benchmark* b) {
+    b->RangeMultiplier(16)->Range(64, 1 << 20);
+}
+
+} // namespace
+
+BENCHMARK_CAPTURE(BM_Base64Encode, scalar, base64::Implementation::Scalar)->Apply(payloadSizes);
+BENCHMARK_CAPTURE(BM_Base64Encode, sse41, base64::Implementation::Sse41)->Apply(payloadSizes);
+BENCHMARK_CAPTURE(BM_Base64Encode, avx2, base64::Implementation::Avx2)->Apply(payloadSizes);
+BENCHMARK_CAPTURE(BM_Base64Decode, scalar, base64::Implementation::Scalar)->Apply(payloadSizes);
+BENCHMARK_CAPTURE(BM_Base64Decode, sse41, base64::Implementation::Sse41)->Apply(payloadSizes);
+BENCHMARK_CAPTURE(BM_Base64Decode, avx2, base64::Implementation::Avx2)->Apply(payloadSizes);
@@ -0,0 +1,100 @@
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+#include "actor/channel_actors.h"
+#include "message.codec.h"
+#include "synthetic_store.h"
+
+namespace {
+
+constexpr size_t kMessagesPerIteration = 8192;
+
+// kMessagesPerIteration relay messages spread round-robin over channels
+std::vector<InboundMessage> makeMessages(size_t channels, size_t textSize) {
+    std::mt19937 rng(7);
+    std::vector<InboundMessage> messages(kMessagesPerIteration);
+    for (size_t i = 0; i < messages.size(); ++i) {
+        InboundMessage& m = messages[i];
+        m.channel = static_cast<ChannelId>(i % channels + 1);
+        m.contentTopic = "/toy-chat/2/bench-" + std::to_string(i % channels) + "/proto";
+        m.payload = synthetic::encodeBase64(synthetic::makeChatPayload(rng, textSize, 1744123537 + i));
+        m.timestamp = (1744123537 + i) * 1000000000ULL;
+    }
+    return messages;
+}
+
+void runActors(benchmark::State& state, HistoryStore* history) {
+    size_t channels = state.range(0);
+    ChannelActorOptions options;
+    options.workers = state.range(1);
+    std::vector<InboundMessage> messages = makeMessages(channels, 256);
+
+    // Delivered messages are already decoded into one shared object
+    std::atomic<size_t> delivered{0};
+    ChannelActors actors(
+        [&delivered](const InboundMessage&, const RecentMessagePtr& decoded) {
+            benchmark::DoNotOptimize(decoded->text().data());
+            delivered.fetch_add(1, std::memory_order_relaxed);
+        },
+        history, options);
+
+    uint64_t round = 0;
+    for (auto _ : state) {
+        // Fresh hashes every round so nothing is dropped as a duplicate
+        state.PauseTiming();
+        std::vector<InboundMessage> batch = messages;
+        for (size_t i = 0; i < batch.size(); ++i) {
+            batch[i].messageHash = "0x" + std::to_string(round) + "_" + std::to_string(i);
+        }
+        round++;
+        state.ResumeTiming();
+
+        // Posting stands in for the single libwaku event thread
+        for (InboundMessage& m : batch) actors.post(std::move(m));
+        actors.waitIdle();
+    }
+    if (delivered.load() != state.iterations() * kMessagesPerIteration) {
+        state.SkipWithError("actors dropped messages");
+    }
+    state.SetItemsProcessed(state.iterations() * kMessagesPerIteration);
+    state.counters["shards"] = static_cast<double>(actors.shardCount());
+}
+
+void BM_ChannelActors(benchmark::State& state) {
+    runActors(state, nullptr);
+}
+
+void BM_ChannelActors_History(benchmark::State& state) {
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "chat_actor_bench";
+    std::filesystem::remove_all(dir);
+    HistoryStoreOptions storeOptions;
+    storeOptions.maxMessagesPerChannel = 1000000;
+    HistoryStore history;
+    if (!history.open(dir.string(), storeOptions)) {
+        state.SkipWithError("cannot open history store");
+        return;
+    }
+    runActors(state, &history);
+    history.close();
+    std::filesystem::remove_all(dir);
+}
+
+// {channels, workers}
+void scalingSweep(benchmark::internal::Benchmark* b) {
+    for (int channels : {1, 4, 16, 64, 256}) {
+        for (int workers : {1, 2, 4, 8}) {
+            b->Args({channels, workers});
+        }
+    }
+    b->ArgNames({"channels", "workers"});
+    b->UseRealTime();
+    b->Unit(benchmark::kMillisecond);
+}
+
+} // namespace
+
+BENCHMARK(BM_ChannelActors)->Apply(scalingSweep);
+BENCHMARK(BM_ChannelActors_History)->Apply(scalingSweep);
@@ -0,0 +1,176 @@
+#include <benchmark/benchmark.h>
+#include <QCoreApplication>
+#include <QObject>
+#include <iostream>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include "chat_api.h"
+#include "corpus_files.h"
+
+// chat_api's own entry points on the checked-in corpora: what the libwaku
+// thread runs per event and per store page, and the helpers around them.
+// Needs Qt, as chat_api does.
+
+namespace {
+
+const int kRetOk = 0;  // libwaku's RET_OK
+
+// The channels events.jsonl has traffic on that a node would have joined
+const char* const kJoinedChannels[] = {"general", "dev", "random", "announcements"};
+
+std::vector<std::vector<uint8_t>> eventPayloads() {
+    std::vector<std::vector<uint8_t>> payloads;
+    for (const std::string& event : corpus::readLines("events.jsonl")) {
+        std::vector<uint8_t> bytes;
+        std::string encoded = corpus::stringField(event, "payload");
+        if (!encoded.empty() && base64Decode(encoded, bytes)) {
+            payloads.push_back(std::move(bytes));
+        }
+    }
+    return payloads;
+}
+
+void BM_DecodeProto(benchmark::State& state) {
+    std::vector<std::vector<uint8_t>> payloads = eventPayloads();
+    if (payloads.empty()) {
+        state.SkipWithError("events.jsonl not found");
+        return;
+    }
+    for (auto _ : state) {
+        for (const auto& payload : payloads) {
+            DecodedMessage decoded = decodeProto(payload);
+            benchmark::DoNotOptimize(decoded.payload.data());
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * payloads.size()));
+}
+
+void BM_FormatTimestampProto(benchmark::State& state) {
+    std::vector<uint64_t> timestamps;
+    for (const std::string& event : corpus::readLines("events.jsonl")) {
+        size_t pos = event.find("\"timestamp\":");
+        if (pos != std::string::npos) {
+            timestamps.push_back(std::strtoull(event.c_str() + pos + 12, nullptr, 10) / 1000000000ULL);
+        }
+    }
+    if (timestamps.empty()) {
+        state.SkipWithError("events.jsonl not found");
+        return;
+    }
+    for (auto _ : state) {
+        for (uint64_t timestamp : timestamps) {
+            std::string text = formatTimestampProto(timestamp);
+            benchmark::DoNotOptimize(text.data());
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * timestamps.size()));
+}
+
+// Every recorded event through event_handler, four channels joined and
+// the receive limits off. This is the cost on the libwaku thread: the
+// actors behind it decode the first pass and drop later ones as duplicates.
+void BM_EventHandler(benchmark::State& state) {
+    std::vector<std::string> events = corpus::readLines("events.jsonl");
+    if (events.empty()) {
+        state.SkipWithError("events.jsonl not found");
+        return;
+    }
+    ChannelRegistry channels;
+    ReceiveLimits unlimited;
+    unlimited.senderRate = 0;
+    unlimited.channelRate = 0;
+    for (const char* name : kJoinedChannels) {
+        ChannelId id = channels.intern(formatContentTopic(name));
+        channels.setState(id, SubscriptionState::Subscribed);
+        channels.setReceiveLimits(id, unlimited);
+    }
+    EventHandlerContext context(&channels);
+
+    size_t bytes = 0;
+    for (const std::string& event : events) bytes += event.size();
+    for (auto _ : state) {
+        for (const std::string& event : events) {
+            event_handler(kRetOk, event.data(), event.size(), &context);
+        }
+    }
+    context.actors->waitIdle();
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * events.size()));
+}
+
+// A store page through storeQueryCallback to a history callback, with no
+// channel so nothing is kept: the stores would otherwise grow with every
+// iteration and be what is measured
+void BM_StoreQueryCallback(benchmark::State& state, const char* name) {
+    std::string page = corpus::readFile(name);
+    if (page.empty()) {
+        state.SkipWithError("store page not found");
+        return;
+    }
+    size_t delivered = 0;
+    ChatMessageCallback callback = [&delivered](const ChatMessageRef& message) {
+        benchmark::DoNotOptimize(message.payload().data());
+        delivered++;
+    };
+    for (auto _ : state) {
+        // The callback takes the context and frees it, as after a query
+        storeQueryCallback(kRetOk, page.data(), page.size(), new StoreQueryContext(callback));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * page.size()));
+    state.SetItemsProcessed(static_cast<int64_t>(delivered));
+}
+
+// The lookup every chat_api call into the Waku plugin starts with, among
+// range(0) other registered plugins
+void BM_GetPlugin(benchmark::State& state) {
+    std::vector<std::unique_ptr<QObject>> plugins;
+    for (int64_t i = 0; i < state.range(0); ++i) {
+        plugins.push_back(std::make_unique<QObject>());
+        PluginRegistry::registerPlugin(plugins.back().get(), QString("plugin_%1").arg(i));
+    }
+    QObject waku;
+    PluginRegistry::registerPlugin(&waku, "waku");
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(PluginRegistry::getPlugin<QObject>("waku"));
+    }
+    PluginRegistry::unregisterPlugin("waku");
+    for (int64_t i = 0; i < state.range(0); ++i) {
+        PluginRegistry::unregisterPlugin(QString("plugin_%1").arg(i));
+    }
+}
+
+// Drops what chat_api prints for every message it handles
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+};
+
+} // namespace
+
+BENCHMARK(BM_DecodeProto);
+BENCHMARK(BM_FormatTimestampProto);
+BENCHMARK(BM_EventHandler);
+BENCHMARK_CAPTURE(BM_StoreQueryCallback, page_20, "store_page_20.json");
+BENCHMARK_CAPTURE(BM_StoreQueryCallback, page_100, "store_page_100.json");
+BENCHMARK(BM_GetPlugin)->Arg(0)->Arg(10)->Arg(100);
+
+// The registry lives on the application object; chat_api's logging goes
+// nowhere while the report goes to the console, or to --benchmark_out
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+
+    std::ostream console(std::cout.rdbuf());
+    NullBuffer discard;
+    std::cout.rdbuf(&discard);
+    benchmark::ConsoleReporter reporter(benchmark::ConsoleReporter::OO_Tabular);
+    reporter.SetOutputStream(&console);
+    reporter.SetErrorStream(&std::cerr);
+    benchmark::RunSpecifiedBenchmarks(&reporter);
+    std::cout.rdbuf(console.rdbuf());
+    benchmark::Shutdown();
+    return 0;
+}
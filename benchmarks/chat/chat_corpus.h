@@ -0,0 +1,143 @@
+#ifndef CHAT_CORPUS_H
+#define CHAT_CORPUS_H
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+// Deterministic chat corpus shaped like a busy public channel: mostly short
+// messages over a Zipf-distributed vocabulary, with mentions, replies,
+// links, emoji, hashes and the odd long paragraph or pasted log line.
+namespace corpus {
+
+inline const std::vector<std::string>& vocabulary() {
+    static const std::vector<std::string> words = {
+        "the", "i", "to", "a", "you", "it", "is", "and", "that", "of", "in", "for", "on", "this", "just",
+        "be", "so", "but", "have", "with", "not", "we", "are", "can", "was", "do", "my", "what", "if",
+        "node", "it's", "no", "yeah", "like", "get", "me", "at", "all", "about", "lol", "think", "there",
+        "know", "any", "or", "from", "one", "will", "up", "how", "out", "now", "waku", "they", "message",
+        "would", "an", "thanks", "good", "does", "why", "when", "working", "need", "some", "see", "don't",
+        "i'm", "sync", "right", "use", "then", "store", "also", "still", "should", "time", "peers", "yes",
+        "relay", "make", "try", "new", "here", "more", "sure", "because", "nice", "filter", "been", "going",
+        "release", "anyone", "ok", "logs", "got", "issue", "way", "running", "only", "too", "which", "could",
+        "build", "version", "people", "well", "did", "chat", "pr", "fix", "today", "let", "back", "something",
+        "network", "same", "maybe", "test", "other", "config", "really", "after", "work", "first", "want",
+        "error", "look", "thing", "last", "latest", "fleet", "cluster", "shard", "topic", "pubsub", "bootstrap",
+        "discovery", "dns", "enr", "peer", "connection", "timeout", "restart", "docker", "compose", "testnet",
+        "mainnet", "metrics", "grafana", "memory", "cpu", "bandwidth", "latency", "messages", "history",
+        "query", "cursor", "page", "light", "push", "protocol", "spec", "rfc", "libp2p", "nim", "rust",
+        "go", "bindings", "android", "ios", "desktop", "app", "wallet", "key", "keys", "encryption", "noise",
+        "handshake", "rln", "membership", "proof", "contract", "sepolia", "gas", "tx", "merged", "review",
+        "approved", "ci", "green", "failing", "flaky", "tests", "branch", "master", "main", "tag", "changelog",
+        "gm", "gn", "morning", "everyone", "hey", "hi", "hello", "folks", "guys", "team", "welcome", "cool",
+        "awesome", "great", "exactly", "agreed", "indeed", "probably", "definitely", "interesting", "weird",
+        "strange", "broken", "fixed", "works", "worked", "seems", "looks", "happening", "happened", "again",
+        "tomorrow", "yesterday", "week", "soon", "later", "meeting", "call", "notes", "agenda", "discuss",
+        "question", "answer", "docs", "readme", "example", "tutorial", "link", "thread", "channel", "dm",
+    };
+    return words;
+}
+
+inline const std::vector<std::string>& nicks() {
+    static const std::vector<std::string> names = {
+        "alice", "bob", "carol", "dave", "erin", "frank", "grace", "heidi", "ivan", "judy",
+        "mallory", "niaj", "olivia", "peggy", "rupert", "sybil", "trent", "victor", "walter", "zoe",
+    };
+    return names;
+}
+
+inline const std::vector<std::string>& emoji() {
+    static const std::vector<std::string> faces = {
+        "\xF0\x9F\x91\x8D", "\xF0\x9F\x98\x82", "\xF0\x9F\x9A\x80", "\xF0\x9F\x99\x8F",
+        "\xF0\x9F\x94\xA5", "\xF0\x9F\x98\x85", "\xE2\x9C\x85", "\xF0\x9F\x91\x80",
+    };
+    return faces;
+}
+
+struct Message {
+    std::string nick;
+    std::string text;
+};
+
+class Generator {
+public:
+    explicit Generator(uint32_t seed = 2024) : rng_(seed) {
+        // Zipf weights over the vocabulary, s = 1.1
+        const auto& words = vocabulary();
+        std::vector<double> weights(words.size());
+        for (size_t i = 0; i < weights.size(); ++i) weights[i] = 1.0 / std::pow(double(i + 1), 1.1);
+        word_ = std::discrete_distribution<size_t>(weights.begin(), weights.end());
+    }
+
+    Message next() {
+        Message m;
+        const auto& names = nicks();
+        m.nick = names[rng_() % names.size()];
+        unsigned kind = rng_() % 100;
+        if (kind < 4) {
+            m.text = pastedLog();
+        } else if (kind < 9) {
+            m.text = sentence(40 + rng_() % 80);  // paragraph
+        } else if (kind < 14) {
+            m.text = link();
+        } else if (kind < 17) {
+            m.text = emoji()[rng_() % emoji().size()];
+        } else {
+            std::geometric_distribution<int> length(0.11);
+            m.text = sentence(1 + length(rng_));
+        }
+        if (rng_() % 6 == 0) m.text = "@" + names[rng_() % names.size()] + " " + m.text;
+        if (rng_() % 10 == 0) m.text += " " + emoji()[rng_() % emoji().size()];
+        return m;
+    }
+
+    std::vector<Message> take(size_t count) {
+        std::vector<Message> messages;
+        messages.reserve(count);
+        for (size_t i = 0; i < count; ++i) messages.push_back(next());
+        return messages;
+    }
+
+private:
+    std::string sentence(size_t words) {
+        const auto& vocab = vocabulary();
+        std::string text;
+        for (size_t i = 0; i < words; ++i) {
+            if (i > 0) text += (rng_() % 12 == 0) ? ", " : " ";
+            text += vocab[word_(rng_)];
+        }
+        text += ".?!"[rng_() % 3];
+        return text;
+    }
+
+    std::string hex(size_t digits) {
+        std::string out = "0x";
+        for (size_t i = 0; i < digits; ++i) out += "0123456789abcdef"[rng_() & 15];
+        return out;
+    }
+
+    std::string link() {
+        static const char* hosts[] = {"https://github.com/waku-org/nwaku/pull/",
+                                      "https://github.com/logos-co/logos-core/issues/",
+                                      "https://rfc.vac.dev/waku/standards/core/", "https://forum.vac.dev/t/"};
+        std::string url = hosts[rng_() % 4] + std::to_string(1000 + rng_() % 3000);
+        return rng_() % 2 ? url : sentence(3 + rng_() % 6) + " " + url;
+    }
+
+    std::string pastedLog() {
+        static const char* levels[] = {"INF", "DBG", "WRN", "ERR"};
+        return std::string(levels[rng_() % 4]) + " 2025-04-08 14:" + std::to_string(10 + rng_() % 50) + ":" +
+               std::to_string(10 + rng_() % 50) + ".123+00:00 " + sentence(3 + rng_() % 5) +
+               " topics=\"waku filter\" peerId=16U*" + hex(6).substr(2) + " msgHash=" + hex(64) +
+               " pubsubTopic=/waku/2/rs/16/32";
+    }
+
+    std::mt19937 rng_;
+    std::discrete_distribution<size_t> word_;
+};
+
+} // namespace corpus
+
+#endif // CHAT_CORPUS_H
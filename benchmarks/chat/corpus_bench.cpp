@@ -0,0 +1,150 @@
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "codec/base64.h"
+#include "codec/store_response_decoder.h"
+#include "corpus_files.h"
+#include "protocol/protocol.h"
+
+// The codec hot paths on the checked-in corpora rather than generated
+// input: chat texts of real-looking lengths, the payloads of a recorded
+// mix of events and libwaku store pages
+
+namespace {
+
+// Chat2Message payloads of the message events, base64 decoded
+std::vector<std::vector<uint8_t>> eventPayloads() {
+    std::vector<std::vector<uint8_t>> payloads;
+    for (const std::string& event : corpus::readLines("events.jsonl")) {
+        std::string encoded = corpus::stringField(event, "payload");
+        if (encoded.empty()) continue;
+        std::vector<uint8_t> bytes(base64::decodedMaxSize(encoded.size()));
+        size_t size = 0;
+        if (base64::decode(encoded.data(), encoded.size(), bytes.data(), size)) {
+            bytes.resize(size);
+            payloads.push_back(std::move(bytes));
+        }
+    }
+    return payloads;
+}
+
+void BM_Corpus_ChatMessageSerialize(benchmark::State& state) {
+    std::vector<ChatMessage> messages;
+    for (const std::string& text : corpus::readLines("chat_texts.txt")) {
+        messages.emplace_back("user42", text);
+    }
+    if (messages.empty()) {
+        state.SkipWithError("chat_texts.txt not found");
+        return;
+    }
+    size_t bytes = 0;
+    for (auto _ : state) {
+        for (const ChatMessage& message : messages) {
+            std::vector<uint8_t> wire = message.serialize();
+            bytes += wire.size();
+            benchmark::DoNotOptimize(wire.data());
+        }
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(bytes));
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * messages.size()));
+}
+
+void BM_Corpus_ChatMessageDeserialize(benchmark::State& state) {
+    std::vector<std::vector<uint8_t>> payloads = eventPayloads();
+    if (payloads.empty()) {
+        state.SkipWithError("events.jsonl not found");
+        return;
+    }
+    size_t bytes = 0;
+    for (const auto& payload : payloads) bytes += payload.size();
+    ChatMessage message;
+    for (auto _ : state) {
+        for (const auto& payload : payloads) {
+            if (!message.deserialize(payload)) {
+                state.SkipWithError("corpus payload did not decode");
+                return;
+            }
+            benchmark::DoNotOptimize(message.nick().data());
+        }
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * payloads.size()));
+}
+
+void BM_Corpus_Base64Encode(benchmark::State& state) {
+    std::vector<std::vector<uint8_t>> payloads = eventPayloads();
+    if (payloads.empty()) {
+        state.SkipWithError("events.jsonl not found");
+        return;
+    }
+    size_t bytes = 0;
+    size_t largest = 0;
+    for (const auto& payload : payloads) {
+        bytes += payload.size();
+        largest = std::max(largest, payload.size());
+    }
+    std::vector<char> out(base64::encodedSize(largest));
+    for (auto _ : state) {
+        for (const auto& payload : payloads) {
+            benchmark::DoNotOptimize(base64::encode(payload.data(), payload.size(), out.data()));
+        }
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * payloads.size()));
+}
+
+void BM_Corpus_Base64Decode(benchmark::State& state) {
+    std::vector<std::string> encoded;
+    size_t chars = 0;
+    size_t largest = 0;
+    for (const std::string& event : corpus::readLines("events.jsonl")) {
+        std::string payload = corpus::stringField(event, "payload");
+        if (payload.empty()) continue;
+        chars += payload.size();
+        largest = std::max(largest, payload.size());
+        encoded.push_back(std::move(payload));
+    }
+    if (encoded.empty()) {
+        state.SkipWithError("events.jsonl not found");
+        return;
+    }
+    std::vector<uint8_t> out(base64::decodedMaxSize(largest));
+    for (auto _ : state) {
+        for (const std::string& payload : encoded) {
+            size_t size = 0;
+            benchmark::DoNotOptimize(base64::decode(payload.data(), payload.size(), out.data(), size));
+        }
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * chars));
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * encoded.size()));
+}
+
+void BM_Corpus_StorePage(benchmark::State& state, const char* name) {
+    std::string page = corpus::readFile(name);
+    if (page.empty()) {
+        state.SkipWithError("store page not found");
+        return;
+    }
+    StoreResponseDecoder decoder;
+    StoreMessage msg;
+    size_t decoded = 0;
+    for (auto _ : state) {
+        decoder.reset(page.data(), page.size());
+        while (decoder.next(msg)) {
+            benchmark::DoNotOptimize(msg.text.data());
+            decoded += msg.decoded;
+        }
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * page.size()));
+    state.SetItemsProcessed(static_cast<int64_t>(decoded));
+}
+
+} // namespace
+
+BENCHMARK(BM_Corpus_ChatMessageSerialize);
+BENCHMARK(BM_Corpus_ChatMessageDeserialize);
+BENCHMARK(BM_Corpus_Base64Encode);
+BENCHMARK(BM_Corpus_Base64Decode);
+BENCHMARK_CAPTURE(BM_Corpus_StorePage, page_20, "store_page_20.json");
+BENCHMARK_CAPTURE(BM_Corpus_StorePage, page_100, "store_page_100.json");
@@ -0,0 +1,47 @@
+#ifndef CORPUS_FILES_H
+#define CORPUS_FILES_H
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// The fixed inputs checked in under benchmarks/corpus, read as they are so
+// results compare across commits and machines. LOGOS_BENCH_CORPUS_DIR is
+// set by the build.
+namespace corpus {
+
+inline std::string path(const std::string& name) {
+    return std::string(LOGOS_BENCH_CORPUS_DIR) + "/" + name;
+}
+
+// Whole file, empty if it cannot be read
+inline std::string readFile(const std::string& name) {
+    std::ifstream in(path(name), std::ios::binary);
+    std::ostringstream out;
+    out << in.rdbuf();
+    return out.str();
+}
+
+// Non-empty lines of a file
+inline std::vector<std::string> readLines(const std::string& name) {
+    std::ifstream in(path(name), std::ios::binary);
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty()) lines.push_back(line);
+    }
+    return lines;
+}
+
+// Value of a string field in flat JSON, as the chat module reads events
+inline std::string stringField(const std::string& json, const std::string& key) {
+    size_t pos = json.find("\"" + key + "\":\"");
+    if (pos == std::string::npos) return std::string();
+    pos += key.size() + 4;
+    return json.substr(pos, json.find('"', pos) - pos);
+}
+
+} // namespace corpus
+
+#endif // CORPUS_FILES_H
@@ -0,0 +1,221 @@
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "codec/store_response_decoder.h"
+#include "sim_json.h"
+#include "sim_network.h"
+#include "synthetic_history.h"
+
+namespace {
+
+// Five million messages, one every 100 ms (almost six days), over ten
+// channels with the first the busiest; topic 9 gets about 3% of them
+constexpr uint64_t kHistoryMessages = 5000000;
+constexpr uint64_t kIntervalNs = 100000000;
+constexpr size_t kTopics = 10;
+const char* const kPubsubTopic = "/waku/2/rs/16/32";
+
+std::string channelTopic(size_t i) {
+    return "/toy-chat/2/history-" + std::to_string(i) + "/proto";
+}
+
+std::shared_ptr<const SyntheticHistory> history() {
+    static std::shared_ptr<const SyntheticHistory> shared = [] {
+        SyntheticHistoryOptions options;
+        options.messages = kHistoryMessages;
+        options.intervalNs = kIntervalNs;
+        options.pubsubTopic = kPubsubTopic;
+        options.contentTopics.clear();
+        for (size_t i = 0; i < kTopics; ++i) options.contentTopics.push_back(channelTopic(i));
+        options.seed = 42;
+        return std::make_shared<const SyntheticHistory>(options);
+    }();
+    return shared;
+}
+
+uint64_t historyEnd() {
+    return kHistoryMessages * kIntervalNs;
+}
+
+// A small network whose store node, node 1, answers after storeDelayMs;
+// node 0 asks. Time is simulated so only the answering costs CPU.
+std::unique_ptr<SimNetwork> storeNetwork(double storeDelayMs) {
+    SimOptions options;
+    options.nodes = 8;
+    options.fanout = 3;
+    options.storeDelayMs = storeDelayMs;
+    options.timeScale = 0;
+    options.seed = 42;
+    auto network = std::make_unique<SimNetwork>(options);
+    network->setHistory(history());
+    return network;
+}
+
+// One page as chat gets it: the query over the network, the store's JSON
+// answer and its cursor
+bool fetchPage(SimNetwork& network, const SimStoreQuery& query, std::string& json, uint64_t& cursor) {
+    bool answered = false;
+    network.storeQuery(0, query, 0, [&](bool success, const SimStoreResult& result) {
+        answered = success;
+        if (success) {
+            json = storeResponseJson("bench", result);
+            cursor = result.cursor;
+        }
+    });
+    network.runUntilIdle();
+    return answered;
+}
+
+size_t decodePage(StoreResponseDecoder& decoder, const std::string& json) {
+    StoreMessage msg;
+    size_t decoded = 0;
+    decoder.reset(json.data(), json.size());
+    while (decoder.next(msg)) {
+        benchmark::DoNotOptimize(msg.text.data());
+        decoded += msg.decoded;
+    }
+    return decoded;
+}
+
+// The newest page of a channel, as chat asks when it joins: query, answer,
+// JSON and decode. sim_ms is the simulated time it took to arrive.
+void BM_HistoryNewestPage(benchmark::State& state) {
+    auto network = storeNetwork(20);
+    SimStoreQuery query;
+    query.pubsubTopic = kPubsubTopic;
+    query.contentTopics = {channelTopic(static_cast<size_t>(state.range(1)))};
+    query.forward = false;
+    query.limit = static_cast<uint32_t>(state.range(0));
+
+    StoreResponseDecoder decoder;
+    std::string json;
+    uint64_t cursor = 0;
+    uint64_t bytes = 0;
+    uint64_t decoded = 0;
+    uint64_t startNs = network->now();
+    for (auto _ : state) {
+        if (!fetchPage(*network, query, json, cursor)) {
+            state.SkipWithError("store query failed");
+            break;
+        }
+        bytes += json.size();
+        decoded += decodePage(decoder, json);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(bytes));
+    state.SetItemsProcessed(static_cast<int64_t>(decoded));
+    state.counters["sim_ms"] = static_cast<double>(network->now() - startNs) / 1e6 /
+                               static_cast<double>(std::max<benchmark::IterationCount>(1, state.iterations()));
+}
+
+// Walking back through a channel page by page with cursors until count
+// messages are in. Pages follow each other, so the simulated time is the
+// round trips added up.
+void BM_HistoryWalk(benchmark::State& state) {
+    auto network = storeNetwork(20);
+    const uint64_t count = static_cast<uint64_t>(state.range(0));
+    SimStoreQuery query;
+    query.pubsubTopic = kPubsubTopic;
+    query.contentTopics = {channelTopic(0)};
+    query.forward = false;
+    query.limit = static_cast<uint32_t>(state.range(1));
+
+    StoreResponseDecoder decoder;
+    std::string json;
+    uint64_t pages = 0;
+    uint64_t decoded = 0;
+    uint64_t startNs = network->now();
+    for (auto _ : state) {
+        uint64_t cursor = 0;
+        uint64_t walked = 0;
+        query.cursor = 0;
+        while (walked < count) {
+            if (!fetchPage(*network, query, json, cursor)) {
+                state.SkipWithError("store query failed");
+                return;
+            }
+            walked += decodePage(decoder, json);
+            pages++;
+            if (cursor == 0) break;
+            query.cursor = cursor;
+        }
+        decoded += walked;
+    }
+    double walks = static_cast<double>(std::max<benchmark::IterationCount>(1, state.iterations()));
+    state.SetItemsProcessed(static_cast<int64_t>(decoded));
+    state.counters["pages"] = static_cast<double>(pages) / walks;
+    state.counters["sim_s"] = static_cast<double>(network->now() - startNs) / 1e9 / walks;
+}
+
+// First page of an hour anywhere in the history, on a busy and on a quiet
+// channel: the store finds the time by arithmetic and then skips the other
+// channels' messages
+void BM_HistoryTimeRange(benchmark::State& state) {
+    auto network = storeNetwork(0);
+    SimStoreQuery query;
+    query.pubsubTopic = kPubsubTopic;
+    query.contentTopics = {channelTopic(static_cast<size_t>(state.range(0)))};
+    query.forward = true;
+    query.limit = 100;
+
+    const uint64_t hourNs = 3600ULL * 1000000000ULL;
+    std::mt19937_64 rng(7);
+    std::uniform_int_distribution<uint64_t> start(0, historyEnd() - hourNs);
+    StoreResponseDecoder decoder;
+    std::string json;
+    uint64_t cursor = 0;
+    uint64_t decoded = 0;
+    for (auto _ : state) {
+        query.timeStart = start(rng);
+        query.timeEnd = query.timeStart + hourNs;
+        if (!fetchPage(*network, query, json, cursor)) {
+            state.SkipWithError("store query failed");
+            break;
+        }
+        decoded += decodePage(decoder, json);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(decoded));
+}
+
+// Decoding alone, on a page taken from the store once
+void BM_HistoryDecode(benchmark::State& state) {
+    auto network = storeNetwork(0);
+    SimStoreQuery query;
+    query.pubsubTopic = kPubsubTopic;
+    query.contentTopics = {channelTopic(0)};
+    query.forward = false;
+    query.limit = static_cast<uint32_t>(state.range(0));
+    std::string json;
+    uint64_t cursor = 0;
+    if (!fetchPage(*network, query, json, cursor)) {
+        state.SkipWithError("store query failed");
+        return;
+    }
+
+    StoreResponseDecoder decoder;
+    for (auto _ : state) {
+        if (decodePage(decoder, json) != query.limit) {
+            state.SkipWithError("decoder dropped messages");
+            break;
+        }
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * json.size()));
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * query.limit));
+}
+
+} // namespace
+
+BENCHMARK(BM_HistoryNewestPage)
+    ->ArgNames({"limit", "topic"})
+    ->ArgsProduct({{20, 100, 500}, {0, 9}})
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_HistoryWalk)
+    ->ArgNames({"messages", "limit"})
+    ->Args({10000, 20})
+    ->Args({10000, 100})
+    ->Args({10000, 500})
+    ->Args({100000, 500})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_HistoryTimeRange)->ArgName("topic")->Arg(0)->Arg(9)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_HistoryDecode)->ArgName("limit")->Arg(20)->Arg(100)->Arg(500)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "store/history_store.h"
+
+// The history store on disk: what a reopened store reads back, records
+// that fail their checksum or were torn by a crash, and compaction with
+// retention, before and after a reopen.
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char* const kTopic = "/toy-chat/2/general/proto";
+const char* const kChannelDir = "_2ftoy-chat_2f2_2fgeneral_2fproto";  // kTopic escaped
+const size_t kSegmentHeaderSize = 16;
+
+int g_failures = 0;
+std::ostream g_report(std::cerr.rdbuf());  // stderr itself is silenced below
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+void check(bool ok, const char* what, int line) {
+    if (ok) return;
+    if (++g_failures <= 20) {
+        g_report << "history_store_test.cpp:" << line << ": check failed: " << what << std::endl;
+    }
+}
+
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+};
+
+std::string hashOf(int i) {
+    return "hash-" + std::to_string(i);
+}
+
+std::string payloadOf(int i) {
+    return "message " + std::to_string(i) + std::string(static_cast<size_t>(i % 37), 'x');
+}
+
+bool appendMessage(HistoryStore& store, int i) {
+    std::string payload = payloadOf(i);
+    return store.append(kTopic, hashOf(i), 1000 + static_cast<uint64_t>(i),
+                        reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+}
+
+bool holds(HistoryStore& store, int i) {
+    HistoryRecord record;
+    return store.find(kTopic, hashOf(i), record) && record.timestamp == 1000 + static_cast<uint64_t>(i) &&
+           std::string(record.payload.begin(), record.payload.end()) == payloadOf(i);
+}
+
+std::vector<fs::path> segments(const fs::path& root) {
+    std::vector<fs::path> paths;
+    std::error_code ec;
+    for (const auto& file : fs::directory_iterator(root / kChannelDir, ec)) {
+        if (file.path().extension() == ".seg") paths.push_back(file.path());
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+void flipByte(const fs::path& path, size_t offset) {
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekg(static_cast<std::streamoff>(offset));
+    char byte = 0;
+    file.read(&byte, 1);
+    file.seekp(static_cast<std::streamoff>(offset));
+    byte = static_cast<char>(byte ^ 0x5a);
+    file.write(&byte, 1);
+}
+
+// Messages, their order and the sync mark survive a reopen, and hashes
+// stored before it are still known
+void reopen(const fs::path& root) {
+    {
+        HistoryStore store;
+        CHECK(store.open(root.string()));
+        for (int i = 0; i < 50; ++i) CHECK(appendMessage(store, i));
+        CHECK(store.setSyncedUntil(kTopic, 1040));
+    }
+    HistoryStore store;
+    CHECK(store.open(root.string()));
+    CHECK(store.messageCount(kTopic) == 50);
+    CHECK(store.newestTimestamp(kTopic) == 1049);
+    CHECK(store.syncedUntil(kTopic) == 1040);
+    CHECK(holds(store, 0) && holds(store, 49));
+    CHECK(!appendMessage(store, 7));
+    std::vector<HistoryRecord> recent = store.readRecent(kTopic, 10);
+    CHECK(recent.size() == 10 && recent.front().messageHash == hashOf(40) && recent.back().messageHash == hashOf(49));
+}
+
+// A bad checksum in a sealed segment loses the rest of that segment only;
+// one in the active segment, or bytes torn off its end, are cut off
+void checksums(const fs::path& root) {
+    HistoryStoreOptions options;
+    options.segmentSize = 1024;
+    options.compactAfterSegments = 1000;
+    {
+        HistoryStore store;
+        CHECK(store.open(root.string(), options));
+        for (int i = 0; i < 100; ++i) CHECK(appendMessage(store, i));
+    }
+    std::vector<fs::path> files = segments(root);
+    CHECK(files.size() > 3);
+    if (files.size() <= 3) return;
+    // The timestamp of the first record, which its checksum covers, and
+    // half a record after the last one
+    flipByte(files[0], kSegmentHeaderSize + 8);
+    {
+        std::ofstream torn(files.back(), std::ios::binary | std::ios::app);
+        torn << "torn write";
+    }
+
+    HistoryStore store;
+    CHECK(store.open(root.string(), options));
+    CHECK(!store.contains(kTopic, hashOf(0)));
+    CHECK(holds(store, 99));
+    size_t count = store.messageCount(kTopic);
+    CHECK(count < 100 && count > 80);
+    CHECK(appendMessage(store, 100) && holds(store, 100));
+    CHECK(store.messageCount(kTopic) == count + 1);
+}
+
+// Compaction merges the sealed segments in time order and drops the
+// oldest messages past the retention limit, reporting them as expired
+void compaction(const fs::path& root) {
+    HistoryStoreOptions options;
+    options.segmentSize = 1024;
+    options.compactAfterSegments = 1000;
+    options.maxMessagesPerChannel = 150;
+    {
+        HistoryStore store;
+        std::vector<std::string> expired;
+        store.setExpiredCallback([&expired](const std::string& topic, const std::vector<std::string>& hashes) {
+            if (topic == kTopic) expired.insert(expired.end(), hashes.begin(), hashes.end());
+        });
+        CHECK(store.open(root.string(), options));
+        // Out of order, so merging has something to sort
+        for (int i = 199; i >= 100; --i) CHECK(appendMessage(store, i));
+        for (int i = 0; i < 100; ++i) CHECK(appendMessage(store, i));
+        size_t before = segments(root).size();
+        CHECK(store.compact(kTopic));
+        CHECK(segments(root).size() < before);
+        CHECK(store.messageCount(kTopic) == 150);
+        CHECK(!store.contains(kTopic, hashOf(0)));
+        CHECK(expired.size() == 50 && std::find(expired.begin(), expired.end(), hashOf(0)) != expired.end());
+        CHECK(holds(store, 199) && holds(store, 99));
+        CHECK(appendMessage(store, 0));  // expired, so no longer a duplicate
+    }
+    HistoryStore store;
+    CHECK(store.open(root.string(), options));
+    CHECK(holds(store, 199) && holds(store, 99) && holds(store, 0));
+    std::vector<HistoryRecord> all = store.readRecent(kTopic, 1000);
+    CHECK(all.size() == store.messageCount(kTopic));
+    for (size_t i = 1; i < all.size(); ++i) CHECK(all[i - 1].timestamp <= all[i].timestamp);
+}
+
+} // namespace
+
+int main() {
+    fs::path dir = fs::temp_directory_path() / ("history_store_test_" + std::to_string(::getpid()));
+
+    // The store reports what it recovers from on stderr
+    NullBuffer discard;
+    std::streambuf* console = std::cerr.rdbuf(&discard);
+    std::streambuf* output = std::cout.rdbuf(&discard);
+
+    std::error_code ec;
+    for (void (*test)(const fs::path&) : {reopen, checksums, compaction}) {
+        fs::remove_all(dir, ec);
+        test(dir);
+    }
+    fs::remove_all(dir, ec);
+
+    std::cerr.rdbuf(console);
+    std::cout.rdbuf(output);
+    if (g_failures > 0) {
+        std::cerr << g_failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "history store: all checks passed" << std::endl;
+    return 0;
+}
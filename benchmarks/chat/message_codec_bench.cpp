@@ -0,0 +1,93 @@
+#include <benchmark/benchmark.h>
+#include <random>
+#include <string>
+#include <vector>
+#include "message.codec.h"
+#include "message.pb.h"
+#include "protocol/protocol.h"
+
+namespace {
+
+std::string randomText(size_t size) {
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> ch(' ', '~');
+    std::string text(size, ' ');
+    for (auto& c : text) c = static_cast<char>(ch(rng));
+    return text;
+}
+
+void BM_Encode_Codec(benchmark::State& state) {
+    std::string text = randomText(state.range(0));
+    chat::Chat2MessageView msg;
+    msg.timestamp = 1744123537;
+    msg.nick = "LogosUser_42";
+    msg.payload = text;
+    std::vector<uint8_t> buffer(proto::encodedSize(msg));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(proto::encode(msg, buffer.data(), buffer.size()));
+    }
+    state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+
+void BM_Encode_Libprotobuf(benchmark::State& state) {
+    std::string text = randomText(state.range(0));
+    chat::Chat2Message msg;
+    msg.set_timestamp(1744123537);
+    msg.set_nick("LogosUser_42");
+    msg.set_payload(text);
+    std::string buffer;
+    for (auto _ : state) {
+        msg.SerializeToString(&buffer);
+        benchmark::DoNotOptimize(buffer.data());
+    }
+    state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+
+// Full send path: build a ChatMessage and serialize it to a vector
+void BM_Encode_ChatMessage(benchmark::State& state) {
+    std::string text = randomText(state.range(0));
+    ChatMessage msg("LogosUser_42", text);
+    size_t size = 0;
+    for (auto _ : state) {
+        std::vector<uint8_t> bytes = msg.serialize();
+        size = bytes.size();
+        benchmark::DoNotOptimize(bytes.data());
+    }
+    state.SetBytesProcessed(state.iterations() * size);
+}
+
+void BM_Decode_Codec(benchmark::State& state) {
+    chat::Chat2Message ref;
+    ref.set_timestamp(1744123537);
+    ref.set_nick("LogosUser_42");
+    ref.set_payload(randomText(state.range(0)));
+    std::string wire = ref.SerializeAsString();
+    chat::Chat2MessageView msg;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(proto::decode(wire, msg));
+        benchmark::DoNotOptimize(msg.payload.data());
+    }
+    state.SetBytesProcessed(state.iterations() * wire.size());
+}
+
+void BM_Decode_Libprotobuf(benchmark::State& state) {
+    chat::Chat2Message ref;
+    ref.set_timestamp(1744123537);
+    ref.set_nick("LogosUser_42");
+    ref.set_payload(randomText(state.range(0)));
+    std::string wire = ref.SerializeAsString();
+    chat::Chat2Message msg;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(msg.ParseFromString(wire));
+        benchmark::DoNotOptimize(msg.payload().data());
+    }
+    state.SetBytesProcessed(state.iterations() * wire.size());
+}
+
+} // namespace
+
+BENCHMARK(BM_Encode_Codec)->Arg(16)->Arg(256)->Arg(4096);
+BENCHMARK(BM_Encode_Libprotobuf)->Arg(16)->Arg(256)->Arg(4096);
+BENCHMARK(BM_Encode_ChatMessage)->Arg(16)->Arg(256)->Arg(4096);
+BENCHMARK(BM_Decode_Codec)->Arg(16)->Arg(256)->Arg(4096);
+BENCHMARK(BM_Decode_Libprotobuf)->Arg(16)->Arg(256)->Arg(4096);
@@ -0,0 +1,170 @@
+#include <QCoreApplication>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "codec/base64.h"
+#include "outbound/outbound_queue.h"
+
+// The outbox write-ahead log: what openLog replays from a log written by
+// an earlier run, a torn last line, done records, and the log being
+// emptied once everything in it is done. No Waku plugin is loaded, so
+// every publish fails right away.
+
+namespace fs = std::filesystem;
+
+namespace {
+
+int g_failures = 0;
+std::ostream g_report(std::cerr.rdbuf());  // stderr itself is silenced below
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+void check(bool ok, const char* what, int line) {
+    if (ok) return;
+    if (++g_failures <= 20) {
+        g_report << "outbound_queue_test.cpp:" << line << ": check failed: " << what << std::endl;
+    }
+}
+
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+};
+
+std::string encoded(const std::string& value) {
+    std::string out(base64::encodedSize(value.size()), '\0');
+    base64::encode(reinterpret_cast<const uint8_t*>(value.data()), value.size(), out.data());
+    return out;
+}
+
+std::string queued(uint64_t id, const std::string& json) {
+    return "E " + std::to_string(id) + " " + encoded("/toy-chat/2/general/proto") + " " +
+           encoded("/waku/2/rs/16/32") + " " + encoded(json);
+}
+
+std::string readFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+void writeFile(const std::string& path, const std::string& text) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << text;
+}
+
+bool waitFor(const OutboundQueue& queue, size_t pending) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (queue.pending() != pending) {
+        if (std::chrono::steady_clock::now() > deadline) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return true;
+}
+
+OutboundQueueOptions failFast() {
+    OutboundQueueOptions options;
+    options.maxAttempts = 1;
+    options.syncLog = false;
+    return options;
+}
+
+// Queued records without a done record come back, in id order; the torn
+// last line is dropped and the log is rewritten with only what is live
+void replay(const std::string& path) {
+    writeFile(path, queued(1, "one") + "\n" + queued(2, "two") + "\n" + "D 1\n" + queued(3, "three") + "\n" +
+                    "D 9\n" + "garbage\n" + queued(4, "four"));
+    OutboundQueue queue(failFast());
+    CHECK(queue.openLog(path));
+    CHECK(queue.pending() == 2);
+    CHECK(queue.reserveId() == 10);
+    CHECK(readFile(path) == queued(2, "two") + "\n" + queued(3, "three") + "\n");
+}
+
+// Failed messages are marked done and not replayed; messages queued
+// before start() are written all the same
+void doneRecords(const std::string& path) {
+    fs::remove(path);
+    std::vector<uint64_t> failed;
+    uint64_t first = 0;
+    uint64_t second = 0;
+    {
+        OutboundQueue queue(failFast());
+        CHECK(queue.openLog(path));
+        queue.setDeliveryCallback([&failed](uint64_t id, DeliveryState state, const std::string&) {
+            if (state == DeliveryState::Failed) failed.push_back(id);
+        });
+        first = queue.enqueue("/toy-chat/2/general/proto", "/waku/2/rs/16/32", "{}");
+        second = queue.enqueue("/toy-chat/2/dev/proto", "/waku/2/rs/16/32", "{}");
+        queue.start();
+        CHECK(waitFor(queue, 0));
+    }
+    // Reported from the worker, which the queue has joined by now
+    CHECK(failed.size() == 2 && failed[0] + failed[1] == first + second);
+    {
+        OutboundQueue queue(failFast());
+        CHECK(queue.openLog(path));
+        CHECK(queue.pending() == 0);
+        queue.enqueue("/toy-chat/2/general/proto", "/waku/2/rs/16/32", "{\"payload\":\"a\"}");
+        queue.enqueue("/toy-chat/2/general/proto", "/waku/2/rs/16/32", "{\"payload\":\"b\"}");
+    }
+    OutboundQueue queue(failFast());
+    CHECK(queue.openLog(path));
+    CHECK(queue.pending() == 2);
+}
+
+// Once enough records are in and nothing is queued, the log is emptied
+void compaction(const std::string& path) {
+    fs::remove(path);
+    {
+        OutboundQueue queue(failFast());
+        CHECK(queue.openLog(path));
+        // All queued first, so the queue is only empty once all are done
+        for (int i = 0; i < 600; ++i) {
+            queue.enqueue("/toy-chat/2/general/proto", "/waku/2/rs/16/32", "{}");
+        }
+        queue.start();
+        CHECK(waitFor(queue, 0));
+    }
+    CHECK(fs::file_size(path) == 0);
+    OutboundQueue queue(failFast());
+    CHECK(queue.openLog(path));
+    CHECK(queue.pending() == 0);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    qInstallMessageHandler([](QtMsgType, const QMessageLogContext&, const QString&) {});
+
+    fs::path dir = fs::temp_directory_path() / ("outbound_queue_test_" + std::to_string(::getpid()));
+    fs::create_directories(dir);
+    std::string path = (dir / "outbox.log").string();
+
+    // Every failed publish is reported on stderr
+    NullBuffer discard;
+    std::streambuf* console = std::cerr.rdbuf(&discard);
+
+    replay(path);
+    doneRecords(path);
+    compaction(path);
+
+    std::cerr.rdbuf(console);
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+
+    if (g_failures > 0) {
+        std::cerr << g_failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "outbound queue: all checks passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include <benchmark/benchmark.h>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "chat_corpus.h"
+#include "codec/base64.h"
+#include "codec/payload_compression.h"
+#include "message.codec.h"
+#include "protocol/protocol.h"
+
+namespace {
+
+const std::string kTopic = "/toy-chat/2/bench/proto";
+constexpr size_t kTrainMessages = 20000;
+constexpr size_t kTestMessages = 4096;
+
+enum Mode { Raw, Zstd, ZstdDictionary };
+
+// The dictionary is trained on the channel's earlier messages and measured
+// on the ones that follow
+struct Corpus {
+    std::vector<std::string> training;
+    std::vector<ChatMessage> messages;
+
+    Corpus() {
+        corpus::Generator generator;
+        for (const corpus::Message& m : generator.take(kTrainMessages)) training.push_back(m.text);
+        for (const corpus::Message& m : generator.take(kTestMessages)) messages.emplace_back(m.nick, m.text);
+    }
+};
+
+const Corpus& chatCorpus() {
+    static const Corpus corpus;
+    return corpus;
+}
+
+std::unique_ptr<PayloadCompressor> makeCompressor(benchmark::State& state) {
+    Mode mode = static_cast<Mode>(state.range(0));
+    PayloadCompressionOptions options;
+    options.dictionarySize = static_cast<size_t>(state.range(1)) * 1024;
+    auto compressor = std::make_unique<PayloadCompressor>(options);
+    compressor->setEnabled(mode != Raw);
+    if (mode == ZstdDictionary) {
+        std::filesystem::path dir = std::filesystem::temp_directory_path() / "chat_compression_bench";
+        std::filesystem::remove_all(dir);
+        compressor->open(dir.string());
+        // Every reader is assumed to have the dictionary
+        if (!compressor->train(kTopic, chatCorpus().training) || !compressor->useTrainedDictionary(kTopic)) {
+            state.SkipWithError("dictionary training failed");
+        }
+    }
+    return compressor;
+}
+
+std::vector<std::vector<uint8_t>> encodeAll(const PayloadCompressor& compressor) {
+    std::vector<std::vector<uint8_t>> encoded;
+    for (const ChatMessage& m : chatCorpus().messages) encoded.push_back(m.serialize(compressor, kTopic));
+    return encoded;
+}
+
+// Size counters per message: the text, the Chat2Message and the base64
+// payload that goes into the Waku message JSON
+void reportSizes(benchmark::State& state, const std::vector<std::vector<uint8_t>>& encoded) {
+    const auto& messages = chatCorpus().messages;
+    double text = 0, wire = 0, base64Size = 0, compressed = 0;
+    for (size_t i = 0; i < encoded.size(); ++i) {
+        text += messages[i].message().size();
+        wire += encoded[i].size();
+        base64Size += base64::encodedSize(encoded[i].size());
+        chat::Chat2MessageView view;
+        if (proto::decode(encoded[i].data(), encoded[i].size(), view) && view.compression != 0) compressed++;
+    }
+    double raw = 0;
+    for (const ChatMessage& m : messages) raw += m.encodedSize();
+    state.counters["textBytes"] = text / encoded.size();
+    state.counters["wireBytes"] = wire / encoded.size();
+    state.counters["base64Bytes"] = base64Size / encoded.size();
+    state.counters["wireRatio"] = wire / raw;
+    state.counters["compressed"] = compressed / encoded.size();
+}
+
+void BM_PayloadEncode(benchmark::State& state) {
+    std::unique_ptr<PayloadCompressor> compressor = makeCompressor(state);
+    const auto& messages = chatCorpus().messages;
+    for (auto _ : state) {
+        for (const ChatMessage& m : messages) {
+            std::vector<uint8_t> bytes = m.serialize(*compressor, kTopic);
+            benchmark::DoNotOptimize(bytes.data());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * messages.size());
+    reportSizes(state, encodeAll(*compressor));
+}
+
+void BM_PayloadDecode(benchmark::State& state) {
+    std::unique_ptr<PayloadCompressor> compressor = makeCompressor(state);
+    std::vector<std::vector<uint8_t>> encoded = encodeAll(*compressor);
+    std::vector<uint8_t> scratch;
+    for (auto _ : state) {
+        for (const std::vector<uint8_t>& bytes : encoded) {
+            chat::Chat2MessageView view;
+            if (!compressor->decode(bytes.data(), bytes.size(), view, scratch)) {
+                state.SkipWithError("decode failed");
+                return;
+            }
+            benchmark::DoNotOptimize(view.payload.data());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * encoded.size());
+    reportSizes(state, encoded);
+}
+
+void compressionArgs(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"mode", "dictKB"});
+    b->Args({Raw, 0});
+    b->Args({Zstd, 0});
+    for (int64_t kb : {4, 16, 64}) b->Args({ZstdDictionary, kb});
+}
+
+} // namespace
+
+// mode 0: uncompressed, 1: zstd without a dictionary, 2: with a trained one
+BENCHMARK(BM_PayloadEncode)->Apply(compressionArgs);
+BENCHMARK(BM_PayloadDecode)->Apply(compressionArgs);
@@ -0,0 +1,373 @@
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "message.codec.h"
+#include "message.pb.h"
+
+// The generated codec against libprotobuf: every message type round trips
+// both ways byte for byte, and truncated, mutated and malformed input is
+// rejected or decoded without reading past the end. Inputs are placed right
+// before an inaccessible page, so an out of bounds read crashes the test.
+
+namespace {
+
+const int kRounds = 2000;
+const int kMutations = 20;
+int g_failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+void check(bool ok, const char* what, int line) {
+    if (ok) return;
+    if (++g_failures <= 20) {
+        std::cerr << "proto_codec_test.cpp:" << line << ": check failed: " << what << std::endl;
+    }
+}
+
+// Bytes that end where an inaccessible page starts. All buffers share one
+// mapping, so only one is alive at a time.
+class GuardedBuffer {
+public:
+    explicit GuardedBuffer(std::string_view bytes) {
+        static uint8_t* const guard = mapArena();
+        if (bytes.size() > kArenaSize) {
+            std::cerr << "input larger than the guarded arena" << std::endl;
+            std::exit(2);
+        }
+        data_ = guard - bytes.size();
+        size_ = bytes.size();
+        if (size_ > 0) std::memcpy(data_, bytes.data(), size_);
+    }
+    GuardedBuffer(const GuardedBuffer&) = delete;
+    GuardedBuffer& operator=(const GuardedBuffer&) = delete;
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    bool contains(std::string_view view) const {
+        if (view.empty()) return true;
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(view.data());
+        return p >= data_ && p + view.size() <= data_ + size_;
+    }
+
+private:
+    static const size_t kArenaSize = 1 << 20;
+
+    // Returns the start of the inaccessible page after the arena
+    static uint8_t* mapArena() {
+        size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        void* base = mmap(nullptr, kArenaSize + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+            std::perror("mmap");
+            std::exit(2);
+        }
+        uint8_t* guard = static_cast<uint8_t*>(base) + kArenaSize;
+        mprotect(guard, page, PROT_NONE);
+        return guard;
+    }
+
+    uint8_t* data_;
+    size_t size_;
+};
+
+std::string_view view(const std::string& s) {
+    return std::string_view(s.data(), s.size());
+}
+
+uint64_t randomVarintValue(std::mt19937_64& rng) {
+    switch (rng() % 5) {
+        case 0: return 0;
+        case 1: return rng() % 128;
+        case 2: return rng() % 100000;
+        case 3: return std::numeric_limits<uint64_t>::max();
+        default: return rng();
+    }
+}
+
+std::string randomBytes(std::mt19937_64& rng) {
+    // Mostly short, sometimes past the one-byte length limit
+    size_t size = rng() % 4 == 0 ? 0 : rng() % 8 == 0 ? 128 + rng() % 2000 : rng() % 100;
+    std::string bytes(size, '\0');
+    for (char& c : bytes) c = static_cast<char>(rng());
+    return bytes;
+}
+
+// proto3 strings have to be UTF-8 for libprotobuf
+std::string randomText(std::mt19937_64& rng) {
+    static const char* const kPieces[] = {"a", "Z", "7", " ", "_", "\xc3\xa9", "\xe3\x81\x93", "\xf0\x9f\x99\x82"};
+    std::string text;
+    size_t count = rng() % 4 == 0 ? 0 : rng() % 40;
+    for (size_t i = 0; i < count; ++i) text += kPieces[rng() % 8];
+    return text;
+}
+
+chat::Chat2Message randomMessage(std::mt19937_64& rng) {
+    chat::Chat2Message msg;
+    msg.set_timestamp(randomVarintValue(rng));
+    msg.set_nick(randomText(rng));
+    msg.set_payload(randomBytes(rng));
+    msg.set_compression(static_cast<uint32_t>(randomVarintValue(rng)));
+    return msg;
+}
+
+chat::Chat2Batch randomBatch(std::mt19937_64& rng) {
+    chat::Chat2Batch batch;
+    size_t count = rng() % 6;
+    for (size_t i = 0; i < count; ++i) *batch.add_messages() = randomMessage(rng);
+    return batch;
+}
+
+chat::Chat2Chunk randomChunk(std::mt19937_64& rng) {
+    chat::Chat2Chunk chunk;
+    chunk.set_transfer(randomBytes(rng));
+    chunk.set_size(randomVarintValue(rng));
+    size_t count = rng() % 6;
+    for (size_t i = 0; i < count; ++i) chunk.add_chunks(randomBytes(rng));
+    chunk.set_index(static_cast<uint32_t>(randomVarintValue(rng)));
+    chunk.set_data(randomBytes(rng));
+    return chunk;
+}
+
+// Field by field equality and bounds, per message type
+
+bool same(const chat::Chat2Message& ref, const chat::Chat2MessageView& msg) {
+    return ref.timestamp() == msg.timestamp && view(ref.nick()) == msg.nick &&
+           view(ref.payload()) == msg.payload && ref.compression() == msg.compression;
+}
+
+bool same(const chat::Chat2Batch& ref, const chat::Chat2BatchView& batch) {
+    if (static_cast<size_t>(ref.messages_size()) != batch.messages.size()) return false;
+    for (size_t i = 0; i < batch.messages.size(); ++i) {
+        chat::Chat2MessageView element;
+        if (!proto::decode(batch.messages[i], element) || !same(ref.messages(static_cast<int>(i)), element)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool same(const chat::Chat2Chunk& ref, const chat::Chat2ChunkView& chunk) {
+    if (static_cast<size_t>(ref.chunks_size()) != chunk.chunks.size()) return false;
+    for (size_t i = 0; i < chunk.chunks.size(); ++i) {
+        if (view(ref.chunks(static_cast<int>(i))) != chunk.chunks[i]) return false;
+    }
+    return view(ref.transfer()) == chunk.transfer && ref.size() == chunk.size &&
+           ref.index() == chunk.index && view(ref.data()) == chunk.data;
+}
+
+bool inBounds(const GuardedBuffer& buffer, const chat::Chat2MessageView& msg) {
+    return buffer.contains(msg.nick) && buffer.contains(msg.payload);
+}
+
+bool inBounds(const GuardedBuffer& buffer, const chat::Chat2BatchView& batch) {
+    for (std::string_view element : batch.messages) {
+        if (!buffer.contains(element)) return false;
+    }
+    return true;
+}
+
+bool inBounds(const GuardedBuffer& buffer, const chat::Chat2ChunkView& chunk) {
+    for (std::string_view element : chunk.chunks) {
+        if (!buffer.contains(element)) return false;
+    }
+    return buffer.contains(chunk.transfer) && buffer.contains(chunk.data);
+}
+
+// The views of a libprotobuf message, with nested messages encoded by the codec
+chat::Chat2MessageView toView(const chat::Chat2Message& ref, std::vector<std::string>&) {
+    chat::Chat2MessageView msg;
+    msg.timestamp = ref.timestamp();
+    msg.nick = ref.nick();
+    msg.payload = ref.payload();
+    msg.compression = ref.compression();
+    return msg;
+}
+
+template <typename View>
+std::string encodeView(const View& msg) {
+    std::string out(proto::encodedSize(msg), '\0');
+    size_t written = proto::encode(msg, reinterpret_cast<uint8_t*>(&out[0]), out.size());
+    CHECK(written == out.size());
+    // One byte short of the exact size must be refused
+    if (!out.empty()) {
+        std::string small(out.size() - 1, '\0');
+        CHECK(proto::encode(msg, reinterpret_cast<uint8_t*>(&small[0]), small.size()) == 0);
+    }
+    return out;
+}
+
+chat::Chat2BatchView toView(const chat::Chat2Batch& ref, std::vector<std::string>& storage) {
+    chat::Chat2BatchView batch;
+    storage.clear();
+    storage.reserve(static_cast<size_t>(ref.messages_size()));
+    for (const chat::Chat2Message& element : ref.messages()) {
+        storage.push_back(encodeView(toView(element, storage)));
+    }
+    for (const std::string& element : storage) batch.messages.push_back(element);
+    return batch;
+}
+
+chat::Chat2ChunkView toView(const chat::Chat2Chunk& ref, std::vector<std::string>&) {
+    chat::Chat2ChunkView chunk;
+    chunk.transfer = ref.transfer();
+    chunk.size = ref.size();
+    for (const std::string& element : ref.chunks()) chunk.chunks.push_back(element);
+    chunk.index = ref.index();
+    chunk.data = ref.data();
+    return chunk;
+}
+
+// libprotobuf -> codec -> libprotobuf, and the codec's own encoding equal
+// to libprotobuf's
+template <typename Ref, typename View>
+void roundTrip(const Ref& ref) {
+    std::string wire;
+    CHECK(ref.SerializeToString(&wire));
+
+    GuardedBuffer buffer(wire);
+    View decoded;
+    CHECK(proto::decode(buffer.data(), buffer.size(), decoded));
+    CHECK(inBounds(buffer, decoded));
+    CHECK(same(ref, decoded));
+
+    std::vector<std::string> storage;
+    std::string encoded = encodeView(toView(ref, storage));
+    CHECK(encoded == wire);
+    Ref parsed;
+    CHECK(parsed.ParseFromString(encoded));
+    CHECK(parsed.SerializeAsString() == wire);
+}
+
+// Every prefix: the codec rejects exactly what libprotobuf rejects and never
+// reads past the cut
+template <typename Ref, typename View>
+void truncations(const std::string& wire) {
+    for (size_t size = 0; size < wire.size(); ++size) {
+        GuardedBuffer buffer(std::string_view(wire.data(), size));
+        View decoded;
+        bool ok = proto::decode(buffer.data(), buffer.size(), decoded);
+        Ref ref;
+        CHECK(ok == ref.ParseFromArray(buffer.data(), static_cast<int>(size)));
+        if (ok) CHECK(inBounds(buffer, decoded));
+    }
+}
+
+// Flipped, inserted and dropped bytes: whatever decodes stays inside the
+// input and encodes to something that decodes the same again
+template <typename View>
+void mutations(std::mt19937_64& rng, const std::string& wire) {
+    for (int round = 0; round < kMutations; ++round) {
+        std::string mutated = wire;
+        int edits = 1 + static_cast<int>(rng() % 3);
+        for (int e = 0; e < edits; ++e) {
+            size_t at = mutated.empty() ? 0 : rng() % mutated.size();
+            switch (rng() % 3) {
+                case 0:
+                    if (!mutated.empty()) mutated[at] = static_cast<char>(mutated[at] ^ (1 << (rng() % 8)));
+                    break;
+                case 1:
+                    mutated.insert(mutated.begin() + static_cast<std::ptrdiff_t>(at), static_cast<char>(rng()));
+                    break;
+                default:
+                    if (!mutated.empty()) mutated.erase(at, 1);
+                    break;
+            }
+        }
+        GuardedBuffer buffer(mutated);
+        View decoded;
+        if (!proto::decode(buffer.data(), buffer.size(), decoded)) continue;
+        CHECK(inBounds(buffer, decoded));
+        std::string again = encodeView(decoded);
+        View redecoded;
+        CHECK(proto::decode(again, redecoded));
+        CHECK(encodeView(redecoded) == again);
+    }
+}
+
+template <typename Ref, typename View>
+void fuzz(std::mt19937_64& rng, Ref (*make)(std::mt19937_64&)) {
+    for (int round = 0; round < kRounds; ++round) {
+        Ref ref = make(rng);
+        roundTrip<Ref, View>(ref);
+        std::string wire = ref.SerializeAsString();
+        truncations<Ref, View>(wire);
+        mutations<View>(rng, wire);
+    }
+}
+
+template <typename View>
+bool decodes(const std::string& bytes) {
+    GuardedBuffer buffer(bytes);
+    View decoded;
+    return proto::decode(buffer.data(), buffer.size(), decoded);
+}
+
+// Hand made inputs that have to be refused, and the longest valid varints
+void malformed() {
+    const std::string overlong(10, '\x80');  // ten continuation bytes, no end
+
+    // Key varints
+    CHECK(!decodes<chat::Chat2MessageView>(overlong + "\x01"));
+    CHECK(!decodes<chat::Chat2MessageView>("\x88"));
+    CHECK(!decodes<chat::Chat2MessageView>(std::string("\x80\x80\x80\x80\x10\x00", 6)));  // key past 32 bits
+    CHECK(!decodes<chat::Chat2MessageView>(std::string("\x00\x00", 2)));                  // field 0
+
+    // Varint values: ten bytes is the most a uint64 takes
+    CHECK(!decodes<chat::Chat2MessageView>("\x08" + overlong + "\x01"));
+    CHECK(!decodes<chat::Chat2MessageView>("\x08" + overlong));
+    chat::Chat2MessageView msg;
+    std::string maxTimestamp = "\x08" + std::string(9, '\xff') + "\x01";
+    CHECK(proto::decode(maxTimestamp, msg) && msg.timestamp == std::numeric_limits<uint64_t>::max());
+
+    // Lengths: over-long, past the end, far past the end
+    CHECK(!decodes<chat::Chat2MessageView>("\x12" + overlong + "\x01"));
+    CHECK(!decodes<chat::Chat2MessageView>("\x12\x05" "abcd"));
+    CHECK(!decodes<chat::Chat2MessageView>("\x12" + std::string(9, '\xff') + "\x01" "abcd"));
+    CHECK(!decodes<chat::Chat2ChunkView>("\x1a\x7f" "abc"));
+    CHECK(!decodes<chat::Chat2BatchView>("\x0a\x80\x01" "abc"));
+
+    // Known fields with the wrong wire type
+    CHECK(!decodes<chat::Chat2MessageView>("\x0a\x01" "a"));  // timestamp as bytes
+    CHECK(!decodes<chat::Chat2MessageView>("\x10\x01"));      // nick as varint
+    CHECK(!decodes<chat::Chat2ChunkView>("\x19" + std::string(8, '\0')));
+
+    // Unknown fields: skipped when whole, refused when cut or of a group type
+    CHECK(decodes<chat::Chat2MessageView>("\x29" + std::string(8, '\0')));
+    CHECK(!decodes<chat::Chat2MessageView>("\x29" + std::string(7, '\0')));
+    CHECK(decodes<chat::Chat2MessageView>("\x2d" + std::string(4, '\0')));
+    CHECK(!decodes<chat::Chat2MessageView>("\x2d" + std::string(3, '\0')));
+    CHECK(!decodes<chat::Chat2MessageView>("\x2a\x03" "ab"));
+    CHECK(!decodes<chat::Chat2MessageView>("\x28" + overlong + "\x01"));
+    CHECK(!decodes<chat::Chat2MessageView>("\x2b"));  // start group
+    CHECK(!decodes<chat::Chat2MessageView>("\x2c"));  // end group
+    CHECK(!decodes<chat::Chat2MessageView>("\x2e"));
+    CHECK(!decodes<chat::Chat2MessageView>("\x2f"));
+}
+
+} // namespace
+
+int main() {
+    // Rejected prefixes make libprotobuf log; the checks say what matters
+    google::protobuf::SetLogHandler(nullptr);
+    std::mt19937_64 rng(20250408);
+    fuzz<chat::Chat2Message, chat::Chat2MessageView>(rng, randomMessage);
+    fuzz<chat::Chat2Batch, chat::Chat2BatchView>(rng, randomBatch);
+    fuzz<chat::Chat2Chunk, chat::Chat2ChunkView>(rng, randomChunk);
+    malformed();
+
+    if (g_failures > 0) {
+        std::cerr << g_failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "proto codec: all checks passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,187 @@
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+#include "actor/channel_actors.h"
+#include "ratelimit/receive_limiter.h"
+#include "message.codec.h"
+#include "synthetic_store.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t kNormalSenders = 50;
+constexpr size_t kNormalPerSecond = 2;  // per normal sender
+constexpr size_t kFloodFactor = 10;     // the flooder sends this many times all the others together
+constexpr size_t kSeconds = 10;         // of traffic per iteration
+constexpr auto kDeliverCost = std::chrono::microseconds(5);  // printing and handing to the UI
+
+struct Traffic {
+    std::vector<InboundMessage> messages;
+    std::vector<bool> flood;  // by message, in the order of messages
+};
+
+std::string chatPayload(std::mt19937& rng, const std::string& nick, uint64_t timestamp) {
+    chat::Chat2Message msg;
+    msg.set_timestamp(timestamp);
+    msg.set_nick(nick);
+    std::uniform_int_distribution<int> ch('a', 'z');
+    std::string text(120, ' ');
+    for (auto& c : text) c = static_cast<char>(ch(rng));
+    msg.set_payload(text);
+    return synthetic::encodeBase64(msg.SerializeAsString());
+}
+
+// kSeconds of one channel: kNormalSenders sending evenly and one sender
+// with kFloodFactor times their traffic, interleaved by timestamp
+Traffic makeTraffic() {
+    std::mt19937 rng(11);
+    struct Timed {
+        uint64_t ms;
+        bool flood;
+        size_t sender;
+    };
+    std::vector<Timed> plan;
+    size_t normal = kNormalSenders * kNormalPerSecond * kSeconds;
+    for (size_t i = 0; i < normal; ++i) {
+        plan.push_back(Timed{i * 1000 * kSeconds / normal, false, i % kNormalSenders});
+    }
+    size_t flood = normal * kFloodFactor;
+    for (size_t i = 0; i < flood; ++i) {
+        plan.push_back(Timed{i * 1000 * kSeconds / flood, true, 0});
+    }
+    std::stable_sort(plan.begin(), plan.end(), [](const Timed& a, const Timed& b) { return a.ms < b.ms; });
+
+    Traffic traffic;
+    for (const Timed& t : plan) {
+        InboundMessage m;
+        m.channel = 1;
+        m.contentTopic = "/toy-chat/2/flood/proto";
+        std::string nick = t.flood ? "flooder" : "user_" + std::to_string(t.sender);
+        m.payload = chatPayload(rng, nick, 1744123537 + t.ms / 1000);
+        m.timestamp = (1744123537000ULL + t.ms) * 1000000ULL;
+        traffic.messages.push_back(std::move(m));
+        traffic.flood.push_back(t.flood);
+    }
+    return traffic;
+}
+
+const Traffic& traffic() {
+    static const Traffic instance = makeTraffic();
+    return instance;
+}
+
+// The traffic replayed as fast as the event thread can take it, with the
+// limiter keeping time by the envelope timestamps. Normal senders stay
+// within the default limits, so all of their messages should get through;
+// what the limiter changes is how long they wait behind the flood.
+void BM_Flood(benchmark::State& state) {
+    bool limited = state.range(0) != 0;
+    const Traffic& input = traffic();
+
+    std::vector<Clock::time_point> posted(input.messages.size());
+    std::vector<double> latencies;  // of normal messages, in us
+    std::mutex latencyMutex;
+    std::atomic<size_t> normalDelivered{0};
+    std::atomic<size_t> floodDelivered{0};
+
+    ChannelActorOptions options;
+    options.workers = 2;
+    ChannelActors actors(
+        [&](const InboundMessage& message, const RecentMessagePtr& decoded) {
+            auto until = Clock::now() + kDeliverCost;
+            while (Clock::now() < until) {
+            }
+            benchmark::DoNotOptimize(decoded->text().data());
+            size_t index = std::stoul(message.messageHash.substr(message.messageHash.find('_') + 1));
+            if (input.flood[index]) {
+                floodDelivered.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            normalDelivered.fetch_add(1, std::memory_order_relaxed);
+            double us = std::chrono::duration<double, std::micro>(Clock::now() - posted[index]).count();
+            std::lock_guard<std::mutex> lock(latencyMutex);
+            latencies.push_back(us);
+        },
+        nullptr, options);
+
+    ReceiveLimiter limiter;
+    ReceiveLimits limits = limiter.defaults();
+    uint64_t round = 0;
+    std::string nick;
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::vector<InboundMessage> batch = input.messages;
+        for (size_t i = 0; i < batch.size(); ++i) {
+            batch[i].messageHash = "0x" + std::to_string(round) + "_" + std::to_string(i);
+        }
+        // Every round starts an hour later, with full buckets
+        uint64_t base = round * 3600 * 1000;
+        round++;
+        state.ResumeTiming();
+
+        // What event_handler does for a plain message
+        for (size_t i = 0; i < batch.size(); ++i) {
+            InboundMessage& m = batch[i];
+            if (limited && peekSender(m.payload, nick)) {
+                uint64_t now = base + m.timestamp / 1000000 - 1744123537000ULL;
+                if (!limiter.allow(m.channel, nick, limits, now)) continue;
+                m.admitted = true;
+            }
+            posted[i] = Clock::now();
+            actors.post(std::move(m));
+        }
+        actors.waitIdle();
+    }
+
+    size_t normal = kNormalSenders * kNormalPerSecond * kSeconds;
+    if (normalDelivered.load() != state.iterations() * normal) {
+        state.SkipWithError("normal senders lost messages");
+        return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    state.SetItemsProcessed(state.iterations() * input.messages.size());
+    state.counters["flood_delivered"] =
+        static_cast<double>(floodDelivered.load()) / static_cast<double>(state.iterations());
+    state.counters["normal_p50_ms"] = latencies[latencies.size() / 2] / 1000;
+    state.counters["normal_p99_ms"] = latencies[latencies.size() * 99 / 100] / 1000;
+    state.counters["dropped"] = static_cast<double>(limiter.dropped()) / static_cast<double>(state.iterations());
+}
+
+// Cost of the check itself: one flooding sender, or many senders spread
+// over the table, from one or more event threads
+void BM_LimiterAllow(benchmark::State& state) {
+    static ReceiveLimiter limiter;
+    size_t senders = state.range(0);
+    std::vector<std::string> nicks;
+    for (size_t i = 0; i < senders; ++i) nicks.push_back("user_" + std::to_string(i));
+    ReceiveLimits limits;
+    limits.channelRate = 1000;
+    uint64_t now = 0;
+    size_t i = static_cast<size_t>(state.thread_index()) * 7919;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(limiter.allow(1, nicks[i++ % senders], limits, now++ / 16));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_PeekSender(benchmark::State& state) {
+    const Traffic& input = traffic();
+    std::string nick;
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(peekSender(input.messages[i++ % input.messages.size()].payload, nick));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+} // namespace
+
+BENCHMARK(BM_Flood)->Arg(0)->Arg(1)->ArgName("limited")->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LimiterAllow)->Arg(1)->Arg(100000)->ArgName("senders")->ThreadRange(1, 4)->UseRealTime();
+BENCHMARK(BM_PeekSender);
@@ -0,0 +1,117 @@
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "chat_corpus.h"
+#include "search/search_index.h"
+
+namespace {
+
+constexpr size_t kIndexedMessages = 1000000;
+constexpr size_t kChannels = 16;
+constexpr size_t kPageSize = 20;
+
+std::string channelTopic(size_t i) {
+    return "/toy-chat/2/bench-" + std::to_string(i % kChannels) + "/proto";
+}
+
+std::string messageHash(size_t i) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hash = "0x";
+    uint64_t x = i * 0x9E3779B97F4A7C15ULL + 1;
+    for (int n = 0; n < 64; ++n) {
+        x ^= x >> 29;
+        x *= 0xBF58476D1CE4E5B9ULL;
+        hash += digits[x & 15];
+    }
+    return hash;
+}
+
+const std::vector<corpus::Message>& chatCorpus() {
+    static const std::vector<corpus::Message> messages = corpus::Generator().take(kIndexedMessages);
+    return messages;
+}
+
+// A million messages over kChannels channels, indexed once and shared by
+// the query benchmarks
+SearchIndex& fullIndex() {
+    static std::unique_ptr<SearchIndex> index = [] {
+        auto built = std::make_unique<SearchIndex>();
+        const auto& messages = chatCorpus();
+        for (size_t i = 0; i < messages.size(); ++i) {
+            built->add(channelTopic(i), messageHash(i), (1744123537 + i) * 1000000000ULL, messages[i].text);
+        }
+        built->waitIdle();
+        return built;
+    }();
+    return *index;
+}
+
+// Indexing throughput, sealing and merging included. The relay delivers a
+// few hundred messages a second on a busy node; this has to stay far above.
+void BM_SearchIndexAdd(benchmark::State& state) {
+    const size_t count = static_cast<size_t>(state.range(0));
+    const auto& messages = chatCorpus();
+    std::vector<std::string> topics, hashes;
+    for (size_t i = 0; i < count; ++i) {
+        topics.push_back(channelTopic(i));
+        hashes.push_back(messageHash(i));
+    }
+    for (auto _ : state) {
+        SearchIndex index;
+        for (size_t i = 0; i < count; ++i) {
+            index.add(topics[i], hashes[i], (1744123537 + i) * 1000000000ULL, messages[i].text);
+        }
+        index.waitIdle();
+        state.counters["segments"] = static_cast<double>(index.segmentCount());
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+
+struct Query {
+    const char* text;
+    bool oneChannel;
+};
+
+// From the most common word of the corpus to rare ones
+const Query kQueries[] = {
+    {"the", false},               // in two messages out of three
+    {"waku", false},
+    {"grafana", false},           // rare
+    {"store node", false},        // two words, anywhere
+    {"\"the node\"", false},      // phrase
+    {"mem*", false},              // prefix
+    {"sync*", true},              // prefix within one channel
+    {"node \"is a\" wak*", false},  // all three together
+};
+
+void BM_SearchQuery(benchmark::State& state) {
+    SearchIndex& index = fullIndex();
+    const Query& query = kQueries[state.range(0)];
+    const std::string topic = query.oneChannel ? channelTopic(3) : std::string();
+    size_t total = 0;
+    for (auto _ : state) {
+        SearchResults results = index.search(query.text, 0, kPageSize, topic);
+        total = results.total;
+        benchmark::DoNotOptimize(results.hits.data());
+    }
+    state.SetLabel(query.text);
+    state.counters["matches"] = static_cast<double>(total);
+    state.counters["segments"] = static_cast<double>(index.segmentCount());
+}
+
+// A later page costs about as much as the first: every match is scored
+void BM_SearchQueryPage(benchmark::State& state) {
+    SearchIndex& index = fullIndex();
+    size_t offset = static_cast<size_t>(state.range(0)) * kPageSize;
+    for (auto _ : state) {
+        SearchResults results = index.search("waku", offset, kPageSize);
+        benchmark::DoNotOptimize(results.hits.data());
+    }
+}
+
+} // namespace
+
+BENCHMARK(BM_SearchIndexAdd)->Arg(100000)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_SearchQuery)->DenseRange(0, sizeof(kQueries) / sizeof(kQueries[0]) - 1)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SearchQueryPage)->Arg(0)->Arg(10)->Arg(100)->Unit(benchmark::kMillisecond);
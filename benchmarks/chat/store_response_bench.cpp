@@ -0,0 +1,90 @@
+#include <benchmark/benchmark.h>
+#include <sstream>
+#include <vector>
+#include "codec/store_response_decoder.h"
+#include "synthetic_store.h"
+
+namespace {
+
+// The pre-decoder storeQueryCallback parsing path, kept as a baseline:
+// find + getline + stoi per byte, then a copy into a string for protobuf.
+size_t legacyDecode(const std::string& jsonStr) {
+    size_t decoded = 0;
+    size_t pos = 0;
+    while ((pos = jsonStr.find("\"payload\":[", pos)) != std::string::npos) {
+        pos += 11;
+        size_t endPos = jsonStr.find("]", pos);
+        if (endPos == std::string::npos) break;
+        std::string payloadStr = jsonStr.substr(pos, endPos - pos);
+        std::vector<uint8_t> payloadBytes;
+        std::stringstream ss(payloadStr);
+        std::string numberStr;
+        while (std::getline(ss, numberStr, ',')) {
+            payloadBytes.push_back(static_cast<uint8_t>(std::stoi(numberStr)));
+        }
+        std::string binary(payloadBytes.begin(), payloadBytes.end());
+        chat::Chat2Message message;
+        if (message.ParseFromString(binary)) {
+            benchmark::DoNotOptimize(message.payload().data());
+            decoded++;
+        }
+    }
+    return decoded;
+}
+
+void BM_StorePage_Legacy(benchmark::State& state) {
+    std::string page = synthetic::makeStorePage(state.range(0), state.range(1),
+                                                synthetic::PayloadFormat::ByteList);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(legacyDecode(page));
+    }
+    state.SetBytesProcessed(state.iterations() * page.size());
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_StorePage_Decoder(benchmark::State& state, synthetic::PayloadFormat format) {
+    std::string page = synthetic::makeStorePage(state.range(0), state.range(1), format);
+    StoreResponseDecoder decoder;
+    StoreMessage msg;
+    for (auto _ : state) {
+        decoder.reset(page.data(), page.size());
+        size_t decoded = 0;
+        while (decoder.next(msg)) {
+            benchmark::DoNotOptimize(msg.text.data());
+            decoded += msg.decoded;
+        }
+        if (decoded != static_cast<size_t>(state.range(0))) {
+            state.SkipWithError("decoder dropped messages");
+            break;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * page.size());
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_ParseByteList(benchmark::State& state) {
+    std::string list;
+    for (int64_t i = 0; i < state.range(0); ++i) {
+        if (i > 0) list += ',';
+        list += std::to_string(static_cast<uint8_t>(i * 131));
+    }
+    list += ']';
+    std::vector<uint8_t> out;
+    for (auto _ : state) {
+        out.clear();
+        benchmark::DoNotOptimize(parseByteList(list.data(), list.data() + list.size(), out));
+    }
+    state.SetBytesProcessed(state.iterations() * list.size());
+}
+
+// Pages of {messages, text bytes}, up to the 100 x 1 KiB case
+void pageSizes(benchmark::internal::Benchmark* b) {
+    b->Args({10, 64})->Args({100, 64})->Args({100, 1024})->Args({100, 16 * 1024});
+}
+
+} // namespace
+
+BENCHMARK(BM_StorePage_Legacy)->Apply(pageSizes);
+BENCHMARK_CAPTURE(BM_StorePage_Decoder, byte_list, synthetic::PayloadFormat::ByteList)->Apply(pageSizes);
+BENCHMARK_CAPTURE(BM_StorePage_Decoder, base64, synthetic::PayloadFormat::Base64)->Apply(pageSizes);
+BENCHMARK(BM_ParseByteList)->Arg(64)->Arg(1024)->Arg(64 * 1024);
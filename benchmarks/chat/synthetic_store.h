@@ -0,0 +1,87 @@
+#ifndef SYNTHETIC_STORE_H
+#define SYNTHETIC_STORE_H
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include "message.pb.h"
+
+// Helpers that build synthetic store query responses shaped like the ones
+// returned by a Waku store node.
+namespace synthetic {
+
+enum class PayloadFormat {
+    ByteList, // "payload":[8,128,...]
+    Base64    // "payload":"CIAB..."
+};
+
+inline std::string encodeBase64(const std::string& data) {
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    out.reserve((data.size() + 2) / 3 * 4);
+    size_t i = 0;
+    for (; i + 3 <= data.size(); i += 3) {
+        uint32_t v = (uint8_t(data[i]) << 16) | (uint8_t(data[i + 1]) << 8) | uint8_t(data[i + 2]);
+        out += alphabet[(v >> 18) & 63];
+        out += alphabet[(v >> 12) & 63];
+        out += alphabet[(v >> 6) & 63];
+        out += alphabet[v & 63];
+    }
+    if (i < data.size()) {
+        uint32_t v = uint8_t(data[i]) << 16;
+        if (i + 1 < data.size()) v |= uint8_t(data[i + 1]) << 8;
+        out += alphabet[(v >> 18) & 63];
+        out += alphabet[(v >> 12) & 63];
+        out += (i + 1 < data.size()) ? alphabet[(v >> 6) & 63] : '=';
+        out += '=';
+    }
+    return out;
+}
+
+// Serialized Chat2Message with a random printable text of textSize bytes
+inline std::string makeChatPayload(std::mt19937& rng, size_t textSize, uint64_t timestamp) {
+    std::uniform_int_distribution<int> ch(' ', '~');
+    std::string text(textSize, ' ');
+    for (auto& c : text) c = static_cast<char>(ch(rng));
+
+    chat::Chat2Message msg;
+    msg.set_timestamp(timestamp);
+    msg.set_nick("LogosUser_" + std::to_string(rng() % 100));
+    msg.set_payload(text);
+    return msg.SerializeAsString();
+}
+
+// A store query response page with messageCount messages of textSize bytes
+inline std::string makeStorePage(size_t messageCount, size_t textSize, PayloadFormat format,
+                                 uint32_t seed = 42) {
+    std::mt19937 rng(seed);
+    std::string json = R"({"request_id":"bench","status_code":200,"status_desc":"OK","messages":[)";
+    for (size_t i = 0; i < messageCount; ++i) {
+        uint64_t ts = 1744123537 + i;
+        std::string payload = makeChatPayload(rng, textSize, ts);
+        if (i > 0) json += ',';
+        json += R"({"messageHash":"0x)";
+        for (int h = 0; h < 8; ++h) json += "0123456789abcdef"[rng() & 15];
+        json += R"(","message":{"payload":)";
+        if (format == PayloadFormat::ByteList) {
+            json += '[';
+            for (size_t b = 0; b < payload.size(); ++b) {
+                if (b > 0) json += ',';
+                json += std::to_string(static_cast<uint8_t>(payload[b]));
+            }
+            json += ']';
+        } else {
+            json += '"' + encodeBase64(payload) + '"';
+        }
+        json += R"(,"contentTopic":"/toy-chat/2/huilong/proto","version":1,"timestamp":)";
+        json += std::to_string(ts * 1000000000ULL);
+        json += R"(,"ephemeral":false},"pubsubTopic":"/waku/2/rs/16/32"})";
+    }
+    json += R"(],"paginationCursor":"0x00"})";
+    return json;
+}
+
+} // namespace synthetic
+
+#endif // SYNTHETIC_STORE_H
@@ -0,0 +1,357 @@
+// End-to-end chat load: messages queued through ChatInterface, published by
+// the Waku plugin, received back by the same node and handed to a message
+// listener, for whichever WakuInterface LOGOS_WAKU_PLUGIN names (waku_sim
+// to run offline). Prints a JSON report for regression tracking.
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QMetaObject>
+#include <QTemporaryDir>
+#include <sys/resource.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "logos_core.h"
+#include "plugin_registry.h"
+#include "chat_interface.h"
+#include "latency/hdr_histogram.h"
+#include "../../modules/waku/waku_interface.h"
+
+// Every allocation in the process, plugins included: the executable
+// exports these, so the plugins it loads resolve to them
+namespace {
+std::atomic<uint64_t> g_allocations{0};
+}
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept {
+    return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+
+namespace {
+
+struct BenchOptions {
+    unsigned int senders = 10;
+    unsigned int channels = 4;
+    size_t messageSize = 100;   // characters of message text
+    double rate = 100;          // messages per second, over all senders
+    double durationS = 10;      // measured
+    double warmupS = 2;         // sent before measuring, not counted
+    double drainS = 5;          // longest wait for the last messages
+    std::string modulesDir;     // plugins; next to the executable by default
+    std::string output;         // JSON report; stdout if empty
+};
+
+void usage() {
+    std::cerr << "Usage: chat_bench [--senders=N] [--channels=N] [--size=BYTES] [--rate=MSGS_PER_S]\n"
+                 "                  [--duration=S] [--warmup=S] [--drain=S] [--modules=DIR] [--output=FILE]\n"
+                 "The Waku plugin is the one LOGOS_WAKU_PLUGIN names, waku by default."
+              << std::endl;
+}
+
+bool parseOptions(int argc, char* argv[], BenchOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) {
+            return false;
+        }
+        std::string key = arg.substr(2, eq - 2);
+        std::string value = arg.substr(eq + 1);
+        double number = std::strtod(value.c_str(), nullptr);
+        if (key == "senders") {
+            options.senders = std::max(1u, static_cast<unsigned int>(number));
+        } else if (key == "channels") {
+            options.channels = std::max(1u, static_cast<unsigned int>(number));
+        } else if (key == "size") {
+            options.messageSize = static_cast<size_t>(number);
+        } else if (key == "rate") {
+            options.rate = number;
+        } else if (key == "duration") {
+            options.durationS = number;
+        } else if (key == "warmup") {
+            options.warmupS = number;
+        } else if (key == "drain") {
+            options.drainS = number;
+        } else if (key == "modules") {
+            options.modulesDir = value;
+        } else if (key == "output") {
+            options.output = value;
+        } else {
+            return false;
+        }
+    }
+    return options.rate > 0 && options.durationS > 0;
+}
+
+uint64_t steadyNanos() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+uint64_t cpuNanos() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    auto toNanos = [](const timeval& tv) {
+        return static_cast<uint64_t>(tv.tv_sec) * 1000000000ULL + static_cast<uint64_t>(tv.tv_usec) * 1000ULL;
+    };
+    return toNanos(usage.ru_utime) + toNanos(usage.ru_stime);
+}
+
+std::string channelName(unsigned int channel) {
+    return "bench-" + std::to_string(channel);
+}
+
+// Messages are "<seq> <sent ns> " padded to the message size, from nicks
+// "bench-<sender>", so the listener can time them
+std::string messageText(uint64_t seq, uint64_t sentNs, size_t size) {
+    std::string text = std::to_string(seq) + " " + std::to_string(sentNs) + " ";
+    if (text.size() < size) text.append(size - text.size(), 'x');
+    return text;
+}
+
+// What the listener saw; messages from before measuring are left out
+class Receipts {
+public:
+    void startMeasuring(uint64_t firstSeq) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        firstSeq_ = firstSeq;
+        measuring_ = true;
+    }
+
+    void record(std::string_view nick, std::string_view text) {
+        uint64_t now = steadyNanos();
+        if (nick.compare(0, 6, "bench-") != 0) return;
+        std::string fields(text.substr(0, std::min<size_t>(text.size(), 48)));
+        char* end = nullptr;
+        uint64_t seq = std::strtoull(fields.c_str(), &end, 10);
+        uint64_t sentNs = std::strtoull(end, nullptr, 10);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!measuring_ || seq < firstSeq_) return;
+        size_t slot = static_cast<size_t>(seq - firstSeq_);
+        if (slot >= seen_.size()) seen_.resize(std::max(slot + 1, seen_.size() * 2));
+        if (seen_[slot]) {
+            duplicates_++;
+            return;
+        }
+        seen_[slot] = 1;
+        received_++;
+        lastNs_ = now;
+        latencyUs_.record(now > sentNs ? (now - sentNs) / 1000 : 0);
+    }
+
+    uint64_t received() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return received_;
+    }
+
+    uint64_t duplicates() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return duplicates_;
+    }
+
+    uint64_t lastNs() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return lastNs_;
+    }
+
+    HdrHistogram latency() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return latencyUs_;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    bool measuring_ = false;
+    uint64_t firstSeq_ = 0;
+    std::vector<uint8_t> seen_;
+    uint64_t received_ = 0;
+    uint64_t duplicates_ = 0;
+    uint64_t lastNs_ = 0;
+    HdrHistogram latencyUs_{60000000ULL, 3};  // up to a minute
+};
+
+struct BenchResult {
+    uint64_t sent = 0;
+    uint64_t received = 0;
+    uint64_t duplicates = 0;
+    double elapsedS = 0;
+    uint64_t cpuNs = 0;
+    uint64_t allocations = 0;
+    HdrHistogram latencyUs{60000000ULL, 3};
+};
+
+// Queue messages at the rate, round robin over senders and channels, then
+// wait for them to come back
+BenchResult runLoad(ChatInterface* chat, const BenchOptions& options, Receipts& receipts) {
+    const uint64_t intervalNs = static_cast<uint64_t>(1e9 / options.rate);
+    const uint64_t warmupCount = static_cast<uint64_t>(options.warmupS * options.rate);
+    const uint64_t measuredCount = std::max<uint64_t>(1, static_cast<uint64_t>(options.durationS * options.rate));
+
+    BenchResult result;
+    uint64_t startNs = 0;
+    uint64_t startCpu = 0;
+    uint64_t startAllocations = 0;
+    uint64_t nextNs = steadyNanos();
+    for (uint64_t seq = 0; seq < warmupCount + measuredCount; ++seq) {
+        if (seq == warmupCount) {
+            receipts.startMeasuring(seq);
+            startNs = steadyNanos();
+            startCpu = cpuNanos();
+            startAllocations = g_allocations.load(std::memory_order_relaxed);
+        }
+        uint64_t now = steadyNanos();
+        if (now < nextNs) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(nextNs - now));
+        }
+        // Paced from the schedule, not from when the last one went, so a
+        // slow send is made up for rather than lowering the rate
+        nextNs += intervalNs;
+        std::string sender = "bench-" + std::to_string(seq % options.senders);
+        std::string channel = channelName(static_cast<unsigned int>(seq % options.channels));
+        chat->queueMessage(channel, sender, messageText(seq, steadyNanos(), options.messageSize));
+    }
+    result.sent = measuredCount;
+
+    uint64_t drainUntil = steadyNanos() + static_cast<uint64_t>(options.drainS * 1e9);
+    while (receipts.received() < measuredCount && steadyNanos() < drainUntil) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    result.cpuNs = cpuNanos() - startCpu;
+    result.allocations = g_allocations.load(std::memory_order_relaxed) - startAllocations;
+    result.received = receipts.received();
+    result.duplicates = receipts.duplicates();
+    uint64_t endNs = std::max(receipts.lastNs(), startNs + static_cast<uint64_t>(options.durationS * 1e9));
+    result.elapsedS = static_cast<double>(endNs - startNs) / 1e9;
+    result.latencyUs = receipts.latency();
+    return result;
+}
+
+std::string reportJson(const BenchOptions& options, const std::string& wakuPlugin, const BenchResult& result) {
+    double perMessage = result.received > 0 ? 1.0 / static_cast<double>(result.received) : 0;
+    auto ms = [&](double percentile) { return static_cast<double>(result.latencyUs.valueAt(percentile)) / 1000; };
+    std::ostringstream out;
+    out << "{\n"
+        << "  \"waku_plugin\": \"" << wakuPlugin << "\",\n"
+        << "  \"senders\": " << options.senders << ",\n"
+        << "  \"channels\": " << options.channels << ",\n"
+        << "  \"message_size\": " << options.messageSize << ",\n"
+        << "  \"rate\": " << options.rate << ",\n"
+        << "  \"duration_s\": " << options.durationS << ",\n"
+        << "  \"sent\": " << result.sent << ",\n"
+        << "  \"received\": " << result.received << ",\n"
+        << "  \"duplicates\": " << result.duplicates << ",\n"
+        << "  \"elapsed_s\": " << result.elapsedS << ",\n"
+        << "  \"throughput_msgs_per_s\": " << static_cast<double>(result.received) / result.elapsedS << ",\n"
+        << "  \"cpu_us_per_msg\": " << static_cast<double>(result.cpuNs) / 1000 * perMessage << ",\n"
+        << "  \"allocs_per_msg\": " << static_cast<double>(result.allocations) * perMessage << ",\n"
+        << "  \"latency_ms\": {\"p50\": " << ms(50) << ", \"p90\": " << ms(90) << ", \"p99\": " << ms(99)
+        << ", \"p999\": " << ms(99.9) << ", \"max\": " << static_cast<double>(result.latencyUs.max()) / 1000
+        << "}\n"
+        << "}\n";
+    return out.str();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        usage();
+        return 2;
+    }
+
+    // Every run starts from an empty history, so messages stored by an
+    // earlier run are neither replayed nor counted as duplicates
+    QTemporaryDir historyDir;
+    if (!historyDir.isValid()) {
+        std::cerr << "Failed to create a history directory" << std::endl;
+        return 1;
+    }
+    qputenv("LOGOS_CHAT_HISTORY_DIR", historyDir.path().toUtf8());
+
+    logos_core_init(argc, argv);
+    std::string modulesDir = options.modulesDir.empty()
+        ? QDir::cleanPath(QCoreApplication::applicationDirPath() + "/modules").toStdString()
+        : options.modulesDir;
+    logos_core_set_plugins_dir(modulesDir.c_str());
+    logos_core_start();
+
+    std::string wakuPlugin = wakuPluginName().toStdString();
+    if (!logos_core_load_plugin(wakuPlugin.c_str()) || !logos_core_load_plugin("chat")) {
+        std::cerr << "Failed to load the " << wakuPlugin << " and chat plugins from " << modulesDir << std::endl;
+        logos_core_cleanup();
+        return 1;
+    }
+    ChatInterface* chat = PluginRegistry::getPlugin<ChatInterface>("chat");
+    if (chat == nullptr || !chat->initialize()) {
+        std::cerr << "Failed to initialize chat" << std::endl;
+        logos_core_cleanup();
+        return 1;
+    }
+
+    Receipts receipts;
+    chat->addMessageListener([&receipts](const ChatMessageRef& message) {
+        receipts.record(message.nick(), message.payload());
+    });
+    for (unsigned int channel = 0; channel < options.channels; ++channel) {
+        chat->joinChannel(channelName(channel));
+    }
+
+    // The load runs beside the event loop, which the plugins may need
+    BenchResult result;
+    std::thread load([&] {
+        result = runLoad(chat, options, receipts);
+        QMetaObject::invokeMethod(QCoreApplication::instance(), "quit", Qt::QueuedConnection);
+    });
+    QCoreApplication::exec();
+    load.join();
+
+    std::string report = reportJson(options, wakuPlugin, result);
+    if (options.output.empty()) {
+        std::cout << report << std::flush;
+    } else {
+        std::ofstream file(options.output);
+        file << report;
+        if (!file) {
+            std::cerr << "Failed to write " << options.output << std::endl;
+        }
+    }
+
+    logos_core_cleanup();
+    return result.received > 0 ? 0 : 1;
+}
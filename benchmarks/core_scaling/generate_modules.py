@@ -0,0 +1,174 @@
+#!/usr/bin/env python3
+"""Writes the sources of N synthetic modules for core_scaling_bench.
+
+  generate_modules.py --count 10000 --core-dir ../../core OUT_DIR
+
+Each module is a trivial PluginInterface plugin, synthetic_00000 to
+synthetic_<N-1>, with its own class, a few invokable methods and a
+metadata.json like the real modules'. Dependencies only point at modules
+with lower numbers, half of them at the first ten, so any first n modules
+are a closed graph and a few modules are depended on by many, as core and
+waku are. OUT_DIR gets a CMake project building all of them into the
+modules directory of its build directory.
+
+The output only depends on --count and --seed, and files that would not
+change are left alone so a rebuild only compiles what changed.
+"""
+
+import argparse
+import json
+import os
+import random
+
+WORDS = (
+    "module plugin core chat waku relay store filter peer message channel history sync key "
+    "wallet storage network identity status bridge light node cache index search metrics "
+    "provides handles manages exposes tracks for the a of and with on"
+).split()
+CAPABILITIES = ["messaging", "storage", "networking", "identity", "plugin_installation",
+                "search", "metrics", "crypto", "ui", "sync"]
+HUBS = 10
+
+CMAKE_LISTS = """\
+# Generated by generate_modules.py, do not edit
+cmake_minimum_required(VERSION 3.16)
+project(SyntheticModules LANGUAGES CXX)
+
+set(CMAKE_CXX_STANDARD 17)
+set(CMAKE_CXX_STANDARD_REQUIRED ON)
+set(CMAKE_AUTOMOC ON)
+
+find_package(QT NAMES Qt6 Qt5 REQUIRED COMPONENTS Core)
+find_package(Qt${{QT_VERSION_MAJOR}} REQUIRED COMPONENTS Core)
+
+include(${{CMAKE_CURRENT_SOURCE_DIR}}/modules.cmake)
+
+foreach(MODULE ${{SYNTHETIC_MODULES}})
+    add_library(${{MODULE}}_plugin SHARED
+        ${{MODULE}}/${{MODULE}}_plugin.h
+        ${{MODULE}}/${{MODULE}}_plugin.cpp
+    )
+    set_target_properties(${{MODULE}}_plugin PROPERTIES
+        PREFIX ""
+        LIBRARY_OUTPUT_DIRECTORY ${{CMAKE_BINARY_DIR}}/modules)
+    target_include_directories(${{MODULE}}_plugin PRIVATE "{core_dir}")
+    target_link_libraries(${{MODULE}}_plugin PRIVATE Qt${{QT_VERSION_MAJOR}}::Core)
+    # Thousands of tiny plugins: parse the Qt headers once
+    if(NOT FIRST_MODULE)
+        set(FIRST_MODULE ${{MODULE}})
+        target_precompile_headers(${{MODULE}}_plugin PRIVATE <QObject> <QString> <QtPlugin>)
+    else()
+        target_precompile_headers(${{MODULE}}_plugin REUSE_FROM ${{FIRST_MODULE}}_plugin)
+    endif()
+endforeach()
+"""
+
+HEADER = """\
+#pragma once
+
+#include <QObject>
+#include "interface.h"
+
+// Generated by generate_modules.py
+class {cls} : public QObject, public PluginInterface
+{{
+    Q_OBJECT
+    Q_PLUGIN_METADATA(IID PluginInterface_iid FILE "metadata.json")
+    Q_INTERFACES(PluginInterface)
+
+public:
+    QString name() const override {{ return "{name}"; }}
+    QString version() const override {{ return "{version}"; }}
+
+{methods}
+}};
+"""
+
+SOURCE = """\
+#include "{name}_plugin.h"
+
+{definitions}
+"""
+
+
+def module_name(index):
+    return "synthetic_%05d" % index
+
+
+def class_name(index):
+    return "Synthetic%05dPlugin" % index
+
+
+def dependencies(rng, index):
+    count = min(index, rng.choice([0, 0, 1, 1, 1, 2, 2, 3, 4, 6]))
+    picked = set()
+    while len(picked) < count:
+        if rng.random() < 0.5:
+            picked.add(rng.randrange(min(index, HUBS)))
+        else:
+            picked.add(rng.randrange(index))
+    return [module_name(dep) for dep in sorted(picked)]
+
+
+def module_files(rng, index):
+    name = module_name(index)
+    cls = class_name(index)
+    version = "%d.%d.%d" % (rng.randint(0, 2), rng.randint(0, 20), rng.randint(0, 9))
+    metadata = {
+        "name": name,
+        "version": version,
+        "description": " ".join(rng.choice(WORDS) for _ in range(rng.randint(4, 40))).capitalize(),
+        "author": "Logos Core Team",
+        "type": "synthetic",
+        "category": rng.choice(["core", "network", "storage", "ui"]),
+        "main": name + "_plugin",
+        "dependencies": dependencies(rng, index),
+        "capabilities": rng.sample(CAPABILITIES, rng.randint(0, 3)),
+    }
+    declarations = []
+    definitions = []
+    for method in range(rng.randint(1, 6)):
+        declarations.append("    Q_INVOKABLE int method%d(int value, const QString& text);" % method)
+        definitions.append("int %s::method%d(int value, const QString& text)\n{\n"
+                           "    return value + text.size() + %d;\n}\n" % (cls, method, method))
+    return {
+        name + "/metadata.json": json.dumps(metadata, indent=2) + "\n",
+        name + "/" + name + "_plugin.h": HEADER.format(cls=cls, name=name, version=version,
+                                                       methods="\n".join(declarations)),
+        name + "/" + name + "_plugin.cpp": SOURCE.format(name=name, definitions="\n".join(definitions)),
+    }
+
+
+def write_if_changed(path, text):
+    if os.path.exists(path):
+        with open(path) as f:
+            if f.read() == text:
+                return
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    with open(path, "w") as f:
+        f.write(text)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("out_dir")
+    parser.add_argument("--count", type=int, default=10000)
+    parser.add_argument("--seed", type=int, default=20250408)
+    parser.add_argument("--core-dir", required=True, help="the repository's core directory, for interface.h")
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    for index in range(args.count):
+        for relative, text in module_files(rng, index).items():
+            write_if_changed(os.path.join(args.out_dir, relative), text)
+
+    names = "\n".join("    " + module_name(index) for index in range(args.count))
+    write_if_changed(os.path.join(args.out_dir, "modules.cmake"),
+                     "# Generated by generate_modules.py, do not edit\nset(SYNTHETIC_MODULES\n%s\n)\n" % names)
+    write_if_changed(os.path.join(args.out_dir, "CMakeLists.txt"),
+                     CMAKE_LISTS.format(core_dir=os.path.abspath(args.core_dir)))
+    print("%d synthetic modules in %s" % (args.count, args.out_dir))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,379 @@
+// How plugin discovery, loading and listing in the core scale with the
+// number of modules, over the synthetic modules generate_modules.py writes.
+// Each size runs in a child process on a directory holding the first n
+// modules, so the core's globals start empty and the libraries cold.
+// Prints a JSON report of scaling curves.
+
+#include <QtGlobal>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "logos_core.h"
+#include "plugin_registry.h"
+#include "core_manager/core_manager.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct BenchOptions {
+    std::string modulesDir = LOGOS_SYNTHETIC_MODULES_DIR;
+    std::vector<size_t> sizes{10, 30, 100, 300, 1000, 3000, 10000};
+    unsigned int repetitions = 5;
+    bool logs = false;      // let the core's qDebug output through
+    std::string output;     // JSON report; stdout if empty
+};
+
+// Operations in report order; what each one times, for one size n
+const char* const kOperations[] = {
+    "discover",             // logos_core_start: findPlugins and processPlugin for every module
+    "process_all",          // CoreManagerPlugin::processPlugin on every module again
+    "known_plugins",        // CoreManagerPlugin::getKnownPlugins, nothing loaded
+    "load_all_cold",        // logos_core_load_plugin on every module, first time
+    "load_all",             // the same once the libraries are mapped
+    "loaded_plugins",       // CoreManagerPlugin::getLoadedPlugins, all loaded
+    "known_plugins_loaded", // CoreManagerPlugin::getKnownPlugins, all loaded
+    "unload_all",           // logos_core_unload_plugin on every module
+};
+
+void usage() {
+    std::cerr << "Usage: core_scaling_bench [--modules=DIR] [--sizes=N,N,...] [--repetitions=N] [--logs]\n"
+                 "                          [--output=FILE]\n"
+                 "DIR holds the built synthetic modules; build the synthetic_modules target first."
+              << std::endl;
+}
+
+bool parseOptions(int argc, char* argv[], BenchOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--logs") {
+            options.logs = true;
+            continue;
+        }
+        size_t eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) {
+            return false;
+        }
+        std::string key = arg.substr(2, eq - 2);
+        std::string value = arg.substr(eq + 1);
+        if (key == "modules") {
+            options.modulesDir = value;
+        } else if (key == "sizes") {
+            options.sizes.clear();
+            std::istringstream in(value);
+            std::string size;
+            while (std::getline(in, size, ',')) {
+                options.sizes.push_back(std::strtoull(size.c_str(), nullptr, 10));
+            }
+        } else if (key == "repetitions") {
+            options.repetitions = std::max(1u, static_cast<unsigned int>(std::strtoul(value.c_str(), nullptr, 10)));
+        } else if (key == "output") {
+            options.output = value;
+        } else {
+            return false;
+        }
+    }
+    std::sort(options.sizes.begin(), options.sizes.end());
+    options.sizes.erase(std::unique(options.sizes.begin(), options.sizes.end()), options.sizes.end());
+    options.sizes.erase(std::remove(options.sizes.begin(), options.sizes.end(), 0), options.sizes.end());
+    return !options.sizes.empty();
+}
+
+uint64_t steadyNanos() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+template <typename F>
+uint64_t timed(F&& f) {
+    uint64_t start = steadyNanos();
+    f();
+    return steadyNanos() - start;
+}
+
+void discardMessage(QtMsgType, const QMessageLogContext&, const QString&) {}
+
+// Plugin files in the directory, by name: the synthetic modules sort by number
+std::vector<fs::path> pluginFiles(const std::string& dir) {
+    std::vector<fs::path> files;
+    std::error_code error;
+    for (const fs::directory_entry& entry : fs::directory_iterator(dir, error)) {
+        if (entry.path().extension() == ".so" || entry.path().extension() == ".dylib") {
+            files.push_back(entry.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+// A directory of links to the first n plugins, as findPlugins would see n modules
+bool linkPlugins(const std::vector<fs::path>& files, size_t n, const fs::path& dir) {
+    std::error_code error;
+    fs::create_directories(dir, error);
+    for (size_t i = 0; i < n && !error; ++i) {
+        fs::create_symlink(fs::absolute(files[i]), dir / files[i].filename(), error);
+    }
+    if (error) {
+        std::cerr << "Failed to link plugins into " << dir << ": " << error.message() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+using Samples = std::map<std::string, std::vector<uint64_t>>;
+
+// One size, in the child: every operation timed, written to out as
+// "<operation> <ns> <ns> ..." lines
+int runSize(const BenchOptions& options, const fs::path& dir, size_t n, int argc, char* argv[], FILE* out) {
+    if (!options.logs) {
+        qInstallMessageHandler(discardMessage);
+    }
+    logos_core_init(argc, argv);
+    std::string pluginsDir = dir.string();
+    logos_core_set_plugins_dir(pluginsDir.c_str());
+    std::vector<fs::path> files = pluginFiles(pluginsDir);
+
+    Samples samples;
+    for (unsigned int r = 0; r < options.repetitions; ++r) {
+        samples["discover"].push_back(timed([] { logos_core_start(); }));
+    }
+    // Each start registers a new core manager; the last one is current
+    CoreManagerPlugin* manager = PluginRegistry::getPlugin<CoreManagerPlugin>("core_manager");
+    if (manager == nullptr) {
+        std::cerr << "core_manager is not registered" << std::endl;
+        return 1;
+    }
+
+    std::vector<QString> names;
+    for (unsigned int r = 0; r < options.repetitions; ++r) {
+        names.clear();
+        samples["process_all"].push_back(timed([&] {
+            for (const fs::path& file : files) {
+                names.push_back(manager->processPlugin(QString::fromStdString(file.string())));
+            }
+        }));
+    }
+    if (names.size() != n || std::count(names.begin(), names.end(), QString()) != 0) {
+        std::cerr << "Only " << names.size() - std::count(names.begin(), names.end(), QString())
+                  << " of " << n << " modules in " << pluginsDir << " could be processed" << std::endl;
+        return 1;
+    }
+    for (unsigned int r = 0; r < options.repetitions; ++r) {
+        samples["known_plugins"].push_back(timed([&] { manager->getKnownPlugins(); }));
+    }
+
+    std::vector<std::string> utf8Names;
+    for (const QString& name : names) {
+        utf8Names.push_back(name.toStdString());
+    }
+    size_t failed = 0;
+    auto loadAll = [&] {
+        for (const std::string& name : utf8Names) {
+            failed += logos_core_load_plugin(name.c_str()) ? 0 : 1;
+        }
+    };
+    auto unloadAll = [&] {
+        for (const std::string& name : utf8Names) {
+            logos_core_unload_plugin(name.c_str());
+        }
+    };
+    samples["load_all_cold"].push_back(timed(loadAll));
+    samples["unload_all"].push_back(timed(unloadAll));
+    for (unsigned int r = 0; r < options.repetitions; ++r) {
+        samples["load_all"].push_back(timed(loadAll));
+        samples["loaded_plugins"].push_back(timed([&] { manager->getLoadedPlugins(); }));
+        samples["known_plugins_loaded"].push_back(timed([&] { manager->getKnownPlugins(); }));
+        samples["unload_all"].push_back(timed(unloadAll));
+    }
+    if (failed > 0) {
+        std::cerr << failed << " loads failed with " << n << " modules" << std::endl;
+        return 1;
+    }
+
+    for (const auto& entry : samples) {
+        std::fprintf(out, "%s", entry.first.c_str());
+        for (uint64_t ns : entry.second) {
+            std::fprintf(out, " %llu", static_cast<unsigned long long>(ns));
+        }
+        std::fprintf(out, "\n");
+    }
+    std::fflush(out);
+    return 0;
+}
+
+// Runs one size in a child process and reads back its samples
+bool runChild(const BenchOptions& options, const fs::path& dir, size_t n, int argc, char* argv[], Samples& samples) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        std::perror("pipe");
+        return false;
+    }
+    std::cout.flush();
+    std::cerr.flush();
+    pid_t pid = fork();
+    if (pid < 0) {
+        std::perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        FILE* out = fdopen(fds[1], "w");
+        int code = runSize(options, dir, n, argc, argv, out);
+        std::fclose(out);
+        // The loaded plugins and the application are left to the exit
+        std::_Exit(code);
+    }
+    close(fds[1]);
+    FILE* in = fdopen(fds[0], "r");
+    char buffer[1 << 16];
+    while (std::fgets(buffer, sizeof(buffer), in) != nullptr) {
+        std::istringstream line(buffer);
+        std::string operation;
+        line >> operation;
+        uint64_t ns = 0;
+        while (line >> ns) {
+            samples[operation].push_back(ns);
+        }
+    }
+    std::fclose(in);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+double median(std::vector<uint64_t> values) {
+    std::sort(values.begin(), values.end());
+    size_t mid = values.size() / 2;
+    return values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2.0;
+}
+
+struct Point {
+    size_t plugins;
+    double medianNs;
+    double minNs;
+};
+
+// Growth between two sizes as a power of n: 1 is linear, 2 quadratic
+double exponent(const Point& previous, const Point& point) {
+    if (previous.medianNs <= 0 || point.medianNs <= 0) return 0;
+    return std::log(point.medianNs / previous.medianNs) / std::log(static_cast<double>(point.plugins) / previous.plugins);
+}
+
+std::string reportJson(const BenchOptions& options, const std::map<std::string, std::vector<Point>>& curves) {
+    std::ostringstream out;
+    out << "{\n"
+        << "  \"modules_dir\": \"" << options.modulesDir << "\",\n"
+        << "  \"repetitions\": " << options.repetitions << ",\n"
+        << "  \"curves\": {";
+    bool firstOperation = true;
+    for (const char* operation : kOperations) {
+        auto it = curves.find(operation);
+        if (it == curves.end()) continue;
+        out << (firstOperation ? "\n" : ",\n") << "    \"" << operation << "\": [";
+        firstOperation = false;
+        const std::vector<Point>& points = it->second;
+        for (size_t i = 0; i < points.size(); ++i) {
+            const Point& point = points[i];
+            out << (i == 0 ? "\n" : ",\n")
+                << "      {\"plugins\": " << point.plugins
+                << ", \"median_ms\": " << point.medianNs / 1e6
+                << ", \"min_ms\": " << point.minNs / 1e6
+                << ", \"per_plugin_us\": " << point.medianNs / 1e3 / point.plugins;
+            if (i > 0) {
+                out << ", \"exponent\": " << exponent(points[i - 1], point);
+            }
+            out << "}";
+        }
+        out << "\n    ]";
+    }
+    out << "\n  }\n}\n";
+    return out.str();
+}
+
+// The curves as a table on stderr, median ms per size
+void printTable(const std::vector<size_t>& sizes, const std::map<std::string, std::vector<Point>>& curves) {
+    std::fprintf(stderr, "%-22s", "median ms");
+    for (size_t size : sizes) std::fprintf(stderr, " %10zu", size);
+    std::fprintf(stderr, "  exponent\n");
+    for (const char* operation : kOperations) {
+        auto it = curves.find(operation);
+        if (it == curves.end() || it->second.empty()) continue;
+        const std::vector<Point>& points = it->second;
+        std::fprintf(stderr, "%-22s", operation);
+        for (const Point& point : points) std::fprintf(stderr, " %10.3f", point.medianNs / 1e6);
+        double last = points.size() > 1 ? exponent(points[points.size() - 2], points.back()) : 0;
+        std::fprintf(stderr, "  %8.2f\n", last);
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        usage();
+        return 2;
+    }
+
+    std::vector<fs::path> files = pluginFiles(options.modulesDir);
+    std::vector<size_t> sizes;
+    for (size_t size : options.sizes) {
+        if (size <= files.size()) sizes.push_back(size);
+    }
+    if (sizes.empty()) {
+        std::cerr << "Found " << files.size() << " modules in " << options.modulesDir << ", fewer than "
+                  << options.sizes.front() << std::endl;
+        usage();
+        return 1;
+    }
+    if (sizes.size() < options.sizes.size()) {
+        std::cerr << "Only " << files.size() << " modules in " << options.modulesDir
+                  << ", larger sizes skipped" << std::endl;
+    }
+
+    std::error_code error;
+    fs::path work = fs::temp_directory_path() / ("core_scaling_bench." + std::to_string(getpid()));
+    std::map<std::string, std::vector<Point>> curves;
+    bool ok = true;
+    for (size_t n : sizes) {
+        fs::path dir = work / std::to_string(n);
+        Samples samples;
+        if (!linkPlugins(files, n, dir) || !runChild(options, dir, n, argc, argv, samples)) {
+            std::cerr << "Run with " << n << " modules failed" << std::endl;
+            ok = false;
+            break;
+        }
+        for (const auto& entry : samples) {
+            const std::vector<uint64_t>& ns = entry.second;
+            curves[entry.first].push_back(
+                Point{n, median(ns), static_cast<double>(*std::min_element(ns.begin(), ns.end()))});
+        }
+        std::cerr << n << " modules done" << std::endl;
+    }
+    fs::remove_all(work, error);
+
+    printTable(sizes, curves);
+    std::string report = reportJson(options, curves);
+    if (options.output.empty()) {
+        std::cout << report << std::flush;
+    } else {
+        std::ofstream file(options.output);
+        file << report;
+        if (!file) {
+            std::cerr << "Failed to write " << options.output << std::endl;
+            return 1;
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+"""Writes the benchmark corpora in this directory.
+
+The files are checked in and the benchmarks read them as they are, so
+results stay comparable across commits and machines. Run this only to
+change the corpora, on purpose, and commit the output with the change.
+"""
+
+import base64
+import json
+import os
+import random
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+PUBSUB_TOPIC = "/waku/2/rs/16/32"
+CHANNELS = ["general", "dev", "random", "announcements"]
+OTHER_CHANNELS = ["waku-status", "nomos"]  # not joined by the benchmarks
+START = 1744123537  # seconds
+
+WORDS = (
+    "the a to and is it that of in you for on we this be with are have not do at i so can but just "
+    "waku node relay store filter peer message chat logos channel history sync build release test "
+    "latency bandwidth protocol topic shard cluster key nick hello thanks ok yes no maybe tomorrow "
+    "today merged review fixed broken works looks good great issue branch commit deploy restart"
+).split()
+EXTRAS = ["🙂", "👍", "🚀", "café", "über", "naïve", "こんにちは", "https://logos.co", "#42", "v0.35.1"]
+
+
+def varint(value):
+    out = bytearray()
+    while value >= 0x80:
+        out.append((value & 0x7F) | 0x80)
+        value >>= 7
+    out.append(value)
+    return bytes(out)
+
+
+def field_bytes(number, data):
+    return varint(number << 3 | 2) + varint(len(data)) + data
+
+
+def chat2_message(timestamp, nick, text):
+    return varint(1 << 3) + varint(timestamp) + field_bytes(2, nick.encode()) + field_bytes(3, text.encode())
+
+
+def chat_text(rng):
+    # Mostly short lines, some paragraphs, a few pasted logs
+    roll = rng.random()
+    length = rng.randint(8, 80) if roll < 0.8 else rng.randint(200, 600) if roll < 0.97 else rng.randint(1500, 3000)
+    words = []
+    size = 0
+    while size < length:
+        word = rng.choice(EXTRAS) if rng.random() < 0.04 else rng.choice(WORDS)
+        words.append(word)
+        size += len(word) + 1
+    return " ".join(words)
+
+
+def message_hash(rng):
+    return "0x" + "".join(rng.choice("0123456789abcdef") for _ in range(64))
+
+
+def message_event(rng, index, channel):
+    timestamp = START + index
+    nick = "user%d" % rng.randint(0, 199)
+    payload = chat2_message(timestamp, nick, chat_text(rng))
+    return {
+        "eventType": "message",
+        "messageHash": message_hash(rng),
+        "pubsubTopic": PUBSUB_TOPIC,
+        "wakuMessage": {
+            "payload": base64.b64encode(payload).decode(),
+            "contentTopic": "/toy-chat/2/%s/proto" % channel,
+            "version": 0,
+            "timestamp": timestamp * 1000000000 + rng.randint(0, 999999999),
+            "ephemeral": False,
+            "meta": "",
+            "proof": "",
+        },
+    }
+
+
+def other_event(rng):
+    if rng.random() < 0.5:
+        return {"eventType": "relay_topic_health_change", "pubsubTopic": PUBSUB_TOPIC,
+                "topicHealth": rng.choice(["SufficientlyHealthy", "MinimallyHealthy", "UnHealthy"])}
+    return {"eventType": "connection_change", "peerId": "16Uiu2HAm" + message_hash(rng)[2:40],
+            "peerEvent": rng.choice(["Joined", "Left"])}
+
+
+def write_events(rng, path, count):
+    # Joined channels with a skew, some traffic on channels not joined and
+    # a few events that are not messages, as a node sees them
+    with open(path, "w") as out:
+        for index in range(count):
+            roll = rng.random()
+            if roll < 0.85:
+                channel = CHANNELS[min(len(CHANNELS) - 1, int(rng.expovariate(1.2)))]
+                event = message_event(rng, index, channel)
+            elif roll < 0.95:
+                event = message_event(rng, index, rng.choice(OTHER_CHANNELS))
+            else:
+                event = other_event(rng)
+            out.write(json.dumps(event, ensure_ascii=False, separators=(",", ":")) + "\n")
+
+
+def write_store_page(rng, path, count):
+    # A store answer as libwaku returns it, base64 payloads and a cursor
+    messages = []
+    for index in range(count):
+        event = message_event(rng, index, "general")
+        waku = event["wakuMessage"]
+        messages.append({
+            "messageHash": event["messageHash"],
+            "message": {
+                "payload": waku["payload"],
+                "contentTopic": waku["contentTopic"],
+                "version": waku["version"],
+                "timestamp": waku["timestamp"],
+                "ephemeral": False,
+            },
+            "pubsubTopic": PUBSUB_TOPIC,
+        })
+    page = {"requestId": "bench", "statusCode": 200, "statusDesc": "OK", "messages": messages,
+            "paginationCursor": message_hash(rng)}
+    with open(path, "w") as out:
+        out.write(json.dumps(page, ensure_ascii=False, separators=(",", ":")) + "\n")
+
+
+def write_texts(rng, path, count):
+    with open(path, "w") as out:
+        for _ in range(count):
+            out.write(chat_text(rng) + "\n")
+
+
+def main():
+    rng = random.Random(20250408)
+    write_texts(rng, os.path.join(HERE, "chat_texts.txt"), 500)
+    write_events(rng, os.path.join(HERE, "events.jsonl"), 500)
+    write_store_page(rng, os.path.join(HERE, "store_page_20.json"), 20)
+    write_store_page(rng, os.path.join(HERE, "store_page_100.json"), 100)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,318 @@
+#!/usr/bin/env python3
+"""Checks benchmark results against the baselines in this directory.
+
+  perf_regress.py check  --bin-dir build/bin [--report report.json] [--force]
+  perf_regress.py update --bin-dir build/bin [--suite chat_codec ...]
+
+Each suite in suites.json names a benchmark executable and a filter. Every
+benchmark runs `repetitions` times and the samples are compared with the
+samples stored in baselines/<suite>.json: a one-sided Mann-Whitney U test
+says whether the new runs are slower at all, and a bootstrap confidence
+interval bounds the ratio of the medians. A benchmark is a regression when
+the test is significant at `alpha`, the whole interval lies above 1 and the
+median got slower by more than `threshold`. Improvements are reported the
+same way but never fail the check.
+
+`check` exits 1 on a regression or a benchmark that failed, `update`
+rewrites the baselines from fresh runs. Only the standard library is used,
+so this runs offline on any Linux box the benchmarks build on.
+
+Baselines are only comparable on the machine they were recorded on. When
+the CPU count, clock or frequency scaling differ, `check` does not compare
+that suite and exits with SKIP_RETURN_CODE, which ctest reports as skipped,
+unless --force is given. Run `update` on the machine first, or point
+--baselines at a directory kept per machine.
+"""
+
+import argparse
+import datetime
+import json
+import math
+import os
+import random
+import subprocess
+import sys
+import tempfile
+import zlib
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+TIME_UNITS = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+BOOTSTRAP_ROUNDS = 2000
+# Exit code of a check that compared nothing wrong but skipped suites
+# recorded on another machine; the SKIP_RETURN_CODE of the ctest test
+SKIP_RETURN_CODE = 77
+# Context fields that must match for timings to be comparable
+HOST_FIELDS = ("num_cpus", "mhz_per_cpu", "cpu_scaling_enabled")
+
+
+def load_config(path):
+    with open(path) as f:
+        config = json.load(f)
+    suites = []
+    for suite in config["suites"]:
+        merged = {key: config[key] for key in ("repetitions", "min_time", "threshold", "alpha", "confidence")}
+        merged.update({"filter": ".", "metric": "cpu_time", "optional": False})
+        merged.update(suite)
+        suites.append(merged)
+    return suites
+
+
+def run_suite(suite, bin_dir, repetitions):
+    """Runs one suite, returns (context, {name: samples in ns}, {name: error})."""
+    executable = os.path.join(bin_dir, suite["executable"])
+    with tempfile.TemporaryDirectory() as tmp:
+        out = os.path.join(tmp, "out.json")
+        command = [executable,
+                   "--benchmark_filter=" + suite["filter"],
+                   "--benchmark_repetitions=%d" % (repetitions or suite["repetitions"]),
+                   "--benchmark_min_time=%g" % suite["min_time"],
+                   "--benchmark_out=" + out,
+                   "--benchmark_out_format=json"]
+        print("running %s" % " ".join(command), flush=True)
+        result = subprocess.run(command, stdout=subprocess.DEVNULL)
+        if result.returncode != 0 or not os.path.exists(out):
+            return None, {}, {"*": "%s exited with %d" % (suite["executable"], result.returncode)}
+        with open(out) as f:
+            data = json.load(f)
+
+    samples = {}
+    errors = {}
+    for bench in data.get("benchmarks", []):
+        if bench.get("run_type") == "aggregate":
+            continue
+        name = bench.get("run_name", bench["name"])
+        if bench.get("error_occurred"):
+            errors[name] = bench.get("error_message", "error")
+            continue
+        samples.setdefault(name, []).append(bench[suite["metric"]] * TIME_UNITS[bench.get("time_unit", "ns")])
+    return data.get("context", {}), samples, errors
+
+
+def median(values):
+    ordered = sorted(values)
+    mid = len(ordered) // 2
+    return ordered[mid] if len(ordered) % 2 else (ordered[mid - 1] + ordered[mid]) / 2.0
+
+
+def mann_whitney_greater(current, baseline):
+    """One-sided p-value that current tends to be larger than baseline.
+
+    Normal approximation with tie and continuity correction, which is close
+    enough from about five samples a side.
+    """
+    n1, n2 = len(current), len(baseline)
+    pooled = sorted([(value, 0) for value in current] + [(value, 1) for value in baseline])
+    ranks = [0.0] * len(pooled)
+    ties = 0.0
+    i = 0
+    while i < len(pooled):
+        j = i
+        while j + 1 < len(pooled) and pooled[j + 1][0] == pooled[i][0]:
+            j += 1
+        for k in range(i, j + 1):
+            ranks[k] = (i + j) / 2.0 + 1
+        count = j - i + 1
+        ties += count ** 3 - count
+        i = j + 1
+    rank_sum = sum(rank for rank, (_, group) in zip(ranks, pooled) if group == 0)
+    u = rank_sum - n1 * (n1 + 1) / 2.0
+    n = n1 + n2
+    variance = n1 * n2 / 12.0 * ((n + 1) - ties / (n * (n - 1)))
+    if variance <= 0:
+        return 0.5
+    z = (u - n1 * n2 / 2.0 - 0.5) / math.sqrt(variance)
+    return 0.5 * math.erfc(z / math.sqrt(2))
+
+
+def bootstrap_ratio(current, baseline, confidence, seed):
+    """Percentile interval of median(current) / median(baseline)."""
+    rng = random.Random(seed)
+    ratios = []
+    for _ in range(BOOTSTRAP_ROUNDS):
+        a = median([rng.choice(current) for _ in current])
+        b = median([rng.choice(baseline) for _ in baseline])
+        ratios.append(a / b if b > 0 else float("inf"))
+    ratios.sort()
+    tail = (1 - confidence) / 2
+    return ratios[int(tail * (BOOTSTRAP_ROUNDS - 1))], ratios[int((1 - tail) * (BOOTSTRAP_ROUNDS - 1))]
+
+
+def compare(name, current, baseline, suite):
+    ratio = median(current) / median(baseline)
+    # Seeded by name so a rerun on the same samples gives the same interval
+    low, high = bootstrap_ratio(current, baseline, suite["confidence"], zlib.crc32(name.encode()))
+    p_slower = mann_whitney_greater(current, baseline)
+    p_faster = mann_whitney_greater(baseline, current)
+    threshold = suite["threshold"]
+    if p_slower < suite["alpha"] and low > 1.0 and ratio > 1.0 + threshold:
+        verdict = "regression"
+    elif p_faster < suite["alpha"] and high < 1.0 and ratio < 1.0 / (1.0 + threshold):
+        verdict = "improvement"
+    else:
+        verdict = "unchanged"
+    return {
+        "name": name,
+        "verdict": verdict,
+        "metric": suite["metric"],
+        "baseline_median_ns": median(baseline),
+        "current_median_ns": median(current),
+        "ratio": ratio,
+        "ci": [low, high],
+        "p_slower": p_slower,
+        "p_faster": p_faster,
+        "threshold": threshold,
+        "samples": current,
+    }
+
+
+def host_mismatch(baseline_context, context):
+    return ["%s %s -> %s" % (field, baseline_context.get(field), context.get(field))
+            for field in HOST_FIELDS if baseline_context.get(field) != context.get(field)]
+
+
+def baseline_path(baselines, suite):
+    return os.path.join(baselines, suite["name"] + ".json")
+
+
+def check(args, suites):
+    report = {
+        "date": datetime.datetime.now(datetime.timezone.utc).isoformat(timespec="seconds"),
+        "baselines": os.path.abspath(args.baselines),
+        "suites": [],
+        "summary": {"regression": 0, "improvement": 0, "unchanged": 0, "new": 0, "missing": 0, "error": 0},
+    }
+    other_host = []
+    summary = report["summary"]
+    for suite in suites:
+        entry = {"name": suite["name"], "executable": suite["executable"], "benchmarks": [], "warnings": []}
+        report["suites"].append(entry)
+        if not os.path.exists(os.path.join(args.bin_dir, suite["executable"])):
+            entry["status"] = "skipped" if suite["optional"] else "error"
+            if not suite["optional"]:
+                summary["error"] += 1
+            print("%s: %s not built%s" % (suite["name"], suite["executable"],
+                                          ", skipped" if suite["optional"] else ""))
+            continue
+        path = baseline_path(args.baselines, suite)
+        baseline = {"context": {}, "benchmarks": {}}
+        if os.path.exists(path):
+            with open(path) as f:
+                baseline = json.load(f)
+        else:
+            entry["warnings"].append("no baseline at %s" % path)
+
+        context, samples, errors = run_suite(suite, args.bin_dir, args.repetitions)
+        if context is None:
+            entry["status"] = "error"
+            entry["error"] = errors["*"]
+            summary["error"] += 1
+            print("%s: %s" % (suite["name"], errors["*"]))
+            continue
+        entry["status"] = "ran"
+        entry["context"] = context
+        mismatch = host_mismatch(baseline.get("context", {}), context) if baseline["benchmarks"] else []
+        if mismatch:
+            entry["warnings"].append("baseline recorded on a different machine: " + ", ".join(mismatch))
+            if not args.force:
+                entry["status"] = "skipped"
+                other_host.append(suite["name"])
+                print("%s: baseline recorded on a different machine (%s), skipped" % (suite["name"], ", ".join(mismatch)))
+                continue
+
+        for name, error in sorted(errors.items()):
+            entry["benchmarks"].append({"name": name, "verdict": "error", "error": error})
+        for name in sorted(samples):
+            reference = baseline["benchmarks"].get(name, {}).get("samples")
+            if not reference:
+                entry["benchmarks"].append({"name": name, "verdict": "new", "samples": samples[name]})
+            else:
+                entry["benchmarks"].append(compare(name, samples[name], reference, suite))
+        for name in sorted(set(baseline["benchmarks"]) - set(samples) - set(errors)):
+            entry["benchmarks"].append({"name": name, "verdict": "missing"})
+
+        for warning in entry["warnings"]:
+            print("%s: warning: %s" % (suite["name"], warning))
+        for bench in entry["benchmarks"]:
+            summary[bench["verdict"]] += 1
+            print(format_result(bench))
+
+    print("%(regression)d regressed, %(improvement)d improved, %(unchanged)d unchanged, "
+          "%(new)d new, %(missing)d missing, %(error)d failed" % summary)
+    if args.report:
+        with open(args.report, "w") as f:
+            json.dump(report, f, indent=1)
+            f.write("\n")
+        print("report written to %s" % args.report)
+    if summary["regression"] or summary["error"]:
+        return 1
+    if other_host:
+        print("not compared, the baselines are from another machine: %s\n"
+              "record baselines on this one with `cmake --build <build dir> --target update_perf_baselines`, "
+              "or pass --force to compare anyway" % ", ".join(other_host))
+        return SKIP_RETURN_CODE
+    return 0
+
+
+def format_result(bench):
+    if "ratio" not in bench:
+        return "  %-11s %s%s" % (bench["verdict"], bench["name"],
+                                 ": " + bench["error"] if "error" in bench else "")
+    return "  %-11s %s  %+.1f%% [%+.1f%%, %+.1f%%] p=%.3g" % (
+        bench["verdict"], bench["name"], (bench["ratio"] - 1) * 100,
+        (bench["ci"][0] - 1) * 100, (bench["ci"][1] - 1) * 100,
+        min(bench["p_slower"], bench["p_faster"]))
+
+
+def update(args, suites):
+    os.makedirs(args.baselines, exist_ok=True)
+    failed = False
+    for suite in suites:
+        if not os.path.exists(os.path.join(args.bin_dir, suite["executable"])):
+            print("%s: %s not built, baseline left as it is" % (suite["name"], suite["executable"]))
+            failed = failed or not suite["optional"]
+            continue
+        context, samples, errors = run_suite(suite, args.bin_dir, args.repetitions)
+        if context is None or errors:
+            print("%s: not updated, %s" % (suite["name"], "; ".join("%s: %s" % e for e in sorted(errors.items()))))
+            failed = True
+            continue
+        baseline = {
+            "suite": suite["name"],
+            "executable": suite["executable"],
+            "filter": suite["filter"],
+            "metric": suite["metric"],
+            "context": {key: context.get(key) for key in ("date", "host_name", "caches") + HOST_FIELDS},
+            "benchmarks": {name: {"samples": values} for name, values in sorted(samples.items())},
+        }
+        path = baseline_path(args.baselines, suite)
+        with open(path, "w") as f:
+            json.dump(baseline, f, indent=1)
+            f.write("\n")
+        print("%s: %d benchmarks written to %s" % (suite["name"], len(samples), path))
+    return 1 if failed else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("command", choices=["check", "update"])
+    parser.add_argument("--bin-dir", required=True, help="where the benchmark executables are")
+    parser.add_argument("--config", default=os.path.join(HERE, "suites.json"))
+    parser.add_argument("--baselines", default=os.path.join(HERE, "baselines"))
+    parser.add_argument("--report", help="write the check results as JSON here")
+    parser.add_argument("--suite", action="append", help="only these suites, by name")
+    parser.add_argument("--repetitions", type=int, help="override the configured repetitions")
+    parser.add_argument("--force", action="store_true",
+                        help="compare with baselines recorded on a different machine")
+    args = parser.parse_args()
+
+    suites = load_config(args.config)
+    if args.suite:
+        unknown = set(args.suite) - {suite["name"] for suite in suites}
+        if unknown:
+            parser.error("unknown suite %s" % ", ".join(sorted(unknown)))
+        suites = [suite for suite in suites if suite["name"] in args.suite]
+    return check(args, suites) if args.command == "check" else update(args, suites)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
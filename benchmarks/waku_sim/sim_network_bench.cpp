@@ -0,0 +1,62 @@
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "sim_network.h"
+
+namespace {
+
+// One chat message at a time spread over the whole network, in simulated
+// time as fast as it goes. Items are messages reaching a node; the counters
+// are simulated times from publishing to arriving, over all nodes.
+void BM_Propagation(benchmark::State& state) {
+    SimOptions options;
+    options.nodes = static_cast<uint32_t>(state.range(0));
+    options.loss = static_cast<double>(state.range(1)) / 1000;
+    options.bandwidth = static_cast<uint64_t>(state.range(2)) * 1000;
+    options.timeScale = 0;
+    options.seed = 42;
+    SimNetwork network(options);
+
+    std::vector<double> arrivals;  // ms
+    uint64_t received = 0;
+    for (uint32_t node = 0; node < network.size(); ++node) {
+        network.relaySubscribe(node, "/waku/2/rs/16/32");
+        network.setReceiver(node, [&](const SimMessagePtr& message, SimNetwork::Delivery) {
+            received++;
+            arrivals.push_back(static_cast<double>(network.now() - message->publishedAt) / 1e6);
+        });
+    }
+
+    SimMessage message;
+    message.pubsubTopic = "/waku/2/rs/16/32";
+    message.contentTopic = "/toy-chat/2/bench/proto";
+    message.payload = std::string(400, 'A');
+    uint64_t published = 0;
+    for (auto _ : state) {
+        message.timestamp = ++published;
+        network.publish(static_cast<uint32_t>(published % network.size()), message);
+        network.runUntilIdle();
+    }
+
+    SimStats stats = network.stats();
+    std::sort(arrivals.begin(), arrivals.end());
+    state.SetItemsProcessed(static_cast<int64_t>(received));
+    state.counters["coverage"] = static_cast<double>(received) / static_cast<double>(published * network.size());
+    state.counters["copies_per_msg"] = static_cast<double>(stats.transmissions) / static_cast<double>(published);
+    if (!arrivals.empty()) {
+        state.counters["sim_p50_ms"] = arrivals[arrivals.size() / 2];
+        state.counters["sim_p99_ms"] = arrivals[arrivals.size() * 99 / 100];
+    }
+}
+
+} // namespace
+
+// nodes, loss in 1/1000, uplink in kB/s (0 unlimited)
+BENCHMARK(BM_Propagation)
+    ->Args({100, 0, 0})
+    ->Args({1000, 0, 0})
+    ->Args({1000, 50, 0})
+    ->Args({1000, 0, 100})
+    ->ArgNames({"nodes", "loss", "uplink"})
+    ->Unit(benchmark::kMillisecond);
@@ -43,11 +43,16 @@ int main(int argc, char *argv[])
     // Explicitly load plugins in specified order
     std::cout << "Loading plugins in specified order..." << std::endl;
     
-    // Load waku plugin first
-    if (logos_core_load_plugin("waku")) {
-        std::cout << "Successfully loaded waku plugin" << std::endl;
+    // Load waku plugin first, or the one LOGOS_WAKU_PLUGIN names, such as
+    // waku_sim for a simulated network
+    QByteArray wakuPlugin = qgetenv("LOGOS_WAKU_PLUGIN");
+    if (wakuPlugin.isEmpty()) {
+        wakuPlugin = "waku";
+    }
+    if (logos_core_load_plugin(wakuPlugin.constData())) {
+        std::cout << "Successfully loaded " << wakuPlugin.constData() << " plugin" << std::endl;
     } else {
-        std::cerr << "Failed to load waku plugin" << std::endl;
+        std::cerr << "Failed to load " << wakuPlugin.constData() << " plugin" << std::endl;
     }
     
     // Then load chat plugin
@@ -11,15 +11,16 @@
 static ChatWidget* activeWidget = nullptr;
 
 // Static callback that can be passed to the C API
-void ChatWidget::handleWakuMessage(const std::string& timestamp, const std::string& nick, const std::string& message) {
-    qDebug() << "RECEIVED: [" << QString::fromStdString(timestamp) << "] " 
-             << QString::fromStdString(nick) << ": " 
-             << QString::fromStdString(message);
+void ChatWidget::handleWakuMessage(const ChatMessageRef& message) {
+    qDebug() << "RECEIVED: [" << message.timestampString() << "] " 
+             << message.nickString() << ": " 
+             << message.payloadString();
     
-    // Forward to the active widget if available
+    // Forward to the active widget if available. The lambda holds a
+    // reference to the shared message, not copies of its strings.
     if (activeWidget) {
-        QMetaObject::invokeMethod(activeWidget, [=]() {
-            activeWidget->displayMessage(QString::fromStdString(nick), QString::fromStdString(message));
+        QMetaObject::invokeMethod(activeWidget, [message]() {
+            activeWidget->displayMessage(message.nickString(), message.payloadString());
         }, Qt::QueuedConnection);
     }
 }
@@ -122,8 +123,9 @@ void ChatWidget::initWaku() {
 
     updateStatus("Status: Initializing Waku...");
     
-    // Initialize chat with message handler
-    bool success = chatPlugin->initialize(handleWakuMessage);
+    // Listen for messages, then initialize chat
+    chatPlugin->addMessageListener(handleWakuMessage);
+    bool success = chatPlugin->initialize();
     
     if (success) {
         isWakuInitialized = true;
@@ -195,16 +197,16 @@ void ChatWidget::onJoinChannelClicked() {
         chatDisplay->append("<i>--- Message History ---</i>");
         
         // Call retrieveHistory for the joined channel
-        chatPlugin->retrieveHistory(currentChannel.toStdString(), [](const std::string& timestamp, const std::string& nick, const std::string& message) {
-            qDebug() << "HISTORY: [" << QString::fromStdString(timestamp) << "] "
-                    << QString::fromStdString(nick) << ": "
-                    << QString::fromStdString(message);
+        chatPlugin->retrieveHistoryMessages(currentChannel.toStdString(), [](const ChatMessageRef& message) {
+            qDebug() << "HISTORY: [" << message.timestampString() << "] "
+                    << message.nickString() << ": "
+                    << message.payloadString();
             
             // Forward to the active widget if available
             if (activeWidget) {
-                QMetaObject::invokeMethod(activeWidget, [=]() {
+                QMetaObject::invokeMethod(activeWidget, [message]() {
                     QString historyPrefix = "[HISTORY] ";
-                    activeWidget->displayMessage(historyPrefix + QString::fromStdString(nick), QString::fromStdString(message));
+                    activeWidget->displayMessage(historyPrefix + message.nickString(), message.payloadString());
                 }, Qt::QueuedConnection);
             }
         });
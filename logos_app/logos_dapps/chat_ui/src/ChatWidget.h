@@ -54,5 +54,5 @@ private:
     void displayMessage(const QString& sender, const QString& message);
     
     // Static callback handlers
-    static void handleWakuMessage(const std::string& timestamp, const std::string& nick, const std::string& message);
+    static void handleWakuMessage(const ChatMessageRef& message);
 }; 
@@ -46,7 +46,7 @@ WakuUIWidget::WakuUIWidget(QWidget* parent) : QWidget(parent), wakuPlugin(nullpt
 
 bool WakuUIWidget::connectToWakuPlugin() {
     // Get the waku plugin from the PluginRegistry
-    wakuPlugin = PluginRegistry::getPlugin<WakuInterface>("waku");
+    wakuPlugin = PluginRegistry::getPlugin<WakuInterface>(wakuPluginName());
     
     if (!wakuPlugin) {
         qWarning() << "Could not find Waku Plugin";
@@ -2,11 +2,149 @@
 
 #include <QtCore/QObject>
 #include "../../core/interface.h"
+#include <cstdint>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "src/cache/recent_messages.h"
+#include "src/analytics/chat_analytics.h"
+#include "src/ratelimit/receive_limiter.h"
+#include "src/latency/latency_probe.h"
 
 // Define a callback type for message handling
 using MessageCallback = std::function<void(const std::string&, const std::string&, const std::string&)>;
 
+// A received message, handed to every listener by reference. The decoded
+// message is shared with the channel's recent messages and read through
+// views; its QString forms are made the first time one is asked for and
+// then shared by all holders as well. Copies are cheap and may be kept or
+// passed across threads.
+class ChatMessageRef {
+public:
+    ChatMessageRef() = default;
+    explicit ChatMessageRef(RecentMessagePtr message) : shared_(std::make_shared<const Shared>(std::move(message))) {}
+
+    explicit operator bool() const { return shared_ != nullptr; }
+    const RecentMessagePtr& message() const { return shared_->message; }
+
+    std::string_view timestamp() const { return shared_->message->timestampText(); }
+    std::string_view nick() const { return shared_->message->nick(); }
+    std::string_view payload() const { return shared_->message->text(); }
+
+    const QString& timestampString() const { return shared_->strings().timestamp; }
+    const QString& nickString() const { return shared_->strings().nick; }
+    const QString& payloadString() const { return shared_->strings().payload; }
+
+private:
+    struct Strings {
+        QString timestamp;
+        QString nick;
+        QString payload;
+    };
+
+    struct Shared {
+        explicit Shared(RecentMessagePtr m) : message(std::move(m)) {}
+
+        const Strings& strings() const {
+            std::call_once(converted, [this] {
+                strings_.timestamp = fromView(message->timestampText());
+                strings_.nick = fromView(message->nick());
+                strings_.payload = fromView(message->text());
+            });
+            return strings_;
+        }
+
+        static QString fromView(std::string_view text) {
+            return QString::fromUtf8(text.data(), static_cast<int>(text.size()));
+        }
+
+        const RecentMessagePtr message;
+        mutable std::once_flag converted;
+        mutable Strings strings_;
+    };
+
+    std::shared_ptr<const Shared> shared_;
+};
+
+using ChatMessageCallback = std::function<void(const ChatMessageRef& message)>;
+
+// Where an outgoing message stands
+enum class DeliveryState {
+    Pending,  // queued, in flight or waiting to be retried
+    Sent,     // accepted by the relay
+    Failed    // given up on after the last retry
+};
+
+using DeliveryCallback = std::function<void(uint64_t messageId, DeliveryState state, const std::string& error)>;
+
+// Opt-in batching of outgoing messages. Messages sent to a channel within
+// windowMs are packed into one Waku message on the channel's batch content
+// topic, up to maxMessages or maxBytes of encoded messages. Receivers always
+// unpack batches, whether or not they send them.
+struct MessageBatchOptions {
+    bool enabled = false;
+    unsigned int windowMs = 20;
+    size_t maxMessages = 64;
+    size_t maxBytes = 32 * 1024;
+};
+
+// A message in a history page, with the same fields as MessageCallback
+struct HistoryEntry {
+    std::string timestamp;
+    std::string nick;
+    std::string message;
+};
+
+// Messages of one page, oldest first
+using HistoryPage = std::vector<HistoryEntry>;
+
+// A message matching a search
+struct MessageSearchHit {
+    std::string contentTopic;
+    RecentMessagePtr message;
+    double score = 0;  // BM25, higher is better
+};
+
+// One page of search results, best first
+struct MessageSearchResults {
+    std::vector<MessageSearchHit> hits;
+    size_t total = 0;  // messages matching, over all pages
+};
+
+struct HistoryPagerOptions {
+    size_t initialPageSize = 50;
+    size_t minPageSize = 20;
+    size_t maxPageSize = 100;        // store nodes cap pages at 100
+    unsigned int targetLatencyMs = 400;  // page size adapts to keep round trips near this
+    size_t prefetchPages = 1;        // pages fetched ahead of the consumer
+    unsigned int timeoutMs = 30000;  // per store query
+};
+
+// Iterator over a channel's history, newest page first and walking back in
+// time. The next page is fetched in the background while the current one
+// is being consumed.
+class HistoryPager {
+public:
+    virtual ~HistoryPager() {}
+
+    // Wait for the next (older) page. Returns false once the history is
+    // exhausted, the pager was cancelled or a query failed.
+    virtual bool next(HistoryPage& page) = 0;
+
+    // Like next() but never waits; false if no page is ready yet
+    virtual bool tryNext(HistoryPage& page) = 0;
+
+    // Stop fetching. Pending and in-flight pages are dropped and next()
+    // returns false from now on.
+    virtual void cancel() = 0;
+
+    // No more pages will be produced
+    virtual bool finished() const = 0;
+};
+
 class ChatInterface : public PluginInterface {
 public:
     virtual ~ChatInterface() {}
@@ -14,9 +152,84 @@ public:
     // Core chat functionality
     Q_INVOKABLE virtual bool initialize(MessageCallback messageCallback = nullptr) = 0;
     Q_INVOKABLE virtual bool joinChannel(const std::string& channelName) = 0;
+    Q_INVOKABLE virtual bool leaveChannel(const std::string& channelName) = 0;
     Q_INVOKABLE virtual void sendMessage(const std::string& channelName, const std::string& username, const std::string& message) = 0;
     Q_INVOKABLE virtual void retrieveHistory(const std::string& channelName, MessageCallback callback = nullptr) = 0;
+
+    // Queue a message and return its id. Messages are kept until the node is
+    // up and retried when publishing fails; sendMessage() does the same
+    // without returning the id.
+    Q_INVOKABLE virtual uint64_t queueMessage(const std::string& channelName, const std::string& username, const std::string& message) = 0;
+
+    // Called as queued messages change state, possibly from another thread
+    Q_INVOKABLE virtual void setDeliveryCallback(DeliveryCallback callback) = 0;
+
+    // Pack messages sent close together into one Waku message. Off by default.
+    Q_INVOKABLE virtual void setMessageBatching(const MessageBatchOptions& options) = 0;
+
+    // Compress the payload of outgoing messages with zstd, using the
+    // channel's dictionary if it has one. Off by default; compressed messages
+    // are always decoded, given the sender's dictionary.
+    Q_INVOKABLE virtual void setPayloadCompression(bool enabled) = 0;
+
+    // Train a channel's compression dictionary on its stored history. It is
+    // only compressed with once every node reading the channel has it (see
+    // PayloadCompressor); until then the channel uses plain zstd.
+    Q_INVOKABLE virtual bool trainCompressionDictionary(const std::string& channelName) = 0;
+
+    // Page back through a channel's history, local messages first
+    Q_INVOKABLE virtual std::shared_ptr<HistoryPager> openHistory(const std::string& channelName,
+                                                                  const HistoryPagerOptions& options = HistoryPagerOptions()) = 0;
+
+    // The newest limit messages received on a channel, oldest first, from
+    // memory. The messages are shared, not copied; hold on to them freely.
+    Q_INVOKABLE virtual std::vector<RecentMessagePtr> recentMessages(const std::string& channelName, size_t limit) = 0;
+
+    // Have received messages delivered to callback, possibly from several
+    // threads at once. Every listener gets the same ChatMessageRef. Returns
+    // an id for removeMessageListener().
+    Q_INVOKABLE virtual uint64_t addMessageListener(ChatMessageCallback callback) = 0;
+    Q_INVOKABLE virtual bool removeMessageListener(uint64_t listenerId) = 0;
+
+    // retrieveHistory() delivering ChatMessageRefs
+    Q_INVOKABLE virtual void retrieveHistoryMessages(const std::string& channelName, ChatMessageCallback callback) = 0;
+
+    // Search the messages received or fetched from the store since startup,
+    // on one channel or, with an empty name, on all of them. Every word of
+    // the query has to appear; "quoted words" have to appear in that order
+    // and word* matches the words starting with word. Returns results
+    // offset to offset + limit.
+    Q_INVOKABLE virtual MessageSearchResults searchMessages(const std::string& query, size_t offset, size_t limit,
+                                                            const std::string& channelName = std::string()) = 0;
+
+    // Message counts, distinct and recently active senders and the
+    // busiest senders, per channel and for the node. Estimated in fixed
+    // memory; the snapshot is shared and refreshed a few times a second,
+    // so this can be called as often as needed.
+    Q_INVOKABLE virtual std::shared_ptr<const ChatActivity> activity() = 0;
+
+    // Limit how fast messages are taken from the relay, per sender and for
+    // all senders of a channel together; with an empty name, for every
+    // channel without limits of its own. Messages over the limits are
+    // dropped, where possible before they are decoded. History from the
+    // store is not limited.
+    Q_INVOKABLE virtual void setReceiveLimits(const std::string& channelName, const ReceiveLimits& limits) = 0;
+
+    // Messages dropped by the receive limits on a channel, or with an empty
+    // name on all of them
+    Q_INVOKABLE virtual uint64_t droppedMessages(const std::string& channelName = std::string()) = 0;
+
+    // Send a probe on every joined channel each options.intervalMs and time
+    // it back through relay, filter and store, printing a report every
+    // options.dumpIntervalMs if set. Probes travel on the channel's probe
+    // topic and are never shown as messages. False if already running.
+    Q_INVOKABLE virtual bool startLatencyProbe(const LatencyProbeOptions& options = LatencyProbeOptions()) = 0;
+    Q_INVOKABLE virtual void stopLatencyProbe() = 0;
+
+    // Latency percentiles per channel and path since the probe was first
+    // started or the report reset
+    Q_INVOKABLE virtual std::vector<LatencySummary> latencyReport(bool reset = false) = 0;
 };
 
 #define ChatInterface_iid "org.logos.ChatInterface"
-Q_DECLARE_INTERFACE(ChatInterface, ChatInterface_iid) 
\ No newline at end of file
+Q_DECLARE_INTERFACE(ChatInterface, ChatInterface_iid)
@@ -1,12 +1,19 @@
 #include "chat_plugin.h"
+#include "src/history_pager.h"
 #include "../../core/plugin_registry.h"
 
 ChatPlugin::ChatPlugin() : wakuCtx(nullptr), currentRelayTopic("/waku/2/rs/16/32"), wakuPlugin(nullptr) {
     // Get the waku plugin from the PluginRegistry
-    wakuPlugin = PluginRegistry::getPlugin<WakuInterface>("waku");
+    wakuPlugin = PluginRegistry::getPlugin<WakuInterface>(wakuPluginName());
+
+    // Messages queued in an earlier run and never sent go out once the node is up
+    outbox.openLog(historyDirectory() + "/outbox.log");
+    appState.compression.open(historyDirectory() + "/dictionaries");
 }
 
 ChatPlugin::~ChatPlugin() {
+    // The probe lists this plugin's channels
+    appState.probe.stop();
     // Clean up any resources if needed
     if (wakuCtx != nullptr) {
         // Cleanup code could go here if needed
@@ -16,7 +23,10 @@ ChatPlugin::~ChatPlugin() {
 
 bool ChatPlugin::initialize(MessageCallback messageCallback) {
     // Initialize and start Waku
-    wakuCtx = ::initAndStart(currentRelayTopic, messageCallback);
+    wakuCtx = ::initAndStart(currentRelayTopic, messageCallback, &channels);
+    if (wakuCtx != nullptr) {
+        outbox.start();
+    }
     
     // Return success/failure
     return (wakuCtx != nullptr);
@@ -27,15 +37,119 @@ bool ChatPlugin::joinChannel(const std::string& channelName) {
         return false;
     }
     
-    return ::joinChannel(wakuCtx, channelName, currentRelayTopic);
+    bool joined = ::joinChannel(wakuCtx, channelName, currentRelayTopic, subscriptions);
+    if (joined && appState.probe.running()) {
+        subscribeProbes({channelContentTopic(channelName)}, true);
+    }
+    return joined;
 }
 
-void ChatPlugin::sendMessage(const std::string& channelName, const std::string& username, const std::string& message) {
+bool ChatPlugin::leaveChannel(const std::string& channelName) {
     if (wakuCtx == nullptr) {
-        return;
+        return false;
     }
     
-    ::sendMessage(wakuCtx, channelName, username, message);
+    // A no-op unless the latency probe subscribed it
+    subscribeProbes({channelContentTopic(channelName)}, false);
+    return ::leaveChannel(wakuCtx, channelName, currentRelayTopic, subscriptions);
+}
+
+void ChatPlugin::sendMessage(const std::string& channelName, const std::string& username, const std::string& message) {
+    queueMessage(channelName, username, message);
+}
+
+uint64_t ChatPlugin::queueMessage(const std::string& channelName, const std::string& username, const std::string& message) {
+    // Queued even before the node is up; the outbox holds it until then
+    std::string contentTopic = channelContentTopic(channelName);
+    std::cout << "Queueing message to channel: " << channelName << " as " << username << std::endl;
+    channels.recordSent(channels.intern(contentTopic));
+
+    std::vector<uint8_t> payload = ::createChatMessage(username, message).serialize(appState.compression, contentTopic);
+    if (payload.size() > MAX_UNCHUNKED_PAYLOAD) {
+        return queueTransfer(contentTopic, payload);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(batcherMutex);
+        if (batcher) {
+            uint64_t messageId = outbox.reserveId();
+            batcher->add(contentTopic, messageId, payload);
+            return messageId;
+        }
+    }
+
+    return outbox.enqueue(contentTopic, currentRelayTopic, ::buildEnvelopeJson(contentTopic, payload));
+}
+
+// Send a payload too large for one Waku message as a manifest and chunks on
+// the channel's chunk topic. The outbox publishes them several at a time,
+// and as that topic is a queue of its own, the channel's other messages go
+// out alongside instead of waiting behind the transfer.
+uint64_t ChatPlugin::queueTransfer(const std::string& contentTopic, const std::vector<uint8_t>& payload) {
+    std::string chunkTopic = chunkContentTopic(contentTopic);
+    std::vector<std::vector<uint8_t>> parts = splitTransfer(payload, TRANSFER_CHUNK_SIZE);
+    std::cout << "Sending " << payload.size() << " bytes to " << contentTopic << " in " << parts.size() - 1
+              << " chunks" << std::endl;
+
+    std::vector<std::string> messageJsons;
+    messageJsons.reserve(parts.size());
+    for (const std::vector<uint8_t>& part : parts) {
+        messageJsons.push_back(::buildEnvelopeJson(chunkTopic, part));
+    }
+    uint64_t messageId = outbox.reserveId();
+    outbox.enqueueParts(chunkTopic, currentRelayTopic, messageJsons, messageId);
+    return messageId;
+}
+
+void ChatPlugin::setDeliveryCallback(DeliveryCallback callback) {
+    outbox.setDeliveryCallback(callback);
+}
+
+void ChatPlugin::setMessageBatching(const MessageBatchOptions& options) {
+    std::lock_guard<std::mutex> lock(batcherMutex);
+    // Whatever the old batcher holds is flushed when it goes away
+    batcher.reset();
+    if (!options.enabled) {
+        return;
+    }
+    std::string relayTopic = currentRelayTopic;
+    batcher = std::make_unique<MessageBatcher>(
+        [this, relayTopic](const std::string& contentTopic, bool batched,
+                           const std::vector<uint8_t>& payload, const std::vector<uint64_t>& ids) {
+            std::string topic = batched ? batchContentTopic(contentTopic) : contentTopic;
+            outbox.enqueue(topic, relayTopic, ::buildEnvelopeJson(topic, payload), ids);
+        },
+        options);
+}
+
+void ChatPlugin::setPayloadCompression(bool enabled) {
+    if (enabled && !PayloadCompressor::available()) {
+        std::cerr << "Payload compression is not available, the chat module was built without zstd" << std::endl;
+        return;
+    }
+    appState.compression.setEnabled(enabled);
+}
+
+bool ChatPlugin::trainCompressionDictionary(const std::string& channelName) {
+    // Train on the text of the channel's recent messages
+    std::string contentTopic = channelContentTopic(channelName);
+    std::vector<std::string> samples;
+    for (const HistoryRecord& record : appState.history.readRecent(contentTopic, 10000)) {
+        DecodedMessage decodedMsg = decodeProto(record.payload);
+        if (decodedMsg.success) {
+            samples.push_back(std::move(decodedMsg.payload));
+        }
+    }
+    if (!appState.compression.train(contentTopic, samples)) {
+        return false;
+    }
+    // Peers without it could not read the channel, so it stays on plain
+    // zstd until the dictionary has been handed out
+    uint32_t id = appState.compression.trainedDictionaryId(contentTopic);
+    std::cout << "Trained compression dictionary " << id << " for " << contentTopic << " on " << samples.size()
+              << " messages. It is used once dictionaries/trained/" << id
+              << ".dict is copied into dictionaries/ on every node reading the channel, this one included" << std::endl;
+    return true;
 }
 
 void ChatPlugin::retrieveHistory(const std::string& channelName, MessageCallback callback) {
@@ -43,5 +157,124 @@ void ChatPlugin::retrieveHistory(const std::string& channelName, MessageCallback
         return;
     }
     
+    ::retrieveHistory(wakuCtx, channelName, toChatMessageCallback(callback));
+}
+
+void ChatPlugin::retrieveHistoryMessages(const std::string& channelName, ChatMessageCallback callback) {
+    if (wakuCtx == nullptr) {
+        return;
+    }
+
     ::retrieveHistory(wakuCtx, channelName, callback);
-} 
\ No newline at end of file
+}
+
+std::shared_ptr<HistoryPager> ChatPlugin::openHistory(const std::string& channelName, const HistoryPagerOptions& options) {
+    // Without a running node only the local history can be paged through
+    return StoreHistoryPager::create(channelName, options, wakuCtx != nullptr);
+}
+
+std::vector<RecentMessagePtr> ChatPlugin::recentMessages(const std::string& channelName, size_t limit) {
+    return appState.recent.recent(channelContentTopic(channelName), limit);
+}
+
+uint64_t ChatPlugin::addMessageListener(ChatMessageCallback callback) {
+    return appState.listeners.add(std::move(callback));
+}
+
+bool ChatPlugin::removeMessageListener(uint64_t listenerId) {
+    return appState.listeners.remove(listenerId);
+}
+
+MessageSearchResults ChatPlugin::searchMessages(const std::string& query, size_t offset, size_t limit,
+                                                const std::string& channelName) {
+    std::string contentTopic = channelName.empty() ? std::string() : channelContentTopic(channelName);
+    return ::searchMessages(query, offset, limit, contentTopic);
+}
+
+std::shared_ptr<const ChatActivity> ChatPlugin::activity() {
+    return appState.analytics.snapshot();
+}
+
+void ChatPlugin::setReceiveLimits(const std::string& channelName, const ReceiveLimits& limits) {
+    if (channelName.empty()) {
+        appState.limiter.setDefaults(limits);
+        return;
+    }
+    channels.setReceiveLimits(channels.intern(channelContentTopic(channelName)), limits);
+}
+
+uint64_t ChatPlugin::droppedMessages(const std::string& channelName) {
+    if (channelName.empty()) return appState.limiter.dropped();
+    ChannelInfo info;
+    if (!channels.info(channels.find(channelContentTopic(channelName)), info)) return 0;
+    return info.dropped;
+}
+
+bool ChatPlugin::startLatencyProbe(const LatencyProbeOptions& options) {
+    if (wakuCtx == nullptr || wakuPlugin == nullptr) {
+        return false;
+    }
+    // Probes are published directly rather than through the outbox, so
+    // they are neither logged nor retried
+    std::string relayTopic = currentRelayTopic;
+    WakuInterface* waku = wakuPlugin;
+    auto send = [waku, relayTopic](const std::string& contentTopic, const std::vector<uint8_t>& payload,
+                                   uint64_t sentAt) {
+        std::string probeTopic = probeContentTopic(contentTopic);
+        waku->relayPublish(QString::fromStdString(relayTopic),
+                           QString::fromStdString(::buildEnvelopeJson(probeTopic, payload, sentAt)), 30000,
+                           [probeTopic](bool success, const QString& responseMsg) {
+                               if (!success) {
+                                   std::cerr << "Latency probe on " << probeTopic
+                                             << " failed to publish: " << responseMsg.toStdString() << std::endl;
+                               }
+                           });
+    };
+    // Every joined channel, by its plain topic
+    auto joined = [this] {
+        std::vector<std::string> topics;
+        for (std::string& topic : channels.subscribedTopics()) {
+            if (!isBatchContentTopic(topic) && !isChunkContentTopic(topic) && !isProbeContentTopic(topic)) {
+                topics.push_back(std::move(topic));
+            }
+        }
+        return topics;
+    };
+    if (!appState.probe.start(options, send, ::queryProbeStore, joined)) {
+        return false;
+    }
+    subscribeProbes(joined(), true);
+    return true;
+}
+
+void ChatPlugin::stopLatencyProbe() {
+    appState.probe.stop();
+    std::vector<std::string> probeTopics;
+    for (std::string& topic : channels.subscribedTopics()) {
+        if (isProbeContentTopic(topic)) probeTopics.push_back(std::move(topic));
+    }
+    for (const std::string& topic : probeTopics) {
+        subscriptions.leave(topic, currentRelayTopic);
+    }
+}
+
+// Probes come back on a topic of their own. Its filter subscription counts
+// against the filter node's topic limit, so it is only held while probing.
+void ChatPlugin::subscribeProbes(const std::vector<std::string>& contentTopics, bool subscribe) {
+    for (const std::string& contentTopic : contentTopics) {
+        std::string topic = probeContentTopic(contentTopic);
+        auto result = [topic, subscribe](bool success, const std::string& message) {
+            std::cout << "Filter " << (subscribe ? "subscribe" : "unsubscribe") << " result for " << topic << ": "
+                      << (success ? "Success" : "Failed") << " - " << message << std::endl;
+        };
+        if (subscribe) {
+            subscriptions.join(topic, currentRelayTopic, result);
+        } else {
+            subscriptions.leave(topic, currentRelayTopic, result);
+        }
+    }
+}
+
+std::vector<LatencySummary> ChatPlugin::latencyReport(bool reset) {
+    return appState.probe.report(reset);
+}
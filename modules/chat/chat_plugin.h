@@ -2,8 +2,12 @@
 
 #include <QtCore/QObject>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include "chat_interface.h"
 #include "src/chat_api.h"
+#include "src/outbound/outbound_queue.h"
+#include "src/outbound/message_batcher.h"
 #include "../../modules/waku/waku_interface.h"
 
 class ChatPlugin : public QObject, public ChatInterface {
@@ -22,11 +26,47 @@ public:
     // ChatInterface implementation
     Q_INVOKABLE bool initialize(MessageCallback messageCallback = nullptr) override;
     Q_INVOKABLE bool joinChannel(const std::string& channelName) override;
+    Q_INVOKABLE bool leaveChannel(const std::string& channelName) override;
     Q_INVOKABLE void sendMessage(const std::string& channelName, const std::string& username, const std::string& message) override;
     Q_INVOKABLE void retrieveHistory(const std::string& channelName, MessageCallback callback = nullptr) override;
+    Q_INVOKABLE uint64_t queueMessage(const std::string& channelName, const std::string& username, const std::string& message) override;
+    Q_INVOKABLE void setDeliveryCallback(DeliveryCallback callback) override;
+    Q_INVOKABLE void setMessageBatching(const MessageBatchOptions& options) override;
+    Q_INVOKABLE void setPayloadCompression(bool enabled) override;
+    Q_INVOKABLE bool trainCompressionDictionary(const std::string& channelName) override;
+
+    // Channels this node has joined, with their subscription state and counters
+    const ChannelRegistry& channelRegistry() const { return channels; }
+
+    Q_INVOKABLE std::shared_ptr<HistoryPager> openHistory(const std::string& channelName,
+                                                          const HistoryPagerOptions& options = HistoryPagerOptions()) override;
+    Q_INVOKABLE std::vector<RecentMessagePtr> recentMessages(const std::string& channelName, size_t limit) override;
+    Q_INVOKABLE uint64_t addMessageListener(ChatMessageCallback callback) override;
+    Q_INVOKABLE bool removeMessageListener(uint64_t listenerId) override;
+    Q_INVOKABLE void retrieveHistoryMessages(const std::string& channelName, ChatMessageCallback callback) override;
+    Q_INVOKABLE MessageSearchResults searchMessages(const std::string& query, size_t offset, size_t limit,
+                                                    const std::string& channelName = std::string()) override;
+    Q_INVOKABLE std::shared_ptr<const ChatActivity> activity() override;
+    Q_INVOKABLE void setReceiveLimits(const std::string& channelName, const ReceiveLimits& limits) override;
+    Q_INVOKABLE uint64_t droppedMessages(const std::string& channelName = std::string()) override;
+    Q_INVOKABLE bool startLatencyProbe(const LatencyProbeOptions& options = LatencyProbeOptions()) override;
+    Q_INVOKABLE void stopLatencyProbe() override;
+    Q_INVOKABLE std::vector<LatencySummary> latencyReport(bool reset = false) override;
 
 private:
+    uint64_t queueTransfer(const std::string& contentTopic, const std::vector<uint8_t>& payload);
+    void subscribeProbes(const std::vector<std::string>& contentTopics, bool subscribe);
+
     void* wakuCtx;
     std::string currentRelayTopic;
     WakuInterface* wakuPlugin;
+    ChannelRegistry channels;
+    // Batches joins and leaves into filter requests; declared after channels,
+    // which it updates
+    SubscriptionAggregator subscriptions{channels};
+    // Outgoing messages; held until the node is started
+    OutboundQueue outbox;
+    // Set while batching is enabled; declared after outbox, which it flushes into
+    std::mutex batcherMutex;
+    std::unique_ptr<MessageBatcher> batcher;
 }; 
\ No newline at end of file
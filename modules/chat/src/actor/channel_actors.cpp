@@ -0,0 +1,215 @@
+#include "channel_actors.h"
+#include <algorithm>
+#include "codec/base64.h"
+#include "message.codec.h"
+
+namespace {
+
+size_t shardsFor(const ChannelActorOptions& options, size_t workers) {
+    return options.shards != 0 ? options.shards : workers * 4;
+}
+
+} // namespace
+
+ChannelActors::ChannelActors(DeliverCallback deliver, HistoryStore* history, const ChannelActorOptions& options,
+                             const PayloadCompressor* compressor, ChunkReassembler* transfers,
+                             RecentMessages* recent, AdmitCallback admit)
+    : deliver_(std::move(deliver)), admit_(std::move(admit)), history_(history), compressor_(compressor), transfers_(transfers),
+      recent_(recent), options_(options), pool_(options.workers) {
+    size_t count = shardsFor(options_, pool_.size());
+    shards_.reserve(count);
+    for (size_t i = 0; i < count; ++i) shards_.push_back(std::make_unique<Shard>());
+}
+
+ChannelActors::~ChannelActors() {
+    waitIdle();
+}
+
+ChannelActors::Shard& ChannelActors::shardFor(const std::string& contentTopic) {
+    return *shards_[std::hash<std::string>()(contentTopic) % shards_.size()];
+}
+
+void ChannelActors::post(InboundMessage message) {
+    {
+        std::lock_guard<std::mutex> lock(idleMutex_);
+        outstanding_++;
+    }
+    Shard& shard = shardFor(message.contentTopic);
+    bool schedule = false;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.mailbox.push_back(std::move(message));
+        schedule = !shard.scheduled;
+        shard.scheduled = true;
+    }
+    if (schedule) pool_.post([this, &shard] { run(shard); });
+}
+
+void ChannelActors::waitIdle() {
+    std::unique_lock<std::mutex> lock(idleMutex_);
+    idleCv_.wait(lock, [this] { return outstanding_ == 0; });
+}
+
+// Handle up to batchSize messages, then give the worker back to the pool so
+// busy channels don't starve the rest
+void ChannelActors::run(Shard& shard) {
+    std::vector<InboundMessage> batch;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        size_t take = std::min(shard.mailbox.size(), std::max<size_t>(1, options_.batchSize));
+        batch.reserve(take);
+        for (size_t i = 0; i < take; ++i) {
+            batch.push_back(std::move(shard.mailbox.front()));
+            shard.mailbox.pop_front();
+        }
+    }
+
+    for (InboundMessage& message : batch) handle(shard, message);
+
+    // Write out before going idle, so an idle actor never holds messages
+    // back. This has to happen while the actor is still scheduled.
+    bool idle = false;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        idle = shard.mailbox.empty();
+    }
+    if (idle || shard.pendingCount >= options_.historyBatch) flushHistory(shard);
+
+    bool more = false;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        more = !shard.mailbox.empty();
+        shard.scheduled = more;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(idleMutex_);
+        outstanding_ -= batch.size();
+        if (outstanding_ == 0) idleCv_.notify_all();
+    }
+    if (more) pool_.post([this, &shard] { run(shard); });
+}
+
+void ChannelActors::handle(Shard& shard, InboundMessage& message) {
+    if (!message.batched && !message.messageHash.empty() && !remember(shard, message.messageHash)) {
+        duplicates_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    std::vector<uint8_t>& bytes = shard.decodeBuffer;
+    bytes.resize(base64::decodedMaxSize(message.payload.size()));
+    size_t size = 0;
+    if (!base64::decode(message.payload.data(), message.payload.size(), bytes.data(), size)) {
+        malformed_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (message.batched) {
+        handleBatch(shard, message, bytes.data(), size);
+        return;
+    }
+    if (message.chunk) {
+        handleChunk(shard, message, bytes.data(), size);
+        return;
+    }
+
+    chat::Chat2MessageView decoded;
+    if (!decodeMessage(shard, bytes.data(), size, decoded)) {
+        malformed_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    accept(shard, message, message.messageHash, bytes.data(), size, decoded);
+}
+
+void ChannelActors::handleBatch(Shard& shard, InboundMessage& message, const uint8_t* data, size_t size) {
+    chat::Chat2BatchView batch;
+    if (!proto::decode(data, size, batch)) {
+        malformed_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    for (size_t i = 0; i < batch.messages.size(); ++i) {
+        std::string key;
+        if (!message.messageHash.empty()) {
+            key = message.messageHash + ":" + std::to_string(i);
+            if (!remember(shard, key)) {
+                duplicates_.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+        }
+        const uint8_t* inner = reinterpret_cast<const uint8_t*>(batch.messages[i].data());
+        chat::Chat2MessageView decoded;
+        if (!decodeMessage(shard, inner, batch.messages[i].size(), decoded)) {
+            malformed_.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        accept(shard, message, key, inner, batch.messages[i].size(), decoded);
+    }
+}
+
+void ChannelActors::handleChunk(Shard& shard, InboundMessage& message, const uint8_t* data, size_t size) {
+    if (transfers_ == nullptr) return;
+    // Transfers are rare and large, so the payload is not kept around
+    std::vector<uint8_t> payload;
+    std::string transfer;
+    switch (transfers_->add(message.contentTopic, data, size, payload, transfer)) {
+        case ChunkResult::Complete:
+            break;
+        case ChunkResult::Invalid:
+            malformed_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        default:
+            return;
+    }
+
+    chat::Chat2MessageView decoded;
+    if (!decodeMessage(shard, payload.data(), payload.size(), decoded)) {
+        malformed_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    accept(shard, message, transferMessageKey(transfer), payload.data(), payload.size(), decoded);
+}
+
+// Buffer a decoded message for the history store and deliver it
+void ChannelActors::accept(Shard& shard, const InboundMessage& message, const std::string& key,
+                           const uint8_t* data, size_t size, const chat::Chat2MessageView& decoded) {
+    if (!message.admitted && admit_ && !admit_(message, decoded.nick)) {
+        limited_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (history_ != nullptr) {
+        std::vector<HistoryRecord>& pending = shard.pendingHistory[message.contentTopic];
+        pending.push_back(HistoryRecord{message.timestamp, key, std::vector<uint8_t>(data, data + size)});
+        shard.pendingCount++;
+    }
+    if (recent_ == nullptr && !deliver_) return;
+    RecentMessagePtr shared =
+        std::make_shared<const RecentMessage>(key, message.timestamp, decoded.timestamp, decoded.nick, decoded.payload);
+    if (recent_ != nullptr) recent_->add(message.contentTopic, shared);
+    if (deliver_) deliver_(message, shared);
+}
+
+bool ChannelActors::decodeMessage(Shard& shard, const uint8_t* data, size_t size, chat::Chat2MessageView& decoded) {
+    if (compressor_ != nullptr) return compressor_->decode(data, size, decoded, shard.textBuffer);
+    return proto::decode(data, size, decoded) && decoded.compression == 0;
+}
+
+// Returns false if the hash was seen recently
+bool ChannelActors::remember(Shard& shard, const std::string& messageHash) {
+    if (!shard.seen.insert(messageHash).second) return false;
+    shard.seenOrder.push_back(messageHash);
+    if (shard.seenOrder.size() > std::max<size_t>(1, options_.dedupeCapacity)) {
+        shard.seen.erase(shard.seenOrder.front());
+        shard.seenOrder.pop_front();
+    }
+    return true;
+}
+
+void ChannelActors::flushHistory(Shard& shard) {
+    if (shard.pendingCount == 0) return;
+    for (auto& entry : shard.pendingHistory) {
+        if (!entry.second.empty()) {
+            history_->appendBatch(entry.first, entry.second);
+            entry.second.clear();
+        }
+    }
+    shard.pendingCount = 0;
+}
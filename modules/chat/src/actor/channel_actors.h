@@ -0,0 +1,155 @@
+#ifndef CHANNEL_ACTORS_H
+#define CHANNEL_ACTORS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+#include "worker_pool.h"
+#include "channel/channel_registry.h"
+#include "store/history_store.h"
+#include "codec/payload_compression.h"
+#include "transfer/chunked_transfer.h"
+#include "cache/recent_messages.h"
+
+namespace chat {
+struct Chat2MessageView;
+}
+
+// A relay message for a subscribed channel, as taken off the event callback
+struct InboundMessage {
+    ChannelId channel = kNoChannel;
+    std::string contentTopic;
+    std::string messageHash;
+    std::string payload;     // base64, as received
+    uint64_t timestamp = 0;  // envelope timestamp (ns)
+    bool batched = false;    // payload is a Chat2Batch; contentTopic is the plain topic
+    bool chunk = false;      // payload is a Chat2Chunk; contentTopic is the plain topic
+    bool admitted = false;   // already let through by the receive limiter
+};
+
+struct ChannelActorOptions {
+    size_t workers = 0;              // pool threads, 0 for one per core
+    size_t shards = 0;               // actors, 0 for four per worker
+    size_t batchSize = 64;           // messages an actor handles before yielding its worker
+    size_t dedupeCapacity = 65536;   // message hashes remembered per actor
+    size_t historyBatch = 256;       // messages buffered per actor before writing them out
+};
+
+// Processes incoming chat messages on a pool of worker threads.
+//
+// Channels are hashed onto a fixed number of actors. Each actor has its own
+// mailbox, its own set of recently seen message hashes and its own buffer of
+// messages waiting to be written to the history store, so actors never
+// share state. At most one worker runs an actor at a time, which keeps the
+// messages of a channel in arrival order while other channels are decoded
+// in parallel. The deliver callback is therefore called from several
+// threads at once, but never concurrently for the same channel.
+//
+// Batched messages are unpacked and each inner message is deduplicated,
+// stored and delivered on its own, under the envelope hash suffixed with
+// its index in the batch.
+//
+// Chunks are handed to the reassembler; a completed transfer is
+// delivered and stored under its digest like any other message.
+//
+// Messages not admitted on the event thread are offered to the admit
+// callback once decoded, before they are stored or delivered; this is how
+// the inner messages of batches and transfers are rate limited.
+//
+// Compressed payloads are decompressed before delivery; the history store
+// gets the message as it was sent. Each accepted message is decoded into
+// one shared RecentMessage, which goes both to the recent-message buffers
+// and to the deliver callback.
+class ChannelActors {
+public:
+    // The decoded message is the one added to the recent-message buffers
+    using DeliverCallback = std::function<void(const InboundMessage& message, const RecentMessagePtr& decoded)>;
+    // False to drop a message of nick
+    using AdmitCallback = std::function<bool(const InboundMessage& message, std::string_view nick)>;
+
+    // history may be null to not keep received messages, compressor null
+    // to drop compressed ones, transfers null to drop chunks and recent
+    // null to not buffer decoded messages. Without admit every message is
+    // let through.
+    ChannelActors(DeliverCallback deliver, HistoryStore* history,
+                  const ChannelActorOptions& options = ChannelActorOptions(),
+                  const PayloadCompressor* compressor = nullptr, ChunkReassembler* transfers = nullptr,
+                  RecentMessages* recent = nullptr, AdmitCallback admit = nullptr);
+    ~ChannelActors();
+
+    ChannelActors(const ChannelActors&) = delete;
+    ChannelActors& operator=(const ChannelActors&) = delete;
+
+    // Queue a message on its channel's actor. Called from the event thread.
+    void post(InboundMessage message);
+
+    // Block until every posted message has been handled and written out
+    void waitIdle();
+
+    size_t shardCount() const { return shards_.size(); }
+    size_t workerCount() const { return pool_.size(); }
+
+    // Messages dropped as duplicates, because they failed to decode or by
+    // the admit callback
+    uint64_t duplicates() const { return duplicates_.load(std::memory_order_relaxed); }
+    uint64_t malformed() const { return malformed_.load(std::memory_order_relaxed); }
+    uint64_t limited() const { return limited_.load(std::memory_order_relaxed); }
+
+private:
+    struct Shard {
+        std::mutex mutex;
+        std::deque<InboundMessage> mailbox;
+        bool scheduled = false;
+
+        // Only touched by the worker running the actor
+        std::unordered_set<std::string> seen;
+        std::deque<std::string> seenOrder;
+        std::map<std::string, std::vector<HistoryRecord>> pendingHistory;  // by content topic
+        size_t pendingCount = 0;
+        std::vector<uint8_t> decodeBuffer;
+        std::vector<uint8_t> textBuffer;  // decompressed payload field
+    };
+
+    Shard& shardFor(const std::string& contentTopic);
+    void run(Shard& shard);
+    void handle(Shard& shard, InboundMessage& message);
+    void handleBatch(Shard& shard, InboundMessage& message, const uint8_t* data, size_t size);
+    void handleChunk(Shard& shard, InboundMessage& message, const uint8_t* data, size_t size);
+    void accept(Shard& shard, const InboundMessage& message, const std::string& key,
+                const uint8_t* data, size_t size, const chat::Chat2MessageView& decoded);
+    bool decodeMessage(Shard& shard, const uint8_t* data, size_t size, chat::Chat2MessageView& decoded);
+    bool remember(Shard& shard, const std::string& messageHash);
+    void flushHistory(Shard& shard);
+
+    DeliverCallback deliver_;
+    AdmitCallback admit_;
+    HistoryStore* history_;
+    const PayloadCompressor* compressor_;
+    ChunkReassembler* transfers_;
+    RecentMessages* recent_;
+    const ChannelActorOptions options_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+
+    std::atomic<uint64_t> duplicates_{0};
+    std::atomic<uint64_t> malformed_{0};
+    std::atomic<uint64_t> limited_{0};
+
+    // Messages posted and not yet handled, for waitIdle()
+    std::mutex idleMutex_;
+    std::condition_variable idleCv_;
+    size_t outstanding_ = 0;
+
+    // Last member, so workers are joined before the shards go away
+    WorkerPool pool_;
+};
+
+#endif // CHANNEL_ACTORS_H
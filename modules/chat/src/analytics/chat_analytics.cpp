@@ -0,0 +1,176 @@
+#include "chat_analytics.h"
+#include <algorithm>
+
+namespace {
+
+// Shards of the node-wide sender counts
+constexpr size_t kNodeShards = 8;
+
+uint64_t unixSeconds() {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+std::vector<SenderActivity> toSenders(const TopK& top) {
+    std::vector<SenderActivity> out;
+    for (auto& entry : top.sorted()) out.push_back(SenderActivity{std::move(entry.first), entry.second});
+    return out;
+}
+
+} // namespace
+
+ChatAnalytics::Senders::Senders(const ChatAnalyticsOptions& options)
+    : all(options.senderPrecision),
+      windows(std::max<size_t>(1, options.windows), Window{UINT64_MAX, HyperLogLog(options.senderPrecision)}),
+      counts(options.countMinWidth, options.countMinDepth),
+      top(options.topSenders) {}
+
+void ChatAnalytics::Senders::add(std::string_view nick, uint64_t hash, uint64_t window) {
+    all.add(hash);
+    Window& slot = windows[window % windows.size()];
+    if (slot.index == UINT64_MAX || window > slot.index) {
+        slot.index = window;
+        slot.senders.clear();
+    }
+    if (slot.index == window) slot.senders.add(hash);
+    top.offer(nick, counts.add(hash));
+}
+
+void ChatAnalytics::Senders::mergeActive(HyperLogLog& into, uint64_t newestWindow, size_t count) const {
+    for (const Window& window : windows) {
+        if (window.index == UINT64_MAX || window.index > newestWindow) continue;
+        if (newestWindow - window.index < count) into.merge(window.senders);
+    }
+}
+
+ChatAnalytics::ChatAnalytics(const ChatAnalyticsOptions& options) : options_(options) {
+    for (size_t i = 0; i < kNodeShards; ++i) shards_.push_back(std::make_unique<NodeShard>(options_));
+}
+
+uint64_t ChatAnalytics::windowOf(uint64_t seconds) const {
+    return seconds / std::max(1u, options_.windowSeconds);
+}
+
+void ChatAnalytics::record(const std::string& contentTopic, std::string_view nick, uint64_t timestamp) {
+    uint64_t seconds = timestamp != 0 ? timestamp / 1000000000ULL : unixSeconds();
+    uint64_t window = windowOf(seconds);
+    uint64_t hash = sketchHash(nick);
+
+    std::shared_ptr<Channel> channel;
+    {
+        std::shared_lock<std::shared_mutex> lock(channelsMutex_);
+        auto it = channels_.find(contentTopic);
+        if (it != channels_.end()) channel = it->second;
+    }
+    if (channel == nullptr) {
+        std::unique_lock<std::shared_mutex> lock(channelsMutex_);
+        std::shared_ptr<Channel>& slot = channels_[contentTopic];
+        if (slot == nullptr) slot = std::make_shared<Channel>(options_);
+        channel = slot;
+    }
+    {
+        std::lock_guard<std::mutex> lock(channel->mutex);
+        channel->messages++;
+        channel->senders.add(nick, hash, window);
+        channel->version++;
+    }
+    {
+        NodeShard& shard = *shards_[hash % kNodeShards];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.senders.add(nick, hash, window);
+    }
+    messages_.fetch_add(1, std::memory_order_relaxed);
+    version_.fetch_add(1, std::memory_order_release);
+}
+
+std::shared_ptr<const ChatActivity> ChatAnalytics::snapshot() {
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(snapshotMutex_);
+    // Active senders change as windows go by, even without new messages
+    uint64_t seconds = unixSeconds();
+    uint64_t version = version_.load(std::memory_order_acquire);
+    bool fresh = snapshot_ != nullptr && snapshot_->windowEnd / std::max(1u, options_.windowSeconds) == windowOf(seconds);
+    if (fresh && (snapshotVersion_ == version ||
+                  now - snapshotTime_ < std::chrono::milliseconds(options_.snapshotIntervalMs))) {
+        return snapshot_;
+    }
+    rebuild(seconds);
+    snapshotVersion_ = version;
+    snapshotTime_ = now;
+    return snapshot_;
+}
+
+// Called with snapshotMutex_ held. Sketches are copied under their own
+// lock and estimated from the copies, so messages only wait for a copy.
+void ChatAnalytics::rebuild(uint64_t now) {
+    uint64_t newestWindow = windowOf(now);
+    size_t count = std::max<size_t>(1, options_.windows);
+
+    auto activity = std::make_shared<ChatActivity>();
+    activity->messages = messages_.load(std::memory_order_relaxed);
+    activity->windowEnd = now;
+    HyperLogLog all(options_.senderPrecision);
+    HyperLogLog active(options_.senderPrecision);
+    for (const auto& shard : shards_) {
+        std::vector<std::pair<std::string, uint64_t>> top;
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            all.merge(shard->senders.all);
+            shard->senders.mergeActive(active, newestWindow, count);
+            top = shard->senders.top.sorted();
+        }
+        for (auto& entry : top) activity->topSenders.push_back(SenderActivity{std::move(entry.first), entry.second});
+    }
+    activity->senders = all.estimate();
+    activity->activeSenders = active.estimate();
+    // A sender is in one shard only, so the busiest of all are among the
+    // busiest of each
+    std::sort(activity->topSenders.begin(), activity->topSenders.end(),
+              [](const SenderActivity& a, const SenderActivity& b) {
+                  if (a.messages != b.messages) return a.messages > b.messages;
+                  return a.nick < b.nick;
+              });
+    if (activity->topSenders.size() > options_.topSenders) activity->topSenders.resize(options_.topSenders);
+
+    std::vector<std::pair<std::string, std::shared_ptr<Channel>>> channels;
+    {
+        std::shared_lock<std::shared_mutex> lock(channelsMutex_);
+        channels.assign(channels_.begin(), channels_.end());
+    }
+    activity->channels.reserve(channels.size());
+    for (const auto& entry : channels) {
+        Channel& channel = *entry.second;
+        bool changed = channel.activityWindow != newestWindow;
+        HyperLogLog channelAll(options_.senderPrecision);
+        HyperLogLog channelActive(options_.senderPrecision);
+        {
+            std::lock_guard<std::mutex> lock(channel.mutex);
+            changed = changed || channel.activityVersion != channel.version;
+            if (changed) {
+                channel.activity.contentTopic = entry.first;
+                channel.activity.messages = channel.messages;
+                channel.activity.topSenders = toSenders(channel.senders.top);
+                channelAll = channel.senders.all;
+                channel.senders.mergeActive(channelActive, newestWindow, count);
+                channel.activityVersion = channel.version;
+            }
+        }
+        if (changed) {
+            channel.activity.senders = channelAll.estimate();
+            channel.activity.activeSenders = channelActive.estimate();
+            channel.activityWindow = newestWindow;
+        }
+        activity->channels.push_back(channel.activity);
+    }
+    std::sort(activity->channels.begin(), activity->channels.end(),
+              [](const ChannelActivity& a, const ChannelActivity& b) {
+                  if (a.messages != b.messages) return a.messages > b.messages;
+                  return a.contentTopic < b.contentTopic;
+              });
+    snapshot_ = std::move(activity);
+}
+
+void ChatAnalytics::drop(const std::string& contentTopic) {
+    std::unique_lock<std::shared_mutex> lock(channelsMutex_);
+    if (channels_.erase(contentTopic) > 0) version_.fetch_add(1, std::memory_order_release);
+}
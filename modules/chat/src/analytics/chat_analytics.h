@@ -0,0 +1,148 @@
+#ifndef CHAT_ANALYTICS_H
+#define CHAT_ANALYTICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "sketches.h"
+
+struct ChatAnalyticsOptions {
+    unsigned int senderPrecision = 11;      // HyperLogLog registers, 2^p bytes per sketch
+    unsigned int windowSeconds = 60;
+    size_t windows = 15;                    // active senders are those of the last windows
+    size_t countMinWidth = 512;
+    size_t countMinDepth = 4;
+    size_t topSenders = 10;                 // per channel and for the node
+    unsigned int snapshotIntervalMs = 200;  // snapshots are rebuilt at most this often
+};
+
+// A sender and about how many messages it sent; never an undercount
+struct SenderActivity {
+    std::string nick;
+    uint64_t messages = 0;
+};
+
+struct ChannelActivity {
+    std::string contentTopic;
+    uint64_t messages = 0;
+    double senders = 0;        // distinct nicks since start, estimated
+    double activeSenders = 0;  // distinct nicks in the last windows, estimated
+    std::vector<SenderActivity> topSenders;  // busiest first
+};
+
+// What the node has seen, over all channels and channel by channel
+struct ChatActivity {
+    uint64_t messages = 0;
+    double senders = 0;
+    double activeSenders = 0;
+    std::vector<SenderActivity> topSenders;
+    std::vector<ChannelActivity> channels;  // busiest first
+    uint64_t windowEnd = 0;                 // the active windows end here (unix seconds)
+};
+
+// Streaming counts of decoded messages: distinct senders, per channel and
+// time window, and the busiest senders and channels.
+//
+// Every channel takes a fixed amount of memory however many senders it
+// has: a HyperLogLog over all its senders, a ring of one per window, and
+// a Count-Min sketch of messages per sender with the top senders. The node
+// keeps the same over all channels, split in shards by sender, so each
+// sender's counts are in one shard and merging them loses nothing.
+// Channels are counted exactly, as each already has its own record.
+//
+// Messages fall in the window of their envelope timestamp, so history
+// fetched from a store node counts in the windows it was sent in, if they
+// are still kept. A window whose slot of the ring has been taken by a
+// newer one is gone.
+//
+// Readers get an immutable snapshot, rebuilt at most once per
+// snapshotIntervalMs; reading it is a pointer copy. A rebuild copies each
+// channel's sketches under that channel's lock and estimates from the
+// copies, and reuses the figures of channels unchanged since the last one.
+//
+// All methods are thread-safe. Messages of different channels only share
+// a node shard lock, for the sender's shard.
+class ChatAnalytics {
+public:
+    explicit ChatAnalytics(const ChatAnalyticsOptions& options = ChatAnalyticsOptions());
+
+    ChatAnalytics(const ChatAnalytics&) = delete;
+    ChatAnalytics& operator=(const ChatAnalytics&) = delete;
+
+    // Count a message; timestamp is the envelope's, in ns, 0 for now
+    void record(const std::string& contentTopic, std::string_view nick, uint64_t timestamp);
+
+    std::shared_ptr<const ChatActivity> snapshot();
+
+    // Forget a channel; it no longer shows in snapshots
+    void drop(const std::string& contentTopic);
+
+private:
+    struct Window {
+        uint64_t index = UINT64_MAX;  // start / windowSeconds; unused until set
+        HyperLogLog senders;
+    };
+
+    // Distinct senders of all time and of the latest windows, and the
+    // busiest senders
+    struct Senders {
+        explicit Senders(const ChatAnalyticsOptions& options);
+
+        void add(std::string_view nick, uint64_t hash, uint64_t window);
+        // Take in the senders of the latest windows
+        void mergeActive(HyperLogLog& into, uint64_t newestWindow, size_t windows) const;
+
+        HyperLogLog all;
+        std::vector<Window> windows;  // ring, by index % size
+        CountMinSketch counts;
+        TopK top;
+    };
+
+    struct Channel {
+        explicit Channel(const ChatAnalyticsOptions& options) : senders(options) {}
+
+        std::mutex mutex;  // of messages, senders and version
+        uint64_t messages = 0;
+        Senders senders;
+        uint64_t version = 0;  // bumped by every message
+
+        // The channel as of the last rebuild, only touched by rebuild()
+        ChannelActivity activity;
+        uint64_t activityVersion = UINT64_MAX;
+        uint64_t activityWindow = UINT64_MAX;
+    };
+
+    // Node-wide senders whose hash falls in this shard
+    struct NodeShard {
+        explicit NodeShard(const ChatAnalyticsOptions& options) : senders(options) {}
+
+        std::mutex mutex;
+        Senders senders;
+    };
+
+    uint64_t windowOf(uint64_t seconds) const;
+    void rebuild(uint64_t now);
+
+    const ChatAnalyticsOptions options_;
+
+    std::shared_mutex channelsMutex_;  // of the map; each channel has its own lock
+    std::unordered_map<std::string, std::shared_ptr<Channel>> channels_;
+    std::vector<std::unique_ptr<NodeShard>> shards_;
+    std::atomic<uint64_t> messages_{0};
+    std::atomic<uint64_t> version_{0};  // bumped by every change
+
+    std::mutex snapshotMutex_;  // one rebuild at a time
+    std::shared_ptr<const ChatActivity> snapshot_;
+    uint64_t snapshotVersion_ = 0;
+    std::chrono::steady_clock::time_point snapshotTime_;
+};
+
+#endif // CHAT_ANALYTICS_H
@@ -0,0 +1,151 @@
+#include "sketches.h"
+#include <algorithm>
+#include <cmath>
+
+uint64_t sketchHash(std::string_view key) {
+    // FNV-1a, then the splitmix64 finalizer so every bit depends on every
+    // byte; HyperLogLog takes its register index from the high bits
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : key) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+HyperLogLog::HyperLogLog(unsigned int precision)
+    : precision_(std::min(16u, std::max(4u, precision))), registers_(size_t(1) << precision_, 0) {}
+
+void HyperLogLog::add(uint64_t hash) {
+    size_t index = static_cast<size_t>(hash >> (64 - precision_));
+    uint64_t rest = hash << precision_;
+    uint8_t rank = 1;
+    uint8_t maxRank = static_cast<uint8_t>(64 - precision_ + 1);
+    while (rank < maxRank && (rest & (1ULL << 63)) == 0) {
+        rank++;
+        rest <<= 1;
+    }
+    if (rank > registers_[index]) registers_[index] = rank;
+}
+
+void HyperLogLog::merge(const HyperLogLog& other) {
+    if (other.precision_ != precision_) return;
+    for (size_t i = 0; i < registers_.size(); ++i) {
+        registers_[i] = std::max(registers_[i], other.registers_[i]);
+    }
+}
+
+void HyperLogLog::clear() {
+    std::fill(registers_.begin(), registers_.end(), 0);
+}
+
+double HyperLogLog::estimate() const {
+    const double m = static_cast<double>(registers_.size());
+    double sum = 0;
+    size_t zeros = 0;
+    for (uint8_t value : registers_) {
+        sum += std::ldexp(1.0, -static_cast<int>(value));
+        if (value == 0) zeros++;
+    }
+    double alpha = 0.7213 / (1 + 1.079 / m);
+    double estimate = alpha * m * m / sum;
+    // Few keys leave registers empty; linear counting is closer then
+    if (estimate <= 2.5 * m && zeros > 0) estimate = m * std::log(m / static_cast<double>(zeros));
+    return estimate;
+}
+
+CountMinSketch::CountMinSketch(size_t width, size_t depth)
+    : width_(std::max<size_t>(1, width)), depth_(std::max<size_t>(1, depth)), counters_(width_ * depth_, 0) {}
+
+namespace {
+
+// Column of a key in a row. Every row mixes the hash with its own seed,
+// so keys sharing a column in one row rarely do in the others.
+size_t column(uint64_t hash, size_t row, size_t width) {
+    uint64_t x = hash + (row + 1) * 0x9e3779b97f4a7c15ULL;
+    x ^= x >> 31;
+    x *= 0xd6e8feb86659fd93ULL;
+    x ^= x >> 32;
+    return static_cast<size_t>(x % width);
+}
+
+} // namespace
+
+uint64_t CountMinSketch::add(uint64_t hash, uint32_t count) {
+    uint64_t current = estimate(hash);
+    uint64_t next = std::min<uint64_t>(current + count, UINT32_MAX);
+    for (size_t row = 0; row < depth_; ++row) {
+        uint32_t& counter = counters_[row * width_ + column(hash, row, width_)];
+        if (counter < next) counter = static_cast<uint32_t>(next);
+    }
+    return next;
+}
+
+uint64_t CountMinSketch::estimate(uint64_t hash) const {
+    uint64_t lowest = UINT32_MAX;
+    for (size_t row = 0; row < depth_; ++row) {
+        lowest = std::min<uint64_t>(lowest, counters_[row * width_ + column(hash, row, width_)]);
+    }
+    return lowest;
+}
+
+TopK::TopK(size_t k) : k_(std::max<size_t>(1, k)) {
+    heap_.reserve(k_);
+}
+
+void TopK::offer(std::string_view key, uint64_t count) {
+    for (size_t i = 0; i < heap_.size(); ++i) {
+        if (heap_[i].key == key) {
+            if (count > heap_[i].count) {
+                heap_[i].count = count;
+                siftDown(i);
+            }
+            return;
+        }
+    }
+    if (heap_.size() < k_) {
+        heap_.push_back(Entry{std::string(key), count});
+        siftUp(heap_.size() - 1);
+    } else if (count > heap_[0].count) {
+        heap_[0] = Entry{std::string(key), count};
+        siftDown(0);
+    }
+}
+
+std::vector<std::pair<std::string, uint64_t>> TopK::sorted() const {
+    std::vector<std::pair<std::string, uint64_t>> out;
+    out.reserve(heap_.size());
+    for (const Entry& entry : heap_) out.emplace_back(entry.key, entry.count);
+    std::sort(out.begin(), out.end(), [](const auto& a, const auto& b) {
+        if (a.second != b.second) return a.second > b.second;
+        return a.first < b.first;
+    });
+    return out;
+}
+
+void TopK::siftUp(size_t i) {
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (heap_[parent].count <= heap_[i].count) break;
+        std::swap(heap_[parent], heap_[i]);
+        i = parent;
+    }
+}
+
+void TopK::siftDown(size_t i) {
+    while (true) {
+        size_t smallest = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        if (left < heap_.size() && heap_[left].count < heap_[smallest].count) smallest = left;
+        if (right < heap_.size() && heap_[right].count < heap_[smallest].count) smallest = right;
+        if (smallest == i) break;
+        std::swap(heap_[smallest], heap_[i]);
+        i = smallest;
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef SKETCHES_H
+#define SKETCHES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// 64-bit hash of a key for the sketches below
+uint64_t sketchHash(std::string_view key);
+
+// Estimates how many distinct keys were added, in 2^precision bytes
+// whatever their number. The standard error is about 1.04 / sqrt(2^precision):
+// 2.3% at precision 11.
+class HyperLogLog {
+public:
+    explicit HyperLogLog(unsigned int precision = 11);
+
+    void add(uint64_t hash);
+    // Take in the keys of another sketch of the same precision
+    void merge(const HyperLogLog& other);
+    void clear();
+
+    double estimate() const;
+
+private:
+    unsigned int precision_;
+    std::vector<uint8_t> registers_;
+};
+
+// Counts of keys, never under and over by at most a small share of the
+// total with high probability. Uses conservative update: only the
+// counters that are lowest for a key are raised.
+class CountMinSketch {
+public:
+    CountMinSketch(size_t width = 512, size_t depth = 4);
+
+    // Count a key and return its new estimate
+    uint64_t add(uint64_t hash, uint32_t count = 1);
+    uint64_t estimate(uint64_t hash) const;
+
+private:
+    size_t width_;
+    size_t depth_;
+    std::vector<uint32_t> counters_;  // depth_ rows of width_
+};
+
+// The k keys with the highest counts offered, kept in a min-heap so the
+// key to push out is always at the top
+class TopK {
+public:
+    explicit TopK(size_t k = 10);
+
+    // A key's count is now count; counts only grow
+    void offer(std::string_view key, uint64_t count);
+
+    // Keys and counts, highest first
+    std::vector<std::pair<std::string, uint64_t>> sorted() const;
+
+private:
+    struct Entry {
+        std::string key;
+        uint64_t count;
+    };
+
+    void siftUp(size_t i);
+    void siftDown(size_t i);
+
+    size_t k_;
+    std::vector<Entry> heap_;
+};
+
+#endif // SKETCHES_H
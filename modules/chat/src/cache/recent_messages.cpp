@@ -0,0 +1,187 @@
+#include "recent_messages.h"
+#include <algorithm>
+#include <ctime>
+
+namespace {
+
+// Reference counts of a message made with make_shared
+constexpr size_t kControlBlockSize = 2 * sizeof(long);
+
+// What a channel costs before it holds any message: its ring and the map
+// and LRU entries naming it
+size_t channelOverhead(const std::string& contentTopic, size_t capacity) {
+    return capacity * sizeof(RecentMessagePtr) + 2 * (sizeof(std::string) + contentTopic.capacity()) + 128;
+}
+
+} // namespace
+
+RecentMessage::RecentMessage(std::string messageHash, uint64_t envelopeTimestamp, uint64_t timestamp,
+                             std::string_view nick, std::string_view text)
+    : messageHash_(std::move(messageHash)), envelopeTimestamp_(envelopeTimestamp), timestamp_(timestamp) {
+    char formatted[32];
+    std::time_t time = static_cast<std::time_t>(timestamp);
+    std::tm tm{};
+#if defined(_WIN32)
+    gmtime_s(&tm, &time);
+#else
+    gmtime_r(&time, &tm);
+#endif
+    size_t formattedSize = std::strftime(formatted, sizeof(formatted), "%Y-%m-%d %H:%M:%S UTC", &tm);
+
+    buffer_.reserve(formattedSize + nick.size() + text.size());
+    buffer_.append(formatted, formattedSize);
+    nickStart_ = buffer_.size();
+    buffer_.append(nick);
+    textStart_ = buffer_.size();
+    buffer_.append(text);
+}
+
+size_t RecentMessage::footprint() const {
+    return sizeof(RecentMessage) + kControlBlockSize + messageHash_.capacity() + buffer_.capacity();
+}
+
+RecentMessages::RecentMessages(const RecentMessagesOptions& options) : options_(options) {}
+
+bool RecentMessages::add(const std::string& contentTopic, RecentMessagePtr message) {
+    if (!message) return false;
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    Ring* ring = find(contentTopic);
+    if (ring == nullptr) {
+        size_t capacity = std::max<size_t>(1, options_.capacityPerChannel);
+        auto it = rings_.emplace(contentTopic, Ring()).first;
+        ring = &it->second;
+        ring->entries.resize(capacity);
+        ring->bytes = channelOverhead(contentTopic, capacity);
+        lru_.push_front(contentTopic);
+        ring->lru = lru_.begin();
+        bytes_ += ring->bytes;
+    }
+
+    // Messages almost always arrive newest last, so look from the end
+    uint64_t timestamp = message->envelopeTimestamp();
+    size_t pos = ring->count;
+    while (pos > 0 && ring->at(pos - 1)->envelopeTimestamp() > timestamp) pos--;
+    if (!message->messageHash().empty()) {
+        for (size_t i = pos; i > 0 && ring->at(i - 1)->envelopeTimestamp() == timestamp; --i) {
+            if (ring->at(i - 1)->messageHash() == message->messageHash()) return false;
+        }
+    }
+
+    if (ring->count == ring->entries.size()) {
+        if (pos == 0) return false;
+        popOldest(*ring);
+        pos--;
+    }
+    for (size_t i = ring->count; i > pos; --i) ring->at(i) = std::move(ring->at(i - 1));
+    size_t footprint = message->footprint();
+    ring->at(pos) = std::move(message);
+    ring->count++;
+    ring->bytes += footprint;
+    bytes_ += footprint;
+
+    if (bytes_ > options_.maxBytes) evict(*ring);
+    return true;
+}
+
+std::vector<RecentMessagePtr> RecentMessages::recent(const std::string& contentTopic, size_t limit) {
+    std::vector<RecentMessagePtr> messages;
+    std::lock_guard<std::mutex> lock(mutex_);
+    Ring* ring = find(contentTopic);
+    if (ring == nullptr) return messages;
+    size_t n = std::min(limit, ring->count);
+    messages.reserve(n);
+    for (size_t i = ring->count - n; i < ring->count; ++i) messages.push_back(ring->at(i));
+    return messages;
+}
+
+RecentMessagePtr RecentMessages::newest(const std::string& contentTopic, size_t index) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Ring* ring = find(contentTopic);
+    if (ring == nullptr || index >= ring->count) return nullptr;
+    return ring->at(ring->count - 1 - index);
+}
+
+RecentMessagePtr RecentMessages::find(const std::string& contentTopic, uint64_t envelopeTimestamp,
+                                      const std::string& messageHash) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Ring* ring = find(contentTopic);
+    if (ring == nullptr) return nullptr;
+    size_t low = 0;
+    size_t high = ring->count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (ring->at(middle)->envelopeTimestamp() < envelopeTimestamp) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    for (size_t i = low; i < ring->count && ring->at(i)->envelopeTimestamp() == envelopeTimestamp; ++i) {
+        if (ring->at(i)->messageHash() == messageHash) return ring->at(i);
+    }
+    return nullptr;
+}
+
+size_t RecentMessages::count(const std::string& contentTopic) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = rings_.find(contentTopic);
+    return it != rings_.end() ? it->second.count : 0;
+}
+
+void RecentMessages::drop(const std::string& contentTopic) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = rings_.find(contentTopic);
+    if (it != rings_.end()) erase(it);
+}
+
+size_t RecentMessages::channelCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return rings_.size();
+}
+
+size_t RecentMessages::bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_;
+}
+
+// Called with the lock held. Marks the channel as the most recently used.
+RecentMessages::Ring* RecentMessages::find(const std::string& contentTopic) {
+    auto it = rings_.find(contentTopic);
+    if (it == rings_.end()) return nullptr;
+    lru_.splice(lru_.begin(), lru_, it->second.lru);
+    return &it->second;
+}
+
+void RecentMessages::popOldest(Ring& ring) {
+    RecentMessagePtr& oldest = ring.at(0);
+    size_t footprint = oldest->footprint();
+    oldest.reset();
+    ring.start = (ring.start + 1) % ring.entries.size();
+    ring.count--;
+    ring.bytes -= footprint;
+    bytes_ -= footprint;
+}
+
+void RecentMessages::erase(std::unordered_map<std::string, Ring>::iterator it) {
+    bytes_ -= it->second.bytes;
+    lru_.erase(it->second.lru);
+    rings_.erase(it);
+}
+
+// Drop the oldest messages of the least recently used channels until the
+// rings fit the budget again. keep, the channel just added to, is only
+// trimmed once it is the last one left, and never emptied.
+void RecentMessages::evict(const Ring& keep) {
+    while (bytes_ > options_.maxBytes && !lru_.empty()) {
+        auto it = rings_.find(lru_.back());
+        Ring& ring = it->second;
+        if (&ring == &keep) {
+            if (ring.count <= 1) break;
+            popOldest(ring);
+            continue;
+        }
+        if (ring.count > 0) popOldest(ring);
+        if (ring.count == 0) erase(it);
+    }
+}
@@ -0,0 +1,120 @@
+#ifndef RECENT_MESSAGES_H
+#define RECENT_MESSAGES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct RecentMessagesOptions {
+    size_t capacityPerChannel = 1000;    // newest messages kept per channel
+    size_t maxBytes = 64 * 1024 * 1024;  // over all channels
+};
+
+// A decoded chat message. It never changes once built, so the buffers,
+// the listeners it is delivered to and everyone else reading it share one
+// copy.
+class RecentMessage {
+public:
+    RecentMessage(std::string messageHash, uint64_t envelopeTimestamp, uint64_t timestamp,
+                  std::string_view nick, std::string_view text);
+
+    const std::string& messageHash() const { return messageHash_; }
+    uint64_t envelopeTimestamp() const { return envelopeTimestamp_; }  // ns
+    uint64_t timestamp() const { return timestamp_; }                  // sender's, in seconds
+
+    // Views into the message's buffer
+    std::string_view timestampText() const { return view(0, nickStart_); }  // timestamp as "%Y-%m-%d %H:%M:%S UTC"
+    std::string_view nick() const { return view(nickStart_, textStart_); }
+    std::string_view text() const { return view(textStart_, buffer_.size()); }
+
+    // Memory held by the message, as counted against the budget
+    size_t footprint() const;
+
+private:
+    std::string_view view(size_t from, size_t to) const { return std::string_view(buffer_).substr(from, to - from); }
+
+    const std::string messageHash_;
+    const uint64_t envelopeTimestamp_;
+    const uint64_t timestamp_;
+    size_t nickStart_ = 0;
+    size_t textStart_ = 0;
+    std::string buffer_;  // timestamp text, nick, text
+};
+
+using RecentMessagePtr = std::shared_ptr<const RecentMessage>;
+
+// The newest decoded messages of every channel, kept in memory.
+//
+// Each channel has a ring of capacityPerChannel entries in envelope
+// timestamp order; once it is full, a new message pushes out the oldest.
+// Messages arriving late (from a store query, say) are slotted in at
+// their place, and a message already in the ring under the same hash is
+// ignored.
+//
+// Together the rings stay under maxBytes. When a message would go over,
+// the oldest messages of the channel that was used least recently are
+// dropped first, so idle channels give way to active ones. Adding to or
+// reading a channel counts as using it. Readers holding a message keep it
+// alive after it has been dropped, outside the budget.
+//
+// All methods are thread-safe.
+class RecentMessages {
+public:
+    explicit RecentMessages(const RecentMessagesOptions& options = RecentMessagesOptions());
+
+    RecentMessages(const RecentMessages&) = delete;
+    RecentMessages& operator=(const RecentMessages&) = delete;
+
+    // Add a message to a channel. Returns false if it is already there, or
+    // is older than everything in a full ring.
+    bool add(const std::string& contentTopic, RecentMessagePtr message);
+
+    // The newest limit messages, oldest first
+    std::vector<RecentMessagePtr> recent(const std::string& contentTopic, size_t limit);
+
+    // The index-th newest message, 0 for the newest; null past the oldest
+    RecentMessagePtr newest(const std::string& contentTopic, size_t index = 0);
+
+    // The message with this envelope timestamp and hash, if the channel
+    // still has it
+    RecentMessagePtr find(const std::string& contentTopic, uint64_t envelopeTimestamp, const std::string& messageHash);
+
+    size_t count(const std::string& contentTopic) const;
+
+    // Forget a channel's messages
+    void drop(const std::string& contentTopic);
+
+    size_t channelCount() const;
+    size_t bytes() const;
+
+private:
+    struct Ring {
+        std::vector<RecentMessagePtr> entries;  // allocated with the first message
+        size_t start = 0;                       // entry of the oldest message
+        size_t count = 0;
+        size_t bytes = 0;
+        std::list<std::string>::iterator lru;
+
+        RecentMessagePtr& at(size_t i) { return entries[(start + i) % entries.size()]; }
+    };
+
+    Ring* find(const std::string& contentTopic);
+    void popOldest(Ring& ring);
+    void erase(std::unordered_map<std::string, Ring>::iterator it);
+    void evict(const Ring& keep);
+
+    const RecentMessagesOptions options_;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Ring> rings_;  // by content topic
+    std::list<std::string> lru_;                   // content topics, most recently used first
+    size_t bytes_ = 0;
+};
+
+#endif // RECENT_MESSAGES_H
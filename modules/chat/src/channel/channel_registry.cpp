@@ -0,0 +1,152 @@
+#include "channel_registry.h"
+#include <mutex>
+
+ChannelId ChannelRegistry::intern(const std::string& contentTopic) {
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto it = ids_.find(contentTopic);
+        if (it != ids_.end()) return it->second;
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto it = ids_.find(contentTopic);
+    if (it != ids_.end()) return it->second;
+    channels_.push_back(std::make_unique<Channel>(contentTopic));
+    ChannelId id = static_cast<ChannelId>(channels_.size());
+    ids_.emplace(contentTopic, id);
+    return id;
+}
+
+ChannelId ChannelRegistry::find(const std::string& contentTopic) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = ids_.find(contentTopic);
+    return it == ids_.end() ? kNoChannel : it->second;
+}
+
+std::string ChannelRegistry::contentTopic(ChannelId id) const {
+    Channel* ch = get(id);
+    return ch == nullptr ? std::string() : ch->contentTopic;
+}
+
+// Channel objects are never freed, so the pointer stays usable without the lock
+ChannelRegistry::Channel* ChannelRegistry::get(ChannelId id) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (id == kNoChannel || id > channels_.size()) return nullptr;
+    return channels_[id - 1].get();
+}
+
+bool ChannelRegistry::beginSubscribe(ChannelId id) {
+    Channel* ch = get(id);
+    if (ch == nullptr) return false;
+    SubscriptionState current = ch->state.load();
+    while (current == SubscriptionState::Unsubscribed || current == SubscriptionState::Failed) {
+        if (ch->state.compare_exchange_weak(current, SubscriptionState::Pending)) return true;
+    }
+    return false;
+}
+
+bool ChannelRegistry::beginUnsubscribe(ChannelId id) {
+    Channel* ch = get(id);
+    if (ch == nullptr) return false;
+    SubscriptionState current = ch->state.load();
+    while (current == SubscriptionState::Subscribed || current == SubscriptionState::Pending) {
+        if (ch->state.compare_exchange_weak(current, SubscriptionState::Unsubscribed)) return true;
+    }
+    return false;
+}
+
+void ChannelRegistry::completeSubscribe(ChannelId id, bool success) {
+    Channel* ch = get(id);
+    if (ch == nullptr) return;
+    SubscriptionState expected = SubscriptionState::Pending;
+    ch->state.compare_exchange_strong(expected, success ? SubscriptionState::Subscribed : SubscriptionState::Failed);
+}
+
+void ChannelRegistry::setState(ChannelId id, SubscriptionState state) {
+    if (Channel* ch = get(id)) ch->state.store(state);
+}
+
+SubscriptionState ChannelRegistry::state(ChannelId id) const {
+    Channel* ch = get(id);
+    return ch == nullptr ? SubscriptionState::Unsubscribed : ch->state.load();
+}
+
+ChannelId ChannelRegistry::subscribed(const std::string& contentTopic) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = ids_.find(contentTopic);
+    if (it == ids_.end()) return kNoChannel;
+    const Channel& ch = *channels_[it->second - 1];
+    return ch.state.load(std::memory_order_relaxed) == SubscriptionState::Subscribed ? it->second : kNoChannel;
+}
+
+bool ChannelRegistry::isSubscribed(ChannelId id) const {
+    return state(id) == SubscriptionState::Subscribed;
+}
+
+void ChannelRegistry::recordReceived(ChannelId id, uint64_t timestamp) {
+    Channel* ch = get(id);
+    if (ch == nullptr) return;
+    ch->received.fetch_add(1, std::memory_order_relaxed);
+    uint64_t seen = ch->lastSeen.load(std::memory_order_relaxed);
+    while (timestamp > seen && !ch->lastSeen.compare_exchange_weak(seen, timestamp, std::memory_order_relaxed)) {
+    }
+}
+
+void ChannelRegistry::recordSent(ChannelId id) {
+    if (Channel* ch = get(id)) ch->sent.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ChannelRegistry::recordDropped(ChannelId id) {
+    if (Channel* ch = get(id)) ch->dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ChannelRegistry::setReceiveLimits(ChannelId id, const ReceiveLimits& limits) {
+    Channel* ch = get(id);
+    if (ch == nullptr) return;
+    ch->senderLimit.store(packLimit(limits.senderRate, limits.senderBurst), std::memory_order_relaxed);
+    ch->channelLimit.store(packLimit(limits.channelRate, limits.channelBurst), std::memory_order_relaxed);
+}
+
+bool ChannelRegistry::receiveLimits(ChannelId id, ReceiveLimits& limits) const {
+    Channel* ch = get(id);
+    if (ch == nullptr) return false;
+    uint64_t sender = ch->senderLimit.load(std::memory_order_relaxed);
+    uint64_t channel = ch->channelLimit.load(std::memory_order_relaxed);
+    if (sender == 0 || channel == 0) return false;
+    unpackLimit(sender, limits.senderRate, limits.senderBurst);
+    unpackLimit(channel, limits.channelRate, limits.channelBurst);
+    return true;
+}
+
+bool ChannelRegistry::info(ChannelId id, ChannelInfo& out) const {
+    Channel* ch = get(id);
+    if (ch == nullptr) return false;
+    out.id = id;
+    out.contentTopic = ch->contentTopic;
+    out.state = ch->state.load();
+    out.lastSeen = ch->lastSeen.load(std::memory_order_relaxed);
+    out.received = ch->received.load(std::memory_order_relaxed);
+    out.sent = ch->sent.load(std::memory_order_relaxed);
+    out.dropped = ch->dropped.load(std::memory_order_relaxed);
+    return true;
+}
+
+std::vector<ChannelInfo> ChannelRegistry::channels() const {
+    size_t count = size();
+    std::vector<ChannelInfo> result(count);
+    for (size_t i = 0; i < count; ++i) info(static_cast<ChannelId>(i + 1), result[i]);
+    return result;
+}
+
+std::vector<std::string> ChannelRegistry::subscribedTopics() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    std::vector<std::string> topics;
+    for (const auto& ch : channels_) {
+        if (ch->state.load() == SubscriptionState::Subscribed) topics.push_back(ch->contentTopic);
+    }
+    return topics;
+}
+
+size_t ChannelRegistry::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return channels_.size();
+}
@@ -0,0 +1,112 @@
+#ifndef CHANNEL_REGISTRY_H
+#define CHANNEL_REGISTRY_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ratelimit/receive_limiter.h"
+
+// Interned content topic. IDs are dense, start at 1 and stay valid for the
+// lifetime of the registry, also after leaving the channel.
+using ChannelId = uint32_t;
+constexpr ChannelId kNoChannel = 0;
+
+enum class SubscriptionState : uint8_t {
+    Unsubscribed,
+    Pending,    // filterSubscribe sent, waiting for the node
+    Subscribed,
+    Failed
+};
+
+// Copy of a channel's state at one point in time
+struct ChannelInfo {
+    ChannelId id = kNoChannel;
+    std::string contentTopic;
+    SubscriptionState state = SubscriptionState::Unsubscribed;
+    uint64_t lastSeen = 0;  // newest envelope timestamp received (ns)
+    uint64_t received = 0;
+    uint64_t sent = 0;
+    uint64_t dropped = 0;   // by the receive limiter
+};
+
+// Registry of the channels a chat node knows about.
+//
+// Topics are interned once; per-channel state lives in atomics so the
+// message path only takes the shared lock for the topic lookup and never
+// blocks on other readers. Writers (interning a new topic) take the lock
+// exclusively, which only happens the first time a topic is seen.
+class ChannelRegistry {
+public:
+    ChannelRegistry() = default;
+
+    ChannelRegistry(const ChannelRegistry&) = delete;
+    ChannelRegistry& operator=(const ChannelRegistry&) = delete;
+
+    // ID for contentTopic, registering it if needed
+    ChannelId intern(const std::string& contentTopic);
+
+    // ID for contentTopic or kNoChannel if it was never registered
+    ChannelId find(const std::string& contentTopic) const;
+
+    std::string contentTopic(ChannelId id) const;
+
+    // Move an unsubscribed or failed channel to Pending. Returns false if it
+    // is already pending or subscribed, so a re-join doesn't subscribe twice.
+    bool beginSubscribe(ChannelId id);
+
+    // Move a subscribed or pending channel to Unsubscribed. Returns false if
+    // there was nothing to leave.
+    bool beginUnsubscribe(ChannelId id);
+
+    // Settle a pending subscription. Ignored if the channel was left while
+    // the request was in flight.
+    void completeSubscribe(ChannelId id, bool success);
+
+    void setState(ChannelId id, SubscriptionState state);
+    SubscriptionState state(ChannelId id) const;
+
+    // Hot path for incoming messages: ID of a subscribed channel for
+    // contentTopic, kNoChannel otherwise
+    ChannelId subscribed(const std::string& contentTopic) const;
+    bool isSubscribed(ChannelId id) const;
+
+    void recordReceived(ChannelId id, uint64_t timestamp);
+    void recordSent(ChannelId id);
+    void recordDropped(ChannelId id);
+
+    // Limits on messages received on a channel. False, leaving limits as
+    // they are, if the channel has none of its own.
+    void setReceiveLimits(ChannelId id, const ReceiveLimits& limits);
+    bool receiveLimits(ChannelId id, ReceiveLimits& limits) const;
+
+    bool info(ChannelId id, ChannelInfo& out) const;
+    std::vector<ChannelInfo> channels() const;
+    std::vector<std::string> subscribedTopics() const;
+    size_t size() const;
+
+private:
+    struct Channel {
+        explicit Channel(const std::string& topic) : contentTopic(topic) {}
+
+        const std::string contentTopic;
+        std::atomic<SubscriptionState> state{SubscriptionState::Unsubscribed};
+        std::atomic<uint64_t> lastSeen{0};
+        std::atomic<uint64_t> received{0};
+        std::atomic<uint64_t> sent{0};
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<uint64_t> senderLimit{0};   // packLimit(), 0 while unset
+        std::atomic<uint64_t> channelLimit{0};
+    };
+
+    Channel* get(ChannelId id) const;
+
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<std::string, ChannelId> ids_;
+    std::vector<std::unique_ptr<Channel>> channels_;  // index id - 1
+};
+
+#endif // CHANNEL_REGISTRY_H
@@ -0,0 +1,243 @@
+#include "subscription_aggregator.h"
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include "../../core/plugin_registry.h"
+#include "../../modules/waku/waku_interface.h"
+
+SubscriptionAggregator::SubscriptionAggregator(ChannelRegistry& channels, const SubscriptionAggregatorOptions& options)
+    : channels_(channels), options_(options), liveness_(std::make_shared<Liveness>()) {
+    liveness_->aggregator = this;
+}
+
+SubscriptionAggregator::~SubscriptionAggregator() {
+    // Filter results coming back from here on are dropped; waits only for
+    // one that is being handled right now
+    {
+        std::lock_guard<std::mutex> lock(liveness_->mutex);
+        liveness_->aggregator = nullptr;
+    }
+    std::vector<Batch> batches;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        batches = takeBatches(true);
+    }
+    cv_.notify_all();
+    if (worker_.joinable()) worker_.join();
+
+    // Requests sent and not answered get no answer now
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& entry : sent_) batches.push_back(std::move(entry.second));
+        sent_.clear();
+    }
+    failAll(batches, "Subscription aggregator shut down");
+}
+
+bool SubscriptionAggregator::join(const std::string& contentTopic, const std::string& pubsubTopic, ResultCallback callback) {
+    ChannelId channel = channels_.intern(contentTopic);
+    if (!channels_.beginSubscribe(channel)) return false;
+    enqueue(Operation::Subscribe, channel, contentTopic, pubsubTopic, std::move(callback));
+    return true;
+}
+
+bool SubscriptionAggregator::leave(const std::string& contentTopic, const std::string& pubsubTopic, ResultCallback callback) {
+    ChannelId channel = channels_.find(contentTopic);
+    if (channel == kNoChannel || !channels_.beginUnsubscribe(channel)) return false;
+    enqueue(Operation::Unsubscribe, channel, contentTopic, pubsubTopic, std::move(callback));
+    return true;
+}
+
+void SubscriptionAggregator::enqueue(Operation op, ChannelId channel, const std::string& contentTopic,
+                                     const std::string& pubsubTopic, ResultCallback callback) {
+    std::vector<ResultCallback> cancelled;
+    std::string cancelledMessage;
+    std::string resultMessage;
+    bool stopped = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopped = stopping_;
+        if (stopped) {
+            resultMessage = "Subscription aggregator shut down";
+        } else {
+            Queue& queue = queues_[pubsubTopic];
+            auto it = queue.requests.find(contentTopic);
+            if (it != queue.requests.end() && it->second.op != op) {
+                // Join and leave within one window: the node's subscription
+                // is already in the state the later request asks for
+                cancelled = std::move(it->second.callbacks);
+                cancelledMessage = (op == Operation::Subscribe) ? "Cancelled by a later join" : "Cancelled by a later leave";
+                (it->second.op == Operation::Subscribe ? queue.subscribes : queue.unsubscribes)--;
+                queue.requests.erase(it);
+                queued_--;
+                if (op == Operation::Subscribe) channels_.completeSubscribe(channel, true);
+                resultMessage = "No change needed";
+            } else if (it != queue.requests.end()) {
+                if (callback) it->second.callbacks.push_back(std::move(callback));
+                return;
+            } else {
+                Request request{op, channel, {}};
+                if (callback) request.callbacks.push_back(std::move(callback));
+                queue.requests.emplace(contentTopic, std::move(request));
+                size_t count = (op == Operation::Subscribe) ? ++queue.subscribes : ++queue.unsubscribes;
+                if (queued_++ == 0) deadline_ = std::chrono::steady_clock::now() + options_.window;
+                if (count >= options_.maxTopicsPerRequest) fullBatch_ = true;
+                if (!worker_.joinable()) worker_ = std::thread(&SubscriptionAggregator::run, this);
+                cv_.notify_all();
+                return;
+            }
+        }
+    }
+
+    // Settled without a round trip
+    for (auto& cb : cancelled) {
+        if (cb) cb(false, cancelledMessage);
+    }
+    if (stopped && op == Operation::Subscribe) channels_.completeSubscribe(channel, false);
+    if (callback) callback(!stopped, resultMessage);
+}
+
+std::vector<SubscriptionAggregator::Batch> SubscriptionAggregator::takeBatches(bool all) {
+    std::vector<Batch> batches;
+    size_t limit = std::max<size_t>(1, options_.maxTopicsPerRequest);
+
+    for (auto queueIt = queues_.begin(); queueIt != queues_.end();) {
+        Queue& queue = queueIt->second;
+        for (Operation op : {Operation::Subscribe, Operation::Unsubscribe}) {
+            size_t& count = (op == Operation::Subscribe) ? queue.subscribes : queue.unsubscribes;
+            // Only full batches go out before the window ends
+            size_t take = all ? count : count - count % limit;
+            if (take == 0) continue;
+
+            Batch batch{op, queueIt->first, {}};
+            for (auto it = queue.requests.begin(); it != queue.requests.end() && take > 0;) {
+                if (it->second.op != op) {
+                    ++it;
+                    continue;
+                }
+                batch.requests.emplace_back(it->first, std::move(it->second));
+                it = queue.requests.erase(it);
+                --take;
+                --count;
+                --queued_;
+                if (batch.requests.size() == limit) {
+                    batches.push_back(std::move(batch));
+                    batch = Batch{op, queueIt->first, {}};
+                }
+            }
+            if (!batch.requests.empty()) batches.push_back(std::move(batch));
+        }
+        queueIt = queue.requests.empty() ? queues_.erase(queueIt) : std::next(queueIt);
+    }
+    fullBatch_ = false;
+    return batches;
+}
+
+void SubscriptionAggregator::flush() {
+    std::vector<Batch> batches;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        batches = takeBatches(true);
+    }
+    for (Batch& batch : batches) send(std::move(batch));
+}
+
+size_t SubscriptionAggregator::pending() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queued_;
+}
+
+void SubscriptionAggregator::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        cv_.wait(lock, [this] { return stopping_ || queued_ > 0; });
+        if (stopping_) break;
+        cv_.wait_until(lock, deadline_, [this] { return stopping_ || fullBatch_ || queued_ == 0; });
+        if (stopping_) break;
+
+        std::vector<Batch> batches = takeBatches(std::chrono::steady_clock::now() >= deadline_);
+        lock.unlock();
+        for (Batch& batch : batches) send(std::move(batch));
+        lock.lock();
+    }
+}
+
+void SubscriptionAggregator::send(Batch batch) {
+    WakuInterface* wakuPlugin = PluginRegistry::getPlugin<WakuInterface>(wakuPluginName());
+    if (!wakuPlugin) {
+        std::cerr << "Failed to get Waku plugin" << std::endl;
+        complete(batch, false, "Failed to get Waku plugin");
+        return;
+    }
+
+    std::string contentTopics = "[";
+    for (size_t i = 0; i < batch.requests.size(); ++i) {
+        if (i > 0) contentTopics += ",";
+        contentTopics += "\"" + batch.requests[i].first + "\"";
+    }
+    contentTopics += "]";
+
+    bool subscribe = (batch.op == Operation::Subscribe);
+    std::cout << "Sending filter " << (subscribe ? "subscribe" : "unsubscribe") << " for "
+              << batch.requests.size() << " content topics on " << batch.pubsubTopic << std::endl;
+
+    QString pubsubTopic = QString::fromStdString(batch.pubsubTopic);
+    uint64_t id = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        id = nextBatch_++;
+        sent_.emplace(id, std::move(batch));
+    }
+    std::shared_ptr<Liveness> liveness = liveness_;
+    auto onResult = [liveness, id](bool success, const QString &message) {
+        std::lock_guard<std::mutex> lock(liveness->mutex);
+        if (liveness->aggregator != nullptr) {
+            liveness->aggregator->finish(id, success, message.toStdString());
+        }
+    };
+    if (subscribe) {
+        wakuPlugin->filterSubscribe(pubsubTopic, QString::fromStdString(contentTopics), onResult);
+    } else {
+        wakuPlugin->filterUnsubscribe(pubsubTopic, QString::fromStdString(contentTopics), onResult);
+    }
+}
+
+// Result of a batch that was sent, reported once
+void SubscriptionAggregator::finish(uint64_t id, bool success, const std::string& message) {
+    Batch batch;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = sent_.find(id);
+        if (it == sent_.end()) return;
+        batch = std::move(it->second);
+        sent_.erase(it);
+    }
+    complete(batch, success, message);
+}
+
+void SubscriptionAggregator::complete(Batch& batch, bool success, const std::string& message) {
+    bool subscribe = (batch.op == Operation::Subscribe);
+    std::cout << "Waku Plugin filter " << (subscribe ? "subscribe" : "unsubscribe") << " result for "
+              << batch.requests.size() << " content topics: " << (success ? "Success" : "Failed")
+              << " - " << message << std::endl;
+    for (auto& entry : batch.requests) {
+        Request& request = entry.second;
+        if (subscribe) channels_.completeSubscribe(request.channel, success);
+        for (auto& cb : request.callbacks) {
+            if (cb) cb(success, message);
+        }
+    }
+}
+
+void SubscriptionAggregator::failAll(std::vector<Batch>& batches, const std::string& message) {
+    for (Batch& batch : batches) {
+        for (auto& entry : batch.requests) {
+            Request& request = entry.second;
+            if (batch.op == Operation::Subscribe) channels_.completeSubscribe(request.channel, false);
+            for (auto& cb : request.callbacks) {
+                if (cb) cb(false, message);
+            }
+        }
+    }
+}
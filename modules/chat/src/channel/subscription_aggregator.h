@@ -0,0 +1,114 @@
+#ifndef SUBSCRIPTION_AGGREGATOR_H
+#define SUBSCRIPTION_AGGREGATOR_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "channel_registry.h"
+
+struct SubscriptionAggregatorOptions {
+    // How long a request waits for others to join its batch
+    std::chrono::milliseconds window{50};
+    // Content topics per filter request; filter service nodes reject more
+    size_t maxTopicsPerRequest = 100;
+};
+
+// Batches filter subscribe/unsubscribe requests.
+//
+// join() and leave() queue a content topic and return immediately.
+// Requests arriving within one window are grouped by pubsub topic and
+// operation and sent as filterSubscribe/filterUnsubscribe calls of up to
+// maxTopicsPerRequest topics each; a batch that fills up is sent without
+// waiting for the window. A join and a leave of the same topic inside one
+// window cancel out and nothing is sent. Each request's callback gets the
+// result of the batch it went out in, and the channel registry is updated
+// accordingly. Requests still queued or waiting on the node when the
+// aggregator is destroyed are failed then.
+class SubscriptionAggregator {
+public:
+    using ResultCallback = std::function<void(bool success, const std::string& message)>;
+
+    explicit SubscriptionAggregator(ChannelRegistry& channels,
+                                    const SubscriptionAggregatorOptions& options = SubscriptionAggregatorOptions());
+    ~SubscriptionAggregator();
+
+    SubscriptionAggregator(const SubscriptionAggregator&) = delete;
+    SubscriptionAggregator& operator=(const SubscriptionAggregator&) = delete;
+
+    // Queue a subscription. Returns false if the channel is already
+    // subscribed or pending, in which case nothing is queued.
+    bool join(const std::string& contentTopic, const std::string& pubsubTopic, ResultCallback callback = nullptr);
+
+    // Queue an unsubscription. Delivery for the channel stops right away.
+    // Returns false if the channel was not joined.
+    bool leave(const std::string& contentTopic, const std::string& pubsubTopic, ResultCallback callback = nullptr);
+
+    // Send everything queued now instead of at the end of the window
+    void flush();
+
+    // Requests queued and not yet sent
+    size_t pending() const;
+
+    ChannelRegistry& channels() { return channels_; }
+
+private:
+    enum class Operation { Subscribe, Unsubscribe };
+
+    struct Request {
+        Operation op;
+        ChannelId channel;
+        std::vector<ResultCallback> callbacks;
+    };
+
+    struct Batch {
+        Operation op;
+        std::string pubsubTopic;
+        std::vector<std::pair<std::string, Request>> requests;  // content topic, request
+    };
+
+    // Requests of one pubsub topic, by content topic
+    struct Queue {
+        std::map<std::string, Request> requests;
+        size_t subscribes = 0;
+        size_t unsubscribes = 0;
+    };
+
+    // Shared with the filter callbacks, which may come back after the
+    // aggregator is gone; aggregator is cleared once it is being destroyed
+    struct Liveness {
+        std::mutex mutex;
+        SubscriptionAggregator* aggregator;
+    };
+
+    void enqueue(Operation op, ChannelId channel, const std::string& contentTopic,
+                 const std::string& pubsubTopic, ResultCallback callback);
+    std::vector<Batch> takeBatches(bool all);
+    void failAll(std::vector<Batch>& batches, const std::string& message);
+    void send(Batch batch);
+    void finish(uint64_t id, bool success, const std::string& message);
+    void complete(Batch& batch, bool success, const std::string& message);
+    void run();
+
+    ChannelRegistry& channels_;
+    const SubscriptionAggregatorOptions options_;
+    std::shared_ptr<Liveness> liveness_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::map<std::string, Queue> queues_;  // by pubsub topic
+    size_t queued_ = 0;
+    bool fullBatch_ = false;  // some queue has maxTopicsPerRequest of one kind
+    std::chrono::steady_clock::time_point deadline_;
+    std::map<uint64_t, Batch> sent_;  // waiting on the node, by batch id
+    uint64_t nextBatch_ = 1;
+    bool stopping_ = false;
+    std::thread worker_;
+};
+
+#endif // SUBSCRIPTION_AGGREGATOR_H
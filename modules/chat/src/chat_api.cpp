@@ -1,5 +1,9 @@
 #include "chat_api.h"
-#include <unordered_set> // Add for storing message hashes
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <QtCore/QDir>
+#include <QtCore/QStandardPaths>
 
 // Constants
 const std::string TOY_CHAT_CONTENT_TOPIC = "/toy-chat/2/huilong/proto";
@@ -7,13 +11,21 @@ const std::string DEFAULT_PUBSUB_TOPIC = "/waku/2/rs/16/32";
 const std::string STORE_NODE = "/dns4/store-01.do-ams3.status.staging.status.im/tcp/30303/p2p/16Uiu2HAm3xVDaz6SRJ6kErwC21zBJEZjavVXg7VSkoWzaV1aMA3F";
 const std::string CONTENT_TOPIC_PREFIX = "/toy-chat/2/";
 const std::string CONTENT_TOPIC_SUFFIX = "/proto";
+// Encoding of a channel's second content topic, carrying Chat2Batch payloads
+const std::string BATCH_CONTENT_TOPIC_SUFFIX = "/proto-batch";
+// Encoding of a channel's third content topic, carrying Chat2Chunk payloads
+const std::string CHUNK_CONTENT_TOPIC_SUFFIX = "/proto-chunk";
+// Encoding of a channel's fourth content topic, carrying latency probes
+const std::string PROBE_CONTENT_TOPIC_SUFFIX = "/proto-probe";
+// Payloads above this are chunked; the node's maxMessageSize is 1024 KiB
+const size_t MAX_UNCHUNKED_PAYLOAD = 512 * 1024;
+const size_t TRANSFER_CHUNK_SIZE = 256 * 1024;
+// Oldest history fetched for a channel with nothing stored locally (ns)
+const uint64_t HISTORY_TIME_START = 1744123537000000000ULL;
+const size_t HISTORY_PAGE_LIMIT = 100;
 
 // Global variables
 void* userData = nullptr;
-std::vector<std::string> subscribedChannels;
-
-// Set to store message hashes we've already processed
-std::unordered_set<std::string> processedMessageHashes;
 
 // Global app state
 AppState appState;
@@ -27,6 +39,80 @@ std::string formatContentTopic(const std::string& channelName) {
     return CONTENT_TOPIC_PREFIX + channelName + CONTENT_TOPIC_SUFFIX;
 }
 
+// Content topic for a channel name, passing already formatted topics through
+std::string channelContentTopic(const std::string& channelName) {
+    if (channelName.find("/toy-chat/") == std::string::npos) {
+        return formatContentTopic(channelName);
+    }
+    return channelName;
+}
+
+namespace {
+
+bool hasSuffix(const std::string& topic, const std::string& suffix) {
+    return topic.size() >= suffix.size() &&
+           topic.compare(topic.size() - suffix.size(), std::string::npos, suffix) == 0;
+}
+
+// Content topic of a channel with its plain suffix replaced
+std::string withSuffix(const std::string& contentTopic, const std::string& suffix) {
+    if (hasSuffix(contentTopic, CONTENT_TOPIC_SUFFIX)) {
+        return contentTopic.substr(0, contentTopic.size() - CONTENT_TOPIC_SUFFIX.size()) + suffix;
+    }
+    return contentTopic + suffix;
+}
+
+} // namespace
+
+// Batch content topic of a channel, from its plain content topic
+std::string batchContentTopic(const std::string& contentTopic) {
+    return withSuffix(contentTopic, BATCH_CONTENT_TOPIC_SUFFIX);
+}
+
+bool isBatchContentTopic(const std::string& contentTopic) {
+    return hasSuffix(contentTopic, BATCH_CONTENT_TOPIC_SUFFIX);
+}
+
+// Chunk content topic of a channel, from its plain content topic
+std::string chunkContentTopic(const std::string& contentTopic) {
+    return withSuffix(contentTopic, CHUNK_CONTENT_TOPIC_SUFFIX);
+}
+
+bool isChunkContentTopic(const std::string& contentTopic) {
+    return hasSuffix(contentTopic, CHUNK_CONTENT_TOPIC_SUFFIX);
+}
+
+// Probe content topic of a channel, from its plain content topic
+std::string probeContentTopic(const std::string& contentTopic) {
+    return withSuffix(contentTopic, PROBE_CONTENT_TOPIC_SUFFIX);
+}
+
+bool isProbeContentTopic(const std::string& contentTopic) {
+    return hasSuffix(contentTopic, PROBE_CONTENT_TOPIC_SUFFIX);
+}
+
+// Plain content topic of a channel, from its batch, chunk or probe content
+// topic
+std::string plainContentTopic(const std::string& topic) {
+    const std::string& suffix = isChunkContentTopic(topic)   ? CHUNK_CONTENT_TOPIC_SUFFIX
+                                : isProbeContentTopic(topic) ? PROBE_CONTENT_TOPIC_SUFFIX
+                                                             : BATCH_CONTENT_TOPIC_SUFFIX;
+    return topic.substr(0, topic.size() - suffix.size()) + CONTENT_TOPIC_SUFFIX;
+}
+
+// Directory of the local history store, LOGOS_CHAT_HISTORY_DIR overrides it
+std::string historyDirectory() {
+    const char* overrideDir = std::getenv("LOGOS_CHAT_HISTORY_DIR");
+    if (overrideDir != nullptr && overrideDir[0] != '\0') {
+        return overrideDir;
+    }
+    QString base = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation);
+    if (base.isEmpty()) {
+        base = QDir::currentPath();
+    }
+    return QDir::cleanPath(base + "/chat_history").toStdString();
+}
+
 // Get the current UTC timestamp in seconds
 uint64_t getCurrentTimestampProto() {
   using namespace std::chrono;
@@ -42,22 +128,6 @@ std::string formatTimestampProto(uint64_t timestamp) {
   return ss.str();
 }
 
-// Create a new Chat2Message
-chat::Chat2Message createMessage(const std::string& nick, const std::string& message) {
-  chat::Chat2Message chat_msg;
-  chat_msg.set_timestamp(getCurrentTimestampProto());
-  chat_msg.set_nick(nick);
-  chat_msg.set_payload(message);
-  return chat_msg;
-}
-
-// Print a Chat2Message
-void printMessage(const chat::Chat2Message& message) {
-  std::cout << "Timestamp: " << formatTimestampProto(message.timestamp()) << std::endl;
-  std::cout << "Nick: " << message.nick() << std::endl;
-  std::cout << "Message: " << message.payload() << std::endl;
-}
-
 // Create a string from a vector of bytes
 std::string bytesToStringProto(const std::vector<uint8_t>& bytes) {
   std::string result;
@@ -69,23 +139,27 @@ std::string bytesToStringProto(const std::vector<uint8_t>& bytes) {
 }
 
 // Decode a binary payload into a DecodedMessage
-DecodedMessage decodeProto(const std::vector<uint8_t>& payload) {
+DecodedMessage decodeProto(const uint8_t* data, size_t size) {
   DecodedMessage result;
   result.success = false;
   
-  std::string binary_data(payload.begin(), payload.end());
-  chat::Chat2Message message;
-  
-  if (message.ParseFromString(binary_data)) {
+  // Decompressed payloads land here; kept per thread so it is reused
+  thread_local std::vector<uint8_t> scratch;
+  chat::Chat2MessageView message;
+  if (appState.compression.decode(data, size, message, scratch)) {
     result.success = true;
-    result.timestamp = formatTimestampProto(message.timestamp());
-    result.nick = message.nick();
-    result.payload = message.payload();
+    result.timestamp = formatTimestampProto(message.timestamp);
+    result.nick.assign(message.nick.data(), message.nick.size());
+    result.payload.assign(message.payload.data(), message.payload.size());
   }
   
   return result;
 }
 
+DecodedMessage decodeProto(const std::vector<uint8_t>& payload) {
+  return decodeProto(payload.data(), payload.size());
+}
+
 // Print a decoded message
 void printDecodedMessage(const DecodedMessage& message, const std::vector<uint8_t>& originalPayload) {
   if (message.success) {
@@ -126,45 +200,70 @@ void storeQueryCallback(int callerRet, const char* msg, size_t len, void* userDa
 
     // Get the message callback from the context
     StoreQueryContext* context = static_cast<StoreQueryContext*>(userData);
-    MessageCallback callback = nullptr;
+    ChatMessageCallback callback = nullptr;
+    std::string contentTopic;
     if (context != nullptr) {
         callback = context->callback;
+        contentTopic = context->contentTopic;
     }
 
     if (callerRet == RET_OK && msg != nullptr && len > 0) {
-        std::string jsonStr(msg, len);
-        // Find all payloads in the JSON
-        size_t pos = 0;
+        // Walk the response once, decoding messages as they are found.
+        // The decoder is kept per thread so its buffers are reused across pages.
+        thread_local StoreResponseDecoder decoder;
+        decoder.setCompressor(&appState.compression);
+        decoder.reset(msg, len);
+
+        StoreMessage storeMsg;
         size_t messageCount = 0;
-        while ((pos = jsonStr.find("\"payload\":[", pos)) != std::string::npos) {
+        size_t failedCount = 0;
+        size_t knownCount = 0;
+        uint64_t newestEnvelope = 0;  // pages are in time order, so all before it has been seen
+        while (decoder.next(storeMsg)) {
             messageCount++;
-            pos += 11; // Skip "payload":[ part
-            // Find end of payload array
-            size_t endPos = jsonStr.find("]", pos);
-            if (endPos != std::string::npos) {
-                std::string payloadStr = jsonStr.substr(pos, endPos - pos);
-                std::cout << "Raw payload " << messageCount << ": [" << payloadStr << "]" << std::endl;
-                // Convert payload string to vector of bytes
-                std::vector<uint8_t> payloadBytes;
-                std::stringstream ss(payloadStr);
-                std::string numberStr;
-                while (std::getline(ss, numberStr, ',')) {
-                    payloadBytes.push_back(static_cast<uint8_t>(std::stoi(numberStr)));
+            newestEnvelope = std::max(newestEnvelope, storeMsg.envelopeTimestamp);
+            uint64_t envelope = storeMsg.envelopeTimestamp;
+            bool unpacked = unpackStoreMessage(storeMsg, [&](const std::string& key, const uint8_t* data, size_t size,
+                                                             const chat::Chat2MessageView& decoded) {
+                // Keep the message locally; anything already stored has
+                // been delivered from the local history
+                if (!contentTopic.empty() && !key.empty() && appState.history.contains(contentTopic, key)) {
+                    knownCount++;
+                    return;
+                }
+                uint64_t timestamp = envelope != 0 ? envelope : decoded.timestamp * 1000000000ULL;
+                RecentMessagePtr message = std::make_shared<const RecentMessage>(
+                    key, timestamp, decoded.timestamp, decoded.nick, decoded.payload);
+                if (!contentTopic.empty()) {
+                    appState.history.append(contentTopic, key, timestamp, data, size);
+                    appState.recent.add(contentTopic, message);
+                    appState.search.add(contentTopic, key, timestamp, message->text());
+                    appState.analytics.record(contentTopic, message->nick(), timestamp);
                 }
-                // Decode the payload
-                std::cout << "Attempting to decode payload " << messageCount << ":" << std::endl;
-                auto decodedMsg = decodeProto(payloadBytes);
-                printDecodedMessage(decodedMsg, payloadBytes);
-                
-                // Call the user callback if provided and message was decoded successfully
-                if (callback && decodedMsg.success) {
-                    callback(decodedMsg.timestamp, decodedMsg.nick, decodedMsg.payload);
+                // Call the user callback if provided
+                if (callback) {
+                    callback(ChatMessageRef(std::move(message)));
                 }
-                
-                std::cout << "----------------------------------------" << std::endl;
+            });
+            if (!unpacked) failedCount++;
+        }
+        if (decoder.failed()) {
+            std::cerr << "Malformed store query response after " << messageCount << " messages" << std::endl;
+        }
+        std::cout << "Total messages found: " << messageCount << " (" << failedCount << " failed to decode, "
+                  << knownCount << " already stored)" << std::endl;
+
+        // Messages relayed meanwhile don't count as synced, only what the
+        // store node returned does. Ask for the next page until there is none.
+        if (context != nullptr && context->sync && !decoder.failed()) {
+            if (newestEnvelope != 0) {
+                appState.history.setSyncedUntil(contentTopic, newestEnvelope);
+            }
+            std::string cursor(decoder.paginationCursor());
+            if (!cursor.empty() && messageCount > 0 && sendHistoryQuery(context, cursor)) {
+                return;
             }
         }
-        std::cout << "Total messages found: " << messageCount << std::endl;
     }
     else if (callerRet != RET_OK) {
         std::cerr << "Store query error: " << callerRet;
@@ -180,135 +279,290 @@ void storeQueryCallback(int callerRet, const char* msg, size_t len, void* userDa
     }
 }
 
-// Event handler for incoming messages
+// The content topics a channel publishes on, quoted and comma separated,
+// for the content_topics of a store query
+std::string historyContentTopics(const std::string& contentTopic) {
+    return "\"" + contentTopic + "\",\"" + batchContentTopic(contentTopic) + "\",\"" +
+           chunkContentTopic(contentTopic) + "\"";
+}
+
+// Hand out the chat messages of a store query result by the content topic
+// it was published on: the message itself, every message of a batch, or a
+// transfer's payload once its last chunk is in. Keys are the ones the
+// channel actors give them, so a message relayed and also read from the
+// store is stored once. Returns false if the result doesn't decode.
+bool unpackStoreMessage(const StoreMessage& stored, const StoredMessageCallback& onMessage) {
+    std::string topic(stored.contentTopic);
+    std::string messageHash(stored.messageHash);
+    thread_local std::vector<uint8_t> scratch;  // decompressed payloads
+
+    if (isBatchContentTopic(topic)) {
+        chat::Chat2BatchView batch;
+        if (!proto::decode(stored.payload, stored.payloadSize, batch)) return false;
+        bool ok = true;
+        for (size_t i = 0; i < batch.messages.size(); ++i) {
+            const uint8_t* inner = reinterpret_cast<const uint8_t*>(batch.messages[i].data());
+            chat::Chat2MessageView decoded;
+            if (!appState.compression.decode(inner, batch.messages[i].size(), decoded, scratch)) {
+                ok = false;
+                continue;
+            }
+            std::string key = messageHash.empty() ? std::string() : messageHash + ":" + std::to_string(i);
+            onMessage(key, inner, batch.messages[i].size(), decoded);
+        }
+        return ok;
+    }
+
+    if (isChunkContentTopic(topic)) {
+        std::vector<uint8_t> payload;
+        std::string transfer;
+        switch (appState.transfers.add(plainContentTopic(topic), stored.payload, stored.payloadSize, payload,
+                                       transfer)) {
+            case ChunkResult::Complete:
+                break;
+            case ChunkResult::Invalid:
+                return false;
+            default:
+                return true;
+        }
+        chat::Chat2MessageView decoded;
+        if (!appState.compression.decode(payload.data(), payload.size(), decoded, scratch)) return false;
+        onMessage(transferMessageKey(transfer), payload.data(), payload.size(), decoded);
+        return true;
+    }
+
+    // The decoder has already read a plain message
+    if (!stored.decoded) return false;
+    chat::Chat2MessageView decoded;
+    decoded.timestamp = stored.timestamp;
+    decoded.nick = stored.nick;
+    decoded.payload = stored.text;
+    onMessage(messageHash, stored.payload, stored.payloadSize, decoded);
+    return true;
+}
+
+// Deliver a message an actor has decoded. Runs on a worker thread.
+void deliverChannelMessage(const InboundMessage& message, const RecentMessagePtr& decoded) {
+    appState.search.add(message.contentTopic, decoded->messageHash(), decoded->envelopeTimestamp(), decoded->text());
+    appState.analytics.record(message.contentTopic, decoded->nick(), decoded->envelopeTimestamp());
+    appState.listeners.deliver(decoded);
+}
+
+uint64_t MessageListeners::add(ChatMessageCallback callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto list = std::make_shared<List>(*listeners_);
+    uint64_t id = nextId_++;
+    list->emplace_back(id, std::move(callback));
+    listeners_ = std::move(list);
+    return id;
+}
+
+bool MessageListeners::remove(uint64_t id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto list = std::make_shared<List>(*listeners_);
+    auto it = std::find_if(list->begin(), list->end(),
+                           [id](const List::value_type& listener) { return listener.first == id; });
+    if (it == list->end()) return false;
+    list->erase(it);
+    listeners_ = std::move(list);
+    return true;
+}
+
+void MessageListeners::deliver(const RecentMessagePtr& message) const {
+    std::shared_ptr<const List> listeners;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        listeners = listeners_;
+    }
+    if (listeners->empty()) return;
+    ChatMessageRef ref(message);
+    for (const auto& listener : *listeners) listener.second(ref);
+}
+
+// Adapt a MessageCallback to ChatMessageRefs. It gets its own strings,
+// as before.
+ChatMessageCallback toChatMessageCallback(MessageCallback callback) {
+    if (!callback) return nullptr;
+    return [callback](const ChatMessageRef& message) {
+        callback(std::string(message.timestamp()), std::string(message.nick()), std::string(message.payload()));
+    };
+}
+
+EventHandlerContext::EventHandlerContext(ChannelRegistry* registry) : channels(registry) {
+    actors = std::make_unique<ChannelActors>(
+        [](const InboundMessage& message, const RecentMessagePtr& decoded) {
+            deliverChannelMessage(message, decoded);
+        },
+        &appState.history, ChannelActorOptions(), &appState.compression, &appState.transfers, &appState.recent,
+        [this](const InboundMessage& message, std::string_view nick) {
+            return channels == nullptr || admitReceived(*channels, message.channel, nick);
+        });
+}
+
+// Whether the receive limits let a message of nick on channel through;
+// counted as dropped if not
+bool admitReceived(ChannelRegistry& channels, ChannelId channel, std::string_view nick) {
+    ReceiveLimits limits;
+    if (!channels.receiveLimits(channel, limits)) limits = appState.limiter.defaults();
+    if (appState.limiter.allow(channel, nick, limits)) return true;
+    channels.recordDropped(channel);
+    return false;
+}
+
+// Value of a string field in an event, empty if absent
+std::string jsonStringField(const std::string& jsonStr, const std::string& key) {
+    size_t keyPos = jsonStr.find("\"" + key + "\":\"");
+    if (keyPos == std::string::npos) return std::string();
+    size_t valueStart = keyPos + key.size() + 4;
+    size_t valueEnd = jsonStr.find("\"", valueStart);
+    if (valueEnd == std::string::npos) return std::string();
+    return jsonStr.substr(valueStart, valueEnd - valueStart);
+}
+
+// Event handler for incoming messages. Runs on the libwaku thread, so it
+// only picks out what is needed to route the message; dedupe, decoding and
+// storage happen on the channel's actor.
 void event_handler(int callerRet, const char* msg, size_t len, void* userData) {
     if (msg == nullptr) {
         std::cerr << "event_handler received null message" << std::endl;
         return;
     }
-    
-    std::string jsonStr(msg);
-    
-    // Check for message hash to avoid duplicates
-    size_t hashPos = jsonStr.find("\"messageHash\":");
-    if (hashPos != std::string::npos) {
-        size_t hashStart = jsonStr.find("\"", hashPos + 14) + 1;
-        size_t hashEnd = jsonStr.find("\"", hashStart);
-        if (hashStart != std::string::npos && hashEnd != std::string::npos) {
-            std::string messageHash = jsonStr.substr(hashStart, hashEnd - hashStart);
-            
-            // If we've already processed this message, skip it
-            if (processedMessageHashes.find(messageHash) != processedMessageHashes.end()) {
-                std::cout << "Skipping duplicate message with hash: " << messageHash << std::endl;
+
+    EventHandlerContext* context = static_cast<EventHandlerContext*>(userData);
+    if (context == nullptr || context->channels == nullptr || context->actors == nullptr) {
+        return;
+    }
+
+    std::string jsonStr(msg, len);
+
+    // Only process messages for one of our subscribed channels
+    std::string contentTopic = jsonStringField(jsonStr, "contentTopic");
+    if (contentTopic.empty()) {
+        return;
+    }
+    ChannelId channelId = context->channels->subscribed(contentTopic);
+    if (channelId == kNoChannel) {
+        return;
+    }
+    if (isProbeContentTopic(contentTopic)) {
+        receiveProbe(plainContentTopic(contentTopic), jsonStringField(jsonStr, "payload"));
+        return;
+    }
+
+    InboundMessage message;
+    message.channel = channelId;
+    if (isBatchContentTopic(contentTopic) || isChunkContentTopic(contentTopic)) {
+        // Unpacked by the actor of the plain topic, so the channel's batched
+        // and single messages stay in one order
+        message.batched = isBatchContentTopic(contentTopic);
+        message.chunk = !message.batched;
+        contentTopic = plainContentTopic(contentTopic);
+        ChannelId plainId = context->channels->find(contentTopic);
+        if (plainId != kNoChannel) {
+            message.channel = plainId;
+        }
+    }
+    message.contentTopic = std::move(contentTopic);
+    message.messageHash = jsonStringField(jsonStr, "messageHash");
+    message.payload = jsonStringField(jsonStr, "payload");
+    size_t tsPos = jsonStr.find("\"timestamp\":");
+    if (tsPos != std::string::npos) {
+        message.timestamp = std::strtoull(jsonStr.c_str() + tsPos + 12, nullptr, 10);
+    }
+    if (message.timestamp == 0) {
+        message.timestamp = getCurrentTimestampProto() * 1000000000ULL;
+    }
+    context->channels->recordReceived(message.channel, message.timestamp);
+
+    // A flooding sender is turned away here, before its message is decoded.
+    // Batches and transfers, and nicks that don't fit in the start of the
+    // payload, are limited by the actor once decoded.
+    if (!message.batched && !message.chunk) {
+        std::string nick;
+        if (peekSender(message.payload, nick)) {
+            if (!admitReceived(*context->channels, message.channel, nick)) {
                 return;
             }
-            
-            // Otherwise, add it to our set of processed hashes
-            processedMessageHashes.insert(messageHash);
-            std::cout << "Processing new message with hash: " << messageHash << std::endl;
+            message.admitted = true;
         }
     }
 
-    // Debug log the message
-    std::cout << "event_handler called with callerRet: " << callerRet << std::endl;
-    
+    context->actors->post(std::move(message));
+}
 
-    EventHandlerContext* context = static_cast<EventHandlerContext*>(userData);
-    MessageCallback callback = nullptr;
-    if (context != nullptr) {
-        callback = context->callback;
+// Time a latency probe pushed back to us. Probes are small and few, so
+// they are decoded right here rather than on an actor.
+void receiveProbe(const std::string& contentTopic, const std::string& payload) {
+    uint64_t now = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    std::vector<uint8_t> bytes;
+    chat::Chat2MessageView decoded;
+    if (!base64Decode(payload, bytes) || !proto::decode(bytes.data(), bytes.size(), decoded)) {
+        return;
     }
+    appState.probe.received(contentTopic, decoded.nick, decoded.payload, false, now);
+}
 
-    // Check if the message contains "contentTopic" field
-    size_t contentTopicPos = jsonStr.find("\"contentTopic\":");
-    if (contentTopicPos != std::string::npos) {
-        // Find the start and end of the content topic value
-        size_t valueStart = jsonStr.find("\"", contentTopicPos + 14) + 1;
-        size_t valueEnd = jsonStr.find("\"", valueStart);
-        if (valueStart != std::string::npos && valueEnd != std::string::npos) {
-            std::string contentTopic = jsonStr.substr(valueStart, valueEnd - valueStart);
-
-            // Check if the content topic is in our list of subscribed channels
-            bool isSubscribed = false;
-            for (const auto& channel : subscribedChannels) {
-                if (contentTopic == channel) {
-                    isSubscribed = true;
-                    break;
-                }
-            }
+// Ask the store node for the probes sent on contentTopics since then (ns)
+// and time the ones found
+void queryProbeStore(const std::vector<std::string>& contentTopics, uint64_t since) {
+    WakuInterface* wakuPlugin = PluginRegistry::getPlugin<WakuInterface>(wakuPluginName());
+    if (!wakuPlugin || contentTopics.empty()) {
+        return;
+    }
+    std::string topics;
+    for (const std::string& contentTopic : contentTopics) {
+        topics += (topics.empty() ? "\"" : ",\"") + probeContentTopic(contentTopic) + "\"";
+    }
+    std::string queryJson = R"({
+        "request_id": "latency-probe",
+        "include_data": true,
+        "content_topics": [)" + topics + R"(],
+        "time_start": )" + std::to_string(since) + R"(,
+        "pagination_forward": true,
+        "pagination_limit": )" + std::to_string(HISTORY_PAGE_LIMIT) + R"(
+    })";
 
-            // Only process if the content topic matches one of our subscribed channels
-            if (isSubscribed) {
-                std::cout << "\nReceived message with matching content topic: " << contentTopic << std::endl;
-                // Extract the payload
-                size_t payloadPos = jsonStr.find("\"payload\":\"");
-                if (payloadPos != std::string::npos) {
-                    size_t payloadStart = payloadPos + 11; // Skip "payload":"
-                    size_t payloadEnd = jsonStr.find("\"", payloadStart);
-                    if (payloadStart != std::string::npos && payloadEnd != std::string::npos) {
-                        std::string encodedPayload = jsonStr.substr(payloadStart, payloadEnd - payloadStart);
-                        std::cout << "Encoded payload: " << encodedPayload << std::endl;
-                        // Decode the base64 payload
-                        std::vector<uint8_t> decodedBytes = base64Decode(encodedPayload);
-                        // Decode the protobuf message
-                        std::cout << "Decoding protobuf payload:" << std::endl;
-                        auto decodedMsg = decodeProto(decodedBytes);
-                        printDecodedMessage(decodedMsg, decodedBytes);
-                        
-                        // Call the user callback if provided and message was decoded successfully
-                        if (callback && decodedMsg.success) {
-                            callback(decodedMsg.timestamp, decodedMsg.nick, decodedMsg.payload);
-                        }
-                    }
+    wakuPlugin->storeQuery(
+        QString::fromStdString(queryJson),
+        QString::fromStdString(STORE_NODE),
+        30000,  // timeout in ms
+        [](bool success, const QString &message) {
+            if (!success || message.isEmpty()) {
+                std::cerr << "Latency probe store query failed" << std::endl;
+                return;
+            }
+            uint64_t now = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count());
+            std::string response = message.toStdString();
+            StoreResponseDecoder decoder(response.data(), response.size());
+            StoreMessage storeMsg;
+            while (decoder.next(storeMsg)) {
+                std::string contentTopic(storeMsg.contentTopic);
+                if (storeMsg.decoded && isProbeContentTopic(contentTopic)) {
+                    appState.probe.received(plainContentTopic(contentTopic), storeMsg.nick, storeMsg.text, true, now);
                 }
             }
         }
-    }
+    );
 }
 
-// Base64 decoding function
-std::vector<uint8_t> base64Decode(const std::string& encoded) {
-    std::string base64_chars =
-        "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-        "abcdefghijklmnopqrstuvwxyz"
-        "0123456789+/";
-    std::vector<uint8_t> decoded;
-    int val = 0, valb = -8;
-    for (char c : encoded) {
-        if (c == '=') break;
-        size_t pos = base64_chars.find(c);
-        if (pos == std::string::npos) continue;
-        val = (val << 6) + static_cast<int>(pos);
-        valb += 6;
-        if (valb >= 0) {
-            decoded.push_back(static_cast<uint8_t>((val >> valb) & 0xFF));
-            valb -= 8;
-        }
+// Base64 decoding function, false if encoded is not valid base64
+bool base64Decode(const std::string& encoded, std::vector<uint8_t>& decoded) {
+    decoded.resize(base64::decodedMaxSize(encoded.size()));
+    size_t size = 0;
+    if (!base64::decode(encoded.data(), encoded.size(), decoded.data(), size)) {
+        decoded.clear();
+        return false;
     }
-    return decoded;
+    decoded.resize(size);
+    return true;
 }
 
 // Base64 encoding function
 std::string base64Encode(const std::vector<uint8_t>& data) {
-    std::string base64_chars =
-        "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-        "abcdefghijklmnopqrstuvwxyz"
-        "0123456789+/";
-    std::string encoded;
-    int val = 0, valb = -6;
-    for (uint8_t c : data) {
-        val = (val << 8) + c;
-        valb += 8;
-        while (valb >= 0) {
-            encoded.push_back(base64_chars[(val >> valb) & 0x3F]);
-            valb -= 6;
-        }
-    }
-    if (valb > -6)
-        encoded.push_back(base64_chars[((val << 8) >> (valb + 8)) & 0x3F]);
-    // Add padding
-    while (encoded.size() % 4)
-        encoded.push_back('=');
+    std::string encoded(base64::encodedSize(data.size()), '\0');
+    base64::encode(data.data(), data.size(), encoded.data());
     return encoded;
 }
 
@@ -325,58 +579,41 @@ bool encodeProto(const ChatMessage& msg, std::vector<uint8_t>& output) {
     return true;
 }
 
-// Function to send a message
-void sendMessage(void* wakuCtx, const std::string& channelName, const std::string& username, const std::string& message) {
-    // Format the channel name into a content topic if not already formatted
-    std::string contentTopic = channelName;
-    if (channelName.find("/toy-chat/") == std::string::npos) {
-        contentTopic = formatContentTopic(channelName);
-    }
-    
-    std::cout << "Sending message to channel: " << channelName << std::endl;
-    std::cout << "Using content topic: " << contentTopic << std::endl;
-
-    // Get waku plugin (if available)
-    WakuInterface* wakuPlugin = PluginRegistry::getPlugin<WakuInterface>("waku");
-
-    // Create a new chat message
-    ChatMessage chatMsg = createChatMessage(username, message);
-    // Encode the message
-    std::vector<uint8_t> encodedBytes = chatMsg.serialize();
-    if (encodedBytes.empty()) {
-        std::cerr << "Failed to encode message" << std::endl;
-        return;
+// Build the Waku message JSON carrying payload on contentTopic, stamped
+// with timestamp (ns) or, if 0, the current time
+std::string buildEnvelopeJson(const std::string& contentTopic, const std::vector<uint8_t>& payload,
+                              uint64_t timestamp) {
+    if (timestamp == 0) {
+        timestamp = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
     }
     // Base64 encode the payload
-    std::string base64Payload = base64Encode(encodedBytes);
+    std::string base64Payload = base64Encode(payload);
     // Create the Waku message JSON
-    std::string messageJson = R"({
+    return R"({
         "payload": ")" + base64Payload + R"(",
         "contentTopic": ")" + contentTopic + R"(",
         "version": 1,
-        "timestamp": )" + std::to_string(std::chrono::duration_cast<std::chrono::nanoseconds>(
-            std::chrono::system_clock::now().time_since_epoch()).count()) + R"(,
+        "timestamp": )" + std::to_string(timestamp) + R"(,
         "ephemeral": false
     })";
-    std::cout << "Sending message as " << username << ": " << message << std::endl;
-    std::cout << "Message JSON: " << messageJson << std::endl;
-
-    // Publish using the waku plugin
-    if (wakuPlugin) {
-        wakuPlugin->relayPublish(
-            QString::fromStdString(DEFAULT_PUBSUB_TOPIC),
-            QString::fromStdString(messageJson),
-            30000,  // timeout in ms
-            [username, message](bool success, const QString &responseMsg) {
-                std::cout << "Waku Plugin relay publish result for message from " << username << ": " 
-                          << (success ? "Success" : "Failed") << " - " << responseMsg.toStdString() << std::endl;
-            }
-        );
+}
+
+// Build the Waku message JSON for a chat message, empty if encoding fails
+std::string buildMessageJson(const std::string& contentTopic, const std::string& username, const std::string& message) {
+    // Create a new chat message
+    ChatMessage chatMsg = createChatMessage(username, message);
+    // Encode the message, compressing it if that is enabled
+    std::vector<uint8_t> encodedBytes = chatMsg.serialize(appState.compression, contentTopic);
+    if (encodedBytes.empty()) {
+        std::cerr << "Failed to encode message" << std::endl;
+        return std::string();
     }
+    return buildEnvelopeJson(contentTopic, encodedBytes);
 }
 
 // Function to initialize and start a Waku node
-void* initAndStart(const std::string& relayTopic, MessageCallback messageCallback) {
+void* initAndStart(const std::string& relayTopic, MessageCallback messageCallback, ChannelRegistry* channels) {
     // Create appropriate Waku config
     std::string configStr = R"({
         "host": "0.0.0.0",
@@ -397,8 +634,22 @@ void* initAndStart(const std::string& relayTopic, MessageCallback messageCallbac
 
     std::cout << "Waku node config: " << configStr << std::endl;
 
+    // Open the local history store so channel joins can be served from disk.
+    // Messages it expires or finds unreadable are no longer searchable.
+    std::string historyDir = historyDirectory();
+    appState.history.setExpiredCallback([](const std::string& contentTopic, const std::vector<std::string>& messageHashes) {
+        appState.search.remove(contentTopic, messageHashes);
+    });
+    if (appState.history.open(historyDir)) {
+        std::cout << "Local history store: " << historyDir << std::endl;
+    } else {
+        std::cerr << "Failed to open local history store at " << historyDir << ", history will not be kept" << std::endl;
+    }
+    // Chunked payloads cut short by a restart are picked up from here
+    appState.transfers.open(historyDir + "/transfers");
+
     // Get waku plugin
-    WakuInterface* wakuPlugin = PluginRegistry::getPlugin<WakuInterface>("waku");
+    WakuInterface* wakuPlugin = PluginRegistry::getPlugin<WakuInterface>(wakuPluginName());
     if (!wakuPlugin) {
         std::cerr << "Failed to get Waku plugin" << std::endl;
         return nullptr;
@@ -415,8 +666,12 @@ void* initAndStart(const std::string& relayTopic, MessageCallback messageCallbac
 
     std::this_thread::sleep_for(std::chrono::seconds(3));
 
+    if (messageCallback) {
+        appState.listeners.add(toChatMessageCallback(messageCallback));
+    }
+
     // Create event handler context
-    EventHandlerContext* context = new EventHandlerContext(messageCallback);
+    EventHandlerContext* context = new EventHandlerContext(channels);
 
     wakuPlugin->setEventCallback([context](const QString &event) {
         // Convert QString to std::string
@@ -448,98 +703,207 @@ void* initAndStart(const std::string& relayTopic, MessageCallback messageCallbac
     return (void*)1;
 }
 
-// Function to join a chat channel
-bool joinChannel(void* wakuCtx, const std::string& channelName, const std::string& relayTopic) {
+// Function to join a chat channel. The subscriptions are batched with other
+// joins and leaves of the same window.
+bool joinChannel(void* wakuCtx, const std::string& channelName, const std::string& relayTopic, SubscriptionAggregator& subscriptions) {
     // Format the channel name into a content topic if not already formatted
-    std::string contentTopic = channelName;
-    if (channelName.find("/toy-chat/") == std::string::npos) {
-        contentTopic = formatContentTopic(channelName);
-    }
+    std::string contentTopic = channelContentTopic(channelName);
 
     std::cout << "Joining channel: " << channelName << std::endl;
-    std::cout << "Subscribing to content topic: " << contentTopic << std::endl;
 
-    // Get waku plugin
-    WakuInterface* wakuPlugin = PluginRegistry::getPlugin<WakuInterface>("waku");
-    if (!wakuPlugin) {
-        std::cerr << "Failed to get Waku plugin" << std::endl;
-        return false;
+    // Before any message of the channel comes in, so none is indexed twice
+    indexLocalHistory(contentTopic);
+
+    // Messages arrive on the plain topic, from batching senders on the batch
+    // topic and, if too large for one Waku message, on the chunk topic. The
+    // probe topic is only subscribed while the latency probe runs.
+    bool queued = false;
+    for (const std::string& topic : {contentTopic, batchContentTopic(contentTopic), chunkContentTopic(contentTopic)}) {
+        queued |= subscriptions.join(topic, relayTopic,
+            [topic](bool success, const std::string& message) {
+                std::cout << "Filter subscribe result for " << topic << ": "
+                          << (success ? "Success" : "Failed") << " - " << message << std::endl;
+            });
+    }
+    if (!queued) {
+        std::cout << "Already joined content topic: " << contentTopic << std::endl;
+        return true;
     }
 
-    std::string contentTopics = "[\"" + contentTopic + "\"]";
-    // Call filterSubscribe on the waku plugin
-    wakuPlugin->filterSubscribe(
-        QString::fromStdString(relayTopic),
-        QString::fromStdString(contentTopics),
-        [contentTopic](bool success, const QString &message) {
-            std::cout << "Waku Plugin filter subscribe result for " << contentTopic << ": " 
-                      << (success ? "Success" : "Failed") << " - " << message.toStdString() << std::endl;
-            if (success) {
-                subscribedChannels.push_back(contentTopic);
-            }
-        }
-    );
-    
+    std::cout << "Subscribing to content topic: " << contentTopic << std::endl;
     return true;
 }
 
-// Function to retrieve message history from store node
-void retrieveHistory(void* wakuCtx, const std::string& channelName, MessageCallback callback) {
-    // Format the channel name into a content topic if not already formatted
-    std::string contentTopic = channelName;
-    if (channelName.find("/toy-chat/") == std::string::npos) {
-        contentTopic = formatContentTopic(channelName);
+// Function to leave a chat channel
+bool leaveChannel(void* wakuCtx, const std::string& channelName, const std::string& relayTopic, SubscriptionAggregator& subscriptions) {
+    std::string contentTopic = channelContentTopic(channelName);
+
+    // Stops delivering messages right away, whatever the node answers
+    bool queued = false;
+    for (const std::string& topic : {contentTopic, batchContentTopic(contentTopic), chunkContentTopic(contentTopic)}) {
+        queued |= subscriptions.leave(topic, relayTopic,
+            [topic](bool success, const std::string& message) {
+                std::cout << "Filter unsubscribe result for " << topic << ": "
+                          << (success ? "Success" : "Failed") << " - " << message << std::endl;
+            });
+    }
+    if (!queued) {
+        std::cout << "Not subscribed to content topic: " << contentTopic << std::endl;
+        return false;
     }
-    
-    std::cout << "Retrieving message history for channel: " << channelName << std::endl;
-    std::cout << "Using content topic: " << contentTopic << std::endl;
 
-    // Get waku plugin
-    WakuInterface* wakuPlugin = PluginRegistry::getPlugin<WakuInterface>("waku");
+    std::cout << "Leaving channel: " << channelName << std::endl;
+    return true;
+}
+
+// Ask the store node for a page of a channel's history from
+// context->timeStart on, continuing at cursor unless it is empty. The
+// context is handed to storeQueryCallback, or deleted if nothing was sent.
+bool sendHistoryQuery(StoreQueryContext* context, const std::string& cursor) {
+    WakuInterface* wakuPlugin = PluginRegistry::getPlugin<WakuInterface>(wakuPluginName());
     if (!wakuPlugin) {
         std::cerr << "Failed to get Waku plugin" << std::endl;
-        return;
+        delete context;
+        return false;
     }
 
-    // Calculate timestamp for 24 hours ago (in nanoseconds)
-    uint64_t oneDay = 60 * 60 * 24;
-    auto now = std::chrono::system_clock::now();
-    auto nowSeconds = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
-    uint64_t timeStart = (nowSeconds - oneDay) * 1000000000ULL; // Convert to nanoseconds
-
-   std::string queryJson = R"({
+    std::string queryJson = R"({
        "request_id": "15be8c48-55ce-4bf2-a34-8813d4da2dec",
        "include_data": true,
-       "content_topics": [")" + contentTopic + R"("],
-       "time_start": 1744123537000000000,
-       "pagination_forward": true,
-       "pagination_limit": 100
+       "content_topics": [)" + historyContentTopics(context->contentTopic) + R"(],
+       "time_start": )" + std::to_string(context->timeStart) + R"(,
+       "pagination_forward": true,)";
+    if (!cursor.empty()) {
+        queryJson += R"(
+       "pagination_cursor": ")" + cursor + R"(",)";
+    }
+    queryJson += R"(
+       "pagination_limit": )" + std::to_string(HISTORY_PAGE_LIMIT) + R"(
    })";
 
     std::cout << "Query JSON: " << queryJson.c_str() << std::endl;
 
-    // Create a context to hold the callback
-    StoreQueryContext* context = new StoreQueryContext(callback);
-    
     // Pass the main storeQueryCallback to the waku plugin
+    std::string contentTopic = context->contentTopic;
     wakuPlugin->storeQuery(
         QString::fromStdString(queryJson),
         QString::fromStdString(STORE_NODE),
         30000,  // timeout in ms
-        [context, channelName](bool success, const QString &message) {
-            std::cout << "Waku Plugin store query response for channel " << channelName << std::endl;
+        [context, contentTopic](bool success, const QString &message) {
+            std::cout << "Waku Plugin store query response for " << contentTopic << std::endl;
             if (success && !message.isEmpty()) {
                 // Convert QString to std::string and call storeQueryCallback
                 std::string messageStr = message.toStdString();
                 storeQueryCallback(RET_OK, messageStr.c_str(), messageStr.length(), context);
             } else {
                 std::cout << "Waku Plugin store query failed or returned empty response" << std::endl;
-                if (context != nullptr) {
-                    delete context; // Clean up the context
-                }
+                delete context;
             }
         }
     );
+    return true;
+}
+
+// Add what the local history holds for a channel to the search index,
+// the first time the channel is joined in this run
+void indexLocalHistory(const std::string& contentTopic) {
+    {
+        std::lock_guard<std::mutex> lock(appState.indexedMutex);
+        if (!appState.indexedTopics.insert(contentTopic).second) return;
+    }
+    thread_local std::vector<uint8_t> scratch;  // decompressed payloads
+    size_t indexed = 0;
+    for (const HistoryRecord& record :
+         appState.history.readRecent(contentTopic, appState.history.messageCount(contentTopic))) {
+        chat::Chat2MessageView decoded;
+        if (record.messageHash.empty() ||
+            !appState.compression.decode(record.payload.data(), record.payload.size(), decoded, scratch)) {
+            continue;
+        }
+        appState.search.add(contentTopic, record.messageHash, record.timestamp, decoded.payload);
+        indexed++;
+    }
+    if (indexed > 0) {
+        std::cout << "Indexed " << indexed << " messages of " << contentTopic << " from local history" << std::endl;
+    }
+}
+
+// Function to retrieve message history from store node
+void retrieveHistory(void* wakuCtx, const std::string& channelName, ChatMessageCallback callback) {
+    std::string contentTopic = channelContentTopic(channelName);
     
-    std::cout << "History query sent to store node" << std::endl;
-} 
\ No newline at end of file
+    std::cout << "Retrieving message history for channel: " << channelName << std::endl;
+    std::cout << "Using content topic: " << contentTopic << std::endl;
+
+    // Serve what we already have from memory, or else from the local
+    // store, which also fills the channel's recent messages for next time
+    std::vector<RecentMessagePtr> localHistory = appState.recent.recent(contentTopic, HISTORY_PAGE_LIMIT);
+    if (localHistory.size() < std::min(HISTORY_PAGE_LIMIT, appState.history.messageCount(contentTopic))) {
+        localHistory.clear();
+        thread_local std::vector<uint8_t> scratch;  // decompressed payloads
+        for (const HistoryRecord& record : appState.history.readRecent(contentTopic, HISTORY_PAGE_LIMIT)) {
+            chat::Chat2MessageView decoded;
+            if (!appState.compression.decode(record.payload.data(), record.payload.size(), decoded, scratch)) {
+                continue;
+            }
+            RecentMessagePtr message = std::make_shared<const RecentMessage>(
+                record.messageHash, record.timestamp, decoded.timestamp, decoded.nick, decoded.payload);
+            appState.recent.add(contentTopic, message);
+            localHistory.push_back(std::move(message));
+        }
+    }
+    for (RecentMessagePtr& message : localHistory) {
+        if (callback) {
+            callback(ChatMessageRef(std::move(message)));
+        }
+    }
+    std::cout << "Served " << localHistory.size() << " messages from local history" << std::endl;
+
+    // Only ask the store node for what it hasn't returned yet. The mark is
+    // included since more messages may share its timestamp; the ones
+    // already stored are skipped.
+    uint64_t synced = appState.history.syncedUntil(contentTopic);
+    StoreQueryContext* context = new StoreQueryContext(callback, contentTopic);
+    context->sync = true;
+    context->timeStart = synced != 0 ? synced : HISTORY_TIME_START;
+    if (sendHistoryQuery(context, std::string())) {
+        std::cout << "History query sent to store node" << std::endl;
+    }
+} 
+
+// Search the index and read the matching messages back, from memory if
+// they are still there or else from the local history. A hit that can't be
+// read back is removed from the index and the page searched again, so the
+// page is full and the total counts only messages that can be shown.
+MessageSearchResults searchMessages(const std::string& query, size_t offset, size_t limit, const std::string& contentTopic) {
+    const int attempts = 3;
+    MessageSearchResults results;
+    thread_local std::vector<uint8_t> scratch;  // decompressed payloads
+    for (int attempt = 0; attempt < attempts; ++attempt) {
+        SearchResults found = appState.search.search(query, offset, limit, contentTopic);
+        results.hits.clear();
+        results.total = found.total;
+        std::map<std::string, std::vector<std::string>> gone;  // by content topic
+        for (SearchHit& hit : found.hits) {
+            RecentMessagePtr message = appState.recent.find(hit.contentTopic, hit.timestamp, hit.messageHash);
+            if (!message) {
+                HistoryRecord record;
+                chat::Chat2MessageView decoded;
+                if (!appState.history.find(hit.contentTopic, hit.messageHash, record) ||
+                    !appState.compression.decode(record.payload.data(), record.payload.size(), decoded, scratch)) {
+                    std::cerr << "Search hit " << hit.messageHash << " is no longer stored" << std::endl;
+                    gone[hit.contentTopic].push_back(hit.messageHash);
+                    continue;
+                }
+                message = std::make_shared<const RecentMessage>(record.messageHash, record.timestamp, decoded.timestamp,
+                                                                decoded.nick, decoded.payload);
+            }
+            results.hits.push_back(MessageSearchHit{std::move(hit.contentTopic), std::move(message), hit.score});
+        }
+        if (gone.empty()) break;
+        size_t removed = 0;
+        for (const auto& entry : gone) removed += appState.search.remove(entry.first, entry.second);
+        results.total -= std::min(removed, results.total);
+    }
+    return results;
+}
@@ -13,10 +13,25 @@
 #include <csignal>
 #include <sstream>
 #include <functional>
+#include <set>
 #include <iomanip>
 #include <fstream>
 #include "protocol/protocol.h"
-#include "message.pb.h"
+#include "codec/store_response_decoder.h"
+#include "codec/base64.h"
+#include "codec/payload_compression.h"
+#include "store/history_store.h"
+#include "channel/channel_registry.h"
+#include "channel/subscription_aggregator.h"
+#include "actor/channel_actors.h"
+#include "transfer/chunked_transfer.h"
+#include "cache/recent_messages.h"
+#include "search/search_index.h"
+#include "analytics/chat_analytics.h"
+#include "ratelimit/receive_limiter.h"
+#include "latency/latency_probe.h"
+#include "message.codec.h"
+#include "../chat_interface.h"
 #include "../../core/plugin_registry.h"
 #include "../../modules/waku/waku_interface.h"
 
@@ -26,10 +41,16 @@ extern const std::string DEFAULT_PUBSUB_TOPIC;
 extern const std::string STORE_NODE;
 extern const std::string CONTENT_TOPIC_PREFIX;
 extern const std::string CONTENT_TOPIC_SUFFIX;
+extern const std::string BATCH_CONTENT_TOPIC_SUFFIX;
+extern const std::string CHUNK_CONTENT_TOPIC_SUFFIX;
+extern const std::string PROBE_CONTENT_TOPIC_SUFFIX;
+extern const size_t MAX_UNCHUNKED_PAYLOAD;
+extern const size_t TRANSFER_CHUNK_SIZE;
+extern const uint64_t HISTORY_TIME_START;
+extern const size_t HISTORY_PAGE_LIMIT;
 
 // Global variables
 extern void* userData;
-extern std::vector<std::string> subscribedChannels;
 
 // Define a callback type for message handling
 using MessageCallback = std::function<void(const std::string&, const std::string&, const std::string&)>;
@@ -42,24 +63,59 @@ struct DecodedMessage {
     std::string payload;
 };
 
+// A chat message read back from a store node, with the key the channel
+// actors store it under. Only valid during the callback.
+using StoredMessageCallback = std::function<void(const std::string& key, const uint8_t* data, size_t size,
+                                                 const chat::Chat2MessageView& decoded)>;
+
 // Store query context to hold callback function
 struct StoreQueryContext {
-    MessageCallback callback;
+    ChatMessageCallback callback;
+    std::string contentTopic;  // channel the results are stored under
+    bool sync = false;         // follow the cursor and raise the channel's sync mark
+    uint64_t timeStart = 0;    // of the query, repeated for every page (ns)
     
-    StoreQueryContext(MessageCallback cb) : callback(cb) {}
+    StoreQueryContext(ChatMessageCallback cb, const std::string& topic = std::string()) : callback(cb), contentTopic(topic) {}
 };
 
-// Event handler context to hold callback function
+// Event handler context
 struct EventHandlerContext {
-    MessageCallback callback;
+    ChannelRegistry* channels;  // messages are only delivered for subscribed channels
+    std::unique_ptr<ChannelActors> actors;  // decode and deliver off the libwaku thread
     
-    EventHandlerContext(MessageCallback cb) : callback(cb) {}
+    explicit EventHandlerContext(ChannelRegistry* registry = nullptr);
+};
+
+// Callbacks received messages are delivered to. A message is wrapped in
+// one ChatMessageRef whatever the number of listeners, and delivering
+// takes a snapshot of the list without copying it.
+class MessageListeners {
+public:
+    uint64_t add(ChatMessageCallback callback);
+    bool remove(uint64_t id);
+    void deliver(const RecentMessagePtr& message) const;
+
+private:
+    using List = std::vector<std::pair<uint64_t, ChatMessageCallback>>;
+
+    mutable std::mutex mutex_;
+    std::shared_ptr<const List> listeners_ = std::make_shared<const List>();  // replaced, never changed
+    uint64_t nextId_ = 1;
 };
 
 // Message history storage
 struct AppState {
-    std::deque<ChatMessage> messages;
-    std::mutex messagesMutex;
+    HistoryStore history;
+    PayloadCompressor compression;  // payloads of sent and received messages
+    ChunkReassembler transfers;     // chunked payloads being received
+    RecentMessages recent;          // newest decoded messages per channel
+    SearchIndex search;             // words of decoded messages, from the relay and the store
+    ChatAnalytics analytics;        // senders and message counts of decoded messages
+    ReceiveLimiter limiter;         // relay messages per sender and channel
+    LatencyProbe probe;             // publish to receive latency, while started
+    MessageListeners listeners;     // received messages are delivered to these
+    std::mutex indexedMutex;
+    std::set<std::string> indexedTopics;  // channels whose local history is in the search index
     std::atomic<bool> running{true};
 };
 
@@ -68,28 +124,48 @@ extern AppState appState;
 
 // Function declarations
 std::string formatContentTopic(const std::string& channelName);
+std::string channelContentTopic(const std::string& channelName);
+std::string batchContentTopic(const std::string& contentTopic);
+bool isBatchContentTopic(const std::string& contentTopic);
+std::string chunkContentTopic(const std::string& contentTopic);
+bool isChunkContentTopic(const std::string& contentTopic);
+std::string probeContentTopic(const std::string& contentTopic);
+bool isProbeContentTopic(const std::string& contentTopic);
+std::string plainContentTopic(const std::string& topic);
+std::string historyContentTopics(const std::string& contentTopic);
+bool unpackStoreMessage(const StoreMessage& stored, const StoredMessageCallback& onMessage);
+std::string historyDirectory();
 uint64_t getCurrentTimestampProto();
 std::string formatTimestampProto(uint64_t timestamp);
-chat::Chat2Message createMessage(const std::string& nick, const std::string& message);
-void printMessage(const chat::Chat2Message& message);
 std::string bytesToStringProto(const std::vector<uint8_t>& bytes);
+DecodedMessage decodeProto(const uint8_t* data, size_t size);
 DecodedMessage decodeProto(const std::vector<uint8_t>& payload);
 void printDecodedMessage(const DecodedMessage& message, const std::vector<uint8_t>& originalPayload);
 void decodePayloadProto(const std::vector<uint8_t>& payload);
 std::string formatTimestamp(uint64_t timestamp);
-std::vector<uint8_t> base64Decode(const std::string& encoded);
+bool base64Decode(const std::string& encoded, std::vector<uint8_t>& decoded);
 std::string base64Encode(const std::vector<uint8_t>& data);
 ChatMessage createChatMessage(const std::string& username, const std::string& message);
 bool encodeProto(const ChatMessage& msg, std::vector<uint8_t>& output);
-void sendMessage(void* wakuCtx, const std::string& channelName, const std::string& username, const std::string& message);
+std::string buildMessageJson(const std::string& contentTopic, const std::string& username, const std::string& message);
+std::string buildEnvelopeJson(const std::string& contentTopic, const std::vector<uint8_t>& payload,
+                              uint64_t timestamp = 0);
 void signalHandler(int signal);
 void relayTopicHealthCallback(int callerRet, const char* msg, size_t len, void* userData);
 void connectionChangeCallback(int callerRet, const char* msg, size_t len, void* userData);
 void storeQueryCallback(int callerRet, const char* msg, size_t len, void* userData);
 void nodeOperationCallback(int callerRet, const char* msg, size_t len, void* userData);
-void retrieveHistory(void* wakuCtx, const std::string& channelName, MessageCallback callback = nullptr);
+ChatMessageCallback toChatMessageCallback(MessageCallback callback);
+bool sendHistoryQuery(StoreQueryContext* context, const std::string& cursor);
+void indexLocalHistory(const std::string& contentTopic);
+void retrieveHistory(void* wakuCtx, const std::string& channelName, ChatMessageCallback callback = nullptr);
+MessageSearchResults searchMessages(const std::string& query, size_t offset, size_t limit, const std::string& contentTopic);
 void event_handler(int callerRet, const char* msg, size_t len, void* userData);
-void* initAndStart(const std::string& relayTopic, MessageCallback messageCallback = nullptr);
-bool joinChannel(void* wakuCtx, const std::string& channelName, const std::string& relayTopic);
+bool admitReceived(ChannelRegistry& channels, ChannelId channel, std::string_view nick);
+void receiveProbe(const std::string& contentTopic, const std::string& payload);
+void queryProbeStore(const std::vector<std::string>& contentTopics, uint64_t since);
+void* initAndStart(const std::string& relayTopic, MessageCallback messageCallback = nullptr, ChannelRegistry* channels = nullptr);
+bool joinChannel(void* wakuCtx, const std::string& channelName, const std::string& relayTopic, SubscriptionAggregator& subscriptions);
+bool leaveChannel(void* wakuCtx, const std::string& channelName, const std::string& relayTopic, SubscriptionAggregator& subscriptions);
 
 #endif // CHAT_API_H 
\ No newline at end of file
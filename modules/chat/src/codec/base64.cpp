@@ -0,0 +1,372 @@
+#include "base64.h"
+#include <atomic>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define BASE64_X86 1
+#include <immintrin.h>
+#endif
+
+namespace base64 {
+namespace {
+
+constexpr char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Character to 6-bit value, 0xFF for anything outside the alphabet
+struct DecodeTable {
+    uint8_t value[256];
+    constexpr DecodeTable() : value() {
+        for (int i = 0; i < 256; ++i) value[i] = 0xFF;
+        for (int i = 0; i < 64; ++i) value[static_cast<uint8_t>(kAlphabet[i])] = static_cast<uint8_t>(i);
+    }
+};
+
+constexpr DecodeTable kDecode;
+
+// Bulk kernels handle as much of the input as they can in whole blocks and
+// report how far they got; the scalar code finishes the rest.
+using EncodeBulk = void (*)(const uint8_t* in, size_t size, char* out, size_t& consumed, size_t& written);
+using DecodeBulk = void (*)(const char* in, size_t size, uint8_t* out, size_t& consumed, size_t& written);
+
+struct Kernels {
+    Implementation impl;
+    EncodeBulk encode;
+    DecodeBulk decode;
+};
+
+void encodeBulkScalar(const uint8_t*, size_t, char*, size_t& consumed, size_t& written) {
+    consumed = 0;
+    written = 0;
+}
+
+void decodeBulkScalar(const char*, size_t, uint8_t*, size_t& consumed, size_t& written) {
+    consumed = 0;
+    written = 0;
+}
+
+size_t encodeScalar(const uint8_t* in, size_t size, char* out) {
+    char* start = out;
+    size_t i = 0;
+    for (; i + 3 <= size; i += 3) {
+        uint32_t v = (static_cast<uint32_t>(in[i]) << 16) | (static_cast<uint32_t>(in[i + 1]) << 8) | in[i + 2];
+        out[0] = kAlphabet[(v >> 18) & 0x3F];
+        out[1] = kAlphabet[(v >> 12) & 0x3F];
+        out[2] = kAlphabet[(v >> 6) & 0x3F];
+        out[3] = kAlphabet[v & 0x3F];
+        out += 4;
+    }
+    size_t rest = size - i;
+    if (rest > 0) {
+        uint32_t v = static_cast<uint32_t>(in[i]) << 16;
+        if (rest == 2) v |= static_cast<uint32_t>(in[i + 1]) << 8;
+        out[0] = kAlphabet[(v >> 18) & 0x3F];
+        out[1] = kAlphabet[(v >> 12) & 0x3F];
+        out[2] = (rest == 2) ? kAlphabet[(v >> 6) & 0x3F] : '=';
+        out[3] = '=';
+        out += 4;
+    }
+    return static_cast<size_t>(out - start);
+}
+
+bool decodeScalar(const char* in, size_t size, uint8_t* out, size_t& outSize) {
+    // Padding is optional, but when present it has to complete the group
+    size_t len = size;
+    if (len > 0 && in[len - 1] == '=') {
+        --len;
+        if (len > 0 && in[len - 1] == '=') --len;
+        if (size % 4 != 0) return false;
+    }
+    if (len % 4 == 1) return false;
+
+    const uint8_t* s = reinterpret_cast<const uint8_t*>(in);
+    uint8_t* o = out;
+    size_t i = 0;
+    for (; i + 4 <= len; i += 4) {
+        uint32_t a = kDecode.value[s[i]];
+        uint32_t b = kDecode.value[s[i + 1]];
+        uint32_t c = kDecode.value[s[i + 2]];
+        uint32_t d = kDecode.value[s[i + 3]];
+        if ((a | b | c | d) & 0x80) return false;
+        uint32_t v = (a << 18) | (b << 12) | (c << 6) | d;
+        o[0] = static_cast<uint8_t>(v >> 16);
+        o[1] = static_cast<uint8_t>(v >> 8);
+        o[2] = static_cast<uint8_t>(v);
+        o += 3;
+    }
+    size_t rest = len - i;
+    if (rest >= 2) {
+        uint32_t a = kDecode.value[s[i]];
+        uint32_t b = kDecode.value[s[i + 1]];
+        uint32_t c = (rest == 3) ? kDecode.value[s[i + 2]] : 0;
+        if ((a | b | c) & 0x80) return false;
+        uint32_t v = (a << 18) | (b << 12) | (c << 6);
+        *o++ = static_cast<uint8_t>(v >> 16);
+        if (rest == 3) *o++ = static_cast<uint8_t>(v >> 8);
+    }
+    outSize = static_cast<size_t>(o - out);
+    return true;
+}
+
+#if defined(BASE64_X86)
+
+// The SIMD kernels follow the approach of Wojciech Muła's and Alfred
+// Klomp's base64 work: reshuffle input bytes into 6-bit lanes with
+// multiplies, and translate between values and ASCII with nibble lookups.
+
+__attribute__((target("sse4.1")))
+inline __m128i encReshuffle(__m128i in) {
+    in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+    const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00));
+    const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003F03F0));
+    const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t1, t3);
+}
+
+__attribute__((target("sse4.1")))
+inline __m128i encTranslate(__m128i in) {
+    const __m128i lut = _mm_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+    __m128i indices = _mm_subs_epu8(in, _mm_set1_epi8(51));
+    __m128i mask = _mm_cmpgt_epi8(in, _mm_set1_epi8(25));
+    indices = _mm_sub_epi8(indices, mask);
+    return _mm_add_epi8(in, _mm_shuffle_epi8(lut, indices));
+}
+
+__attribute__((target("sse4.1")))
+void encodeBulkSse41(const uint8_t* in, size_t size, char* out, size_t& consumed, size_t& written) {
+    size_t i = 0;
+    size_t o = 0;
+    // Each step reads 16 bytes but only encodes 12 of them
+    while (size - i >= 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        block = encTranslate(encReshuffle(block));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + o), block);
+        i += 12;
+        o += 16;
+    }
+    consumed = i;
+    written = o;
+}
+
+__attribute__((target("sse4.1")))
+void decodeBulkSse41(const char* in, size_t size, uint8_t* out, size_t& consumed, size_t& written) {
+    const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                        0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                          0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask2F = _mm_set1_epi8(0x2F);
+    const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    size_t i = 0;
+    size_t o = 0;
+    // Each step stores 16 bytes but only produces 12, so stay clear of the
+    // end of the output; padding and anything invalid go to the scalar code
+    while (size - i >= 24) {
+        __m128i str = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        const __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask2F);
+        const __m128i loNibbles = _mm_and_si128(str, mask2F);
+        const __m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+        const __m128i lo = _mm_shuffle_epi8(lutLo, loNibbles);
+        if (!_mm_testz_si128(lo, hi)) break;
+
+        const __m128i eq2F = _mm_cmpeq_epi8(str, mask2F);
+        const __m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(eq2F, hiNibbles));
+        str = _mm_add_epi8(str, roll);
+
+        const __m128i mergeAbBc = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+        __m128i bytes = _mm_madd_epi16(mergeAbBc, _mm_set1_epi32(0x00011000));
+        bytes = _mm_shuffle_epi8(bytes, pack);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + o), bytes);
+        i += 16;
+        o += 12;
+    }
+    consumed = i;
+    written = o;
+}
+
+__attribute__((target("avx2")))
+void encodeBulkAvx2(const uint8_t* in, size_t size, char* out, size_t& consumed, size_t& written) {
+    const __m256i shuffle = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                             1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m256i lut = _mm256_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0,
+                                         65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+    size_t i = 0;
+    size_t o = 0;
+    // Two 12 byte groups per step, one in each 128-bit lane
+    while (size - i >= 28) {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 12));
+        __m256i block = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+
+        block = _mm256_shuffle_epi8(block, shuffle);
+        const __m256i t0 = _mm256_and_si256(block, _mm256_set1_epi32(0x0FC0FC00));
+        const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        const __m256i t2 = _mm256_and_si256(block, _mm256_set1_epi32(0x003F03F0));
+        const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        block = _mm256_or_si256(t1, t3);
+
+        __m256i indices = _mm256_subs_epu8(block, _mm256_set1_epi8(51));
+        __m256i mask = _mm256_cmpgt_epi8(block, _mm256_set1_epi8(25));
+        indices = _mm256_sub_epi8(indices, mask);
+        block = _mm256_add_epi8(block, _mm256_shuffle_epi8(lut, indices));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + o), block);
+        i += 24;
+        o += 32;
+    }
+
+    // Finish whole 12 byte groups with the 128-bit kernel
+    size_t tailConsumed = 0;
+    size_t tailWritten = 0;
+    encodeBulkSse41(in + i, size - i, out + o, tailConsumed, tailWritten);
+    consumed = i + tailConsumed;
+    written = o + tailWritten;
+}
+
+__attribute__((target("avx2")))
+void decodeBulkAvx2(const char* in, size_t size, uint8_t* out, size_t& consumed, size_t& written) {
+    const __m256i lutLo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                           0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+                                           0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                           0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lutHi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                           0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                           0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                           0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lutRoll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                             0, 0, 0, 0, 0, 0, 0, 0,
+                                             0, 16, 19, 4, -65, -65, -71, -71,
+                                             0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask2F = _mm256_set1_epi8(0x2F);
+    const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                          2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1);
+
+    size_t i = 0;
+    size_t o = 0;
+    // 32 characters in, 24 bytes out, 32 bytes stored
+    while (size - i >= 48) {
+        __m256i str = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        const __m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask2F);
+        const __m256i loNibbles = _mm256_and_si256(str, mask2F);
+        const __m256i hi = _mm256_shuffle_epi8(lutHi, hiNibbles);
+        const __m256i lo = _mm256_shuffle_epi8(lutLo, loNibbles);
+        if (!_mm256_testz_si256(lo, hi)) break;
+
+        const __m256i eq2F = _mm256_cmpeq_epi8(str, mask2F);
+        const __m256i roll = _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(eq2F, hiNibbles));
+        str = _mm256_add_epi8(str, roll);
+
+        const __m256i mergeAbBc = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+        __m256i bytes = _mm256_madd_epi16(mergeAbBc, _mm256_set1_epi32(0x00011000));
+        bytes = _mm256_shuffle_epi8(bytes, pack);
+        bytes = _mm256_permutevar8x32_epi32(bytes, lanes);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + o), bytes);
+        i += 32;
+        o += 24;
+    }
+
+    // Finish whole 16 character blocks with the 128-bit kernel
+    size_t tailConsumed = 0;
+    size_t tailWritten = 0;
+    decodeBulkSse41(in + i, size - i, out + o, tailConsumed, tailWritten);
+    consumed = i + tailConsumed;
+    written = o + tailWritten;
+}
+
+#endif // BASE64_X86
+
+const Kernels kScalarKernels{Implementation::Scalar, encodeBulkScalar, decodeBulkScalar};
+#if defined(BASE64_X86)
+const Kernels kSse41Kernels{Implementation::Sse41, encodeBulkSse41, decodeBulkSse41};
+const Kernels kAvx2Kernels{Implementation::Avx2, encodeBulkAvx2, decodeBulkAvx2};
+#endif
+
+const Kernels* kernelsFor(Implementation impl) {
+    switch (impl) {
+#if defined(BASE64_X86)
+        case Implementation::Avx2:
+            return &kAvx2Kernels;
+        case Implementation::Sse41:
+            return &kSse41Kernels;
+#endif
+        default:
+            return &kScalarKernels;
+    }
+}
+
+const Kernels* detectKernels() {
+#if defined(BASE64_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return &kAvx2Kernels;
+    if (__builtin_cpu_supports("sse4.1")) return &kSse41Kernels;
+#endif
+    return &kScalarKernels;
+}
+
+std::atomic<const Kernels*>& activeKernels() {
+    static std::atomic<const Kernels*> kernels{detectKernels()};
+    return kernels;
+}
+
+} // namespace
+
+size_t encode(const uint8_t* data, size_t size, char* out) {
+    const Kernels* kernels = activeKernels().load(std::memory_order_relaxed);
+    size_t consumed = 0;
+    size_t written = 0;
+    kernels->encode(data, size, out, consumed, written);
+    return written + encodeScalar(data + consumed, size - consumed, out + written);
+}
+
+bool decode(const char* data, size_t size, uint8_t* out, size_t& outSize) {
+    const Kernels* kernels = activeKernels().load(std::memory_order_relaxed);
+    size_t consumed = 0;
+    size_t written = 0;
+    kernels->decode(data, size, out, consumed, written);
+    size_t tail = 0;
+    if (!decodeScalar(data + consumed, size - consumed, out + written, tail)) return false;
+    outSize = written + tail;
+    return true;
+}
+
+Implementation activeImplementation() {
+    return activeKernels().load(std::memory_order_relaxed)->impl;
+}
+
+bool isSupported(Implementation impl) {
+    switch (impl) {
+        case Implementation::Scalar:
+            return true;
+#if defined(BASE64_X86)
+        case Implementation::Sse41:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse4.1");
+        case Implementation::Avx2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+bool useImplementation(Implementation impl) {
+    if (!isSupported(impl)) return false;
+    activeKernels().store(kernelsFor(impl), std::memory_order_relaxed);
+    return true;
+}
+
+const char* implementationName(Implementation impl) {
+    switch (impl) {
+        case Implementation::Sse41:
+            return "sse4.1";
+        case Implementation::Avx2:
+            return "avx2";
+        default:
+            return "scalar";
+    }
+}
+
+} // namespace base64
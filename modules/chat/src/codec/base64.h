@@ -0,0 +1,53 @@
+#ifndef BASE64_H
+#define BASE64_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Table-driven base64 codec (standard alphabet, padded output) with SSE4.1
+// and AVX2 code paths picked at runtime and a scalar fallback.
+//
+// Both directions write into caller-provided buffers sized with
+// encodedSize()/decodedMaxSize(); nothing is allocated.
+namespace base64 {
+
+enum class Implementation {
+    Scalar,
+    Sse41,
+    Avx2
+};
+
+constexpr size_t encodedSize(size_t size) {
+    return (size + 2) / 3 * 4;
+}
+
+// Upper bound for the decoded size of size characters
+constexpr size_t decodedMaxSize(size_t size) {
+    return (size + 3) / 4 * 3;
+}
+
+// Encode size bytes into out, which must hold encodedSize(size) characters.
+// Returns the number of characters written.
+size_t encode(const uint8_t* data, size_t size, char* out);
+
+// Decode size characters into out, which must hold decodedMaxSize(size)
+// bytes. Trailing padding is optional. Returns false on characters outside
+// the alphabet, misplaced padding or a truncated final group; outSize is
+// only meaningful on success.
+bool decode(const char* data, size_t size, uint8_t* out, size_t& outSize);
+
+// The implementation encode()/decode() currently dispatch to
+Implementation activeImplementation();
+
+// Whether impl can run on this CPU
+bool isSupported(Implementation impl);
+
+// Force a specific implementation (benchmarks). Returns false, leaving the
+// current choice in place, if impl is not supported on this CPU.
+bool useImplementation(Implementation impl);
+
+const char* implementationName(Implementation impl);
+
+} // namespace base64
+
+#endif // BASE64_H
@@ -0,0 +1,343 @@
+#include "payload_compression.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include "message.codec.h"
+
+#ifdef LOGOS_CHAT_ZSTD
+#include <zdict.h>
+#include <zstd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Trained dictionaries wait here until they are distributed
+constexpr const char* kTrainedDirectory = "trained";
+
+} // namespace
+
+#ifdef LOGOS_CHAT_ZSTD
+
+namespace {
+
+struct CCtxDeleter {
+    void operator()(ZSTD_CCtx* ctx) const { ZSTD_freeCCtx(ctx); }
+};
+
+struct DCtxDeleter {
+    void operator()(ZSTD_DCtx* ctx) const { ZSTD_freeDCtx(ctx); }
+};
+
+// Contexts hold the match state and window buffers; reusing them per thread
+// saves an allocation of several hundred KB per message
+ZSTD_CCtx* threadCCtx() {
+    thread_local std::unique_ptr<ZSTD_CCtx, CCtxDeleter> ctx(ZSTD_createCCtx());
+    return ctx.get();
+}
+
+ZSTD_DCtx* threadDCtx() {
+    thread_local std::unique_ptr<ZSTD_DCtx, DCtxDeleter> ctx(ZSTD_createDCtx());
+    return ctx.get();
+}
+
+} // namespace
+
+// A loaded dictionary, digested for both directions
+struct PayloadCompressor::Dictionary {
+    uint32_t id = 0;
+    std::vector<uint8_t> bytes;
+    ZSTD_CDict* cdict = nullptr;
+    ZSTD_DDict* ddict = nullptr;
+
+    ~Dictionary() {
+        ZSTD_freeCDict(cdict);
+        ZSTD_freeDDict(ddict);
+    }
+};
+
+#else
+
+struct PayloadCompressor::Dictionary {
+    uint32_t id = 0;
+};
+
+#endif
+
+PayloadCompressor::PayloadCompressor(const PayloadCompressionOptions& options) : options_(options) {}
+
+PayloadCompressor::~PayloadCompressor() = default;
+
+bool PayloadCompressor::available() {
+#ifdef LOGOS_CHAT_ZSTD
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Dictionary files are "<id>.dict": the channel's content topic on the first
+// line, the zstd dictionary after it
+bool PayloadCompressor::open(const std::string& directory) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        directory_ = directory;
+    }
+    std::error_code ec;
+    fs::create_directories(fs::path(directory) / kTrainedDirectory, ec);
+    if (ec) {
+        std::cerr << "Payload compression: cannot create " << directory << ": " << ec.message() << std::endl;
+        return false;
+    }
+    if (!available()) return true;
+
+    size_t loaded = load(directory, false) + load((fs::path(directory) / kTrainedDirectory).string(), true);
+    if (loaded > 0) {
+        std::cout << "Payload compression: " << loaded << " dictionaries loaded from " << directory << std::endl;
+    }
+    return true;
+}
+
+size_t PayloadCompressor::load(const std::string& directory, bool trained) {
+    // A channel's newest dictionary is the current one; older ones are still
+    // loaded to decode messages sent with them
+    std::map<std::string, fs::file_time_type> newest;
+    size_t loaded = 0;
+    std::error_code ec;
+    for (const fs::directory_entry& entry : fs::directory_iterator(directory, ec)) {
+        if (entry.path().extension() != ".dict") continue;
+        std::ifstream in(entry.path(), std::ios::binary);
+        std::string topic;
+        if (!std::getline(in, topic) || topic.empty()) continue;
+        std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+        fs::file_time_type written = entry.last_write_time(ec);
+        auto it = newest.find(topic);
+        bool current = it == newest.end() || written > it->second;
+        if (!install(current ? topic : std::string(), std::move(bytes), trained, false)) {
+            std::cerr << "Payload compression: ignoring unreadable dictionary " << entry.path().string() << std::endl;
+            continue;
+        }
+        if (current) newest[topic] = written;
+        loaded++;
+    }
+    return loaded;
+}
+
+bool PayloadCompressor::train(const std::string& contentTopic, const std::vector<std::string>& samples) {
+#ifdef LOGOS_CHAT_ZSTD
+    std::string buffer;
+    std::vector<size_t> sizes;
+    sizes.reserve(samples.size());
+    for (const std::string& sample : samples) {
+        if (sample.empty()) continue;
+        buffer += sample;
+        sizes.push_back(sample.size());
+    }
+
+    // zstd wants a hundred times the dictionary size in samples; settle for
+    // a smaller dictionary on channels with little history
+    size_t capacity = std::min(options_.dictionarySize, buffer.size() / 10);
+    if (sizes.size() < 8 || capacity < 256) {
+        std::cerr << "Payload compression: not enough messages to train a dictionary for " << contentTopic << std::endl;
+        return false;
+    }
+    std::vector<uint8_t> dictionary(capacity);
+    size_t size = ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(), buffer.data(), sizes.data(),
+                                        static_cast<unsigned>(sizes.size()));
+    if (ZDICT_isError(size)) {
+        std::cerr << "Payload compression: training a dictionary for " << contentTopic
+                  << " failed: " << ZDICT_getErrorName(size) << std::endl;
+        return false;
+    }
+    dictionary.resize(size);
+    return install(contentTopic, std::move(dictionary), true, true);
+#else
+    (void)samples;
+    std::cerr << "Payload compression: built without zstd, no dictionary for " << contentTopic << std::endl;
+    return false;
+#endif
+}
+
+bool PayloadCompressor::addDictionary(const std::string& contentTopic, const std::vector<uint8_t>& dictionary) {
+    return install(contentTopic, dictionary, false, true);
+}
+
+bool PayloadCompressor::useTrainedDictionary(const std::string& contentTopic) {
+    std::shared_ptr<const Dictionary> dictionary;
+    std::string directory;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = trained_.find(contentTopic);
+        if (it == trained_.end()) return false;
+        dictionary = it->second;
+        byTopic_[contentTopic] = dictionary;
+        directory = directory_;
+    }
+    return directory.empty() || save(directory, contentTopic, *dictionary);
+}
+
+// Digest a dictionary and make it the channel's, if contentTopic is set, and
+// decodable by its id. A trained one only becomes the channel's candidate
+// for useTrainedDictionary().
+bool PayloadCompressor::install(const std::string& contentTopic, std::vector<uint8_t> bytes, bool trained, bool persist) {
+#ifdef LOGOS_CHAT_ZSTD
+    // Raw content dictionaries have no id for receivers to find them by
+    uint32_t id = ZDICT_getDictID(bytes.data(), bytes.size());
+    if (id == 0) return false;
+
+    auto dictionary = std::make_shared<Dictionary>();
+    dictionary->id = id;
+    dictionary->bytes = std::move(bytes);
+    dictionary->cdict = ZSTD_createCDict(dictionary->bytes.data(), dictionary->bytes.size(), options_.level);
+    dictionary->ddict = ZSTD_createDDict(dictionary->bytes.data(), dictionary->bytes.size());
+    if (dictionary->cdict == nullptr || dictionary->ddict == nullptr) return false;
+
+    std::string directory;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        byId_[id] = dictionary;
+        if (!contentTopic.empty()) (trained ? trained_ : byTopic_)[contentTopic] = dictionary;
+        directory = directory_;
+    }
+
+    if (!persist || directory.empty()) return true;
+    return save(trained ? (fs::path(directory) / kTrainedDirectory).string() : directory,
+                      contentTopic, *dictionary);
+#else
+    (void)contentTopic;
+    (void)bytes;
+    (void)trained;
+    (void)persist;
+    return false;
+#endif
+}
+
+bool PayloadCompressor::save(const std::string& directory, const std::string& contentTopic,
+                             const Dictionary& dictionary) const {
+#ifdef LOGOS_CHAT_ZSTD
+    std::string path = (fs::path(directory) / (std::to_string(dictionary.id) + ".dict")).string();
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << contentTopic << '\n';
+    out.write(reinterpret_cast<const char*>(dictionary.bytes.data()),
+              static_cast<std::streamsize>(dictionary.bytes.size()));
+    if (!out) {
+        std::cerr << "Payload compression: cannot save dictionary " << path << std::endl;
+        return false;
+    }
+    return true;
+#else
+    (void)directory;
+    (void)contentTopic;
+    (void)dictionary;
+    return false;
+#endif
+}
+
+std::shared_ptr<const PayloadCompressor::Dictionary> PayloadCompressor::forTopic(const std::string& contentTopic) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = byTopic_.find(contentTopic);
+    return it != byTopic_.end() ? it->second : nullptr;
+}
+
+std::shared_ptr<const PayloadCompressor::Dictionary> PayloadCompressor::forId(uint32_t id) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = byId_.find(id);
+    return it != byId_.end() ? it->second : nullptr;
+}
+
+uint32_t PayloadCompressor::dictionaryId(const std::string& contentTopic) const {
+    std::shared_ptr<const Dictionary> dictionary = forTopic(contentTopic);
+    return dictionary ? dictionary->id : 0;
+}
+
+uint32_t PayloadCompressor::trainedDictionaryId(const std::string& contentTopic) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = trained_.find(contentTopic);
+    return it != trained_.end() ? it->second->id : 0;
+}
+
+bool PayloadCompressor::compress(const std::string& contentTopic, std::string_view payload,
+                                 std::vector<uint8_t>& out) const {
+#ifdef LOGOS_CHAT_ZSTD
+    // Receivers refuse to inflate more than maxDecompressedSize
+    if (!enabled() || payload.size() < options_.minSize || payload.size() > options_.maxDecompressedSize) {
+        return false;
+    }
+
+    ZSTD_CCtx* ctx = threadCCtx();
+    if (ctx == nullptr) return false;
+    ZSTD_CCtx_reset(ctx, ZSTD_reset_session_and_parameters);
+    // Every byte counts at this size: the content size is needed to size
+    // the output when decompressing, the checksum is not
+    ZSTD_CCtx_setParameter(ctx, ZSTD_c_checksumFlag, 0);
+    ZSTD_CCtx_setParameter(ctx, ZSTD_c_contentSizeFlag, 1);
+
+    std::shared_ptr<const Dictionary> dictionary = forTopic(contentTopic);
+    if (dictionary) {
+        ZSTD_CCtx_refCDict(ctx, dictionary->cdict);
+    } else {
+        ZSTD_CCtx_setParameter(ctx, ZSTD_c_compressionLevel, options_.level);
+    }
+
+    out.resize(ZSTD_compressBound(payload.size()));
+    size_t size = ZSTD_compress2(ctx, out.data(), out.size(), payload.data(), payload.size());
+    // The compression field costs two bytes on the wire
+    if (ZSTD_isError(size) || size + 2 >= payload.size()) return false;
+    out.resize(size);
+    return true;
+#else
+    (void)contentTopic;
+    (void)payload;
+    (void)out;
+    return false;
+#endif
+}
+
+bool PayloadCompressor::decompress(std::string_view frame, std::vector<uint8_t>& out) const {
+#ifdef LOGOS_CHAT_ZSTD
+    unsigned long long contentSize = ZSTD_getFrameContentSize(frame.data(), frame.size());
+    if (contentSize == ZSTD_CONTENTSIZE_ERROR || contentSize == ZSTD_CONTENTSIZE_UNKNOWN ||
+        contentSize > options_.maxDecompressedSize) {
+        return false;
+    }
+
+    ZSTD_DCtx* ctx = threadDCtx();
+    if (ctx == nullptr) return false;
+    out.resize(static_cast<size_t>(contentSize));
+
+    size_t size = 0;
+    uint32_t id = ZSTD_getDictID_fromFrame(frame.data(), frame.size());
+    if (id != 0) {
+        std::shared_ptr<const Dictionary> dictionary = forId(id);
+        if (!dictionary) return false;
+        size = ZSTD_decompress_usingDDict(ctx, out.data(), out.size(), frame.data(), frame.size(), dictionary->ddict);
+    } else {
+        size = ZSTD_decompressDCtx(ctx, out.data(), out.size(), frame.data(), frame.size());
+    }
+    if (ZSTD_isError(size) || size != out.size()) return false;
+    return true;
+#else
+    (void)frame;
+    (void)out;
+    return false;
+#endif
+}
+
+bool PayloadCompressor::decode(const uint8_t* data, size_t size, chat::Chat2MessageView& msg,
+                               std::vector<uint8_t>& scratch) const {
+    if (!proto::decode(data, size, msg)) return false;
+    switch (static_cast<PayloadEncoding>(msg.compression)) {
+        case PayloadEncoding::None:
+            return true;
+        case PayloadEncoding::Zstd:
+            if (!decompress(msg.payload, scratch)) return false;
+            msg.payload = proto::asView(scratch.data(), scratch.size());
+            return true;
+        default:
+            return false;
+    }
+}
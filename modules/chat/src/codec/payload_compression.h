@@ -0,0 +1,123 @@
+#ifndef PAYLOAD_COMPRESSION_H
+#define PAYLOAD_COMPRESSION_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace chat {
+struct Chat2MessageView;
+}
+
+// Values of the Chat2Message compression field
+enum class PayloadEncoding : uint32_t {
+    None = 0,
+    Zstd = 1  // zstd frame; the frame header names the dictionary, if any
+};
+
+struct PayloadCompressionOptions {
+    int level = 3;                             // zstd level used without a dictionary
+    size_t minSize = 48;                       // smaller payloads are never compressed
+    size_t dictionarySize = 16 * 1024;         // capacity of trained dictionaries
+    size_t maxDecompressedSize = 1024 * 1024;  // the node's maxMessageSize; larger payloads go out uncompressed
+};
+
+// zstd compression of the Chat2Message payload field.
+//
+// Chat messages are short, so on their own they barely compress. A
+// dictionary trained on a channel's earlier messages gives zstd the
+// vocabulary up front; channels without one are compressed plainly. A
+// payload is only sent compressed if that makes it smaller, and tiny
+// payloads are not tried at all.
+//
+// Dictionaries are kept in a directory, one file per dictionary, and loaded
+// by open(). A receiver needs the sender's dictionary to read its
+// messages: it picks it by the id in the zstd frame header, and a message
+// compressed with a dictionary it doesn't have fails to decode. So a
+// trained dictionary is only kept for decoding, in trained/ under the
+// directory, and the channel stays on plain zstd until the dictionary is
+// distributed: copy the file into the directory of every node reading the
+// channel, this one included, or install it there with addDictionary().
+//
+// Payloads over maxDecompressedSize are not compressed, as receivers
+// refuse to inflate them; chunked transfers of large payloads go raw.
+//
+// Without zstd (LOGOS_CHAT_ZSTD undefined) nothing is compressed and
+// compressed messages fail to decode.
+//
+// All methods are thread-safe; compression contexts are kept per thread.
+class PayloadCompressor {
+public:
+    explicit PayloadCompressor(const PayloadCompressionOptions& options = PayloadCompressionOptions());
+    ~PayloadCompressor();
+
+    PayloadCompressor(const PayloadCompressor&) = delete;
+    PayloadCompressor& operator=(const PayloadCompressor&) = delete;
+
+    // Built with zstd
+    static bool available();
+
+    // Load the dictionaries in directory; trained ones are saved there
+    bool open(const std::string& directory);
+
+    // Compress outgoing payloads. Off by default; decompression is always on.
+    void setEnabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    // Train a dictionary for a channel from sample payloads and save it to
+    // trained/. It decodes right away but is not compressed with until it
+    // is distributed, see above.
+    bool train(const std::string& contentTopic, const std::vector<std::string>& samples);
+
+    // Id of the dictionary last trained for a channel, 0 if none
+    uint32_t trainedDictionaryId(const std::string& contentTopic) const;
+
+    // Install a dictionary every node reading the channel has been given,
+    // save it and compress the channel with it. It replaces the channel's
+    // previous one, which is kept for decoding.
+    bool addDictionary(const std::string& contentTopic, const std::vector<uint8_t>& dictionary);
+
+    // Compress a channel with its trained dictionary, once it is distributed
+    bool useTrainedDictionary(const std::string& contentTopic);
+
+    // Id of the dictionary a channel is compressed with, 0 if it has none
+    uint32_t dictionaryId(const std::string& contentTopic) const;
+
+    // Compress payload with the channel's dictionary into out. Returns false,
+    // and the payload goes out as it is, if compression is off, the payload
+    // is below minSize or compressing doesn't make it smaller.
+    bool compress(const std::string& contentTopic, std::string_view payload, std::vector<uint8_t>& out) const;
+
+    // Decompress a zstd frame into out
+    bool decompress(std::string_view frame, std::vector<uint8_t>& out) const;
+
+    // Decode a Chat2Message. A compressed payload is decompressed into
+    // scratch, which msg.payload then views.
+    bool decode(const uint8_t* data, size_t size, chat::Chat2MessageView& msg, std::vector<uint8_t>& scratch) const;
+
+private:
+    struct Dictionary;
+
+    size_t load(const std::string& directory, bool trained);
+    std::shared_ptr<const Dictionary> forTopic(const std::string& contentTopic) const;
+    std::shared_ptr<const Dictionary> forId(uint32_t id) const;
+    bool install(const std::string& contentTopic, std::vector<uint8_t> bytes, bool trained, bool persist);
+    bool save(const std::string& directory, const std::string& contentTopic, const Dictionary& dictionary) const;
+
+    const PayloadCompressionOptions options_;
+    std::atomic<bool> enabled_{false};
+
+    mutable std::mutex mutex_;
+    std::string directory_;
+    std::map<std::string, std::shared_ptr<const Dictionary>> byTopic_;    // compressed with
+    std::map<std::string, std::shared_ptr<const Dictionary>> trained_;    // trained here, not distributed yet
+    std::map<uint32_t, std::shared_ptr<const Dictionary>> byId_;
+};
+
+#endif // PAYLOAD_COMPRESSION_H
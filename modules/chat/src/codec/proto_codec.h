@@ -0,0 +1,240 @@
+#ifndef PROTO_CODEC_H
+#define PROTO_CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// Minimal protobuf wire format codec driven by compile-time field tables.
+//
+// Message structs and their field tables are generated from .proto files by
+// protobuf/proto_codec_gen.cmake. Encoding sizes the output exactly and
+// writes into a caller-provided buffer; decoding never copies, string and
+// bytes fields are returned as views into the input. Repeated string, bytes
+// and message fields are a vector of views of the encoded elements.
+
+// Enum for protobuf wire types
+enum WireType {
+    VARINT = 0,           // int32, int64, uint32, uint64, sint32, sint64, bool, enum
+    FIXED64 = 1,          // fixed64, sfixed64, double
+    LENGTH_DELIMITED = 2, // string, bytes, embedded messages, packed repeated fields
+    FIXED32 = 5           // fixed32, sfixed32, float
+};
+
+enum class FieldKind {
+    Uint64,
+    Uint32,
+    Bool,
+    String,
+    Bytes,
+    RepeatedBytes  // repeated string, bytes or embedded message
+};
+
+namespace proto {
+
+constexpr uint32_t makeTag(uint32_t number, WireType type) {
+    return (number << 3) | static_cast<uint32_t>(type);
+}
+
+constexpr size_t varintSize(uint64_t value) {
+    size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        ++size;
+    }
+    return size;
+}
+
+inline uint8_t* writeVarint(uint8_t* out, uint64_t value) {
+    while (value >= 0x80) {
+        *out++ = static_cast<uint8_t>(value) | 0x80;
+        value >>= 7;
+    }
+    *out++ = static_cast<uint8_t>(value);
+    return out;
+}
+
+// Read a varint, returning nullptr on truncated or overlong input
+inline const uint8_t* readVarint(const uint8_t* p, const uint8_t* end, uint64_t& value) {
+    // Fast path for the single byte tags and lengths that dominate chat traffic
+    if (p < end && *p < 0x80) {
+        value = *p;
+        return p + 1;
+    }
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (p >= end) return nullptr;
+        uint8_t byte = *p++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return p;
+    }
+    return nullptr;
+}
+
+// Skip the value of an unknown field
+inline const uint8_t* skipField(const uint8_t* p, const uint8_t* end, uint32_t wireType) {
+    uint64_t value = 0;
+    switch (wireType) {
+        case VARINT:
+            return readVarint(p, end, value);
+        case FIXED64:
+            return (end - p >= 8) ? p + 8 : nullptr;
+        case LENGTH_DELIMITED:
+            p = readVarint(p, end, value);
+            if (p == nullptr || value > static_cast<uint64_t>(end - p)) return nullptr;
+            return p + value;
+        case FIXED32:
+            return (end - p >= 4) ? p + 4 : nullptr;
+        default:
+            return nullptr;
+    }
+}
+
+inline std::string_view asView(const uint8_t* data, size_t size) {
+    return std::string_view(reinterpret_cast<const char*>(data), size);
+}
+
+// Compile-time description of one message field
+template <typename Message, typename T, T Message::*Member, uint32_t Number, FieldKind Kind>
+struct Field {
+    using value_type = T;
+    static constexpr uint32_t number = Number;
+    static constexpr FieldKind kind = Kind;
+    static constexpr bool repeated = (Kind == FieldKind::RepeatedBytes);
+    static constexpr bool lengthDelimited = repeated || Kind == FieldKind::String || Kind == FieldKind::Bytes;
+    static constexpr WireType wireType = lengthDelimited ? LENGTH_DELIMITED : VARINT;
+    static constexpr uint32_t tag = makeTag(Number, wireType);
+
+    static const T& get(const Message& msg) { return msg.*Member; }
+    static T& get(Message& msg) { return msg.*Member; }
+
+    // proto3: fields holding their default value are not written. Every
+    // element of a repeated field is, empty ones included.
+    static size_t size(const Message& msg) {
+        const T& value = get(msg);
+        if constexpr (repeated) {
+            size_t total = 0;
+            for (const auto& element : value) {
+                total += varintSize(tag) + varintSize(element.size()) + element.size();
+            }
+            return total;
+        } else if constexpr (lengthDelimited) {
+            if (value.empty()) return 0;
+            return varintSize(tag) + varintSize(value.size()) + value.size();
+        } else {
+            if (value == T()) return 0;
+            return varintSize(tag) + varintSize(static_cast<uint64_t>(value));
+        }
+    }
+
+    static uint8_t* write(const Message& msg, uint8_t* out) {
+        const T& value = get(msg);
+        if constexpr (repeated) {
+            for (const auto& element : value) {
+                out = writeVarint(out, tag);
+                out = writeVarint(out, element.size());
+                if (!element.empty()) std::memcpy(out, element.data(), element.size());
+                out += element.size();
+            }
+            return out;
+        } else if constexpr (lengthDelimited) {
+            if (value.empty()) return out;
+            out = writeVarint(out, tag);
+            out = writeVarint(out, value.size());
+            std::memcpy(out, value.data(), value.size());
+            return out + value.size();
+        } else {
+            if (value == T()) return out;
+            out = writeVarint(out, tag);
+            return writeVarint(out, static_cast<uint64_t>(value));
+        }
+    }
+
+    static const uint8_t* read(const uint8_t* p, const uint8_t* end, uint32_t wireType, Message& msg) {
+        if (wireType != static_cast<uint32_t>(Field::wireType)) return nullptr;
+        uint64_t value = 0;
+        p = readVarint(p, end, value);
+        if (p == nullptr) return nullptr;
+        if constexpr (repeated) {
+            if (value > static_cast<uint64_t>(end - p)) return nullptr;
+            get(msg).push_back(asView(p, static_cast<size_t>(value)));
+            return p + value;
+        } else if constexpr (lengthDelimited) {
+            if (value > static_cast<uint64_t>(end - p)) return nullptr;
+            get(msg) = asView(p, static_cast<size_t>(value));
+            return p + value;
+        } else {
+            get(msg) = static_cast<T>(value);
+            return p;
+        }
+    }
+};
+
+// Specialized by the generated code for every message struct
+template <typename Message>
+struct Fields;
+
+template <typename Message>
+using FieldsOf = typename Fields<Message>::type;
+
+// Exact number of bytes encode() will write
+template <typename Message>
+size_t encodedSize(const Message& msg) {
+    return std::apply([&msg](auto... field) {
+        return (size_t(0) + ... + decltype(field)::size(msg));
+    }, FieldsOf<Message>());
+}
+
+// Encode msg into out. Returns the number of bytes written, or 0 if
+// capacity is smaller than encodedSize(msg).
+template <typename Message>
+size_t encode(const Message& msg, uint8_t* out, size_t capacity) {
+    size_t size = encodedSize(msg);
+    if (size > capacity) return 0;
+    uint8_t* p = out;
+    std::apply([&msg, &p](auto... field) {
+        ((p = decltype(field)::write(msg, p)), ...);
+    }, FieldsOf<Message>());
+    return static_cast<size_t>(p - out);
+}
+
+// Decode data into msg. String and bytes fields view into data, which has to
+// outlive msg. Unknown fields are skipped; returns false on malformed input.
+template <typename Message>
+bool decode(const uint8_t* data, size_t size, Message& msg) {
+    msg = Message();
+    const uint8_t* p = data;
+    const uint8_t* end = data + size;
+    while (p < end) {
+        uint64_t key = 0;
+        p = readVarint(p, end, key);
+        if (p == nullptr || key > 0xFFFFFFFFu) return false;
+        uint32_t number = static_cast<uint32_t>(key >> 3);
+        uint32_t wireType = static_cast<uint32_t>(key & 0x07);
+        if (number == 0) return false;
+
+        bool known = false;
+        std::apply([&](auto... field) {
+            ((!known && decltype(field)::number == number
+                ? (known = true, p = decltype(field)::read(p, end, wireType, msg), true)
+                : false) || ...);
+        }, FieldsOf<Message>());
+
+        if (!known) p = skipField(p, end, wireType);
+        if (p == nullptr) return false;
+    }
+    return true;
+}
+
+template <typename Message>
+bool decode(std::string_view data, Message& msg) {
+    return decode(reinterpret_cast<const uint8_t*>(data.data()), data.size(), msg);
+}
+
+} // namespace proto
+
+#endif // PROTO_CODEC_H
@@ -0,0 +1,37 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// SHA-256 (FIPS 180-4), for naming content-addressed chunks.
+namespace sha256 {
+
+constexpr size_t kDigestSize = 32;
+
+class Hasher {
+public:
+    Hasher();
+
+    void update(const uint8_t* data, size_t size);
+
+    // Write the digest of everything passed to update() into out, which
+    // must hold kDigestSize bytes. The hasher is spent afterwards.
+    void finish(uint8_t* out);
+
+private:
+    void block(const uint8_t* data);
+
+    uint32_t state_[8];
+    uint8_t buffer_[64];
+    size_t buffered_ = 0;
+    uint64_t length_ = 0;  // bytes hashed
+};
+
+// Digest of size bytes, as kDigestSize raw bytes
+std::string digest(const uint8_t* data, size_t size);
+
+} // namespace sha256
+
+#endif // SHA256_H
@@ -0,0 +1,316 @@
+#include "store_response_decoder.h"
+#include <cstring>
+#include "base64.h"
+#include "payload_compression.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+inline bool isJsonSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+inline const char* skipSpace(const char* p, const char* end) {
+    while (p < end && isJsonSpace(*p)) ++p;
+    return p;
+}
+
+inline bool keyIs(std::string_view key, const char* name) {
+    return key == name;
+}
+
+// Decode a base64 JSON string body into out. JSON-escaped slashes ("\/")
+// are accepted by unescaping into scratch first; anything else outside the
+// alphabet is an error.
+bool decodeBase64Into(std::string_view encoded, std::vector<uint8_t>& out, std::string& scratch) {
+    if (encoded.find('\\') != std::string_view::npos) {
+        scratch.clear();
+        for (char c : encoded) {
+            if (c != '\\') scratch.push_back(c);
+        }
+        encoded = scratch;
+    }
+    size_t base = out.size();
+    out.resize(base + base64::decodedMaxSize(encoded.size()));
+    size_t written = 0;
+    if (!base64::decode(encoded.data(), encoded.size(), out.data() + base, written)) return false;
+    out.resize(base + written);
+    return true;
+}
+
+// Append one decimal byte value of 1-3 digits
+inline bool appendByte(const char* digits, int len, std::vector<uint8_t>& out) {
+    if (len < 1 || len > 3) return false;
+    unsigned value = static_cast<unsigned>(digits[0] - '0');
+    for (int i = 1; i < len; ++i) {
+        value = value * 10 + static_cast<unsigned>(digits[i] - '0');
+    }
+    if (value > 255) return false;
+    out.push_back(static_cast<uint8_t>(value));
+    return true;
+}
+
+} // namespace
+
+// Byte lists are parsed 16 characters at a time: digit, separator and ']'
+// positions come out of a few vector compares as bitmasks, and numbers are
+// read straight from the runs of set digit bits.
+const char* parseByteList(const char* p, const char* end, std::vector<uint8_t>& out) {
+#if defined(__SSE2__)
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i ret = _mm_set1_epi8('\r');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i close = _mm_set1_epi8(']');
+
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i shifted = _mm_sub_epi8(chunk, zero);
+        unsigned digitMask = static_cast<unsigned>(_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_min_epu8(shifted, nine), shifted)));
+        __m128i sep = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, comma), _mm_cmpeq_epi8(chunk, space)),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, newline), _mm_cmpeq_epi8(chunk, ret)),
+                         _mm_cmpeq_epi8(chunk, tab)));
+        unsigned sepMask = static_cast<unsigned>(_mm_movemask_epi8(sep));
+        unsigned closeMask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, close)));
+
+        // Only look at the characters before a closing bracket
+        int limit = closeMask ? __builtin_ctz(closeMask) : 16;
+        unsigned limitMask = (limit == 16) ? 0xFFFFu : ((1u << limit) - 1);
+        if (((digitMask | sepMask) & limitMask) != limitMask) return nullptr;
+        digitMask &= limitMask;
+
+        // A number running into the end of the block is left for the next one
+        if (!closeMask && (digitMask & 0x8000u)) {
+            unsigned nonDigit = ~digitMask & 0xFFFFu;
+            if (!nonDigit) return nullptr;
+            limit = 32 - __builtin_clz(nonDigit);
+            digitMask &= (1u << limit) - 1;
+        }
+
+        while (digitMask) {
+            int start = __builtin_ctz(digitMask);
+            int len = __builtin_ctz(~(digitMask >> start));
+            if (!appendByte(p + start, len, out)) return nullptr;
+            digitMask &= ~(((1u << len) - 1) << start);
+        }
+
+        p += limit;
+        if (closeMask) return p + 1;
+    }
+#endif
+
+    // Scalar tail (and the whole list on targets without SSE2)
+    while (p < end) {
+        char c = *p;
+        if (c >= '0' && c <= '9') {
+            const char* start = p;
+            while (p < end && *p >= '0' && *p <= '9') ++p;
+            if (!appendByte(start, static_cast<int>(p - start), out)) return nullptr;
+        } else if (c == ']') {
+            return p + 1;
+        } else if (c == ',' || isJsonSpace(c)) {
+            ++p;
+        } else {
+            return nullptr;
+        }
+    }
+    return nullptr;
+}
+
+void StoreResponseDecoder::reset(const char* data, size_t len) {
+    pos_ = data;
+    end_ = data + len;
+    failed_ = (data == nullptr);
+    depth_ = 0;
+    messagesDepth_ = -1;
+    payloadDepth_ = -1;
+    expectMessages_ = false;
+    cursor_ = std::string_view();
+    clearEntry();
+}
+
+void StoreResponseDecoder::clearEntry() {
+    messageHash_ = std::string_view();
+    contentTopic_ = std::string_view();
+    envelopeTimestamp_ = 0;
+    havePayload_ = false;
+}
+
+// Read a JSON string starting at the opening quote, leaving pos_ after the
+// closing quote. Escapes are not resolved.
+bool StoreResponseDecoder::scanString(std::string_view& out) {
+    const char* start = pos_ + 1;
+    const char* p = start;
+    while (true) {
+        p = static_cast<const char*>(std::memchr(p, '"', static_cast<size_t>(end_ - p)));
+        if (p == nullptr) return false;
+        // Count the backslashes in front of the quote
+        const char* q = p;
+        while (q > start && q[-1] == '\\') --q;
+        if (((p - q) & 1) == 0) break;
+        ++p;
+    }
+    out = std::string_view(start, static_cast<size_t>(p - start));
+    pos_ = p + 1;
+    return true;
+}
+
+bool StoreResponseDecoder::skipString() {
+    std::string_view ignored;
+    return scanString(ignored);
+}
+
+// Read an unsigned integer value, which some encoders put in quotes
+bool StoreResponseDecoder::readUnsigned(uint64_t& out) {
+    bool quoted = (pos_ < end_ && *pos_ == '"');
+    if (quoted) ++pos_;
+    uint64_t value = 0;
+    const char* start = pos_;
+    while (pos_ < end_ && *pos_ >= '0' && *pos_ <= '9') {
+        value = value * 10 + static_cast<uint64_t>(*pos_ - '0');
+        ++pos_;
+    }
+    if (quoted) {
+        if (pos_ >= end_ || *pos_ != '"') return false;
+        ++pos_;
+    }
+    out = value;
+    return pos_ != start;
+}
+
+bool StoreResponseDecoder::readPayload() {
+    payloadBuffer_.clear();
+    if (*pos_ == '[') {
+        const char* next = parseByteList(pos_ + 1, end_, payloadBuffer_);
+        if (next == nullptr) return false;
+        pos_ = next;
+    } else if (*pos_ == '"') {
+        std::string_view encoded;
+        if (!scanString(encoded)) return false;
+        if (!decodeBase64Into(encoded, payloadBuffer_, escapeBuffer_)) return false;
+    } else {
+        // null or an unexpected type, leave it to the main loop
+        return true;
+    }
+    havePayload_ = true;
+    payloadDepth_ = depth_;
+    return true;
+}
+
+bool StoreResponseDecoder::next(StoreMessage& out) {
+    if (failed_) return false;
+
+    while (pos_ < end_) {
+        char c = *pos_;
+        switch (c) {
+            case '{':
+                ++depth_;
+                ++pos_;
+                if (messagesDepth_ >= 0 && depth_ == messagesDepth_ + 1) {
+                    clearEntry();
+                }
+                break;
+
+            case '}': {
+                // An entry ends either with its element of the "messages"
+                // array or, without one, with the object holding the payload
+                bool entryEnd = havePayload_ &&
+                    ((messagesDepth_ >= 0 && depth_ == messagesDepth_ + 1) ||
+                     (messagesDepth_ < 0 && depth_ == payloadDepth_));
+                --depth_;
+                ++pos_;
+                if (entryEnd) {
+                    out.messageHash = messageHash_;
+                    out.contentTopic = contentTopic_;
+                    out.envelopeTimestamp = envelopeTimestamp_;
+                    out.payload = payloadBuffer_.data();
+                    out.payloadSize = payloadBuffer_.size();
+                    if (compressor_ != nullptr) {
+                        out.decoded = compressor_->decode(payloadBuffer_.data(), payloadBuffer_.size(), message_, textBuffer_);
+                    } else {
+                        out.decoded = proto::decode(payloadBuffer_.data(), payloadBuffer_.size(), message_) &&
+                                      message_.compression == 0;
+                    }
+                    if (out.decoded) {
+                        out.timestamp = message_.timestamp;
+                        out.nick = message_.nick;
+                        out.text = message_.payload;
+                    } else {
+                        out.timestamp = 0;
+                        out.nick = std::string_view();
+                        out.text = std::string_view();
+                    }
+                    clearEntry();
+                    return true;
+                }
+                break;
+            }
+
+            case '[':
+                ++depth_;
+                ++pos_;
+                if (expectMessages_) {
+                    messagesDepth_ = depth_;
+                    expectMessages_ = false;
+                }
+                break;
+
+            case ']':
+                if (depth_ == messagesDepth_) messagesDepth_ = -1;
+                --depth_;
+                ++pos_;
+                break;
+
+            case '"': {
+                std::string_view key;
+                if (!scanString(key)) {
+                    failed_ = true;
+                    return false;
+                }
+                pos_ = skipSpace(pos_, end_);
+                if (pos_ >= end_ || *pos_ != ':') {
+                    // A string value we don't care about
+                    break;
+                }
+                pos_ = skipSpace(pos_ + 1, end_);
+                if (pos_ >= end_) break;
+
+                bool ok = true;
+                if (keyIs(key, "payload")) {
+                    ok = readPayload();
+                } else if (keyIs(key, "messageHash") || keyIs(key, "message_hash")) {
+                    ok = (*pos_ != '"') || scanString(messageHash_);
+                } else if (keyIs(key, "contentTopic") || keyIs(key, "content_topic")) {
+                    ok = (*pos_ != '"') || scanString(contentTopic_);
+                } else if (keyIs(key, "timestamp")) {
+                    uint64_t ts = 0;
+                    if (readUnsigned(ts)) envelopeTimestamp_ = ts;
+                } else if (depth_ == 1 && (keyIs(key, "pagination_cursor") || keyIs(key, "paginationCursor"))) {
+                    ok = (*pos_ != '"') || scanString(cursor_);
+                } else if (keyIs(key, "messages")) {
+                    expectMessages_ = (*pos_ == '[');
+                } else if (*pos_ == '"') {
+                    ok = skipString();
+                }
+                if (!ok) {
+                    failed_ = true;
+                    return false;
+                }
+                break;
+            }
+
+            default:
+                ++pos_;
+                break;
+        }
+    }
+    return false;
+}
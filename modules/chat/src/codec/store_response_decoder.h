@@ -0,0 +1,94 @@
+#ifndef STORE_RESPONSE_DECODER_H
+#define STORE_RESPONSE_DECODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "message.codec.h"
+
+class PayloadCompressor;
+
+// A single message handed out by StoreResponseDecoder.
+// All views point either into the response buffer or into the decoder's
+// reusable buffers and are only valid until the next call to next().
+struct StoreMessage {
+    std::string_view messageHash;
+    std::string_view contentTopic;
+    uint64_t envelopeTimestamp = 0;   // Waku envelope timestamp (ns)
+    const uint8_t* payload = nullptr; // raw Chat2Message bytes, as sent
+    size_t payloadSize = 0;
+    bool decoded = false;             // payload parsed as a Chat2Message
+    uint64_t timestamp = 0;           // Chat2Message timestamp (s)
+    std::string_view nick;
+    std::string_view text;            // decompressed if it was sent compressed
+};
+
+// Single-pass decoder for store query responses.
+//
+// Walks the JSON once, decoding each "payload" (either a byte list or a
+// base64 string) straight into a reusable buffer and decoding the protobuf
+// in place, with nick and text viewing into that buffer. Messages are handed
+// out one at a time through next(), so a page is never materialized as a
+// whole.
+class StoreResponseDecoder {
+public:
+    StoreResponseDecoder() = default;
+    StoreResponseDecoder(const char* data, size_t len) { reset(data, len); }
+
+    // Start decoding a new response. Buffers are kept, so a decoder reused
+    // across pages stops allocating once it has seen the largest payload.
+    void reset(const char* data, size_t len);
+
+    // Decode the next message. Returns false at the end of the response or
+    // on malformed input (see failed()).
+    bool next(StoreMessage& out);
+
+    bool failed() const { return failed_; }
+
+    // Decompress compressed payloads with compressor, which has to outlive
+    // the decoder. Without one, compressed messages fail to decode.
+    void setCompressor(const PayloadCompressor* compressor) { compressor_ = compressor; }
+
+    // Cursor for the next page, empty on the last page. Only complete once
+    // next() has returned false, as it may follow the messages.
+    std::string_view paginationCursor() const { return cursor_; }
+
+private:
+    bool scanString(std::string_view& out);
+    bool skipString();
+    bool readUnsigned(uint64_t& out);
+    bool readPayload();
+    void clearEntry();
+
+    const char* pos_ = nullptr;
+    const char* end_ = nullptr;
+    bool failed_ = false;
+
+    // Structural state carried between next() calls
+    int depth_ = 0;
+    int messagesDepth_ = -1;  // depth of the "messages" array, if any
+    int payloadDepth_ = -1;   // depth of the object holding "payload"
+    bool expectMessages_ = false;
+    std::string_view cursor_;
+
+    // Current entry
+    std::string_view messageHash_;
+    std::string_view contentTopic_;
+    uint64_t envelopeTimestamp_ = 0;
+    bool havePayload_ = false;
+
+    std::vector<uint8_t> payloadBuffer_;
+    std::string escapeBuffer_;  // base64 payloads with JSON escapes
+    std::vector<uint8_t> textBuffer_;  // decompressed payload field
+    chat::Chat2MessageView message_;
+    const PayloadCompressor* compressor_ = nullptr;
+};
+
+// Parse a JSON list of byte values (e.g. "12,0,255]") starting right after
+// the opening '[' and append them to out. Returns a pointer past the closing
+// ']' or nullptr if the list is malformed or a value is out of range.
+const char* parseByteList(const char* begin, const char* end, std::vector<uint8_t>& out);
+
+#endif // STORE_RESPONSE_DECODER_H
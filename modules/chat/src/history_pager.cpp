@@ -0,0 +1,227 @@
+#include "history_pager.h"
+#include <algorithm>
+#include <QtCore/QUuid>
+#include "chat_api.h"
+
+namespace {
+
+HistoryPage toPage(const std::vector<HistoryRecord>& records) {
+    HistoryPage page;
+    page.reserve(records.size());
+    for (const HistoryRecord& record : records) {
+        DecodedMessage decodedMsg = decodeProto(record.payload);
+        if (decodedMsg.success) {
+            page.push_back(HistoryEntry{decodedMsg.timestamp, decodedMsg.nick, decodedMsg.payload});
+        }
+    }
+    return page;
+}
+
+} // namespace
+
+std::shared_ptr<StoreHistoryPager> StoreHistoryPager::create(const std::string& channelName,
+                                                             const HistoryPagerOptions& options, bool remote) {
+    std::shared_ptr<StoreHistoryPager> pager(new StoreHistoryPager(channelContentTopic(channelName), options, remote));
+    std::unique_lock<std::mutex> lock(pager->mutex_);
+    pager->fill(lock);
+    return pager;
+}
+
+StoreHistoryPager::StoreHistoryPager(const std::string& contentTopic, const HistoryPagerOptions& options, bool remote)
+    : contentTopic_(contentTopic), options_(options), remote_(remote) {
+    options_.minPageSize = std::max<size_t>(1, options_.minPageSize);
+    options_.maxPageSize = std::max(options_.minPageSize, options_.maxPageSize);
+    pageSize_ = std::clamp(options_.initialPageSize, options_.minPageSize, options_.maxPageSize);
+    decoder_.setCompressor(&appState.compression);
+}
+
+StoreHistoryPager::~StoreHistoryPager() {
+    cancel();
+}
+
+bool StoreHistoryPager::next(HistoryPage& page) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return !ready_.empty() || cancelled_ || (exhausted_ && !inFlight_); });
+    return popPage(page, lock);
+}
+
+bool StoreHistoryPager::tryNext(HistoryPage& page) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return popPage(page, lock);
+}
+
+void StoreHistoryPager::cancel() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cancelled_ = true;
+    ready_.clear();
+    cv_.notify_all();
+}
+
+bool StoreHistoryPager::finished() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cancelled_ || (exhausted_ && !inFlight_ && ready_.empty());
+}
+
+bool StoreHistoryPager::failed() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return failed_;
+}
+
+size_t StoreHistoryPager::pageSize() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pageSize_;
+}
+
+bool StoreHistoryPager::popPage(HistoryPage& page, std::unique_lock<std::mutex>& lock) {
+    if (cancelled_ || ready_.empty()) return false;
+    page = std::move(ready_.front());
+    ready_.pop_front();
+    // Start on the page after this one while the caller works on it
+    fill(lock);
+    return true;
+}
+
+// Top up ready_ until prefetchPages pages are ready or on their way.
+// Called with the lock held; released around the store query.
+void StoreHistoryPager::fill(std::unique_lock<std::mutex>& lock) {
+    size_t target = std::max<size_t>(1, options_.prefetchPages);
+    while (!cancelled_ && !exhausted_ && !inFlight_ && ready_.size() < target) {
+        if (!localDone_) {
+            std::vector<HistoryRecord> records =
+                appState.history.readBefore(contentTopic_, localBefore_, localBeforeHash_, pageSize_);
+            if (records.empty()) {
+                localDone_ = true;
+                continue;
+            }
+            localBefore_ = records.front().timestamp;
+            localBeforeHash_ = records.front().messageHash;
+            remoteEnd_ = localBefore_;
+            localDone_ = records.size() < pageSize_;
+            ready_.push_back(toPage(records));
+            cv_.notify_all();
+            continue;
+        }
+
+        if (!remote_) {
+            exhausted_ = true;
+            break;
+        }
+
+        WakuInterface* wakuPlugin = PluginRegistry::getPlugin<WakuInterface>(wakuPluginName());
+        if (!wakuPlugin) {
+            std::cerr << "Failed to get Waku plugin" << std::endl;
+            exhausted_ = true;
+            failed_ = true;
+            break;
+        }
+
+        inFlight_ = true;
+        std::string queryJson = buildQuery();
+        std::weak_ptr<StoreHistoryPager> weakSelf = shared_from_this();
+        auto sent = std::chrono::steady_clock::now();
+
+        // The plugin may answer synchronously, so don't hold the lock
+        lock.unlock();
+        wakuPlugin->storeQuery(
+            QString::fromStdString(queryJson),
+            QString::fromStdString(STORE_NODE),
+            options_.timeoutMs,
+            [weakSelf, sent](bool success, const QString &message) {
+                if (auto self = weakSelf.lock()) {
+                    self->onResponse(success, message.toStdString(), sent);
+                }
+            }
+        );
+        lock.lock();
+    }
+    if (exhausted_ && !inFlight_) cv_.notify_all();
+}
+
+std::string StoreHistoryPager::buildQuery() const {
+    std::string requestId = QUuid::createUuid().toString(QUuid::WithoutBraces).toStdString();
+    std::string queryJson = R"({
+       "request_id": ")" + requestId + R"(",
+       "include_data": true,
+       "content_topics": [)" + historyContentTopics(contentTopic_) + R"(],
+       "pagination_forward": false,
+       "pagination_limit": )" + std::to_string(pageSize_);
+    // Inclusive, other messages may share the oldest local timestamp
+    if (remoteEnd_ != 0) {
+        queryJson += ",\n       \"time_end\": " + std::to_string(remoteEnd_);
+    }
+    if (!cursor_.empty()) {
+        queryJson += ",\n       \"pagination_cursor\": \"" + cursor_ + "\"";
+    }
+    queryJson += "\n   }";
+    return queryJson;
+}
+
+void StoreHistoryPager::onResponse(bool success, const std::string& response, std::chrono::steady_clock::time_point sent) {
+    double latencyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sent).count();
+
+    // Decode outside the lock; only one query is ever in flight
+    std::vector<std::pair<uint64_t, HistoryEntry>> entries;
+    std::string cursor;
+    bool malformed = false;
+    if (success && !response.empty()) {
+        decoder_.reset(response.data(), response.size());
+        StoreMessage storeMsg;
+        while (decoder_.next(storeMsg)) {
+            uint64_t envelope = storeMsg.envelopeTimestamp;
+            unpackStoreMessage(storeMsg, [&](const std::string& key, const uint8_t* data, size_t size,
+                                             const chat::Chat2MessageView& decoded) {
+                uint64_t timestamp = envelope != 0 ? envelope : decoded.timestamp * 1000000000ULL;
+                // At the boundary, the ones stored locally were on a local page
+                if (timestamp == remoteEnd_ && !key.empty() && appState.history.contains(contentTopic_, key)) {
+                    return;
+                }
+                appState.history.append(contentTopic_, key, timestamp, data, size);
+                entries.emplace_back(timestamp, HistoryEntry{formatTimestampProto(decoded.timestamp),
+                                                             std::string(decoded.nick),
+                                                             std::string(decoded.payload)});
+            });
+        }
+        malformed = decoder_.failed();
+        cursor.assign(decoder_.paginationCursor());
+    }
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    inFlight_ = false;
+    if (cancelled_) {
+        cv_.notify_all();
+        return;
+    }
+    if (!success || malformed) {
+        std::cerr << "History page query for " << contentTopic_ << " failed"
+                  << (malformed ? ": malformed response" : "") << std::endl;
+        exhausted_ = true;
+        failed_ = true;
+        cv_.notify_all();
+        return;
+    }
+
+    adaptPageSize(latencyMs);
+    cursor_ = cursor;
+    if (cursor_.empty()) exhausted_ = true;
+    if (!entries.empty()) {
+        HistoryPage page;
+        page.reserve(entries.size());
+        for (auto& entry : entries) page.push_back(std::move(entry.second));
+        ready_.push_back(std::move(page));
+    }
+    cv_.notify_all();
+    fill(lock);
+}
+
+void StoreHistoryPager::adaptPageSize(double latencyMs) {
+    latencyMs_ = (latencyMs_ == 0) ? latencyMs : 0.7 * latencyMs_ + 0.3 * latencyMs;
+    // Fast round trips: bigger pages need fewer of them. Slow ones: smaller
+    // pages get the next screenful in before the reader catches up.
+    if (latencyMs_ > options_.targetLatencyMs) {
+        pageSize_ = std::max(options_.minPageSize, pageSize_ * 2 / 3);
+    } else if (latencyMs_ < options_.targetLatencyMs / 2.0) {
+        pageSize_ = std::min(options_.maxPageSize, pageSize_ + pageSize_ / 2);
+    }
+}
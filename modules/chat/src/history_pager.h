@@ -0,0 +1,72 @@
+#ifndef HISTORY_PAGER_H
+#define HISTORY_PAGER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "../chat_interface.h"
+#include "codec/store_response_decoder.h"
+
+// HistoryPager backed by the local history store and the store node.
+//
+// Pages are served from the local store first. Once it runs out, the
+// store node is queried backwards from the oldest local message, following
+// the pagination cursor from page to page; remote results are written to
+// the local store so the next pass over the same range stays local. One
+// query is kept in flight ahead of the consumer, and the page size grows
+// while round trips stay well under targetLatencyMs and shrinks when they
+// go over it.
+class StoreHistoryPager : public HistoryPager, public std::enable_shared_from_this<StoreHistoryPager> {
+public:
+    // With remote false only the local store is paged through
+    static std::shared_ptr<StoreHistoryPager> create(const std::string& channelName,
+                                                     const HistoryPagerOptions& options, bool remote);
+    ~StoreHistoryPager() override;
+
+    bool next(HistoryPage& page) override;
+    bool tryNext(HistoryPage& page) override;
+    void cancel() override;
+    bool finished() const override;
+
+    // Whether paging stopped because a store query failed
+    bool failed() const;
+
+    // Page size the next query will ask for
+    size_t pageSize() const;
+
+private:
+    StoreHistoryPager(const std::string& contentTopic, const HistoryPagerOptions& options, bool remote);
+
+    void fill(std::unique_lock<std::mutex>& lock);
+    bool popPage(HistoryPage& page, std::unique_lock<std::mutex>& lock);
+    std::string buildQuery() const;
+    void onResponse(bool success, const std::string& response, std::chrono::steady_clock::time_point sent);
+    void adaptPageSize(double latencyMs);
+
+    const std::string contentTopic_;
+    HistoryPagerOptions options_;
+    const bool remote_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<HistoryPage> ready_;
+    bool inFlight_ = false;
+    bool cancelled_ = false;
+    bool exhausted_ = false;
+    bool failed_ = false;
+    bool localDone_ = false;
+
+    uint64_t localBefore_ = UINT64_MAX;  // next local page ends before the message
+    std::string localBeforeHash_;        // (localBefore_, localBeforeHash_)
+    uint64_t remoteEnd_ = 0;             // remote queries end at this, 0 for now
+    std::string cursor_;
+    size_t pageSize_;
+    double latencyMs_ = 0;               // smoothed store query latency
+
+    StoreResponseDecoder decoder_;       // only used by the query in flight
+};
+
+#endif // HISTORY_PAGER_H
@@ -0,0 +1,101 @@
+#include "hdr_histogram.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+unsigned int bitLength(uint64_t value) {
+    return value == 0 ? 0 : 64 - static_cast<unsigned int>(__builtin_clzll(value));
+}
+
+} // namespace
+
+HdrHistogram::HdrHistogram(uint64_t highest, int significantDigits) : highest_(std::max<uint64_t>(2, highest)) {
+    int digits = std::min(5, std::max(1, significantDigits));
+    // Values below this are counted exactly
+    uint64_t singleUnitResolution = 2 * static_cast<uint64_t>(std::pow(10, digits));
+    unsigned int subBucketCountMagnitude = bitLength(singleUnitResolution - 1);
+    subBucketHalfCountMagnitude_ = subBucketCountMagnitude - 1;
+    uint64_t subBucketCount = 1ULL << subBucketCountMagnitude;
+    subBucketHalfCount_ = subBucketCount / 2;
+    subBucketMask_ = subBucketCount - 1;
+
+    size_t buckets = 1;
+    for (uint64_t untrackable = subBucketCount; untrackable <= highest_ && untrackable < (1ULL << 62); untrackable <<= 1) {
+        buckets++;
+    }
+    counts_.assign((buckets + 1) * subBucketHalfCount_, 0);
+}
+
+size_t HdrHistogram::indexOf(uint64_t value) const {
+    unsigned int bucket = bitLength(value | subBucketMask_) - (subBucketHalfCountMagnitude_ + 1);
+    uint64_t subBucket = value >> bucket;
+    return static_cast<size_t>((uint64_t(bucket + 1) << subBucketHalfCountMagnitude_) + (subBucket - subBucketHalfCount_));
+}
+
+uint64_t HdrHistogram::valueOf(size_t index) const {
+    int64_t bucket = static_cast<int64_t>(index >> subBucketHalfCountMagnitude_) - 1;
+    uint64_t subBucket = (index & (subBucketHalfCount_ - 1)) + subBucketHalfCount_;
+    if (bucket < 0) {
+        subBucket -= subBucketHalfCount_;
+        bucket = 0;
+    }
+    return subBucket << bucket;
+}
+
+// Largest value counted in the same counter as value
+uint64_t HdrHistogram::highestEquivalent(uint64_t value) const {
+    unsigned int bucket = bitLength(value | subBucketMask_) - (subBucketHalfCountMagnitude_ + 1);
+    uint64_t lowest = value >> bucket << bucket;
+    return lowest + (1ULL << bucket) - 1;
+}
+
+void HdrHistogram::record(uint64_t value, uint64_t count) {
+    value = std::min(value, highest_);
+    counts_[indexOf(value)] += count;
+    total_ += count;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+    sum_ += static_cast<double>(value) * static_cast<double>(count);
+}
+
+void HdrHistogram::merge(const HdrHistogram& other) {
+    if (other.counts_.size() != counts_.size() || other.subBucketMask_ != subBucketMask_) return;
+    for (size_t i = 0; i < counts_.size(); ++i) counts_[i] += other.counts_[i];
+    total_ += other.total_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+    sum_ += other.sum_;
+}
+
+void HdrHistogram::reset() {
+    std::fill(counts_.begin(), counts_.end(), 0);
+    total_ = 0;
+    min_ = UINT64_MAX;
+    max_ = 0;
+    sum_ = 0;
+}
+
+uint64_t HdrHistogram::min() const {
+    return total_ == 0 ? 0 : min_;
+}
+
+uint64_t HdrHistogram::max() const {
+    return max_;
+}
+
+double HdrHistogram::mean() const {
+    return total_ == 0 ? 0 : sum_ / static_cast<double>(total_);
+}
+
+uint64_t HdrHistogram::valueAt(double percentile) const {
+    if (total_ == 0) return 0;
+    double share = std::min(100.0, std::max(0.0, percentile)) / 100;
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(share * static_cast<double>(total_))));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts_.size(); ++i) {
+        seen += counts_[i];
+        if (seen >= rank) return std::min(max_, highestEquivalent(valueOf(i)));
+    }
+    return max_;
+}
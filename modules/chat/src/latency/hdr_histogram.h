@@ -0,0 +1,50 @@
+#ifndef HDR_HISTOGRAM_H
+#define HDR_HISTOGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Counts of values from 0 to highest with a fixed relative precision, as in
+// HdrHistogram: values are kept to significantDigits decimal digits, so
+// with 2 a value reads back less than 1% off (12345 as 12351). Buckets
+// double in width, each split into the same number of sub-buckets, which
+// keeps the memory at a few thousand counters for any range.
+//
+// Not thread-safe.
+class HdrHistogram {
+public:
+    explicit HdrHistogram(uint64_t highest = 3600000000ULL, int significantDigits = 2);
+
+    // Values above highest are counted as highest
+    void record(uint64_t value, uint64_t count = 1);
+    // Add the counts of a histogram of the same range and precision
+    void merge(const HdrHistogram& other);
+    void reset();
+
+    uint64_t count() const { return total_; }
+    uint64_t min() const;
+    uint64_t max() const;
+    double mean() const;
+
+    // Smallest recorded value that percentile percent of the values are at
+    // or below, to the histogram's precision. 0 when empty.
+    uint64_t valueAt(double percentile) const;
+
+private:
+    size_t indexOf(uint64_t value) const;
+    uint64_t valueOf(size_t index) const;
+    uint64_t highestEquivalent(uint64_t value) const;
+
+    uint64_t highest_;
+    unsigned int subBucketHalfCountMagnitude_;
+    uint64_t subBucketHalfCount_;
+    uint64_t subBucketMask_;
+    std::vector<uint64_t> counts_;
+    uint64_t total_ = 0;
+    uint64_t min_ = UINT64_MAX;
+    uint64_t max_ = 0;
+    double sum_ = 0;
+};
+
+#endif // HDR_HISTOGRAM_H
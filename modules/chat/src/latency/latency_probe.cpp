@@ -0,0 +1,256 @@
+#include "latency_probe.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <set>
+#include <sstream>
+#include "message.codec.h"
+
+namespace {
+
+const std::string PROBE_NICK_PREFIX = "probe:";
+
+uint64_t unixNanos() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+std::string randomNodeId() {
+    std::random_device device;
+    uint64_t id = (uint64_t(device()) << 32) ^ device();
+    std::ostringstream out;
+    out << std::hex << std::setw(16) << std::setfill('0') << id;
+    return out.str();
+}
+
+bool parseNumber(std::string_view& text, uint64_t& value) {
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (result.ec != std::errc()) return false;
+    text.remove_prefix(static_cast<size_t>(result.ptr - text.data()));
+    return true;
+}
+
+} // namespace
+
+const char* probePathName(ProbePath path) {
+    switch (path) {
+        case ProbePath::Relay:
+            return "relay";
+        case ProbePath::Filter:
+            return "filter";
+        case ProbePath::Store:
+            return "store";
+    }
+    return "unknown";
+}
+
+LatencyProbe::LatencyProbe() : nodeId_(randomNodeId()) {}
+
+LatencyProbe::~LatencyProbe() {
+    stop();
+}
+
+bool LatencyProbe::start(const LatencyProbeOptions& options, SendProbe send, QueryStore queryStore,
+                         ListChannels channels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_) return false;
+    options_ = options;
+    options_.intervalMs = std::max(1u, options_.intervalMs);
+    options_.timeoutMs = std::max(options_.intervalMs, options_.timeoutMs);
+    send_ = std::move(send);
+    queryStore_ = std::move(queryStore);
+    channels_ = std::move(channels);
+    running_ = true;
+    stopping_ = false;
+    worker_ = std::thread(&LatencyProbe::run, this);
+    return true;
+}
+
+void LatencyProbe::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) return;
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    worker_.join();
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+    pending_.clear();
+}
+
+bool LatencyProbe::running() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return running_;
+}
+
+std::vector<uint8_t> LatencyProbe::encodeProbe(uint64_t seq, uint64_t sentAt) const {
+    std::string nick = PROBE_NICK_PREFIX + nodeId_;
+    std::string text = std::to_string(seq) + " " + std::to_string(sentAt);
+    chat::Chat2MessageView msg;
+    msg.timestamp = sentAt / 1000000000ULL;
+    msg.nick = nick;
+    msg.payload = text;
+    std::vector<uint8_t> out(proto::encodedSize(msg));
+    proto::encode(msg, out.data(), out.size());
+    return out;
+}
+
+bool LatencyProbe::received(const std::string& contentTopic, std::string_view nick, std::string_view text,
+                            bool fromStore, uint64_t now) {
+    if (nick.size() != PROBE_NICK_PREFIX.size() + nodeId_.size() ||
+        nick.compare(0, PROBE_NICK_PREFIX.size(), PROBE_NICK_PREFIX) != 0 ||
+        nick.substr(PROBE_NICK_PREFIX.size()) != nodeId_) {
+        return false;
+    }
+    uint64_t seq = 0;
+    uint64_t sentAt = 0;
+    if (!parseNumber(text, seq) || text.empty() || text[0] != ' ') return false;
+    text.remove_prefix(1);
+    if (!parseNumber(text, sentAt)) return false;
+    uint64_t latencyUs = now > sentAt ? (now - sentAt) / 1000 : 0;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = pending_.find(seq);
+    // Already expired, or a copy past the ones counted
+    if (it == pending_.end() || it->second.contentTopic != contentTopic) return true;
+    Pending& probe = it->second;
+    if (fromStore) {
+        if (probe.stored) return true;
+        probe.stored = true;
+        stats(contentTopic, ProbePath::Store).histogram.record(latencyUs);
+    } else {
+        if (probe.pushes >= 2) return true;
+        stats(contentTopic, probe.pushes == 0 ? ProbePath::Relay : ProbePath::Filter).histogram.record(latencyUs);
+        probe.pushes++;
+    }
+    if (probe.pushes >= 2 && (probe.stored || options_.storeCheckMs == 0)) pending_.erase(it);
+    return true;
+}
+
+// Called with the lock held
+LatencyProbe::Stats& LatencyProbe::stats(const std::string& contentTopic, ProbePath path) {
+    auto it = stats_.find(Key(contentTopic, path));
+    if (it == stats_.end()) {
+        it = stats_.emplace(Key(contentTopic, path), Stats(options_.significantDigits)).first;
+    }
+    return it->second;
+}
+
+std::vector<LatencySummary> LatencyProbe::report(bool reset) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<LatencySummary> out = summarize();
+    if (reset) stats_.clear();
+    return out;
+}
+
+// Called with the lock held
+std::vector<LatencySummary> LatencyProbe::summarize() const {
+    std::vector<LatencySummary> out;
+    out.reserve(stats_.size());
+    for (const auto& entry : stats_) {
+        const HdrHistogram& histogram = entry.second.histogram;
+        LatencySummary summary;
+        summary.contentTopic = entry.first.first;
+        summary.path = entry.first.second;
+        summary.count = histogram.count();
+        summary.lost = entry.second.lost;
+        summary.p50Ms = static_cast<double>(histogram.valueAt(50)) / 1000;
+        summary.p99Ms = static_cast<double>(histogram.valueAt(99)) / 1000;
+        summary.p999Ms = static_cast<double>(histogram.valueAt(99.9)) / 1000;
+        summary.maxMs = static_cast<double>(histogram.max()) / 1000;
+        out.push_back(std::move(summary));
+    }
+    return out;
+}
+
+void LatencyProbe::run() {
+    using Clock = std::chrono::steady_clock;
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto now = Clock::now();
+    auto nextProbe = now;
+    auto nextStore = now + std::chrono::milliseconds(options_.storeCheckMs);
+    auto nextDump = now + std::chrono::milliseconds(options_.dumpIntervalMs);
+    while (!stopping_) {
+        now = Clock::now();
+        if (now >= nextProbe) {
+            expire(unixNanos());
+            lock.unlock();
+            sendProbes(unixNanos());
+            lock.lock();
+            nextProbe = std::max(nextProbe + std::chrono::milliseconds(options_.intervalMs), now);
+        }
+        if (options_.storeCheckMs != 0 && now >= nextStore) {
+            lock.unlock();
+            queryStore(unixNanos());
+            lock.lock();
+            nextStore = now + std::chrono::milliseconds(options_.storeCheckMs);
+        }
+        if (options_.dumpIntervalMs != 0 && now >= nextDump) {
+            dump();
+            nextDump = now + std::chrono::milliseconds(options_.dumpIntervalMs);
+        }
+        auto wake = nextProbe;
+        if (options_.storeCheckMs != 0) wake = std::min(wake, nextStore);
+        if (options_.dumpIntervalMs != 0) wake = std::min(wake, nextDump);
+        cv_.wait_until(lock, wake, [this] { return stopping_; });
+    }
+}
+
+void LatencyProbe::sendProbes(uint64_t now) {
+    if (!channels_ || !send_) return;
+    for (const std::string& contentTopic : channels_()) {
+        uint64_t seq = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            seq = nextSeq_++;
+            pending_[seq] = Pending{contentTopic, now, 0, false};
+        }
+        send_(contentTopic, encodeProbe(seq, now), now);
+    }
+}
+
+// Count what did not come back in time as lost; called with the lock held
+void LatencyProbe::expire(uint64_t now) {
+    uint64_t timeout = uint64_t(options_.timeoutMs) * 1000000ULL;
+    for (auto it = pending_.begin(); it != pending_.end();) {
+        const Pending& probe = it->second;
+        if (now - probe.sentAt < timeout) {
+            ++it;
+            continue;
+        }
+        // A missing second copy is no loss, there may be no filter
+        if (probe.pushes == 0) stats(probe.contentTopic, ProbePath::Relay).lost++;
+        if (options_.storeCheckMs != 0 && !probe.stored) stats(probe.contentTopic, ProbePath::Store).lost++;
+        it = pending_.erase(it);
+    }
+}
+
+void LatencyProbe::queryStore(uint64_t now) {
+    if (!queryStore_) return;
+    std::set<std::string> topics;
+    uint64_t since = now;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& entry : pending_) {
+            if (entry.second.stored) continue;
+            topics.insert(entry.second.contentTopic);
+            since = std::min(since, entry.second.sentAt);
+        }
+    }
+    if (topics.empty()) return;
+    queryStore_(std::vector<std::string>(topics.begin(), topics.end()), since);
+}
+
+// Called with the lock held
+void LatencyProbe::dump() const {
+    for (const LatencySummary& summary : summarize()) {
+        std::cout << "Latency " << summary.contentTopic << " " << probePathName(summary.path) << ": " << summary.count
+                  << " probes, p50 " << summary.p50Ms << " ms, p99 " << summary.p99Ms << " ms, p999 "
+                  << summary.p999Ms << " ms, max " << summary.maxMs << " ms, " << summary.lost << " lost"
+                  << std::endl;
+    }
+}
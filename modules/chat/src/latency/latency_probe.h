@@ -0,0 +1,141 @@
+#ifndef LATENCY_PROBE_H
+#define LATENCY_PROBE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "hdr_histogram.h"
+
+// How a probe came back
+enum class ProbePath : uint8_t {
+    Relay,   // first copy pushed by the node
+    Filter,  // second copy, pushed by a filter service node
+    Store    // found by querying the store node
+};
+
+const char* probePathName(ProbePath path);
+
+struct LatencyProbeOptions {
+    unsigned int intervalMs = 1000;     // between probes on each channel
+    unsigned int storeCheckMs = 10000;  // store queried for probes this often, 0 not at all
+    unsigned int timeoutMs = 120000;    // a probe not back on a path by then is lost there
+    unsigned int dumpIntervalMs = 0;    // report printed this often, 0 never
+    int significantDigits = 2;          // histogram precision
+};
+
+// Latency of one channel and path since the probe started or was reset
+struct LatencySummary {
+    std::string contentTopic;
+    ProbePath path = ProbePath::Relay;
+    uint64_t count = 0;  // probes back
+    uint64_t lost = 0;   // probes not back within timeoutMs
+    double p50Ms = 0;
+    double p99Ms = 0;
+    double p999Ms = 0;
+    double maxMs = 0;
+};
+
+// Measures publish to receive latency by sending probe messages and timing
+// them as they come back.
+//
+// Every intervalMs a probe goes out on each channel's probe topic, a
+// Chat2Message whose nick names this node and whose payload carries a
+// sequence number and the send time in ns, the same the envelope gets.
+// When a probe of this node comes back its latency is recorded in an HDR
+// histogram of its channel and path. The node hands out relay and filter
+// pushes alike, so they are told apart by order: the first copy counts as
+// relay and a second one as filter. Every storeCheckMs the store node is
+// asked for the probes of the last timeoutMs; a probe found there for the
+// first time counts as stored when the answer arrives, so store latency
+// is only as fine as storeCheckMs.
+//
+// Sending, store queries and listing the channels are left to callbacks,
+// which are called from the probe's own thread. Probes of other nodes are
+// ignored.
+//
+// All methods are thread-safe.
+class LatencyProbe {
+public:
+    using SendProbe = std::function<void(const std::string& contentTopic, const std::vector<uint8_t>& payload,
+                                         uint64_t sentAt)>;
+    // Ask for the messages on contentTopics since the given time (ns) and
+    // pass them to received()
+    using QueryStore = std::function<void(const std::vector<std::string>& contentTopics, uint64_t since)>;
+    // Channels to probe, by content topic
+    using ListChannels = std::function<std::vector<std::string>()>;
+
+    LatencyProbe();
+    ~LatencyProbe();
+
+    LatencyProbe(const LatencyProbe&) = delete;
+    LatencyProbe& operator=(const LatencyProbe&) = delete;
+
+    // Start probing; histograms are kept from an earlier run. False if
+    // already running.
+    bool start(const LatencyProbeOptions& options, SendProbe send, QueryStore queryStore, ListChannels channels);
+    void stop();
+    bool running() const;
+
+    // A message came back on a probe topic, pushed or from the store; now
+    // is in ns since the epoch. False if it is not a probe of this node.
+    bool received(const std::string& contentTopic, std::string_view nick, std::string_view text, bool fromStore,
+                  uint64_t now);
+
+    // Summaries by channel, then path; with reset the histograms start
+    // over afterwards
+    std::vector<LatencySummary> report(bool reset = false);
+
+    // Probe payload for sequence number seq sent at sentAt (ns)
+    std::vector<uint8_t> encodeProbe(uint64_t seq, uint64_t sentAt) const;
+    const std::string& nodeId() const { return nodeId_; }
+
+private:
+    struct Pending {
+        std::string contentTopic;
+        uint64_t sentAt = 0;
+        uint8_t pushes = 0;  // copies pushed back so far
+        bool stored = false;
+    };
+
+    struct Stats {
+        explicit Stats(int significantDigits) : histogram(3600000000ULL, significantDigits) {}
+
+        HdrHistogram histogram;  // us
+        uint64_t lost = 0;
+    };
+
+    using Key = std::pair<std::string, ProbePath>;
+
+    void run();
+    void sendProbes(uint64_t now);
+    void expire(uint64_t now);
+    void queryStore(uint64_t now);
+    void dump() const;
+    Stats& stats(const std::string& contentTopic, ProbePath path);
+    std::vector<LatencySummary> summarize() const;
+
+    const std::string nodeId_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    LatencyProbeOptions options_;
+    SendProbe send_;
+    QueryStore queryStore_;
+    ListChannels channels_;
+    bool running_ = false;
+    bool stopping_ = false;
+    uint64_t nextSeq_ = 1;
+    std::unordered_map<uint64_t, Pending> pending_;  // by sequence number
+    std::map<Key, Stats> stats_;
+    std::thread worker_;
+};
+
+#endif // LATENCY_PROBE_H
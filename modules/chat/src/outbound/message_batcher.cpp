@@ -0,0 +1,101 @@
+#include "message_batcher.h"
+#include <algorithm>
+#include "message.codec.h"
+
+MessageBatcher::MessageBatcher(FlushCallback flush, const MessageBatchOptions& options)
+    : flush_(std::move(flush)), options_(options) {
+    worker_ = std::thread(&MessageBatcher::run, this);
+}
+
+MessageBatcher::~MessageBatcher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    worker_.join();
+    flush();
+}
+
+void MessageBatcher::add(const std::string& contentTopic, uint64_t id, std::vector<uint8_t> message) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Pending& pending = pending_[contentTopic];
+    if (pending.messages.empty()) {
+        pending.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(options_.windowMs);
+    }
+    pending.bytes += message.size();
+    pending.messages.push_back(std::move(message));
+    pending.ids.push_back(id);
+    if (pending.messages.size() >= std::max<size_t>(1, options_.maxMessages) || pending.bytes >= options_.maxBytes) {
+        // Full: close it without waiting for the window
+        ready_.emplace_back(contentTopic, std::move(pending));
+        pending_.erase(contentTopic);
+        cv_.notify_all();
+    } else if (pending.messages.size() == 1) {
+        cv_.notify_all();
+    }
+}
+
+void MessageBatcher::flush() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& entry : pending_) ready_.emplace_back(entry.first, std::move(entry.second));
+        pending_.clear();
+    }
+    sendReady();
+}
+
+void MessageBatcher::sendReady() {
+    std::lock_guard<std::mutex> sendLock(sendMutex_);
+    std::deque<std::pair<std::string, Pending>> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ready.swap(ready_);
+    }
+    for (auto& entry : ready) send(entry.first, entry.second);
+}
+
+void MessageBatcher::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        auto now = std::chrono::steady_clock::now();
+        auto next = std::chrono::steady_clock::time_point::max();
+        for (auto it = pending_.begin(); it != pending_.end();) {
+            if (it->second.deadline <= now) {
+                ready_.emplace_back(it->first, std::move(it->second));
+                it = pending_.erase(it);
+            } else {
+                next = std::min(next, it->second.deadline);
+                ++it;
+            }
+        }
+        if (!ready_.empty()) {
+            lock.unlock();
+            sendReady();
+            lock.lock();
+            continue;
+        }
+        if (next == std::chrono::steady_clock::time_point::max()) {
+            cv_.wait(lock);
+        } else {
+            cv_.wait_until(lock, next);
+        }
+    }
+}
+
+void MessageBatcher::send(const std::string& contentTopic, Pending& pending) {
+    if (pending.messages.empty() || !flush_) return;
+    if (pending.messages.size() == 1) {
+        flush_(contentTopic, false, pending.messages.front(), pending.ids);
+        return;
+    }
+
+    chat::Chat2BatchView batch;
+    batch.messages.reserve(pending.messages.size());
+    for (const auto& message : pending.messages) {
+        batch.messages.push_back(proto::asView(message.data(), message.size()));
+    }
+    std::vector<uint8_t> payload(proto::encodedSize(batch));
+    proto::encode(batch, payload.data(), payload.size());
+    flush_(contentTopic, true, payload, pending.ids);
+}
@@ -0,0 +1,67 @@
+#ifndef MESSAGE_BATCHER_H
+#define MESSAGE_BATCHER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../chat_interface.h"
+
+// Coalesces outgoing chat messages per channel.
+//
+// Messages added for a channel are held until the channel's window has
+// passed or the held messages reach maxMessages or maxBytes, then handed
+// to the flush callback in one go: as a serialized Chat2Batch, or as the
+// plain Chat2Message if only one message was waiting, so a quiet channel
+// pays nothing for batching.
+class MessageBatcher {
+public:
+    // payload is a serialized Chat2Batch if batched, a Chat2Message otherwise;
+    // ids are those passed to add(), in order
+    using FlushCallback = std::function<void(const std::string& contentTopic, bool batched,
+                                             const std::vector<uint8_t>& payload, const std::vector<uint64_t>& ids)>;
+
+    MessageBatcher(FlushCallback flush, const MessageBatchOptions& options);
+    // Flushes what is still held
+    ~MessageBatcher();
+
+    MessageBatcher(const MessageBatcher&) = delete;
+    MessageBatcher& operator=(const MessageBatcher&) = delete;
+
+    // Hold a serialized Chat2Message for contentTopic (the plain topic)
+    void add(const std::string& contentTopic, uint64_t id, std::vector<uint8_t> message);
+
+    // Flush every channel now
+    void flush();
+
+private:
+    struct Pending {
+        std::vector<std::vector<uint8_t>> messages;
+        std::vector<uint64_t> ids;
+        size_t bytes = 0;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    void run();
+    void sendReady();
+    void send(const std::string& contentTopic, Pending& pending);
+
+    FlushCallback flush_;
+    const MessageBatchOptions options_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::map<std::string, Pending> pending_;  // by content topic
+    std::deque<std::pair<std::string, Pending>> ready_;  // closed, in send order
+    std::mutex sendMutex_;  // one sender at a time keeps a channel's batches in order
+    bool stopping_ = false;
+    std::thread worker_;
+};
+
+#endif // MESSAGE_BATCHER_H
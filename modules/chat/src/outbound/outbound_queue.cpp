@@ -0,0 +1,476 @@
+#include "outbound_queue.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "codec/base64.h"
+#include "../../core/plugin_registry.h"
+#include "../../modules/waku/waku_interface.h"
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Write-ahead log, one record per line:
+//   E <id> <content topic> <pubsub topic> <message json> [<member>,...]
+//                                                          message queued
+//   D <id>                                                 message sent or failed
+// Strings are base64 encoded. A last line without its newline is a torn
+// write and is ignored.
+
+// Done records the log may collect before it is rewritten
+constexpr size_t kLogCompactRecords = 1024;
+
+std::string encodeField(const std::string& value) {
+    std::string encoded(base64::encodedSize(value.size()), '\0');
+    base64::encode(reinterpret_cast<const uint8_t*>(value.data()), value.size(), encoded.data());
+    return encoded;
+}
+
+bool decodeField(const std::string& encoded, std::string& value) {
+    std::vector<uint8_t> bytes(base64::decodedMaxSize(encoded.size()));
+    size_t size = 0;
+    if (!base64::decode(encoded.data(), encoded.size(), bytes.data(), size)) return false;
+    value.assign(reinterpret_cast<const char*>(bytes.data()), size);
+    return true;
+}
+
+std::string queuedRecord(uint64_t id, const std::string& contentTopic, const std::string& pubsubTopic,
+                         const std::string& json, const std::vector<uint64_t>& members) {
+    std::string record = "E " + std::to_string(id) + " " + encodeField(contentTopic) + " " +
+                         encodeField(pubsubTopic) + " " + encodeField(json);
+    for (size_t i = 0; i < members.size(); ++i) {
+        record += (i == 0 ? " " : ",") + std::to_string(members[i]);
+    }
+    return record + "\n";
+}
+
+bool flushFile(std::FILE* file, bool sync) {
+    if (std::fflush(file) != 0) return false;
+    if (!sync) return true;
+#if defined(_WIN32)
+    return _commit(_fileno(file)) == 0;
+#else
+    return ::fsync(fileno(file)) == 0;
+#endif
+}
+
+} // namespace
+
+OutboundQueue::OutboundQueue(const OutboundQueueOptions& options)
+    : options_(options), liveness_(std::make_shared<Liveness>()), rng_(std::random_device()()) {
+    liveness_->queue = this;
+}
+
+OutboundQueue::~OutboundQueue() {
+    // Publishes still out complete into nothing from here on; waits only
+    // for a callback that is running right now
+    {
+        std::lock_guard<std::mutex> lock(liveness_->mutex);
+        liveness_->queue = nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    if (worker_.joinable()) worker_.join();
+
+    // Messages in flight or unsent stay in the log and are queued again
+    // by the next openLog
+    std::unique_lock<std::mutex> lock(mutex_);
+    logFlush(lock);
+    if (log_ != nullptr) {
+        std::fclose(log_);
+        log_ = nullptr;
+    }
+}
+
+bool OutboundQueue::openLog(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (queued_ > 0 || worker_.joinable()) {
+        std::cerr << "Outbound queue: log must be opened once, before messages are queued" << std::endl;
+        return false;
+    }
+    if (log_ != nullptr) {
+        std::fclose(log_);
+        log_ = nullptr;
+    }
+
+    // Replay: everything queued and not marked done is still to be sent
+    std::map<uint64_t, Message> live;
+    {
+        std::ifstream in(path);
+        std::string line;
+        while (std::getline(in, line)) {
+            if (in.eof()) break;  // torn last line
+            std::istringstream fields(line);
+            char type = 0;
+            uint64_t id = 0;
+            if (!(fields >> type >> id)) continue;
+            nextId_ = std::max(nextId_, id + 1);
+            if (type == 'D') {
+                live.erase(id);
+                continue;
+            }
+            std::string topic, pubsub, json;
+            Message message;
+            message.id = id;
+            if (type == 'E' && (fields >> topic >> pubsub >> json) && decodeField(topic, message.contentTopic) &&
+                decodeField(pubsub, message.pubsubTopic) && decodeField(json, message.json)) {
+                std::string members;
+                if (fields >> members) {
+                    std::istringstream list(members);
+                    std::string member;
+                    while (std::getline(list, member, ',')) {
+                        message.members.push_back(std::strtoull(member.c_str(), nullptr, 10));
+                        nextId_ = std::max(nextId_, message.members.back() + 1);
+                    }
+                }
+                live.emplace(id, std::move(message));
+            }
+        }
+    }
+
+    // Rewrite it with only the live messages, so it doesn't grow forever
+    std::error_code ec;
+    fs::create_directories(fs::path(path).parent_path(), ec);
+    std::string tmpPath = path + ".tmp";
+    std::FILE* out = std::fopen(tmpPath.c_str(), "wb");
+    bool ok = out != nullptr;
+    for (const auto& entry : live) {
+        const Message& m = entry.second;
+        ok = ok && std::fputs(queuedRecord(m.id, m.contentTopic, m.pubsubTopic, m.json, m.members).c_str(), out) >= 0;
+    }
+    ok = ok && flushFile(out, options_.syncLog);
+    if (out != nullptr) std::fclose(out);
+    if (ok) {
+        fs::rename(tmpPath, path, ec);
+        ok = !ec;
+    }
+    if (!ok) {
+        std::cerr << "Outbound queue: cannot write log " << path << std::endl;
+        fs::remove(tmpPath, ec);
+    } else {
+        log_ = std::fopen(path.c_str(), "ab");
+        ok = log_ != nullptr;
+    }
+    logging_ = ok;
+
+    for (auto& entry : live) {
+        for (uint64_t member : entry.second.members) members_[member].parts++;
+        channels_[entry.second.contentTopic].queue.push_back(std::move(entry.second));
+        queued_++;
+    }
+    logPath_ = path;
+    logRecords_ = live.size();
+    if (!live.empty()) {
+        std::cout << "Outbound queue: " << live.size() << " unsent messages restored from " << path << std::endl;
+    }
+    // Writes what is queued before start() too
+    if (ok) startWorker();
+    return ok;
+}
+
+void OutboundQueue::setDeliveryCallback(DeliveryCallback callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    deliveryCallback_ = std::move(callback);
+}
+
+uint64_t OutboundQueue::enqueue(const std::string& contentTopic, const std::string& pubsubTopic,
+                                const std::string& messageJson, const std::vector<uint64_t>& members) {
+    uint64_t id = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        id = queueLocked(contentTopic, pubsubTopic, messageJson, members);
+    }
+    cv_.notify_all();
+    // Members were reported Pending when their ids were reserved
+    if (members.empty()) {
+        notify({Notification{id, DeliveryState::Pending, std::string()}});
+    }
+    return id;
+}
+
+void OutboundQueue::enqueueParts(const std::string& contentTopic, const std::string& pubsubTopic,
+                                 const std::vector<std::string>& messageJsons, uint64_t member) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const std::string& json : messageJsons) {
+            queueLocked(contentTopic, pubsubTopic, json, {member});
+        }
+    }
+    cv_.notify_all();
+}
+
+// Called with the lock held
+uint64_t OutboundQueue::queueLocked(const std::string& contentTopic, const std::string& pubsubTopic,
+                                    const std::string& messageJson, const std::vector<uint64_t>& members) {
+    uint64_t id = nextId_++;
+    Message message;
+    message.id = id;
+    message.contentTopic = contentTopic;
+    message.pubsubTopic = pubsubTopic;
+    message.json = messageJson;
+    message.members = members;
+    for (uint64_t member : members) members_[member].parts++;
+    logAppend(queuedRecord(id, contentTopic, pubsubTopic, messageJson, members));
+    channels_[contentTopic].queue.push_back(std::move(message));
+    queued_++;
+    return id;
+}
+
+uint64_t OutboundQueue::reserveId() {
+    uint64_t id = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        id = nextId_++;
+    }
+    notify({Notification{id, DeliveryState::Pending, std::string()}});
+    return id;
+}
+
+void OutboundQueue::start() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        started_ = true;
+        startWorker();
+    }
+    cv_.notify_all();
+}
+
+// Called with the lock held
+void OutboundQueue::startWorker() {
+    if (!worker_.joinable()) worker_ = std::thread(&OutboundQueue::run, this);
+}
+
+void OutboundQueue::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        started_ = false;
+    }
+    cv_.notify_all();
+}
+
+size_t OutboundQueue::pending() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queued_;
+}
+
+size_t OutboundQueue::inFlight() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return inFlight_;
+}
+
+void OutboundQueue::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        // Everything taken below has been logged
+        logFlush(lock);
+        if (!logPending_.empty()) continue;
+        if (!started_) {
+            cv_.wait(lock, [this] { return stopping_ || started_ || !logPending_.empty(); });
+            continue;
+        }
+        auto nextRetry = std::chrono::steady_clock::time_point::max();
+        std::vector<Message> ready = takeReady(std::chrono::steady_clock::now(), nextRetry);
+        if (ready.empty()) {
+            // Woken by new messages, completions, or the next retry coming due
+            if (nextRetry == std::chrono::steady_clock::time_point::max()) {
+                cv_.wait(lock);
+            } else {
+                cv_.wait_until(lock, nextRetry);
+            }
+            continue;
+        }
+        lock.unlock();
+        for (const Message& message : ready) publish(message);
+        lock.lock();
+    }
+}
+
+// Pick the messages to publish now, one per channel per round so a busy
+// channel doesn't take the whole window. Called with the lock held.
+std::vector<OutboundQueue::Message> OutboundQueue::takeReady(std::chrono::steady_clock::time_point now,
+                                                             std::chrono::steady_clock::time_point& nextRetry) {
+    std::vector<Message> ready;
+    size_t maxInFlight = std::max<size_t>(1, options_.maxInFlight);
+    size_t maxPerChannel = std::max<size_t>(1, options_.maxInFlightPerChannel);
+    bool progress = true;
+    while (progress && inFlight_ < maxInFlight) {
+        progress = false;
+        for (auto& entry : channels_) {
+            Channel& ch = entry.second;
+            if (inFlight_ >= maxInFlight) break;
+            if (ch.inFlight >= maxPerChannel) continue;
+            for (Message& message : ch.queue) {
+                if (message.inFlight) continue;
+                if (message.notBefore > now) {
+                    // Waiting to be retried; the rest of the channel waits too
+                    nextRetry = std::min(nextRetry, message.notBefore);
+                    break;
+                }
+                message.inFlight = true;
+                message.attempts++;
+                ch.inFlight++;
+                inFlight_++;
+                ready.push_back(message);
+                progress = true;
+                break;
+            }
+        }
+    }
+    return ready;
+}
+
+void OutboundQueue::publish(const Message& message) {
+    WakuInterface* wakuPlugin = PluginRegistry::getPlugin<WakuInterface>(wakuPluginName());
+    if (!wakuPlugin) {
+        std::cerr << "Failed to get Waku plugin" << std::endl;
+        complete(message.contentTopic, message.id, false, "Failed to get Waku plugin");
+        return;
+    }
+
+    std::string contentTopic = message.contentTopic;
+    uint64_t id = message.id;
+    std::shared_ptr<Liveness> liveness = liveness_;
+    wakuPlugin->relayPublish(
+        QString::fromStdString(message.pubsubTopic),
+        QString::fromStdString(message.json),
+        options_.publishTimeoutMs,
+        [liveness, contentTopic, id](bool success, const QString &responseMsg) {
+            std::lock_guard<std::mutex> lock(liveness->mutex);
+            if (liveness->queue != nullptr) {
+                liveness->queue->complete(contentTopic, id, success, responseMsg.toStdString());
+            }
+        }
+    );
+}
+
+void OutboundQueue::complete(const std::string& contentTopic, uint64_t id, bool success, const std::string& error) {
+    std::vector<Notification> notifications;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto chIt = channels_.find(contentTopic);
+        if (chIt == channels_.end()) return;
+        Channel& ch = chIt->second;
+        auto it = std::find_if(ch.queue.begin(), ch.queue.end(), [id](const Message& m) { return m.id == id; });
+        if (it == ch.queue.end() || !it->inFlight) return;
+
+        it->inFlight = false;
+        ch.inFlight--;
+        inFlight_--;
+        if (success || it->attempts >= options_.maxAttempts) {
+            if (!success) {
+                std::cerr << "Outbound queue: giving up on message " << id << " after " << it->attempts
+                          << " attempts - " << error << std::endl;
+            }
+            addNotifications(*it, success ? DeliveryState::Sent : DeliveryState::Failed,
+                             success ? std::string() : error, notifications);
+            ch.queue.erase(it);
+            queued_--;
+            logAppend("D " + std::to_string(id) + "\n");
+            if (ch.queue.empty()) channels_.erase(chIt);
+        } else {
+            std::chrono::milliseconds delay = backoff(it->attempts);
+            it->notBefore = std::chrono::steady_clock::now() + delay;
+            std::cerr << "Outbound queue: publishing message " << id << " failed (" << error << "), retrying in "
+                      << delay.count() << " ms" << std::endl;
+        }
+    }
+    cv_.notify_all();
+    notify(notifications);
+}
+
+// Exponential backoff with jitter, so messages that failed together don't
+// all come back at once. Called with the lock held.
+std::chrono::milliseconds OutboundQueue::backoff(unsigned int attempts) {
+    double base = static_cast<double>(options_.initialBackoff.count()) * std::pow(2.0, attempts - 1.0);
+    base = std::min(base, static_cast<double>(options_.maxBackoff.count()));
+    std::uniform_real_distribution<double> jitter(0.5, 1.0);
+    return std::chrono::milliseconds(static_cast<long long>(base * jitter(rng_)));
+}
+
+// Called with the lock held
+void OutboundQueue::addNotifications(const Message& message, DeliveryState state, const std::string& error,
+                                     std::vector<Notification>& out) {
+    if (message.members.empty()) {
+        out.push_back(Notification{message.id, state, error});
+        return;
+    }
+    for (uint64_t member : message.members) {
+        auto it = members_.find(member);
+        if (it == members_.end()) continue;
+        Member& m = it->second;
+        if (state == DeliveryState::Failed && !m.failed) {
+            m.failed = true;
+            m.error = error;
+        }
+        if (--m.parts > 0) continue;
+        if (m.failed) {
+            out.push_back(Notification{member, DeliveryState::Failed, m.error});
+        } else {
+            out.push_back(Notification{member, state, error});
+        }
+        members_.erase(it);
+    }
+}
+
+void OutboundQueue::notify(const std::vector<Notification>& notifications) {
+    DeliveryCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        callback = deliveryCallback_;
+    }
+    if (!callback) return;
+    for (const Notification& n : notifications) callback(n.id, n.state, n.error);
+}
+
+// Called with the lock held
+void OutboundQueue::logAppend(const std::string& line) {
+    if (!logging_) return;
+    logPending_ += line;
+    logRecords_++;
+}
+
+// Write the records collected so far and sync them, with the lock released
+// meanwhile, or empty the log instead once nothing is queued. Only the
+// worker writes, and the destructor after it has stopped. Called with the
+// lock held.
+void OutboundQueue::logFlush(std::unique_lock<std::mutex>& lock) {
+    if (!logging_ || logPending_.empty()) return;
+    std::string records;
+    records.swap(logPending_);
+    // With nothing queued, every message logged so far is done
+    bool compact = queued_ == 0 && logRecords_ >= kLogCompactRecords;
+    if (compact) logRecords_ = 0;
+    lock.unlock();
+
+    bool ok = true;
+    if (compact) {
+        std::FILE* truncated = std::freopen(logPath_.c_str(), "wb", log_);
+        if (truncated == nullptr) {
+            std::cerr << "Outbound queue: cannot truncate " << logPath_ << std::endl;
+            ok = false;
+        }
+        log_ = truncated;
+        ok = ok && flushFile(log_, options_.syncLog);
+    } else if (std::fputs(records.c_str(), log_) < 0 || !flushFile(log_, options_.syncLog)) {
+        std::cerr << "Outbound queue: write to " << logPath_ << " failed" << std::endl;
+    }
+
+    lock.lock();
+    if (!ok) {
+        logging_ = false;
+        logPending_.clear();
+    }
+}
@@ -0,0 +1,161 @@
+#ifndef OUTBOUND_QUEUE_H
+#define OUTBOUND_QUEUE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../chat_interface.h"
+
+struct OutboundQueueOptions {
+    size_t maxInFlight = 32;            // publishes waiting on libwaku, over all channels
+    size_t maxInFlightPerChannel = 8;
+    unsigned int maxAttempts = 6;       // publishes per message before it is reported failed
+    std::chrono::milliseconds initialBackoff{250};
+    std::chrono::milliseconds maxBackoff{30000};
+    unsigned int publishTimeoutMs = 30000;
+    bool syncLog = true;                // fsync the write-ahead log, once per worker round
+};
+
+// Queue of messages waiting to be relayed.
+//
+// Messages are published through the Waku plugin with at most maxInFlight
+// relayPublish calls outstanding, so a fast sender keeps libwaku busy
+// without piling up work inside it. Messages of one channel are published
+// in the order they were queued; a message waiting to be retried holds back
+// the rest of its channel. Failed publishes are retried with exponential
+// backoff and jitter until maxAttempts is reached.
+//
+// Nothing is published before start(), so messages sent while the node is
+// still starting are kept until it is up. With a write-ahead log open,
+// queued messages are also kept across restarts: every message is logged
+// before it is published and marked done once it was sent or given up on.
+// Records are collected under the lock and written by the worker, which
+// syncs them once per round outside it.
+class OutboundQueue {
+public:
+    explicit OutboundQueue(const OutboundQueueOptions& options = OutboundQueueOptions());
+    ~OutboundQueue();
+
+    OutboundQueue(const OutboundQueue&) = delete;
+    OutboundQueue& operator=(const OutboundQueue&) = delete;
+
+    // Open the write-ahead log at path and queue the messages it still
+    // holds. Call before start().
+    bool openLog(const std::string& path);
+
+    void setDeliveryCallback(DeliveryCallback callback);
+
+    // Queue a Waku message (JSON) for contentTopic. Returns its id, which
+    // delivery callbacks refer to. A Waku message carrying several chat
+    // messages passes their reserved ids as members; callbacks then report
+    // each member instead of the envelope. A chat message split over
+    // several Waku messages is a member of each, and is reported once the
+    // last of them is done: Sent if all were sent, Failed otherwise.
+    uint64_t enqueue(const std::string& contentTopic, const std::string& pubsubTopic, const std::string& messageJson,
+                     const std::vector<uint64_t>& members = std::vector<uint64_t>());
+
+    // Queue the Waku messages one chat message was split into, with its
+    // reserved id as their member. They are queued together, so the chat
+    // message can't be reported before its last part is queued.
+    void enqueueParts(const std::string& contentTopic, const std::string& pubsubTopic,
+                      const std::vector<std::string>& messageJsons, uint64_t member);
+
+    // Id for a message that is held back before being queued, reported
+    // Pending right away
+    uint64_t reserveId();
+
+    // Start or pause publishing. Queued messages stay queued while paused.
+    void start();
+    void stop();
+
+    // Messages queued or in flight
+    size_t pending() const;
+    size_t inFlight() const;
+
+private:
+    struct Message {
+        uint64_t id = 0;
+        std::string contentTopic;
+        std::string pubsubTopic;
+        std::string json;
+        std::vector<uint64_t> members;  // chat messages carried, if batched
+        unsigned int attempts = 0;
+        bool inFlight = false;
+        std::chrono::steady_clock::time_point notBefore;
+    };
+
+    struct Channel {
+        std::deque<Message> queue;  // in publish order, in-flight messages included
+        size_t inFlight = 0;
+    };
+
+    // A chat message carried by queued Waku messages
+    struct Member {
+        size_t parts = 0;  // Waku messages carrying it that are not done
+        bool failed = false;
+        std::string error;
+    };
+
+    struct Notification {
+        uint64_t id;
+        DeliveryState state;
+        std::string error;
+    };
+
+    // Shared with the relayPublish callbacks, which may come back after
+    // the queue is gone; queue is cleared once it is being destroyed
+    struct Liveness {
+        std::mutex mutex;
+        OutboundQueue* queue;
+    };
+
+    uint64_t queueLocked(const std::string& contentTopic, const std::string& pubsubTopic,
+                         const std::string& messageJson, const std::vector<uint64_t>& members);
+    void run();
+    std::vector<Message> takeReady(std::chrono::steady_clock::time_point now,
+                                   std::chrono::steady_clock::time_point& nextRetry);
+    void publish(const Message& message);
+    void complete(const std::string& contentTopic, uint64_t id, bool success, const std::string& error);
+    std::chrono::milliseconds backoff(unsigned int attempts);
+    void notify(const std::vector<Notification>& notifications);
+    void addNotifications(const Message& message, DeliveryState state, const std::string& error,
+                          std::vector<Notification>& out);
+
+    void startWorker();
+    void logAppend(const std::string& line);
+    void logFlush(std::unique_lock<std::mutex>& lock);
+
+    const OutboundQueueOptions options_;
+    std::shared_ptr<Liveness> liveness_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::map<std::string, Channel> channels_;  // by content topic
+    std::map<uint64_t, Member> members_;       // by reserved id
+    size_t queued_ = 0;
+    size_t inFlight_ = 0;
+    uint64_t nextId_ = 1;
+    bool started_ = false;
+    bool stopping_ = false;
+    std::mt19937 rng_;
+    DeliveryCallback deliveryCallback_;
+
+    std::string logPath_;
+    std::FILE* log_ = nullptr;     // written by the worker alone once open
+    bool logging_ = false;         // cleared if the log can't be written
+    std::string logPending_;       // records not written yet
+    size_t logRecords_ = 0;
+
+    std::thread worker_;
+};
+
+#endif // OUTBOUND_QUEUE_H
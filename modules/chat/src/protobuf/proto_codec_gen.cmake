@@ -0,0 +1,138 @@
+# Generate a proto_codec.h field table header from a .proto file.
+#
+# Usage:
+#   cmake -DPROTO_FILE=message.proto -DOUTPUT_FILE=message.codec.h -P proto_codec_gen.cmake
+#
+# Every message becomes a <Name>View struct plus a proto::Fields<> table.
+# Only the scalar types the chat protocol uses are supported: uint64,
+# uint32, bool, string and bytes, plus repeated string, bytes and message
+# fields, which are kept as views of the encoded elements. Anything else is
+# a hard error so the codec never silently drops a field.
+
+if(NOT PROTO_FILE OR NOT OUTPUT_FILE)
+    message(FATAL_ERROR "PROTO_FILE and OUTPUT_FILE must be set")
+endif()
+
+file(READ "${PROTO_FILE}" PROTO_CONTENT)
+get_filename_component(PROTO_NAME "${PROTO_FILE}" NAME)
+get_filename_component(OUTPUT_NAME "${OUTPUT_FILE}" NAME)
+
+# Strip comments, and swap statement terminators for '#' so they don't
+# split CMake lists
+string(REGEX REPLACE "//[^\n]*" "" PROTO_CONTENT "${PROTO_CONTENT}")
+string(REPLACE ";" "#" PROTO_CONTENT "${PROTO_CONTENT}")
+
+# Package becomes the namespace
+set(PROTO_PACKAGE "")
+if(PROTO_CONTENT MATCHES "package[ \t]+([A-Za-z0-9_.]+)[ \t]*#")
+    string(REPLACE "." "::" PROTO_PACKAGE "${CMAKE_MATCH_1}")
+endif()
+
+string(TOUPPER "${OUTPUT_NAME}" GUARD)
+string(REGEX REPLACE "[^A-Z0-9]" "_" GUARD "${GUARD}")
+
+set(OUT "// Generated from ${PROTO_NAME} by proto_codec_gen.cmake. Do not edit.\n")
+string(APPEND OUT "#ifndef ${GUARD}\n#define ${GUARD}\n\n")
+string(APPEND OUT "#include <cstdint>\n#include <string_view>\n#include <tuple>\n#include <vector>\n")
+string(APPEND OUT "#include \"codec/proto_codec.h\"\n\n")
+
+set(STRUCTS "")
+set(TABLES "")
+
+string(REGEX MATCHALL "message[ \t\n]+[A-Za-z0-9_]+[ \t\n]*{[^}]*}" MESSAGES "${PROTO_CONTENT}")
+
+# Message names, so repeated fields can refer to them
+set(MESSAGE_NAMES "")
+foreach(MESSAGE_BLOCK IN LISTS MESSAGES)
+    string(REGEX MATCH "message[ \t\n]+([A-Za-z0-9_]+)" _ "${MESSAGE_BLOCK}")
+    list(APPEND MESSAGE_NAMES "${CMAKE_MATCH_1}")
+endforeach()
+
+foreach(MESSAGE_BLOCK IN LISTS MESSAGES)
+    string(REGEX MATCH "message[ \t\n]+([A-Za-z0-9_]+)" _ "${MESSAGE_BLOCK}")
+    set(MESSAGE_NAME "${CMAKE_MATCH_1}")
+    set(VIEW_NAME "${MESSAGE_NAME}View")
+    set(QUALIFIED_VIEW "${VIEW_NAME}")
+    if(PROTO_PACKAGE)
+        set(QUALIFIED_VIEW "${PROTO_PACKAGE}::${VIEW_NAME}")
+    endif()
+
+    if(MESSAGE_BLOCK MATCHES "(optional|oneof|map<)")
+        message(FATAL_ERROR "${PROTO_NAME}: ${MESSAGE_NAME} uses '${CMAKE_MATCH_1}', which is not supported")
+    endif()
+
+    string(APPEND STRUCTS "struct ${VIEW_NAME} {\n")
+    set(FIELD_ENTRIES "")
+
+    string(REGEX MATCHALL "(repeated[ \t]+)?[A-Za-z0-9_]+[ \t]+[A-Za-z0-9_]+[ \t]*=[ \t]*[0-9]+[ \t]*#" FIELDS "${MESSAGE_BLOCK}")
+    foreach(FIELD IN LISTS FIELDS)
+        string(REGEX MATCH "(repeated[ \t]+)?([A-Za-z0-9_]+)[ \t]+([A-Za-z0-9_]+)[ \t]*=[ \t]*([0-9]+)" _ "${FIELD}")
+        set(FIELD_REPEATED "${CMAKE_MATCH_1}")
+        set(FIELD_TYPE "${CMAKE_MATCH_2}")
+        set(FIELD_NAME "${CMAKE_MATCH_3}")
+        set(FIELD_NUMBER "${CMAKE_MATCH_4}")
+
+        if(FIELD_REPEATED)
+            # Elements are views of their encoded bytes; message elements
+            # are decoded on their own
+            list(FIND MESSAGE_NAMES "${FIELD_TYPE}" MESSAGE_INDEX)
+            if(NOT (FIELD_TYPE STREQUAL "string" OR FIELD_TYPE STREQUAL "bytes" OR MESSAGE_INDEX GREATER -1))
+                message(FATAL_ERROR "${PROTO_NAME}: unsupported repeated type '${FIELD_TYPE}' for ${MESSAGE_NAME}.${FIELD_NAME}")
+            endif()
+            set(CPP_TYPE "std::vector<std::string_view>")
+            set(KIND "RepeatedBytes")
+            set(INIT "")
+        elseif(FIELD_TYPE STREQUAL "uint64")
+            set(CPP_TYPE "uint64_t")
+            set(KIND "Uint64")
+            set(INIT " = 0")
+        elseif(FIELD_TYPE STREQUAL "uint32")
+            set(CPP_TYPE "uint32_t")
+            set(KIND "Uint32")
+            set(INIT " = 0")
+        elseif(FIELD_TYPE STREQUAL "bool")
+            set(CPP_TYPE "bool")
+            set(KIND "Bool")
+            set(INIT " = false")
+        elseif(FIELD_TYPE STREQUAL "string")
+            set(CPP_TYPE "std::string_view")
+            set(KIND "String")
+            set(INIT "")
+        elseif(FIELD_TYPE STREQUAL "bytes")
+            set(CPP_TYPE "std::string_view")
+            set(KIND "Bytes")
+            set(INIT "")
+        else()
+            message(FATAL_ERROR "${PROTO_NAME}: unsupported type '${FIELD_TYPE}' for ${MESSAGE_NAME}.${FIELD_NAME}")
+        endif()
+
+        string(APPEND STRUCTS "    ${CPP_TYPE} ${FIELD_NAME}${INIT};\n")
+        if(FIELD_ENTRIES)
+            string(APPEND FIELD_ENTRIES ",\n")
+        endif()
+        string(APPEND FIELD_ENTRIES
+            "        proto::Field<${QUALIFIED_VIEW}, ${CPP_TYPE}, &${QUALIFIED_VIEW}::${FIELD_NAME}, ${FIELD_NUMBER}, FieldKind::${KIND}>")
+    endforeach()
+
+    string(APPEND STRUCTS "};\n\n")
+    string(APPEND TABLES "template <>\nstruct proto::Fields<${QUALIFIED_VIEW}> {\n")
+    string(APPEND TABLES "    using type = std::tuple<\n${FIELD_ENTRIES}>;\n")
+    string(APPEND TABLES "};\n\n")
+endforeach()
+
+if(PROTO_PACKAGE)
+    string(APPEND OUT "namespace ${PROTO_PACKAGE} {\n\n${STRUCTS}} // namespace ${PROTO_PACKAGE}\n\n")
+else()
+    string(APPEND OUT "${STRUCTS}")
+endif()
+string(APPEND OUT "${TABLES}")
+string(APPEND OUT "#endif // ${GUARD}\n")
+
+# Only touch the output when it changes to avoid needless rebuilds
+set(EXISTING "")
+if(EXISTS "${OUTPUT_FILE}")
+    file(READ "${OUTPUT_FILE}" EXISTING)
+endif()
+if(NOT EXISTING STREQUAL OUT)
+    file(WRITE "${OUTPUT_FILE}" "${OUT}")
+endif()
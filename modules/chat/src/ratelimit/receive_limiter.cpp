@@ -0,0 +1,216 @@
+#include "receive_limiter.h"
+#include <algorithm>
+#include <cmath>
+#include "codec/base64.h"
+
+namespace {
+
+constexpr uint64_t kTimeMask = (1ULL << 40) - 1;  // ms, wraps after 34 years
+constexpr uint64_t kTokenMask = (1ULL << 24) - 1;
+constexpr uint64_t kToken = 256;
+constexpr uint32_t kMaxBurst = 65535;
+
+uint64_t keyOf(uint32_t channel, std::string_view sender, bool wholeChannel) {
+    uint64_t hash = 0xcbf29ce484222325ULL ^ (uint64_t(channel) << 1 | (wholeChannel ? 1 : 0));
+    for (unsigned char c : sender) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+size_t roundUpPow2(size_t n) {
+    size_t size = 1;
+    while (size < n) size <<= 1;
+    return size;
+}
+
+// Rate in thousandths of a message per second, 0 for no limit
+uint64_t milliRate(double rate) {
+    if (!(rate > 0)) return 0;
+    return std::max<uint64_t>(1, static_cast<uint64_t>(std::llround(std::min(rate, 4e6) * 1000)));
+}
+
+} // namespace
+
+uint64_t packLimit(double rate, uint32_t burst) {
+    return 1ULL << 63 | uint64_t(std::min(burst, kMaxBurst)) << 32 | milliRate(rate);
+}
+
+void unpackLimit(uint64_t packed, double& rate, uint32_t& burst) {
+    rate = static_cast<double>(packed & 0xffffffffULL) / 1000;
+    burst = static_cast<uint32_t>(packed >> 32 & 0xffff);
+}
+
+ReceiveLimiter::ReceiveLimiter(const ReceiveLimiterOptions& options)
+    : mask_(roundUpPow2(std::max<size_t>(1, options.slotsPerShard)) - 1),
+      probes_(std::max<size_t>(1, std::min(options.probes, mask_ + 1))),
+      shards_(std::max<size_t>(1, options.shards)),
+      senderDefaults_(packLimit(options.defaults.senderRate, options.defaults.senderBurst)),
+      channelDefaults_(packLimit(options.defaults.channelRate, options.defaults.channelBurst)),
+      start_(std::chrono::steady_clock::now()) {
+    for (Shard& shard : shards_) shard.table.reset(new Slot[mask_ + 1]);
+}
+
+bool ReceiveLimiter::allow(uint32_t channel, std::string_view sender, const ReceiveLimits& limits) {
+    auto elapsed = std::chrono::steady_clock::now() - start_;
+    return allow(channel, sender, limits,
+                 static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count()));
+}
+
+bool ReceiveLimiter::allow(uint32_t channel, std::string_view sender, const ReceiveLimits& limits, uint64_t now) {
+    now &= kTimeMask;
+    uint64_t key = keyOf(channel, sender, false);
+    Shard& shard = shards_[(key >> 32) % shards_.size()];
+    if (limits.senderRate > 0 && !take(slotFor(shard, key, now), limits.senderRate, limits.senderBurst, now)) {
+        shard.dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    if (limits.channelRate > 0) {
+        uint64_t channelKey = keyOf(channel, std::string_view(), true);
+        Shard& channelShard = shards_[(channelKey >> 32) % shards_.size()];
+        if (!take(slotFor(channelShard, channelKey, now), limits.channelRate, limits.channelBurst, now)) {
+            shard.dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+    shard.allowed.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+// The slot of key: its own, a free one, or the one refilled the longest ago
+ReceiveLimiter::Slot& ReceiveLimiter::slotFor(Shard& shard, uint64_t key, uint64_t now) {
+    uint64_t tag = key | 1;  // never 0, which marks a free slot
+    Slot* victim = nullptr;
+    uint64_t oldest = UINT64_MAX;
+    for (size_t i = 0; i < probes_; ++i) {
+        Slot& slot = shard.table[(key + i) & mask_];
+        uint64_t current = slot.key.load(std::memory_order_acquire);
+        if (current == 0) {
+            if (slot.key.compare_exchange_strong(current, tag, std::memory_order_acq_rel)) return slot;
+        }
+        if (current == tag) return slot;
+        uint64_t state = slot.state.load(std::memory_order_relaxed);
+        uint64_t idle = state == 0 ? UINT64_MAX : (now - (state >> 24)) & kTimeMask;
+        if (victim == nullptr || idle > oldest) {
+            victim = &slot;
+            oldest = idle;
+        }
+    }
+    uint64_t previous = victim->key.load(std::memory_order_relaxed);
+    if (previous != tag && victim->key.compare_exchange_strong(previous, tag, std::memory_order_acq_rel)) {
+        victim->state.store(0, std::memory_order_release);
+    }
+    return *victim;
+}
+
+bool ReceiveLimiter::take(Slot& slot, double rate, uint32_t burst, uint64_t now) {
+    uint64_t perSecond = milliRate(rate) * kToken;  // in 1/256 tokens per 1000 s
+    uint64_t capacity = std::max<uint32_t>(1, std::min(burst, kMaxBurst)) * kToken;
+    uint64_t fullAfter = capacity * 1000000 / perSecond + 1;  // ms from empty to full
+
+    uint64_t state = slot.state.load(std::memory_order_acquire);
+    while (true) {
+        uint64_t tokens = capacity;
+        uint64_t last = now;
+        if (state != 0) {
+            tokens = std::min(state & kTokenMask, capacity);
+            last = state >> 24;
+            uint64_t elapsed = (now - last) & kTimeMask;
+            if (elapsed > kTimeMask / 2) elapsed = 0;  // another thread refilled at a later now
+            if (elapsed >= fullAfter) {
+                tokens = capacity;
+                last = now;
+            } else {
+                // Only the time the new tokens took is used up, so slow
+                // rates are not lost to rounding
+                uint64_t added = elapsed * perSecond / 1000000;
+                if (added > 0) {
+                    tokens = std::min(capacity, tokens + added);
+                    last = (last + added * 1000000 / perSecond) & kTimeMask;
+                }
+            }
+        }
+        if (tokens < kToken) return false;
+        uint64_t next = last << 24 | (tokens - kToken);
+        if (next == 0) next = 1;  // 0 is a full bucket
+        if (slot.state.compare_exchange_weak(state, next, std::memory_order_acq_rel)) return true;
+    }
+}
+
+ReceiveLimits ReceiveLimiter::defaults() const {
+    ReceiveLimits limits;
+    unpackLimit(senderDefaults_.load(std::memory_order_relaxed), limits.senderRate, limits.senderBurst);
+    unpackLimit(channelDefaults_.load(std::memory_order_relaxed), limits.channelRate, limits.channelBurst);
+    return limits;
+}
+
+void ReceiveLimiter::setDefaults(const ReceiveLimits& limits) {
+    senderDefaults_.store(packLimit(limits.senderRate, limits.senderBurst), std::memory_order_relaxed);
+    channelDefaults_.store(packLimit(limits.channelRate, limits.channelBurst), std::memory_order_relaxed);
+}
+
+uint64_t ReceiveLimiter::allowed() const {
+    uint64_t total = 0;
+    for (const Shard& shard : shards_) total += shard.allowed.load(std::memory_order_relaxed);
+    return total;
+}
+
+uint64_t ReceiveLimiter::dropped() const {
+    uint64_t total = 0;
+    for (const Shard& shard : shards_) total += shard.dropped.load(std::memory_order_relaxed);
+    return total;
+}
+
+namespace {
+
+bool readVarint(const uint8_t*& p, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t byte = *p++;
+        value |= uint64_t(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+} // namespace
+
+bool peekSender(const std::string& payload, std::string& nick) {
+    // 128 characters are 96 bytes: the timestamp and any usual nick
+    size_t take = std::min<size_t>(payload.size(), 128);
+    if (take < payload.size()) take &= ~size_t(3);
+    uint8_t bytes[base64::decodedMaxSize(128)];
+    size_t size = 0;
+    if (!base64::decode(payload.data(), take, bytes, size)) return false;
+
+    const uint8_t* p = bytes;
+    const uint8_t* end = bytes + size;
+    while (p < end) {
+        uint64_t tag = 0;
+        if (!readVarint(p, end, tag)) return false;
+        uint64_t field = tag >> 3;
+        uint64_t wireType = tag & 7;
+        if (field == 1 && wireType == 0) {
+            uint64_t timestamp = 0;
+            if (!readVarint(p, end, timestamp)) return false;
+        } else if (field == 2 && wireType == 2) {
+            uint64_t length = 0;
+            if (!readVarint(p, end, length) || length > static_cast<uint64_t>(end - p)) return false;
+            nick.assign(reinterpret_cast<const char*>(p), static_cast<size_t>(length));
+            return true;
+        } else {
+            // Encoders write fields in order, so past the nick's field there
+            // is none; anything else is left to the full decode
+            if (field <= 2) return false;
+            nick.clear();
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,101 @@
+#ifndef RECEIVE_LIMITER_H
+#define RECEIVE_LIMITER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// How fast messages may come in on a channel. Rates are messages per
+// second, bursts how many are let through at once after a quiet spell. A
+// rate of 0 is no limit; bursts are capped at 65535.
+struct ReceiveLimits {
+    double senderRate = 10;       // per nick
+    uint32_t senderBurst = 50;
+    double channelRate = 0;       // all senders together
+    uint32_t channelBurst = 500;
+};
+
+struct ReceiveLimiterOptions {
+    ReceiveLimits defaults;       // for channels without limits of their own
+    size_t shards = 16;
+    size_t slotsPerShard = 4096;  // buckets per shard, rounded up to a power of two
+    size_t probes = 8;            // slots a sender may land in
+};
+
+// Token buckets of the senders on each channel, checked for every message
+// received from the relay.
+//
+// The buckets live in fixed tables of atomic slots: a slot is a key hash
+// and one word holding the bucket's tokens and the time it was last
+// refilled, updated with compare-and-swap. Nothing is locked or allocated
+// per message. Keys are hashed onto a shard and then onto a run of probe
+// slots in it; a new key takes a free slot of its run or, if there is none,
+// the one refilled the longest ago, whose bucket is likely full anyway.
+// Each shard counts its own allowed and dropped messages, so the counters
+// are not one contended cache line.
+//
+// A message takes a token from its sender's bucket and then from its
+// channel's. Messages dropped by their sender's bucket never drain the
+// channel's, so one flooding nick does not crowd out the others.
+//
+// Under contention on one bucket, or when a slot changes hands, a message
+// can be let through or dropped that strict accounting would not have; the
+// limits hold on average.
+//
+// All methods are thread-safe.
+class ReceiveLimiter {
+public:
+    explicit ReceiveLimiter(const ReceiveLimiterOptions& options = ReceiveLimiterOptions());
+
+    ReceiveLimiter(const ReceiveLimiter&) = delete;
+    ReceiveLimiter& operator=(const ReceiveLimiter&) = delete;
+
+    // Take a token for a message of sender on channel; false to drop it.
+    // now is in ms on any steady clock, the same for every call.
+    bool allow(uint32_t channel, std::string_view sender, const ReceiveLimits& limits, uint64_t now);
+    bool allow(uint32_t channel, std::string_view sender, const ReceiveLimits& limits);
+
+    ReceiveLimits defaults() const;
+    void setDefaults(const ReceiveLimits& limits);
+
+    uint64_t allowed() const;
+    uint64_t dropped() const;
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> key{0};    // 0 while free
+        std::atomic<uint64_t> state{0};  // refill time << 24 | tokens in 1/256, 0 for a full bucket
+    };
+
+    struct alignas(64) Shard {
+        std::unique_ptr<Slot[]> table;
+        std::atomic<uint64_t> allowed{0};
+        std::atomic<uint64_t> dropped{0};
+    };
+
+    Slot& slotFor(Shard& shard, uint64_t key, uint64_t now);
+    static bool take(Slot& slot, double rate, uint32_t burst, uint64_t now);
+
+    size_t mask_;
+    size_t probes_;
+    std::vector<Shard> shards_;
+    std::atomic<uint64_t> senderDefaults_;   // packed limits, see packLimit()
+    std::atomic<uint64_t> channelDefaults_;
+    const std::chrono::steady_clock::time_point start_;
+};
+
+// Pack a rate and burst into one word and back, for keeping limits in
+// atomics. Rates keep three decimals.
+uint64_t packLimit(double rate, uint32_t burst);
+void unpackLimit(uint64_t packed, double& rate, uint32_t& burst);
+
+// Nick of a base64 Chat2Message, decoded from the start of the payload
+// only. False if it does not end there.
+bool peekSender(const std::string& payload, std::string& nick);
+
+#endif // RECEIVE_LIMITER_H
@@ -0,0 +1,1101 @@
+#include "search_index.h"
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
+
+namespace {
+
+// BM25 parameters
+constexpr double kK1 = 1.2;
+constexpr double kB = 0.75;
+
+// Longer messages count as this many words
+constexpr uint32_t kMaxLength = UINT16_MAX;
+
+struct DocInfo {
+    uint64_t timestamp = 0;
+    uint32_t hashOffset = 0;  // into the part's hash arena
+    uint32_t hashSize = 0;
+};
+
+// Doc id of a removed doc when its part is rebuilt
+constexpr uint32_t kDropped = UINT32_MAX;
+
+// A segment with this share of its docs removed is rewritten without them
+constexpr size_t kPurgeShare = 4;  // a quarter
+
+// Terms in this share of a segment's docs or more also get a doc bitset
+constexpr size_t kDenseShare = 8;  // an eighth
+constexpr uint64_t kNotDense = UINT64_MAX;
+
+// Postings of one term (or clause) in one part, by ascending doc id.
+// positions holds freqs[i] positions for every doc, in doc order, and is
+// only filled when asked for.
+struct PostingList {
+    std::vector<uint32_t> docs;
+    std::vector<uint32_t> freqs;
+    std::vector<uint32_t> positions;
+};
+
+void putVarint(std::vector<uint8_t>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+uint32_t getVarint(const uint8_t*& p) {
+    uint32_t value = *p++;
+    if (value < 0x80) return value;  // most deltas fit in a byte
+    value &= 0x7f;
+    for (int shift = 7;; shift += 7) {
+        uint8_t byte = *p++;
+        value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) return value;
+    }
+}
+
+bool isRemoved(const std::vector<bool>* removed, size_t index) {
+    return removed != nullptr && index < removed->size() && (*removed)[index];
+}
+
+// Give the docs of list the ids they have in a rebuilt part, by their index
+// in the old one, and drop those without one along with their positions
+void renumber(PostingList& list, uint32_t base, const std::vector<uint32_t>& ids) {
+    size_t kept = 0;
+    size_t keptPositions = 0;
+    size_t offset = 0;
+    for (size_t i = 0; i < list.docs.size(); offset += list.freqs[i], ++i) {
+        uint32_t id = ids[list.docs[i] - base];
+        if (id == kDropped) continue;
+        if (!list.positions.empty()) {
+            std::copy(list.positions.begin() + offset, list.positions.begin() + offset + list.freqs[i],
+                      list.positions.begin() + keptPositions);
+            keptPositions += list.freqs[i];
+        }
+        list.docs[kept] = id;
+        list.freqs[kept] = list.freqs[i];
+        kept++;
+    }
+    list.docs.resize(kept);
+    list.freqs.resize(kept);
+    list.positions.resize(keptPositions);
+}
+
+bool isWordByte(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c >= 0x80;
+}
+
+// Calls emit(word, position) for every word of text
+template <typename Emit>
+void forEachWord(std::string_view text, size_t maxTermLength, Emit emit) {
+    std::string word;
+    uint32_t position = 0;
+    size_t i = 0;
+    while (i < text.size()) {
+        while (i < text.size() && !isWordByte(static_cast<unsigned char>(text[i]))) i++;
+        if (i == text.size()) break;
+        word.clear();
+        for (; i < text.size() && isWordByte(static_cast<unsigned char>(text[i])); ++i) {
+            if (word.size() >= maxTermLength) continue;
+            char c = text[i];
+            word += (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+        }
+        emit(word, position++);
+    }
+}
+
+} // namespace
+
+// A part of the index: the buffer taking new messages, a frozen buffer or
+// a sealed segment. Doc ids of a part are base to base + docs.size().
+// Topics and lengths are read for every doc a query matches and are kept
+// apart from the rest, which is only read for the docs returned: a common
+// word then streams a few bytes per doc rather than a whole DocInfo.
+//
+// Removed docs stay in a part until it is sealed, merged or rewritten;
+// until then they are flagged in removed, by index into docs. The flags
+// are guarded by the index lock and replaced rather than changed, so a
+// search keeps reading the set it started with.
+struct SearchIndexPart {
+    uint32_t base = 0;
+    std::vector<DocInfo> docs;
+    std::vector<uint32_t> topics;   // by index into docs
+    std::vector<uint16_t> lengths;  // words
+    std::string hashes;
+    mutable std::shared_ptr<const std::vector<bool>> removed;
+    mutable size_t removedCount = 0;
+
+    virtual ~SearchIndexPart() {}
+
+    // Docs term is in, 0 if the part doesn't have it
+    virtual uint32_t docFrequency(std::string_view term) const = 0;
+    // Postings of term, only in the sorted docs of within unless it is
+    // null; false if there are none
+    virtual bool postings(std::string_view term, const std::vector<uint32_t>* within, bool withPositions,
+                          PostingList& out) const = 0;
+    // Terms starting with prefix, with their document frequency
+    virtual void expand(std::string_view prefix, std::vector<std::pair<std::string, uint32_t>>& out) const = 0;
+
+    std::string_view hash(const DocInfo& info) const {
+        return std::string_view(hashes).substr(info.hashOffset, info.hashSize);
+    }
+
+    void addDoc(uint32_t topic, const std::string& messageHash, uint64_t timestamp, uint32_t length) {
+        DocInfo info;
+        info.timestamp = timestamp;
+        info.hashOffset = static_cast<uint32_t>(hashes.size());
+        info.hashSize = static_cast<uint32_t>(messageHash.size());
+        hashes += messageHash;
+        docs.push_back(info);
+        topics.push_back(topic);
+        lengths.push_back(static_cast<uint16_t>(length));
+    }
+
+    // Copy the docs of another part that were not removed as of removedDocs.
+    // Returns the id each of its docs has here, kDropped for the others.
+    std::vector<uint32_t> addKept(const SearchIndexPart& from, const std::vector<bool>* removedDocs) {
+        std::vector<uint32_t> ids(from.docs.size(), kDropped);
+        for (size_t i = 0; i < from.docs.size(); ++i) {
+            if (isRemoved(removedDocs, i)) continue;
+            DocInfo info = from.docs[i];
+            ids[i] = base + static_cast<uint32_t>(docs.size());
+            info.hashOffset = static_cast<uint32_t>(hashes.size());
+            hashes.append(from.hashes, from.docs[i].hashOffset, info.hashSize);
+            docs.push_back(info);
+            topics.push_back(from.topics[i]);
+            lengths.push_back(from.lengths[i]);
+        }
+        return ids;
+    }
+
+    // Flag docs as removed, by index. Called under the index lock.
+    void markRemoved(const std::vector<size_t>& indexes) const {
+        if (indexes.empty()) return;
+        auto flags = removed ? std::make_shared<std::vector<bool>>(*removed) : std::make_shared<std::vector<bool>>();
+        flags->resize(docs.size(), false);
+        for (size_t index : indexes) (*flags)[index] = true;
+        removed = std::move(flags);
+        removedCount += indexes.size();
+    }
+
+    // Flag the docs removed from a part this one was built from since it
+    // was read, as of since; ids maps them here. Called under the index lock.
+    void carryRemoved(const SearchIndexPart& from, const std::vector<bool>* since, const std::vector<uint32_t>& ids) const {
+        const std::vector<bool>* now = from.removed.get();
+        if (now == since) return;
+        std::vector<size_t> indexes;
+        for (size_t i = 0; i < from.docs.size(); ++i) {
+            if (isRemoved(now, i) && !isRemoved(since, i) && ids[i] != kDropped) indexes.push_back(ids[i] - base);
+        }
+        markRemoved(indexes);
+    }
+};
+
+struct SearchIndex::Buffer : SearchIndexPart {
+    struct Term {
+        std::vector<uint32_t> docs;
+        std::vector<uint32_t> freqs;
+        std::vector<uint32_t> positions;
+    };
+    std::map<std::string, Term, std::less<>> terms;
+
+    uint32_t docFrequency(std::string_view word) const override {
+        auto it = terms.find(word);
+        return it != terms.end() ? static_cast<uint32_t>(it->second.docs.size()) : 0;
+    }
+
+    bool postings(std::string_view word, const std::vector<uint32_t>* within, bool withPositions,
+                  PostingList& out) const override {
+        out.docs.clear();
+        out.freqs.clear();
+        out.positions.clear();
+        auto it = terms.find(word);
+        if (it == terms.end()) return false;
+        const Term& term = it->second;
+        size_t offset = 0;
+        size_t d = 0;
+        for (size_t i = 0; i < term.docs.size(); offset += term.freqs[i], ++i) {
+            if (within != nullptr) {
+                while (d < within->size() && (*within)[d] < term.docs[i]) d++;
+                if (d == within->size()) break;
+                if ((*within)[d] != term.docs[i]) continue;
+            }
+            out.docs.push_back(term.docs[i]);
+            out.freqs.push_back(term.freqs[i]);
+            if (withPositions) {
+                out.positions.insert(out.positions.end(), term.positions.begin() + offset,
+                                     term.positions.begin() + offset + term.freqs[i]);
+            }
+        }
+        return !out.docs.empty();
+    }
+
+    void expand(std::string_view prefix, std::vector<std::pair<std::string, uint32_t>>& out) const override {
+        for (auto it = terms.lower_bound(prefix); it != terms.end() && it->first.compare(0, prefix.size(), prefix) == 0;
+             ++it) {
+            out.emplace_back(it->first, static_cast<uint32_t>(it->second.docs.size()));
+        }
+    }
+};
+
+// Sealed, immutable part. Terms are sorted; each has its docs as varint
+// (doc delta, frequency) pairs and, in a stream of their own, the
+// positions in those docs as varint deltas. The size in bytes of the
+// positions of every doc is kept in a third stream, so a phrase query
+// steps over the docs it doesn't need without reading their positions.
+//
+// A term in many docs, like "the", also has a bitset of its docs and the
+// number of them before every 64. Looking it up in a few docs then costs
+// a bit test and a popcount each, and stepping over the sizes in between,
+// rather than decoding every doc of the term.
+struct SearchIndex::Segment : SearchIndexPart {
+    struct Term {
+        uint32_t textOffset;
+        uint32_t textSize;
+        uint32_t docFreq;
+        uint64_t docsOffset;
+        uint64_t positionsOffset;
+        uint64_t sizesOffset;
+        uint64_t denseOffset;  // into denseBits and denseRanks, or kNotDense
+    };
+    std::string termText;
+    std::vector<Term> terms;
+    std::vector<uint8_t> docStream;
+    std::vector<uint8_t> positionStream;
+    std::vector<uint8_t> sizeStream;
+    std::vector<uint64_t> denseBits;   // per dense term, a bit per doc
+    std::vector<uint32_t> denseRanks;  // per word of those, docs of the term before it
+
+    std::string_view text(const Term& term) const {
+        return std::string_view(termText).substr(term.textOffset, term.textSize);
+    }
+
+    std::vector<Term>::const_iterator lowerBound(std::string_view word) const {
+        return std::lower_bound(terms.begin(), terms.end(), word,
+                                [this](const Term& term, std::string_view w) { return text(term) < w; });
+    }
+
+    void decode(const Term& term, bool withPositions, PostingList& out) const {
+        out.docs.resize(term.docFreq);
+        out.freqs.resize(term.docFreq);
+        const uint8_t* p = docStream.data() + term.docsOffset;
+        uint32_t doc = base;
+        uint64_t positionCount = 0;
+        for (uint32_t i = 0; i < term.docFreq; ++i) {
+            doc += getVarint(p);
+            out.docs[i] = doc;
+            out.freqs[i] = getVarint(p);
+            positionCount += out.freqs[i];
+        }
+        if (!withPositions) return;
+        out.positions.resize(positionCount);
+        const uint8_t* q = positionStream.data() + term.positionsOffset;
+        size_t k = 0;
+        for (uint32_t i = 0; i < term.docFreq; ++i) {
+            uint32_t position = 0;
+            for (uint32_t j = 0; j < out.freqs[i]; ++j) {
+                position += getVarint(q);
+                out.positions[k++] = position;
+            }
+        }
+    }
+
+    // Build the bitsets of the dense terms and trim the streams, once all
+    // terms are written
+    void finish() {
+        size_t words = (docs.size() + 63) / 64;
+        for (Term& term : terms) {
+            term.denseOffset = kNotDense;
+            if (static_cast<size_t>(term.docFreq) * kDenseShare < docs.size()) continue;
+            term.denseOffset = denseBits.size();
+            denseBits.resize(denseBits.size() + words, 0);
+            uint64_t* bits = denseBits.data() + term.denseOffset;
+            const uint8_t* p = docStream.data() + term.docsOffset;
+            uint32_t id = 0;
+            for (uint32_t i = 0; i < term.docFreq; ++i) {
+                id += getVarint(p);
+                getVarint(p);
+                bits[id / 64] |= uint64_t(1) << (id % 64);
+            }
+            uint32_t rank = 0;
+            for (size_t w = 0; w < words; ++w) {
+                denseRanks.push_back(rank);
+                rank += static_cast<uint32_t>(__builtin_popcountll(bits[w]));
+            }
+        }
+        docStream.shrink_to_fit();
+        positionStream.shrink_to_fit();
+        sizeStream.shrink_to_fit();
+    }
+
+    // postings() of a dense term within some docs. A doc's frequency is
+    // the number of its positions, which end in a byte below 0x80.
+    bool densePostings(const Term& term, const std::vector<uint32_t>& within, bool withPositions,
+                       PostingList& out) const {
+        const uint64_t* bits = denseBits.data() + term.denseOffset;
+        const uint32_t* ranks = denseRanks.data() + term.denseOffset;
+        const uint8_t* q = positionStream.data() + term.positionsOffset;
+        const uint8_t* z = sizeStream.data() + term.sizesOffset;
+        uint32_t rank = 0;  // docs of the term whose sizes were read
+        for (uint32_t doc : within) {
+            uint32_t id = doc - base;
+            uint64_t bit = uint64_t(1) << (id % 64);
+            uint64_t word = bits[id / 64];
+            if ((word & bit) == 0) continue;
+            uint32_t target = ranks[id / 64] + static_cast<uint32_t>(__builtin_popcountll(word & (bit - 1)));
+            for (; rank < target; ++rank) q += getVarint(z);
+            const uint8_t* end = q + getVarint(z);
+            rank++;
+            uint32_t freq = 0;
+            if (withPositions) {
+                uint32_t position = 0;
+                while (q != end) {
+                    position += getVarint(q);
+                    out.positions.push_back(position);
+                    freq++;
+                }
+            } else {
+                for (; q != end; ++q) freq += *q < 0x80;
+            }
+            out.docs.push_back(doc);
+            out.freqs.push_back(freq);
+        }
+        return !out.docs.empty();
+    }
+
+    const Term* find(std::string_view word) const {
+        auto it = lowerBound(word);
+        return it != terms.end() && text(*it) == word ? &*it : nullptr;
+    }
+
+    uint32_t docFrequency(std::string_view word) const override {
+        const Term* term = find(word);
+        return term != nullptr ? term->docFreq : 0;
+    }
+
+    // Without within, the whole term is decoded; with it, the docs stream
+    // is still read up to the last doc of within, but positions are only
+    // decoded for the docs kept
+    bool postings(std::string_view word, const std::vector<uint32_t>* within, bool withPositions,
+                  PostingList& out) const override {
+        out.docs.clear();
+        out.freqs.clear();
+        out.positions.clear();
+        const Term* term = find(word);
+        if (term == nullptr) return false;
+        if (within == nullptr) {
+            decode(*term, withPositions, out);
+            return true;
+        }
+        if (term->denseOffset != kNotDense) return densePostings(*term, *within, withPositions, out);
+        const uint8_t* p = docStream.data() + term->docsOffset;
+        const uint8_t* q = positionStream.data() + term->positionsOffset;
+        const uint8_t* z = sizeStream.data() + term->sizesOffset;
+        uint32_t doc = base;
+        size_t d = 0;
+        for (uint32_t i = 0; i < term->docFreq; ++i) {
+            doc += getVarint(p);
+            uint32_t freq = getVarint(p);
+            while (d < within->size() && (*within)[d] < doc) d++;
+            if (d == within->size()) break;
+            uint32_t size = withPositions ? getVarint(z) : 0;
+            if ((*within)[d] != doc) {
+                q += size;
+                continue;
+            }
+            out.docs.push_back(doc);
+            out.freqs.push_back(freq);
+            if (withPositions) {
+                uint32_t position = 0;
+                for (uint32_t j = 0; j < freq; ++j) {
+                    position += getVarint(q);
+                    out.positions.push_back(position);
+                }
+            }
+        }
+        return !out.docs.empty();
+    }
+
+    void expand(std::string_view prefix, std::vector<std::pair<std::string, uint32_t>>& out) const override {
+        for (auto it = lowerBound(prefix); it != terms.end() && text(*it).substr(0, prefix.size()) == prefix; ++it) {
+            out.emplace_back(std::string(text(*it)), it->docFreq);
+        }
+    }
+
+    // Append a term; its docs must come after those of the previous parts
+    // appended for the same term
+    class Writer {
+    public:
+        explicit Writer(Segment& segment) : segment_(segment) {}
+
+        // The term is only written once it has docs
+        void begin(std::string_view word) {
+            word_.assign(word.data(), word.size());
+            started_ = false;
+        }
+
+        void add(const PostingList& list) {
+            if (list.docs.empty()) return;
+            if (!started_) {
+                Term term;
+                term.textOffset = static_cast<uint32_t>(segment_.termText.size());
+                term.textSize = static_cast<uint32_t>(word_.size());
+                term.docFreq = 0;
+                term.docsOffset = segment_.docStream.size();
+                term.positionsOffset = segment_.positionStream.size();
+                term.sizesOffset = segment_.sizeStream.size();
+                segment_.termText += word_;
+                segment_.terms.push_back(term);
+                lastDoc_ = segment_.base;
+                started_ = true;
+            }
+            Term& term = segment_.terms.back();
+            size_t k = 0;
+            for (size_t i = 0; i < list.docs.size(); ++i) {
+                putVarint(segment_.docStream, list.docs[i] - lastDoc_);
+                putVarint(segment_.docStream, list.freqs[i]);
+                lastDoc_ = list.docs[i];
+                positions_.clear();
+                uint32_t previous = 0;
+                for (uint32_t j = 0; j < list.freqs[i]; ++j, ++k) {
+                    putVarint(positions_, list.positions[k] - previous);
+                    previous = list.positions[k];
+                }
+                putVarint(segment_.sizeStream, static_cast<uint32_t>(positions_.size()));
+                segment_.positionStream.insert(segment_.positionStream.end(), positions_.begin(), positions_.end());
+            }
+            term.docFreq += static_cast<uint32_t>(list.docs.size());
+        }
+
+    private:
+        Segment& segment_;
+        std::string word_;
+        bool started_ = false;
+        uint32_t lastDoc_ = 0;
+        std::vector<uint8_t> positions_;  // of one doc
+    };
+};
+
+struct SearchIndex::Clause {
+    enum Kind { Term, Prefix, Phrase };
+    Kind kind = Term;
+    std::vector<std::string> words;
+};
+
+namespace {
+
+// Size tier of a segment: segments within a tier are merged together
+size_t tier(size_t docs, const SearchIndexOptions& options) {
+    size_t level = 0;
+    size_t limit = std::max<size_t>(1, options.segmentDocs);
+    size_t factor = std::max<size_t>(2, options.mergeFactor);
+    while (docs > limit) {
+        limit *= factor;
+        level++;
+    }
+    return level;
+}
+
+} // namespace
+
+SearchIndex::SearchIndex(const SearchIndexOptions& options)
+    : options_(options), buffer_(std::make_shared<Buffer>()) {
+    worker_ = std::thread([this] { run(); });
+}
+
+SearchIndex::~SearchIndex() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    if (worker_.joinable()) worker_.join();
+}
+
+std::vector<std::string> SearchIndex::tokenize(std::string_view text, size_t maxTermLength) {
+    std::vector<std::string> words;
+    forEachWord(text, maxTermLength, [&words](const std::string& word, uint32_t) { words.push_back(word); });
+    return words;
+}
+
+void SearchIndex::add(const std::string& contentTopic, const std::string& messageHash, uint64_t timestamp,
+                      std::string_view text) {
+    // Tokenize outside the lock; the words of a message, with positions
+    std::vector<std::pair<std::string, uint32_t>> words;
+    forEachWord(text, options_.maxTermLength,
+                [&words](const std::string& word, uint32_t position) { words.emplace_back(word, position); });
+    std::sort(words.begin(), words.end());
+    uint32_t length = static_cast<uint32_t>(std::min<size_t>(words.size(), kMaxLength));
+
+    bool frozen = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto topic = topicIds_.find(contentTopic);
+        if (topic == topicIds_.end()) {
+            topic = topicIds_.emplace(contentTopic, static_cast<uint32_t>(topics_.size())).first;
+            topics_.push_back(contentTopic);
+        }
+
+        uint32_t doc = nextDoc_++;
+        if (buffer_->docs.empty()) buffer_->base = doc;
+        buffer_->addDoc(topic->second, messageHash, timestamp, length);
+        documents_++;
+        totalLength_ += length;
+        for (size_t i = 0; i < words.size();) {
+            Buffer::Term& term = buffer_->terms[words[i].first];
+            size_t j = i;
+            for (; j < words.size() && words[j].first == words[i].first; ++j) {
+                term.positions.push_back(words[j].second);
+            }
+            term.docs.push_back(doc);
+            term.freqs.push_back(static_cast<uint32_t>(j - i));
+            i = j;
+        }
+
+        if (buffer_->docs.size() >= std::max<size_t>(1, options_.segmentDocs)) {
+            freezeLocked();
+            frozen = true;
+        }
+    }
+    if (frozen) cv_.notify_all();
+}
+
+size_t SearchIndex::remove(const std::string& contentTopic, const std::vector<std::string>& messageHashes) {
+    std::unordered_set<std::string_view> wanted(messageHashes.begin(), messageHashes.end());
+    size_t count = 0;
+    bool purge = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto topic = topicIds_.find(contentTopic);
+        if (topic == topicIds_.end() || wanted.empty()) return 0;
+        auto removeFrom = [&](const SearchIndexPart& part) {
+            std::vector<size_t> indexes;
+            const std::vector<bool>* removed = part.removed.get();
+            for (size_t i = 0; i < part.docs.size(); ++i) {
+                if (part.topics[i] != topic->second || isRemoved(removed, i) ||
+                    wanted.count(part.hash(part.docs[i])) == 0) {
+                    continue;
+                }
+                indexes.push_back(i);
+                documents_--;
+                totalLength_ -= part.lengths[i];
+            }
+            part.markRemoved(indexes);
+            count += indexes.size();
+        };
+        for (const auto& segment : segments_) {
+            removeFrom(*segment);
+            if (segment->removedCount > 0 && segment->removedCount * kPurgeShare >= segment->docs.size()) purge = true;
+        }
+        for (const auto& buffer : frozen_) removeFrom(*buffer);
+        removeFrom(*buffer_);
+        purge_ = purge_ || purge;
+    }
+    if (purge) cv_.notify_all();
+    return count;
+}
+
+// Hand the buffer to the background thread and start a new one
+void SearchIndex::freezeLocked() {
+    if (buffer_->docs.empty()) return;
+    frozen_.push_back(std::move(buffer_));
+    buffer_ = std::make_shared<Buffer>();
+}
+
+void SearchIndex::waitIdle() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    freezeLocked();
+    cv_.notify_all();
+    idleCv_.wait(lock, [this] { return (frozen_.empty() && !purge_ && !busy_) || stopping_; });
+}
+
+size_t SearchIndex::documentCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return documents_;
+}
+
+size_t SearchIndex::segmentCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return segments_.size();
+}
+
+void SearchIndex::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this] { return stopping_ || !frozen_.empty() || purge_; });
+        if (stopping_) break;
+        busy_ = true;
+        purge_ = false;
+        std::shared_ptr<const Buffer> buffer;
+        std::shared_ptr<const std::vector<bool>> removed;
+        if (!frozen_.empty()) {
+            buffer = frozen_.front();
+            removed = buffer->removed;
+        }
+        lock.unlock();
+        if (buffer) seal(buffer, removed);
+        while (mergeOnce()) {
+        }
+        lock.lock();
+        busy_ = false;
+        idleCv_.notify_all();
+    }
+    busy_ = false;
+    idleCv_.notify_all();
+}
+
+// Turn the oldest frozen buffer into a segment, leaving out the docs
+// removed as of removed. It stays searchable as a buffer until the
+// segment replaces it.
+void SearchIndex::seal(const std::shared_ptr<const Buffer>& buffer,
+                       const std::shared_ptr<const std::vector<bool>>& removed) {
+    auto segment = std::make_shared<Segment>();
+    segment->base = buffer->base;
+    std::vector<uint32_t> ids = segment->addKept(*buffer, removed.get());
+    segment->terms.reserve(buffer->terms.size());
+
+    Segment::Writer writer(*segment);
+    PostingList list;
+    for (const auto& entry : buffer->terms) {
+        list.docs = entry.second.docs;
+        list.freqs = entry.second.freqs;
+        list.positions = entry.second.positions;
+        if (removed) renumber(list, buffer->base, ids);
+        writer.begin(entry.first);
+        writer.add(list);
+    }
+    segment->finish();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    segment->carryRemoved(*buffer, removed.get(), ids);
+    frozen_.erase(frozen_.begin());
+    if (!segment->docs.empty()) segments_.push_back(std::move(segment));
+}
+
+// Merge the oldest run of mergeFactor adjacent segments of one tier, or
+// else rewrite a segment with a quarter of its docs removed. Removed docs
+// are left out either way. Returns false if there is nothing to do. Only
+// the background thread changes segments_, so the run is still in place
+// when the merge is done.
+bool SearchIndex::mergeOnce() {
+    size_t factor = std::max<size_t>(2, options_.mergeFactor);
+    std::vector<std::shared_ptr<const Segment>> run;
+    std::vector<std::shared_ptr<const std::vector<bool>>> removed;
+    size_t first = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < segments_.size();) {
+            size_t level = tier(segments_[i]->docs.size(), options_);
+            size_t j = i;
+            while (j < segments_.size() && tier(segments_[j]->docs.size(), options_) == level) j++;
+            if (j - i >= factor) {
+                first = i;
+                run.assign(segments_.begin() + i, segments_.begin() + i + factor);
+                break;
+            }
+            i = j;
+        }
+        for (size_t i = 0; i < segments_.size() && run.empty(); ++i) {
+            const Segment& segment = *segments_[i];
+            if (segment.removedCount > 0 && segment.removedCount * kPurgeShare >= segment.docs.size()) {
+                first = i;
+                run.push_back(segments_[i]);
+            }
+        }
+        for (const auto& segment : run) removed.push_back(segment->removed);
+    }
+    if (run.empty()) return false;
+
+    auto merged = std::make_shared<Segment>();
+    merged->base = run.front()->base;
+    std::vector<std::vector<uint32_t>> ids;
+    for (size_t s = 0; s < run.size(); ++s) ids.push_back(merged->addKept(*run[s], removed[s].get()));
+
+    // k-way merge of the sorted term dictionaries; docs of the older
+    // segments come first, so every term's docs stay in order
+    Segment::Writer writer(*merged);
+    std::vector<size_t> next(run.size(), 0);
+    PostingList list;
+    while (true) {
+        std::string_view word;
+        bool found = false;
+        for (size_t s = 0; s < run.size(); ++s) {
+            if (next[s] == run[s]->terms.size()) continue;
+            std::string_view candidate = run[s]->text(run[s]->terms[next[s]]);
+            if (!found || candidate < word) {
+                word = candidate;
+                found = true;
+            }
+        }
+        if (!found) break;
+        std::string term(word);
+        writer.begin(term);
+        for (size_t s = 0; s < run.size(); ++s) {
+            if (next[s] == run[s]->terms.size() || run[s]->text(run[s]->terms[next[s]]) != term) continue;
+            run[s]->decode(run[s]->terms[next[s]], true, list);
+            renumber(list, run[s]->base, ids[s]);
+            writer.add(list);
+            next[s]++;
+        }
+    }
+    merged->finish();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t s = 0; s < run.size(); ++s) merged->carryRemoved(*run[s], removed[s].get(), ids[s]);
+    segments_.erase(segments_.begin() + first, segments_.begin() + first + run.size());
+    if (!merged->docs.empty()) segments_.insert(segments_.begin() + first, std::move(merged));
+    return true;
+}
+
+namespace {
+
+// Docs of one part matching a clause, with how often they match
+struct ClauseMatches {
+    std::vector<uint32_t> docs;
+    std::vector<uint32_t> freqs;
+};
+
+// Union of postings lists, frequencies summed
+ClauseMatches unite(std::vector<PostingList>& lists) {
+    std::vector<std::pair<uint32_t, uint32_t>> all;
+    for (const PostingList& list : lists) {
+        for (size_t i = 0; i < list.docs.size(); ++i) all.emplace_back(list.docs[i], list.freqs[i]);
+    }
+    std::sort(all.begin(), all.end());
+    ClauseMatches out;
+    for (const auto& entry : all) {
+        if (!out.docs.empty() && out.docs.back() == entry.first) {
+            out.freqs.back() += entry.second;
+        } else {
+            out.docs.push_back(entry.first);
+            out.freqs.push_back(entry.second);
+        }
+    }
+    return out;
+}
+
+// Phrase matches in a part, within the given docs unless null.
+//
+// The rarest word gives the docs and, in each, the positions the phrase
+// could start at. Every other word, from the rarest on, is then read for
+// the docs left only, and keeps the starts it is found at the right
+// distance from; a doc is dropped once it has none. A common word like
+// "the" is thus decoded for few docs and matched by merging, not searched.
+ClauseMatches phraseMatches(const SearchIndexPart& part, const std::vector<std::string>& words,
+                            const std::vector<uint32_t>& freqs, const std::vector<uint32_t>* within) {
+    std::vector<size_t> order(words.size());
+    for (size_t w = 0; w < words.size(); ++w) order[w] = w;
+    std::sort(order.begin(), order.end(), [&freqs](size_t a, size_t b) { return freqs[a] < freqs[b]; });
+
+    PostingList list;
+    if (!part.postings(words[order[0]], within, true, list)) return ClauseMatches();
+    std::vector<uint32_t> docs;
+    std::vector<uint32_t> ends;    // per doc, where its starts end
+    std::vector<uint32_t> starts;  // phrase starts by doc, ascending
+    uint32_t shift = static_cast<uint32_t>(order[0]);
+    for (size_t i = 0, k = 0; i < list.docs.size(); ++i) {
+        for (uint32_t j = 0; j < list.freqs[i]; ++j, ++k) {
+            if (list.positions[k] >= shift) starts.push_back(list.positions[k] - shift);
+        }
+        if (starts.size() > (ends.empty() ? 0 : ends.back())) {
+            docs.push_back(list.docs[i]);
+            ends.push_back(static_cast<uint32_t>(starts.size()));
+        }
+    }
+
+    std::vector<uint32_t> keptDocs;
+    std::vector<uint32_t> keptEnds;
+    for (size_t n = 1; n < order.size() && !docs.empty(); ++n) {
+        shift = static_cast<uint32_t>(order[n]);
+        if (!part.postings(words[order[n]], &docs, true, list)) return ClauseMatches();
+        keptDocs.clear();
+        keptEnds.clear();
+        size_t kept = 0;  // starts, compacted in place
+        for (size_t i = 0, d = 0, k = 0; i < list.docs.size(); k += list.freqs[i], ++i) {
+            while (docs[d] < list.docs[i]) d++;
+            const uint32_t* positions = list.positions.data() + k;
+            const uint32_t* last = positions + list.freqs[i];
+            size_t first = kept;
+            for (size_t s = d == 0 ? 0 : ends[d - 1]; s < ends[d] && positions != last; ++s) {
+                uint32_t wanted = starts[s] + shift;
+                while (positions != last && *positions < wanted) positions++;
+                if (positions != last && *positions == wanted) starts[kept++] = starts[s];
+            }
+            if (kept > first) {
+                keptDocs.push_back(docs[d]);
+                keptEnds.push_back(static_cast<uint32_t>(kept));
+            }
+        }
+        docs.swap(keptDocs);
+        ends.swap(keptEnds);
+        starts.resize(kept);
+    }
+
+    ClauseMatches out;
+    out.docs = std::move(docs);
+    out.freqs.resize(out.docs.size());
+    for (size_t d = 0; d < ends.size(); ++d) out.freqs[d] = ends[d] - (d == 0 ? 0 : ends[d - 1]);
+    return out;
+}
+
+// Contribution of a clause to a doc's BM25 score
+double bm25(double idf, double tf, double norm) {
+    return idf * tf * (kK1 + 1) / (tf + norm);
+}
+
+struct Candidate {
+    double score;
+    uint64_t timestamp;
+    uint32_t doc;
+    uint32_t part;
+};
+
+} // namespace
+
+SearchResults SearchIndex::search(std::string_view query, size_t offset, size_t limit,
+                                  const std::string& contentTopic) const {
+    SearchResults results;
+
+    // Parse the query into clauses
+    std::vector<Clause> clauses;
+    for (size_t i = 0; i < query.size();) {
+        if (query[i] == ' ' || query[i] == '\t') {
+            i++;
+            continue;
+        }
+        Clause clause;
+        if (query[i] == '"') {
+            size_t end = query.find('"', i + 1);
+            if (end == std::string_view::npos) end = query.size();
+            clause.words = tokenize(query.substr(i + 1, end - i - 1), options_.maxTermLength);
+            clause.kind = Clause::Phrase;
+            i = std::min(query.size(), end + 1);
+        } else {
+            size_t end = query.find_first_of(" \t\"", i);
+            if (end == std::string_view::npos) end = query.size();
+            std::string_view token = query.substr(i, end - i);
+            bool prefix = token.size() > 1 && token.back() == '*';
+            clause.words = tokenize(prefix ? token.substr(0, token.size() - 1) : token, options_.maxTermLength);
+            // A prefix of several words, like "don't*", is a phrase ending
+            // in a prefix; keep it simple and match the words before it
+            if (prefix && clause.words.size() == 1) {
+                clause.kind = Clause::Prefix;
+            } else {
+                clause.kind = clause.words.size() > 1 ? Clause::Phrase : Clause::Term;
+            }
+            i = end;
+        }
+        if (clause.words.empty()) continue;
+        if (clause.kind == Clause::Phrase && clause.words.size() == 1) clause.kind = Clause::Term;
+        clauses.push_back(std::move(clause));
+    }
+    if (clauses.empty()) return results;
+
+    // Evaluate the query on every part. The buffer still taking messages
+    // is evaluated under the lock and scored on a copy of its docs; the
+    // frozen buffers and segments don't change and are evaluated after.
+    //
+    // The statistics BM25 needs come from the term dictionaries: the
+    // document frequency of every word, and for a prefix the sum over the
+    // words it expands to. A phrase weighs as much as its words together.
+    // Matching starts with the clause matching the fewest docs and looks
+    // for each next clause only in the docs still matching, so a common
+    // word costs little next to a rare one.
+    std::vector<std::shared_ptr<const SearchIndexPart>> parts;
+    std::vector<std::shared_ptr<const SearchIndexPart>> hashParts;  // hashes are read from these
+    std::vector<std::shared_ptr<const std::vector<bool>>> removed;  // per part, as of the snapshot
+    std::vector<std::vector<ClauseMatches>> matches;
+    std::vector<size_t> matching;  // per part, the clause whose docs match every clause
+    std::vector<std::vector<uint64_t>> docFreqs(clauses.size());
+    for (size_t c = 0; c < clauses.size(); ++c) {
+        docFreqs[c].assign(clauses[c].kind == Clause::Phrase ? clauses[c].words.size() : 1, 0);
+    }
+    uint64_t documents = 0;
+    uint64_t totalLength = 0;
+    bool filter = !contentTopic.empty();
+    uint32_t topic = 0;
+
+    auto evaluate = [this, &clauses, &docFreqs, &matches, &matching](const SearchIndexPart& part) {
+        std::vector<std::vector<uint32_t>> freqs(clauses.size());
+        std::vector<std::vector<std::string>> expansions(clauses.size());
+        std::vector<uint64_t> cost(clauses.size());
+        for (size_t c = 0; c < clauses.size(); ++c) {
+            const Clause& clause = clauses[c];
+            if (clause.kind == Clause::Prefix) {
+                std::vector<std::pair<std::string, uint32_t>> terms;
+                part.expand(clause.words[0], terms);
+                if (terms.size() > options_.maxPrefixTerms) {
+                    std::nth_element(terms.begin(), terms.begin() + options_.maxPrefixTerms, terms.end(),
+                                     [](const auto& a, const auto& b) { return a.second > b.second; });
+                    terms.resize(options_.maxPrefixTerms);
+                }
+                uint64_t sum = 0;
+                for (auto& term : terms) {
+                    sum += term.second;
+                    expansions[c].push_back(std::move(term.first));
+                }
+                freqs[c].push_back(static_cast<uint32_t>(std::min<uint64_t>(sum, part.docs.size())));
+            } else {
+                for (const std::string& word : clause.words) freqs[c].push_back(part.docFrequency(word));
+            }
+            for (size_t w = 0; w < freqs[c].size(); ++w) docFreqs[c][w] += freqs[c][w];
+            cost[c] = *std::min_element(freqs[c].begin(), freqs[c].end());
+        }
+
+        std::vector<size_t> order(clauses.size());
+        for (size_t c = 0; c < clauses.size(); ++c) order[c] = c;
+        std::sort(order.begin(), order.end(), [&cost](size_t a, size_t b) { return cost[a] < cost[b]; });
+
+        // Every clause has to match, so stop at the first that doesn't
+        std::vector<ClauseMatches> out(clauses.size());
+        size_t last = order[0];  // its docs match every clause so far
+        std::vector<PostingList> lists;
+        for (size_t k = 0; k < order.size(); ++k) {
+            size_t c = order[k];
+            const Clause& clause = clauses[c];
+            const std::vector<uint32_t>* within = k == 0 ? nullptr : &out[last].docs;
+            last = c;
+            if (cost[c] == 0) break;
+            if (clause.kind == Clause::Term) {
+                PostingList list;
+                if (part.postings(clause.words[0], within, false, list)) {
+                    out[c].docs = std::move(list.docs);
+                    out[c].freqs = std::move(list.freqs);
+                }
+            } else if (clause.kind == Clause::Prefix) {
+                lists.assign(expansions[c].size(), PostingList());
+                for (size_t t = 0; t < expansions[c].size(); ++t) {
+                    part.postings(expansions[c][t], within, false, lists[t]);
+                }
+                out[c] = unite(lists);
+            } else {
+                out[c] = phraseMatches(part, clause.words, freqs[c], within);
+            }
+            if (out[c].docs.empty()) break;
+        }
+        matches.push_back(std::move(out));
+        matching.push_back(last);
+    };
+
+    std::vector<std::shared_ptr<const SearchIndexPart>> later;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (filter) {
+            auto it = topicIds_.find(contentTopic);
+            if (it == topicIds_.end()) return results;
+            topic = it->second;
+        }
+        for (const auto& segment : segments_) later.push_back(segment);
+        for (const auto& buffer : frozen_) later.push_back(buffer);
+        if (!buffer_->docs.empty()) {
+            auto docs = std::make_shared<Buffer>();
+            docs->base = buffer_->base;
+            docs->docs = buffer_->docs;
+            docs->topics = buffer_->topics;
+            docs->lengths = buffer_->lengths;
+            parts.push_back(std::move(docs));
+            hashParts.push_back(buffer_);
+            removed.push_back(buffer_->removed);
+            evaluate(*buffer_);
+        }
+        for (const auto& part : later) removed.push_back(part->removed);
+        documents = documents_;
+        totalLength = totalLength_;
+    }
+    for (const auto& part : later) {
+        parts.push_back(part);
+        hashParts.push_back(part);
+        evaluate(*part);
+    }
+    if (documents == 0) return results;
+
+    std::vector<double> idf(clauses.size(), 0);
+    for (size_t c = 0; c < clauses.size(); ++c) {
+        for (uint64_t df : docFreqs[c]) {
+            df = std::min(df, documents);
+            idf[c] += std::log(1.0 + (documents - df + 0.5) / (df + 0.5));
+        }
+    }
+    double averageLength = std::max(1.0, static_cast<double>(totalLength) / documents);
+
+    // Score the docs matching every clause, keeping the best offset + limit
+    // in a heap with the worst of them on top
+    auto better = [](const Candidate& a, const Candidate& b) {
+        if (a.score != b.score) return a.score > b.score;
+        return a.timestamp > b.timestamp;
+    };
+    size_t keep = limit > SIZE_MAX - offset ? SIZE_MAX : offset + limit;
+    std::vector<Candidate> best;
+    best.reserve(std::min<size_t>(keep, 4096));
+    std::vector<size_t> cursor(clauses.size());
+    double lengthWeight = kK1 * kB / averageLength;
+    size_t total = 0;
+    bool single = clauses.size() == 1;
+    double weight = idf[0] * (kK1 + 1);
+    for (size_t p = 0; p < parts.size(); ++p) {
+        const std::vector<ClauseMatches>& partMatches = matches[p];
+        const SearchIndexPart& part = *parts[p];
+        const std::vector<bool>* removedDocs = removed[p].get();
+        const ClauseMatches& matched = partMatches[matching[p]];
+        const uint32_t* topics = part.topics.data();
+        const uint16_t* lengths = part.lengths.data();
+        std::fill(cursor.begin(), cursor.end(), 0);
+        for (size_t i = 0; i < matched.docs.size(); ++i) {
+            uint32_t doc = matched.docs[i];
+            size_t index = doc - part.base;
+            if (filter && topics[index] != topic) continue;
+            if (isRemoved(removedDocs, index)) continue;
+            total++;
+            if (keep == 0) continue;
+            double norm = kK1 * (1 - kB) + lengthWeight * lengths[index];
+            // With one clause, a doc that can't beat the worst kept is
+            // known without dividing
+            if (single && best.size() == keep) {
+                double tf = matched.freqs[i];
+                if (weight * tf < best.front().score * (tf + norm)) continue;
+            }
+            double score = 0;
+            for (size_t c = 0; c < clauses.size(); ++c) {
+                const ClauseMatches& m = partMatches[c];
+                size_t k = cursor[c];
+                while (m.docs[k] < doc) k++;
+                cursor[c] = k;
+                score += bm25(idf[c], m.freqs[k], norm);
+            }
+            if (best.size() < keep) {
+                best.push_back(Candidate{score, part.docs[index].timestamp, doc, static_cast<uint32_t>(p)});
+                std::push_heap(best.begin(), best.end(), better);
+                continue;
+            }
+            // Most docs score below the worst kept; their timestamp isn't read
+            if (score < best.front().score) continue;
+            Candidate candidate{score, part.docs[index].timestamp, doc, static_cast<uint32_t>(p)};
+            if (better(candidate, best.front())) {
+                std::pop_heap(best.begin(), best.end(), better);
+                best.back() = candidate;
+                std::push_heap(best.begin(), best.end(), better);
+            }
+        }
+    }
+    results.total = total;
+    if (offset >= best.size()) return results;
+    std::sort_heap(best.begin(), best.end(), better);
+
+    results.hits.reserve(best.size() - offset);
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = offset; i < best.size(); ++i) {
+        const Candidate& candidate = best[i];
+        const SearchIndexPart& part = *hashParts[candidate.part];
+        size_t index = candidate.doc - part.base;
+        const DocInfo& info = part.docs[index];
+        SearchHit hit;
+        hit.contentTopic = topics_[part.topics[index]];
+        hit.messageHash = std::string(part.hash(info));
+        hit.timestamp = info.timestamp;
+        hit.score = candidate.score;
+        results.hits.push_back(std::move(hit));
+    }
+    return results;
+}
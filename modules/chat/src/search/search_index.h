@@ -0,0 +1,120 @@
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct SearchIndexOptions {
+    size_t segmentDocs = 16384;  // messages buffered before they are sealed into a segment
+    size_t mergeFactor = 8;      // segments of one size that are merged into one
+    size_t maxPrefixTerms = 256; // terms a prefix query expands to, most frequent first
+    size_t maxTermLength = 64;   // longer words are cut
+};
+
+// A message matching a query
+struct SearchHit {
+    std::string contentTopic;
+    std::string messageHash;
+    uint64_t timestamp = 0;  // envelope timestamp (ns)
+    double score = 0;
+};
+
+// One page of results, best first
+struct SearchResults {
+    std::vector<SearchHit> hits;
+    size_t total = 0;  // messages matching the query
+};
+
+// Incremental full-text index over chat messages.
+//
+// Messages are tokenized into lowercase words (runs of letters and digits;
+// non-ASCII UTF-8 sequences count as letters) and added to an in-memory
+// buffer. Once segmentDocs messages have been buffered, the buffer is
+// frozen and a background thread seals it into an immutable segment: a
+// sorted term dictionary with delta-encoded postings and, separately,
+// word positions. The same thread merges mergeFactor segments of a similar
+// size into one, so a large index is a handful of big segments and a few
+// small ones. Searches read a snapshot of the segments and never wait for
+// a merge.
+//
+// A query is a list of words that must all appear. A word ending in '*'
+// matches every word starting with it, and words in double quotes must
+// appear next to each other, in order. Results are ranked by BM25, newer
+// messages first among equal scores, and returned a page at a time.
+//
+// Messages are identified by content topic and hash, and read back from
+// the history store; the index keeps no text. It lives in memory only.
+// Messages the store no longer holds are removed by hash: they stop
+// matching right away and are dropped from their segment when it is next
+// merged, or rewritten once a quarter of it is gone.
+//
+// All methods are thread-safe.
+class SearchIndex {
+public:
+    explicit SearchIndex(const SearchIndexOptions& options = SearchIndexOptions());
+    ~SearchIndex();
+
+    SearchIndex(const SearchIndex&) = delete;
+    SearchIndex& operator=(const SearchIndex&) = delete;
+
+    void add(const std::string& contentTopic, const std::string& messageHash, uint64_t timestamp,
+             std::string_view text);
+
+    // Forget messages of a channel. Returns how many were indexed.
+    size_t remove(const std::string& contentTopic, const std::vector<std::string>& messageHashes);
+
+    // Results offset to offset + limit of a query, limited to one channel
+    // unless contentTopic is empty
+    SearchResults search(std::string_view query, size_t offset, size_t limit,
+                         const std::string& contentTopic = std::string()) const;
+
+    // Block until buffered messages are sealed and pending merges are done
+    void waitIdle();
+
+    // Messages indexed and not removed
+    size_t documentCount() const;
+    size_t segmentCount() const;
+
+    // Lowercase words of text, as indexed
+    static std::vector<std::string> tokenize(std::string_view text, size_t maxTermLength = 64);
+
+private:
+    struct Buffer;
+    struct Segment;
+    struct Clause;
+
+    void freezeLocked();
+    void run();
+    void seal(const std::shared_ptr<const Buffer>& buffer, const std::shared_ptr<const std::vector<bool>>& removed);
+    bool mergeOnce();
+
+    const SearchIndexOptions options_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::condition_variable idleCv_;
+    std::shared_ptr<Buffer> buffer_;                     // taking new messages
+    std::vector<std::shared_ptr<const Buffer>> frozen_;  // full, waiting to be sealed
+    std::vector<std::shared_ptr<const Segment>> segments_;  // oldest first
+    std::unordered_map<std::string, uint32_t> topicIds_;
+    std::vector<std::string> topics_;                    // by topic id, never shrinks
+    uint32_t nextDoc_ = 0;
+    size_t documents_ = 0;     // not removed, for BM25
+    uint64_t totalLength_ = 0;  // words of those
+    bool purge_ = false;  // a segment has enough docs removed to be rewritten
+    bool busy_ = false;   // the background thread is sealing or merging
+    bool stopping_ = false;
+
+    std::thread worker_;
+};
+
+#endif // SEARCH_INDEX_H
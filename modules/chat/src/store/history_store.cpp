@@ -0,0 +1,861 @@
+#include "history_store.h"
+#include "actor/worker_pool.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <iterator>
+#include <unordered_map>
+
+#if defined(_WIN32)
+#include <fstream>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Segment layout:
+//   header  8 byte magic, 8 reserved bytes
+//   records u32 length       bytes following this field, without padding
+//           u32 crc32        of the bytes following this field
+//           u64 timestamp
+//           u16 hash length
+//           u16 flags        reserved, 0
+//           u32 payload length
+//           hash bytes, payload bytes, zero padding to 8 bytes
+constexpr char kSegmentMagic[8] = {'L', 'C', 'H', 'S', 'E', 'G', '0', '1'};
+constexpr size_t kSegmentHeaderSize = 16;
+constexpr size_t kRecordHeaderSize = 24;
+constexpr uint32_t kMaxRecordLength = 64 * 1024 * 1024;
+constexpr const char* kSegmentSuffix = ".seg";
+constexpr const char* kTempSuffix = ".tmp";
+constexpr const char* kSyncFile = "synced";  // the store sync mark, in decimal
+
+struct Crc32Table {
+    uint32_t value[256];
+    constexpr Crc32Table() : value() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            value[i] = c;
+        }
+    }
+};
+
+constexpr Crc32Table kCrc32;
+
+uint32_t crc32(const uint8_t* data, size_t size) {
+    uint32_t c = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i) c = kCrc32.value[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
+}
+
+inline void putU16(uint8_t* p, uint16_t v) {
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+}
+
+inline void putU32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; ++i) p[i] = static_cast<uint8_t>(v >> (8 * i));
+}
+
+inline void putU64(uint8_t* p, uint64_t v) {
+    for (int i = 0; i < 8; ++i) p[i] = static_cast<uint8_t>(v >> (8 * i));
+}
+
+inline uint16_t getU16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+inline uint32_t getU32(const uint8_t* p) {
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; --i) v = (v << 8) | p[i];
+    return v;
+}
+
+inline uint64_t getU64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; --i) v = (v << 8) | p[i];
+    return v;
+}
+
+inline size_t align8(size_t n) {
+    return (n + 7) & ~static_cast<size_t>(7);
+}
+
+// Directory name for a content topic: alphanumerics, '-' and '.' are kept,
+// everything else is hex-escaped so distinct topics never collide
+std::string channelDirName(const std::string& topic) {
+    static const char* hex = "0123456789abcdef";
+    std::string name;
+    name.reserve(topic.size() + 8);
+    for (char c : topic) {
+        unsigned char u = static_cast<unsigned char>(c);
+        if ((u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z') || (u >= '0' && u <= '9') || u == '-' || u == '.') {
+            name.push_back(c);
+        } else {
+            name.push_back('_');
+            name.push_back(hex[u >> 4]);
+            name.push_back(hex[u & 0xF]);
+        }
+    }
+    return name;
+}
+
+std::string segmentFileName(uint32_t id) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%08u%s", id, kSegmentSuffix);
+    return name;
+}
+
+bool flushFile(std::FILE* file, bool sync) {
+    if (std::fflush(file) != 0) return false;
+    if (!sync) return true;
+#if defined(_WIN32)
+    return _commit(_fileno(file)) == 0;
+#else
+    return ::fsync(fileno(file)) == 0;
+#endif
+}
+
+// Read-only view of the first size bytes of a file
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile() { unmap(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool map(const std::string& path, size_t size) {
+        unmap();
+        if (size == 0) return true;
+#if defined(_WIN32)
+        std::ifstream in(path, std::ios::binary);
+        buffer_.resize(size);
+        if (!in.read(reinterpret_cast<char*>(buffer_.data()), size)) {
+            buffer_.clear();
+            return false;
+        }
+        data_ = buffer_.data();
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        void* addr = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED) return false;
+        addr_ = addr;
+        data_ = static_cast<const uint8_t*>(addr);
+#endif
+        size_ = size;
+        return true;
+    }
+
+    void unmap() {
+#if defined(_WIN32)
+        buffer_.clear();
+#else
+        if (addr_ != nullptr) ::munmap(addr_, size_);
+        addr_ = nullptr;
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+#if defined(_WIN32)
+    std::vector<uint8_t> buffer_;
+#else
+    void* addr_ = nullptr;
+#endif
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+struct Segment {
+    uint32_t id = 0;
+    std::string path;
+    size_t size = 0;  // bytes of valid data
+    MappedFile map;
+
+    // Make sure the mapping covers everything written so far
+    bool ensureMapped() {
+        if (map.size() >= size) return true;
+        return map.map(path, size);
+    }
+};
+
+Segment* findSegment(const std::vector<std::unique_ptr<Segment>>& segments, uint32_t id) {
+    auto it = std::lower_bound(segments.begin(), segments.end(), id,
+                               [](const std::unique_ptr<Segment>& s, uint32_t v) { return s->id < v; });
+    return (it != segments.end() && (*it)->id == id) ? it->get() : nullptr;
+}
+
+// Validate the record at offset. Returns its padded size, 0 if invalid.
+size_t checkRecord(const uint8_t* base, size_t segmentSize, size_t offset) {
+    if (offset + kRecordHeaderSize > segmentSize) return 0;
+    const uint8_t* p = base + offset;
+    uint32_t length = getU32(p);
+    if (length < kRecordHeaderSize - 4 || length > kMaxRecordLength) return 0;
+    if (offset + 4 + length > segmentSize) return 0;
+    if (size_t(kRecordHeaderSize) + getU16(p + 16) + getU32(p + 20) != 4 + size_t(length)) return 0;
+    if (crc32(p + 8, length - 4) != getU32(p + 4)) return 0;
+    return align8(4 + length);
+}
+
+} // namespace
+
+struct HistoryStore::IndexEntry {
+    uint64_t timestamp;
+    uint32_t segment;
+    uint64_t offset;  // a compacted segment may pass 4 GiB
+};
+
+struct HistoryStore::Channel {
+    std::mutex mutex;
+    std::mutex compactMutex;                         // one compaction at a time
+    std::string topic;
+    std::string dir;
+    HistoryStoreOptions options;
+    std::list<Channel*>::iterator lruPosition;
+    bool loaded = false;
+    bool compactionQueued = false;
+    uint64_t generation = 0;                         // bumped by every reload
+    uint64_t syncedUntil = 0;
+    std::vector<std::unique_ptr<Segment>> segments;  // by id, the last one is active
+    std::FILE* active = nullptr;
+    std::vector<IndexEntry> byTime;                  // sorted by timestamp
+    std::unordered_map<std::string, IndexEntry> byHash;
+    std::vector<uint8_t> recordBuffer;
+
+    ~Channel() { closeActive(); }
+
+    void closeActive() {
+        if (active != nullptr) std::fclose(active);
+        active = nullptr;
+    }
+
+    Segment* segment(uint32_t id) { return findSegment(segments, id); }
+
+    void index(const IndexEntry& entry, const std::string& hash) {
+        if (byTime.empty() || byTime.back().timestamp <= entry.timestamp) {
+            byTime.push_back(entry);
+        } else {
+            auto pos = std::upper_bound(byTime.begin(), byTime.end(), entry.timestamp,
+                                        [](uint64_t ts, const IndexEntry& e) { return ts < e.timestamp; });
+            byTime.insert(pos, entry);
+        }
+        if (!hash.empty()) byHash.emplace(hash, entry);
+    }
+};
+
+HistoryStore::HistoryStore() = default;
+
+HistoryStore::~HistoryStore() {
+    close();
+}
+
+bool HistoryStore::open(const std::string& directory, const HistoryStoreOptions& options) {
+    close();
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::error_code ec;
+    fs::create_directories(directory, ec);
+    if (ec) {
+        std::cerr << "History store: cannot create " << directory << ": " << ec.message() << std::endl;
+        return false;
+    }
+    directory_ = directory;
+    options_ = options;
+    if (options_.segmentSize < kSegmentHeaderSize + kRecordHeaderSize) {
+        options_.segmentSize = kSegmentHeaderSize + kRecordHeaderSize;
+    }
+    // Compactions are rare and disk bound, one thread is plenty
+    compactor_ = std::make_unique<WorkerPool>(1);
+    open_ = true;
+    return true;
+}
+
+void HistoryStore::close() {
+    std::unique_ptr<WorkerPool> compactor;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        open_ = false;
+        compactor = std::move(compactor_);
+    }
+    // Finish the queued compactions before the channels go away
+    compactor.reset();
+    std::lock_guard<std::mutex> lock(mutex_);
+    channels_.clear();
+    lru_.clear();
+}
+
+bool HistoryStore::isOpen() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return open_;
+}
+
+// The channel for a topic, created unloaded if needed. The caller locks it
+// and calls ready() before touching its segments.
+std::shared_ptr<HistoryStore::Channel> HistoryStore::channel(const std::string& contentTopic) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!open_) return nullptr;
+    auto it = channels_.find(contentTopic);
+    if (it != channels_.end()) {
+        lru_.splice(lru_.begin(), lru_, it->second->lruPosition);
+        return it->second;
+    }
+
+    auto ch = std::make_shared<Channel>();
+    ch->topic = contentTopic;
+    ch->dir = (fs::path(directory_) / channelDirName(contentTopic)).string();
+    ch->options = options_;
+    lru_.push_front(ch.get());
+    ch->lruPosition = lru_.begin();
+    channels_.emplace(contentTopic, ch);
+    evictIdle();
+    return ch;
+}
+
+// Close the least recently used channels past maxOpenChannels. Called with
+// mutex_ held. References only leave the map under mutex_, so a channel
+// nobody else references is idle and stays idle while it is dropped.
+void HistoryStore::evictIdle() {
+    auto it = lru_.end();
+    while (channels_.size() > options_.maxOpenChannels && it != lru_.begin()) {
+        --it;
+        auto found = channels_.find((*it)->topic);
+        if (found->second.use_count() > 1) continue;
+        it = lru_.erase(it);
+        channels_.erase(found);
+    }
+}
+
+// Load the channel if it is not loaded yet. Called with the channel locked.
+bool HistoryStore::ready(Channel& ch) {
+    return ch.loaded || loadChannel(ch);
+}
+
+bool HistoryStore::loadChannel(Channel& ch) {
+    ch.loaded = false;
+    ch.generation++;
+    ch.closeActive();
+    ch.segments.clear();
+    ch.byTime.clear();
+    ch.byHash.clear();
+    ch.syncedUntil = 0;
+
+    std::error_code ec;
+    fs::create_directories(ch.dir, ec);
+    if (ec) {
+        std::cerr << "History store: cannot create " << ch.dir << ": " << ec.message() << std::endl;
+        return false;
+    }
+
+    if (std::FILE* sync = std::fopen((fs::path(ch.dir) / kSyncFile).string().c_str(), "rb")) {
+        char text[32] = {};
+        if (std::fgets(text, sizeof(text), sync) != nullptr) ch.syncedUntil = std::strtoull(text, nullptr, 10);
+        std::fclose(sync);
+    }
+
+    for (const auto& file : fs::directory_iterator(ch.dir, ec)) {
+        std::string name = file.path().filename().string();
+        if (file.path().extension() == kTempSuffix) {
+            // Left behind by an interrupted compaction
+            fs::remove(file.path(), ec);
+            continue;
+        }
+        if (file.path().extension() != kSegmentSuffix) continue;
+        auto seg = std::make_unique<Segment>();
+        seg->id = static_cast<uint32_t>(std::strtoul(name.c_str(), nullptr, 10));
+        seg->path = file.path().string();
+        seg->size = static_cast<size_t>(fs::file_size(file.path(), ec));
+        ch.segments.push_back(std::move(seg));
+    }
+    std::sort(ch.segments.begin(), ch.segments.end(),
+              [](const std::unique_ptr<Segment>& a, const std::unique_ptr<Segment>& b) { return a->id < b->id; });
+
+    for (size_t i = 0; i < ch.segments.size(); ++i) {
+        Segment& seg = *ch.segments[i];
+        bool isActive = (i + 1 == ch.segments.size());
+        if (seg.size < kSegmentHeaderSize || !seg.map.map(seg.path, seg.size) ||
+            std::memcmp(seg.map.data(), kSegmentMagic, sizeof(kSegmentMagic)) != 0) {
+            std::cerr << "History store: skipping unreadable segment " << seg.path << std::endl;
+            seg.size = 0;
+            seg.map.unmap();
+            continue;
+        }
+
+        size_t offset = kSegmentHeaderSize;
+        while (offset < seg.size) {
+            size_t recordSize = checkRecord(seg.map.data(), seg.size, offset);
+            if (recordSize == 0) break;
+            const uint8_t* p = seg.map.data() + offset;
+            std::string hash(reinterpret_cast<const char*>(p + kRecordHeaderSize), getU16(p + 16));
+            // A compaction interrupted before removing its inputs leaves
+            // duplicates in later segments
+            if (hash.empty() || ch.byHash.find(hash) == ch.byHash.end()) {
+                ch.index(IndexEntry{getU64(p + 8), seg.id, offset}, hash);
+            }
+            offset += std::min(recordSize, seg.size - offset);
+        }
+
+        if (offset < seg.size) {
+            if (isActive) {
+                std::cerr << "History store: dropping " << (seg.size - offset) << " torn bytes from " << seg.path << std::endl;
+                seg.map.unmap();
+                fs::resize_file(seg.path, offset, ec);
+            } else {
+                std::cerr << "History store: corrupt record in " << seg.path << " at " << offset << std::endl;
+            }
+            seg.size = offset;
+        }
+    }
+
+    // Drop segments that turned out unreadable so appends go to a fresh one
+    ch.segments.erase(std::remove_if(ch.segments.begin(), ch.segments.end(),
+                                     [](const std::unique_ptr<Segment>& s) { return s->size == 0; }),
+                      ch.segments.end());
+
+    if (ch.segments.empty() || ch.segments.back()->size >= ch.options.segmentSize) {
+        uint32_t id = ch.segments.empty() ? 1 : ch.segments.back()->id + 1;
+        ch.loaded = startSegment(ch, id);
+        return ch.loaded;
+    }
+
+    ch.active = std::fopen(ch.segments.back()->path.c_str(), "ab");
+    if (ch.active == nullptr) {
+        std::cerr << "History store: cannot open " << ch.segments.back()->path << " for writing" << std::endl;
+        return false;
+    }
+    ch.loaded = true;
+    return true;
+}
+
+bool HistoryStore::startSegment(Channel& ch, uint32_t id) {
+    ch.closeActive();
+    auto seg = std::make_unique<Segment>();
+    seg->id = id;
+    seg->path = (fs::path(ch.dir) / segmentFileName(id)).string();
+
+    ch.active = std::fopen(seg->path.c_str(), "wb");
+    if (ch.active == nullptr) {
+        std::cerr << "History store: cannot create " << seg->path << std::endl;
+        return false;
+    }
+    uint8_t header[kSegmentHeaderSize] = {};
+    std::memcpy(header, kSegmentMagic, sizeof(kSegmentMagic));
+    if (std::fwrite(header, 1, sizeof(header), ch.active) != sizeof(header) || !flushFile(ch.active, ch.options.syncWrites)) {
+        std::cerr << "History store: cannot write " << seg->path << std::endl;
+        ch.closeActive();
+        return false;
+    }
+    seg->size = kSegmentHeaderSize;
+    ch.segments.push_back(std::move(seg));
+    return true;
+}
+
+bool HistoryStore::append(const std::string& contentTopic, const std::string& messageHash,
+                          uint64_t timestamp, const uint8_t* payload, size_t size) {
+    std::shared_ptr<Channel> ch = channel(contentTopic);
+    if (ch == nullptr) return false;
+    std::lock_guard<std::mutex> lock(ch->mutex);
+    if (!ready(*ch) || ch->active == nullptr) return false;
+    bool ok = appendRecord(*ch, contentTopic, messageHash, timestamp, payload, size) && flushActive(*ch, contentTopic);
+    scheduleCompaction(ch);
+    return ok;
+}
+
+size_t HistoryStore::appendBatch(const std::string& contentTopic, const std::vector<HistoryRecord>& records) {
+    std::shared_ptr<Channel> ch = channel(contentTopic);
+    if (ch == nullptr) return 0;
+    std::lock_guard<std::mutex> lock(ch->mutex);
+    if (!ready(*ch) || ch->active == nullptr) return 0;
+    size_t appended = 0;
+    for (const HistoryRecord& record : records) {
+        if (ch->active == nullptr) break;
+        appended += appendRecord(*ch, contentTopic, record.messageHash, record.timestamp,
+                                 record.payload.data(), record.payload.size());
+    }
+    // One flush for the whole batch
+    if (appended > 0 && ch->active != nullptr && !flushActive(*ch, contentTopic)) return 0;
+    scheduleCompaction(ch);
+    return appended;
+}
+
+// Write one record to the active segment without flushing it. Called with
+// the channel locked.
+bool HistoryStore::appendRecord(Channel& ch, const std::string& contentTopic, const std::string& messageHash,
+                                uint64_t timestamp, const uint8_t* payload, size_t size) {
+    if (!messageHash.empty() && ch.byHash.find(messageHash) != ch.byHash.end()) return false;
+    if (messageHash.size() > 0xFFFF || size > kMaxRecordLength - kRecordHeaderSize - messageHash.size()) {
+        std::cerr << "History store: message too large for " << contentTopic << std::endl;
+        return false;
+    }
+
+    uint32_t length = static_cast<uint32_t>(kRecordHeaderSize - 4 + messageHash.size() + size);
+    size_t recordSize = align8(4 + length);
+    ch.recordBuffer.assign(recordSize, 0);
+    uint8_t* p = ch.recordBuffer.data();
+    putU32(p, length);
+    putU64(p + 8, timestamp);
+    putU16(p + 16, static_cast<uint16_t>(messageHash.size()));
+    putU16(p + 18, 0);
+    putU32(p + 20, static_cast<uint32_t>(size));
+    std::memcpy(p + kRecordHeaderSize, messageHash.data(), messageHash.size());
+    if (size > 0) std::memcpy(p + kRecordHeaderSize + messageHash.size(), payload, size);
+    putU32(p + 4, crc32(p + 8, length - 4));
+
+    Segment* seg = ch.segments.back().get();
+    if (seg->size > kSegmentHeaderSize && seg->size + recordSize > ch.options.segmentSize) {
+        if (!startSegment(ch, seg->id + 1)) return false;
+        seg = ch.segments.back().get();
+    }
+
+    if (std::fwrite(p, 1, recordSize, ch.active) != recordSize) {
+        std::cerr << "History store: write failed for " << contentTopic << std::endl;
+        // Reload so the index matches what actually reached the disk
+        loadChannel(ch);
+        return false;
+    }
+
+    ch.index(IndexEntry{timestamp, seg->id, seg->size}, messageHash);
+    seg->size += recordSize;
+    return true;
+}
+
+bool HistoryStore::flushActive(Channel& ch, const std::string& contentTopic) {
+    if (flushFile(ch.active, ch.options.syncWrites)) return true;
+    std::cerr << "History store: write failed for " << contentTopic << std::endl;
+    loadChannel(ch);
+    return false;
+}
+
+// Queue a compaction once enough segments are sealed. Called with the
+// channel locked.
+void HistoryStore::scheduleCompaction(const std::shared_ptr<Channel>& ch) {
+    if (ch->compactionQueued || ch->segments.size() < 2 ||
+        ch->segments.size() - 1 < ch->options.compactAfterSegments) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!compactor_) return;
+    ch->compactionQueued = true;
+    // The task keeps the channel referenced, so it is not evicted meanwhile
+    compactor_->post([this, ch] { compactChannel(*ch); });
+}
+
+bool HistoryStore::contains(const std::string& contentTopic, const std::string& messageHash) {
+    std::shared_ptr<Channel> ch = channel(contentTopic);
+    if (ch == nullptr) return false;
+    std::lock_guard<std::mutex> lock(ch->mutex);
+    return ready(*ch) && ch->byHash.find(messageHash) != ch->byHash.end();
+}
+
+bool HistoryStore::find(const std::string& contentTopic, const std::string& messageHash, HistoryRecord& out) {
+    std::shared_ptr<Channel> ch = channel(contentTopic);
+    if (ch == nullptr) return false;
+    std::lock_guard<std::mutex> lock(ch->mutex);
+    if (!ready(*ch)) return false;
+    auto it = ch->byHash.find(messageHash);
+    return it != ch->byHash.end() && readRecord(*ch, it->second, out);
+}
+
+uint64_t HistoryStore::newestTimestamp(const std::string& contentTopic) {
+    std::shared_ptr<Channel> ch = channel(contentTopic);
+    if (ch == nullptr) return 0;
+    std::lock_guard<std::mutex> lock(ch->mutex);
+    return (!ready(*ch) || ch->byTime.empty()) ? 0 : ch->byTime.back().timestamp;
+}
+
+size_t HistoryStore::messageCount(const std::string& contentTopic) {
+    std::shared_ptr<Channel> ch = channel(contentTopic);
+    if (ch == nullptr) return 0;
+    std::lock_guard<std::mutex> lock(ch->mutex);
+    return ready(*ch) ? ch->byTime.size() : 0;
+}
+
+std::vector<HistoryRecord> HistoryStore::readRecent(const std::string& contentTopic, size_t limit) {
+    std::vector<HistoryRecord> records;
+    std::shared_ptr<Channel> ch = channel(contentTopic);
+    if (ch == nullptr) return records;
+    std::lock_guard<std::mutex> lock(ch->mutex);
+    if (!ready(*ch)) return records;
+
+    size_t count = std::min(limit, ch->byTime.size());
+    records.reserve(count);
+    for (size_t i = ch->byTime.size() - count; i < ch->byTime.size(); ++i) {
+        HistoryRecord record;
+        if (readRecord(*ch, ch->byTime[i], record)) records.push_back(std::move(record));
+    }
+    return records;
+}
+
+std::vector<HistoryRecord> HistoryStore::readRange(const std::string& contentTopic, uint64_t from, uint64_t to, size_t limit) {
+    std::vector<HistoryRecord> records;
+    std::shared_ptr<Channel> ch = channel(contentTopic);
+    if (ch == nullptr) return records;
+    std::lock_guard<std::mutex> lock(ch->mutex);
+    if (!ready(*ch)) return records;
+
+    auto it = std::lower_bound(ch->byTime.begin(), ch->byTime.end(), from,
+                               [](const IndexEntry& e, uint64_t ts) { return e.timestamp < ts; });
+    for (; it != ch->byTime.end() && it->timestamp <= to && records.size() < limit; ++it) {
+        HistoryRecord record;
+        if (readRecord(*ch, *it, record)) records.push_back(std::move(record));
+    }
+    return records;
+}
+
+std::vector<HistoryRecord> HistoryStore::readBefore(const std::string& contentTopic, uint64_t before, size_t limit) {
+    return readBefore(contentTopic, before, std::string(), limit);
+}
+
+std::vector<HistoryRecord> HistoryStore::readBefore(const std::string& contentTopic, uint64_t before,
+                                                    const std::string& beforeHash, size_t limit) {
+    std::vector<HistoryRecord> records;
+    std::shared_ptr<Channel> ch = channel(contentTopic);
+    if (ch == nullptr) return records;
+    std::lock_guard<std::mutex> lock(ch->mutex);
+    if (!ready(*ch)) return records;
+
+    auto end = std::lower_bound(ch->byTime.begin(), ch->byTime.end(), before,
+                                [](const IndexEntry& e, uint64_t ts) { return e.timestamp < ts; });
+    auto cursor = beforeHash.empty() ? ch->byHash.end() : ch->byHash.find(beforeHash);
+    if (cursor != ch->byHash.end() && cursor->second.timestamp == before) {
+        // Step over the messages with the same timestamp stored before it
+        for (auto it = end; it != ch->byTime.end() && it->timestamp == before; ++it) {
+            if (it->segment == cursor->second.segment && it->offset == cursor->second.offset) {
+                end = it;
+                break;
+            }
+        }
+    }
+    auto begin = end - std::min(limit, static_cast<size_t>(end - ch->byTime.begin()));
+    records.reserve(end - begin);
+    for (auto it = begin; it != end; ++it) {
+        HistoryRecord record;
+        if (readRecord(*ch, *it, record)) records.push_back(std::move(record));
+    }
+    return records;
+}
+
+uint64_t HistoryStore::syncedUntil(const std::string& contentTopic) {
+    std::shared_ptr<Channel> ch = channel(contentTopic);
+    if (ch == nullptr) return 0;
+    std::lock_guard<std::mutex> lock(ch->mutex);
+    return ready(*ch) ? ch->syncedUntil : 0;
+}
+
+bool HistoryStore::setSyncedUntil(const std::string& contentTopic, uint64_t timestamp) {
+    std::shared_ptr<Channel> ch = channel(contentTopic);
+    if (ch == nullptr) return false;
+    std::lock_guard<std::mutex> lock(ch->mutex);
+    if (!ready(*ch)) return false;
+    if (timestamp <= ch->syncedUntil) return true;
+
+    // Written aside and renamed, so a crash leaves the old mark
+    std::string path = (fs::path(ch->dir) / kSyncFile).string();
+    std::string temp = path + kTempSuffix;
+    std::FILE* out = std::fopen(temp.c_str(), "wb");
+    bool ok = out != nullptr && std::fprintf(out, "%llu\n", static_cast<unsigned long long>(timestamp)) > 0;
+    if (out != nullptr) ok = flushFile(out, ch->options.syncWrites) && ok;
+    if (out != nullptr) std::fclose(out);
+    std::error_code ec;
+    if (ok) fs::rename(temp, path, ec);
+    if (!ok || ec) {
+        std::cerr << "History store: cannot save the sync mark of " << contentTopic << std::endl;
+        fs::remove(temp, ec);
+        return false;
+    }
+    ch->syncedUntil = timestamp;
+    return true;
+}
+
+void HistoryStore::setExpiredCallback(ExpiredCallback callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    expiredCallback_ = std::move(callback);
+}
+
+bool HistoryStore::compact(const std::string& contentTopic) {
+    std::shared_ptr<Channel> ch = channel(contentTopic);
+    return ch != nullptr && compactChannel(*ch);
+}
+
+bool HistoryStore::readRecord(Channel& ch, const IndexEntry& entry, HistoryRecord& out) {
+    Segment* seg = ch.segment(entry.segment);
+    if (seg == nullptr || !seg->ensureMapped() || entry.offset + kRecordHeaderSize > seg->map.size()) return false;
+    const uint8_t* p = seg->map.data() + entry.offset;
+    uint16_t hashSize = getU16(p + 16);
+    uint32_t payloadSize = getU32(p + 20);
+    if (entry.offset + kRecordHeaderSize + hashSize + payloadSize > seg->map.size()) return false;
+    out.timestamp = getU64(p + 8);
+    out.messageHash.assign(reinterpret_cast<const char*>(p + kRecordHeaderSize), hashSize);
+    const uint8_t* payload = p + kRecordHeaderSize + hashSize;
+    out.payload.assign(payload, payload + payloadSize);
+    return true;
+}
+
+// Sealed segments never change, so they are merged without holding the
+// channel lock: it is only taken to pick the inputs and to swap the result
+// in, and the index is patched rather than rebuilt from disk.
+bool HistoryStore::compactChannel(Channel& ch) {
+    std::lock_guard<std::mutex> compacting(ch.compactMutex);
+
+    std::vector<std::unique_ptr<Segment>> sealed;  // own mappings of the inputs
+    std::vector<IndexEntry> entries;               // their records by time
+    size_t excess = 0;
+    uint64_t generation = 0;
+    {
+        std::lock_guard<std::mutex> lock(ch.mutex);
+        ch.compactionQueued = false;
+        if (!ready(ch)) return false;
+        if (ch.segments.size() < 2) return true;
+        uint32_t activeId = ch.segments.back()->id;
+        size_t sealedCount = ch.segments.size() - 1;
+
+        // Retention drops the oldest messages, but only from sealed segments
+        excess = ch.byTime.size() > ch.options.maxMessagesPerChannel
+                     ? ch.byTime.size() - ch.options.maxMessagesPerChannel : 0;
+        if (sealedCount < 2 && excess == 0) return true;
+
+        for (size_t i = 0; i < sealedCount; ++i) {
+            auto seg = std::make_unique<Segment>();
+            seg->id = ch.segments[i]->id;
+            seg->path = ch.segments[i]->path;
+            seg->size = ch.segments[i]->size;
+            sealed.push_back(std::move(seg));
+        }
+        for (const IndexEntry& entry : ch.byTime) {
+            if (entry.segment < activeId) entries.push_back(entry);
+        }
+        generation = ch.generation;
+    }
+
+    for (auto& seg : sealed) {
+        if (!seg->ensureMapped()) return false;
+    }
+
+    uint32_t targetId = sealed.front()->id;
+    std::string target = sealed.front()->path;
+    std::string temp = target + kTempSuffix;
+    std::FILE* out = std::fopen(temp.c_str(), "wb");
+    if (out == nullptr) {
+        std::cerr << "History store: cannot create " << temp << std::endl;
+        return false;
+    }
+
+    uint8_t header[kSegmentHeaderSize] = {};
+    std::memcpy(header, kSegmentMagic, sizeof(kSegmentMagic));
+    bool ok = std::fwrite(header, 1, sizeof(header), out) == sizeof(header);
+    size_t size = kSegmentHeaderSize;
+    std::vector<IndexEntry> merged;
+    std::vector<std::string> mergedHashes;
+    std::vector<std::string> droppedHashes;
+    std::vector<IndexEntry> corrupt;
+    merged.reserve(entries.size() - std::min(excess, entries.size()));
+    mergedHashes.reserve(merged.capacity());
+    for (const IndexEntry& entry : entries) {
+        if (!ok) break;
+        Segment* seg = findSegment(sealed, entry.segment);
+        size_t recordSize = checkRecord(seg->map.data(), seg->size, entry.offset);
+        if (recordSize == 0) {
+            corrupt.push_back(entry);
+            continue;
+        }
+        const uint8_t* p = seg->map.data() + entry.offset;
+        std::string hash(reinterpret_cast<const char*>(p + kRecordHeaderSize), getU16(p + 16));
+        if (droppedHashes.size() < excess) {
+            droppedHashes.push_back(std::move(hash));
+            continue;
+        }
+        // Records are copied verbatim, checksum included
+        recordSize = std::min(recordSize, seg->size - entry.offset);
+        ok = std::fwrite(p, 1, recordSize, out) == recordSize;
+        static const uint8_t zeros[8] = {};
+        size_t pad = align8(recordSize) - recordSize;
+        if (ok && pad > 0) ok = std::fwrite(zeros, 1, pad, out) == pad;
+        merged.push_back(IndexEntry{entry.timestamp, targetId, size});
+        mergedHashes.push_back(std::move(hash));
+        size += recordSize + pad;
+    }
+    ok = ok && flushFile(out, true);
+    std::fclose(out);
+    for (auto& seg : sealed) seg->map.unmap();
+
+    std::unique_lock<std::mutex> lock(ch.mutex);
+    std::error_code ec;
+    if (!ok || ch.generation != generation) {
+        // A failed write reloaded the channel meanwhile; its segments may
+        // no longer be the ones merged
+        std::cerr << "History store: compaction of " << ch.topic << " failed" << std::endl;
+        fs::remove(temp, ec);
+        return false;
+    }
+
+    // Swap the merged segment in. Until the old segments are removed a
+    // reload sees duplicates, which the hash index filters out.
+    size_t sealedCount = sealed.size();
+    for (size_t i = 0; i < sealedCount; ++i) ch.segments[i]->map.unmap();
+    fs::rename(temp, target, ec);
+    if (ec) {
+        std::cerr << "History store: cannot replace " << target << ": " << ec.message() << std::endl;
+        fs::remove(temp, ec);
+        return false;
+    }
+    for (size_t i = 1; i < sealedCount; ++i) fs::remove(ch.segments[i]->path, ec);
+    ch.segments.erase(ch.segments.begin() + 1, ch.segments.begin() + sealedCount);
+    ch.segments.front()->size = size;
+
+    // Segments sealed since the snapshot keep their entries
+    uint32_t lastMerged = sealed.back()->id;
+    std::vector<IndexEntry> byTime;
+    byTime.reserve(merged.size() + ch.byTime.size() - entries.size());
+    std::vector<IndexEntry> newer;
+    newer.reserve(ch.byTime.size() - entries.size());
+    for (const IndexEntry& entry : ch.byTime) {
+        if (entry.segment > lastMerged) newer.push_back(entry);
+    }
+    std::merge(merged.begin(), merged.end(), newer.begin(), newer.end(), std::back_inserter(byTime),
+               [](const IndexEntry& a, const IndexEntry& b) { return a.timestamp < b.timestamp; });
+    ch.byTime.swap(byTime);
+    for (const std::string& hash : droppedHashes) {
+        if (!hash.empty()) ch.byHash.erase(hash);
+    }
+    size_t expiredCount = droppedHashes.size();
+    for (const IndexEntry& entry : corrupt) {
+        for (auto it = ch.byHash.begin(); it != ch.byHash.end(); ++it) {
+            if (it->second.segment == entry.segment && it->second.offset == entry.offset) {
+                droppedHashes.push_back(it->first);
+                ch.byHash.erase(it);
+                break;
+            }
+        }
+    }
+    for (size_t i = 0; i < merged.size(); ++i) {
+        if (!mergedHashes[i].empty()) ch.byHash[mergedHashes[i]] = merged[i];
+    }
+
+    std::cout << "History store: compacted " << sealedCount << " segments of " << ch.topic
+              << " into " << segmentFileName(targetId) << " (" << merged.size() << " kept, "
+              << expiredCount << " expired)" << std::endl;
+    lock.unlock();
+
+    droppedHashes.erase(std::remove(droppedHashes.begin(), droppedHashes.end(), std::string()), droppedHashes.end());
+    ExpiredCallback expired;
+    {
+        std::lock_guard<std::mutex> storeLock(mutex_);
+        expired = expiredCallback_;
+    }
+    if (expired && !droppedHashes.empty()) expired(ch.topic, droppedHashes);
+    return true;
+}
@@ -0,0 +1,141 @@
+#ifndef HISTORY_STORE_H
+#define HISTORY_STORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class WorkerPool;
+
+// A message as read back from the history store
+struct HistoryRecord {
+    uint64_t timestamp = 0;        // Waku envelope timestamp (ns)
+    std::string messageHash;
+    std::vector<uint8_t> payload;  // raw Chat2Message bytes
+};
+
+struct HistoryStoreOptions {
+    size_t segmentSize = 4 * 1024 * 1024;  // roll the active segment past this size
+    size_t compactAfterSegments = 4;       // sealed segments that trigger a compaction
+    size_t maxMessagesPerChannel = 10000;  // retention applied when compacting
+    size_t maxOpenChannels = 256;          // loaded channels, the least recently used idle ones are closed
+    bool syncWrites = false;               // fsync after every append
+};
+
+// Embedded, append-only message store with one log per channel.
+//
+// Each channel is a directory of numbered segment files. Records are
+// appended to the newest segment and never modified; once a segment grows
+// past segmentSize it is sealed and a new one is started. Records are
+// 8-byte aligned, little-endian and checksummed, so sealed segments can be
+// read straight from a read-only mapping, and a torn write at the end of the
+// active segment is dropped when the channel is reopened.
+//
+// The timestamp and message hash indexes are kept in memory and rebuilt
+// from the segments the first time a channel is touched. Past
+// maxOpenChannels the least recently used idle channel is closed, which
+// releases its file, mappings and indexes until it is touched again.
+//
+// Compaction merges the sealed segments into one, in timestamp order,
+// dropping duplicates and anything past the retention limit. It runs on a
+// background thread; appends to the channel only wait for the final swap.
+//
+// All methods are thread-safe. Each channel has its own lock, so channels
+// never wait on each other.
+class HistoryStore {
+public:
+    HistoryStore();
+    ~HistoryStore();
+
+    HistoryStore(const HistoryStore&) = delete;
+    HistoryStore& operator=(const HistoryStore&) = delete;
+
+    // Open (creating if needed) a store rooted at directory
+    bool open(const std::string& directory, const HistoryStoreOptions& options = HistoryStoreOptions());
+    void close();
+    bool isOpen() const;
+
+    // Append a message to a channel. Returns false if a message with the
+    // same hash is already stored or the write failed. Messages without a
+    // hash are always appended.
+    bool append(const std::string& contentTopic, const std::string& messageHash,
+                uint64_t timestamp, const uint8_t* payload, size_t size);
+
+    // Append several messages of one channel under a single lock and flush.
+    // Returns how many were appended; duplicates are skipped.
+    size_t appendBatch(const std::string& contentTopic, const std::vector<HistoryRecord>& records);
+
+    bool contains(const std::string& contentTopic, const std::string& messageHash);
+    bool find(const std::string& contentTopic, const std::string& messageHash, HistoryRecord& out);
+
+    // Newest stored envelope timestamp, 0 if the channel is empty
+    uint64_t newestTimestamp(const std::string& contentTopic);
+    size_t messageCount(const std::string& contentTopic);
+
+    // The newest limit messages, oldest first
+    std::vector<HistoryRecord> readRecent(const std::string& contentTopic, size_t limit);
+
+    // Up to limit messages with from <= timestamp <= to, oldest first
+    std::vector<HistoryRecord> readRange(const std::string& contentTopic, uint64_t from, uint64_t to, size_t limit);
+
+    // The newest limit messages with timestamp < before, oldest first
+    std::vector<HistoryRecord> readBefore(const std::string& contentTopic, uint64_t before, size_t limit);
+
+    // The newest limit messages stored before the message (before,
+    // beforeHash), oldest first. Messages sharing its timestamp are split at
+    // it, so paging back from the oldest message of each page neither skips
+    // nor repeats any. An unknown hash falls back to timestamp < before.
+    std::vector<HistoryRecord> readBefore(const std::string& contentTopic, uint64_t before,
+                                          const std::string& beforeHash, size_t limit);
+
+    // Envelope timestamp up to which the channel has been fetched from the
+    // store node, 0 if never. Appends don't move it, so messages missed
+    // while offline are still fetched after newer ones came in by relay.
+    uint64_t syncedUntil(const std::string& contentTopic);
+    // Raise the mark, kept on disk; lower values are ignored
+    bool setSyncedUntil(const std::string& contentTopic, uint64_t timestamp);
+
+    // Merge the sealed segments of a channel now rather than waiting for
+    // compactAfterSegments
+    bool compact(const std::string& contentTopic);
+
+    // Called with the hashes of the messages a compaction dropped, expired
+    // or unreadable, on the compaction thread and without any lock held
+    using ExpiredCallback = std::function<void(const std::string& contentTopic,
+                                               const std::vector<std::string>& messageHashes)>;
+    void setExpiredCallback(ExpiredCallback callback);
+
+private:
+    struct Channel;
+    struct IndexEntry;
+
+    std::shared_ptr<Channel> channel(const std::string& contentTopic);
+    void evictIdle();
+    bool ready(Channel& ch);
+    bool loadChannel(Channel& ch);
+    bool startSegment(Channel& ch, uint32_t id);
+    bool appendRecord(Channel& ch, const std::string& contentTopic, const std::string& messageHash,
+                      uint64_t timestamp, const uint8_t* payload, size_t size);
+    bool flushActive(Channel& ch, const std::string& contentTopic);
+    void scheduleCompaction(const std::shared_ptr<Channel>& ch);
+    bool compactChannel(Channel& ch);
+    bool readRecord(Channel& ch, const IndexEntry& entry, HistoryRecord& out);
+
+    // Guards the fields below; each channel is guarded by its own mutex
+    mutable std::mutex mutex_;
+    std::string directory_;
+    HistoryStoreOptions options_;
+    bool open_ = false;
+    std::map<std::string, std::shared_ptr<Channel>> channels_;
+    std::list<Channel*> lru_;  // most recently used first
+    std::unique_ptr<WorkerPool> compactor_;
+    ExpiredCallback expiredCallback_;
+};
+
+#endif // HISTORY_STORE_H
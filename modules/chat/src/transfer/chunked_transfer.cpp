@@ -0,0 +1,373 @@
+#include "chunked_transfer.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include "codec/sha256.h"
+#include "message.codec.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr size_t kDigestSize = sha256::kDigestSize;
+// Completed transfers remembered to drop their late chunks
+constexpr size_t kDoneTransfers = 1024;
+
+std::string toHex(const std::string& bytes) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(bytes.size() * 2);
+    for (unsigned char c : bytes) {
+        hex += digits[c >> 4];
+        hex += digits[c & 15];
+    }
+    return hex;
+}
+
+std::string chunkDigest(const std::string& data) {
+    return ::chunkDigest(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+}
+
+std::vector<uint8_t> encodeChunk(const chat::Chat2ChunkView& chunk) {
+    std::vector<uint8_t> out(proto::encodedSize(chunk));
+    proto::encode(chunk, out.data(), out.size());
+    return out;
+}
+
+bool readFile(const std::string& path, std::string& out) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    out.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+}
+
+void writeFile(const std::string& path, const std::string& data) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    if (!out) {
+        std::cerr << "Chunked transfer: cannot write " << path << std::endl;
+    }
+}
+
+void removeFile(const std::string& path) {
+    std::error_code ec;
+    fs::remove(path, ec);
+}
+
+} // namespace
+
+std::string chunkDigest(const uint8_t* data, size_t size) {
+    return sha256::digest(data, size);
+}
+
+std::string transferMessageKey(const std::string& transfer) {
+    static const char digits[] = "0123456789abcdef";
+    std::string key = "transfer:";
+    for (unsigned char c : transfer) {
+        key += digits[c >> 4];
+        key += digits[c & 15];
+    }
+    return key;
+}
+
+std::vector<std::vector<uint8_t>> splitTransfer(const std::vector<uint8_t>& payload, size_t chunkSize) {
+    chunkSize = std::max<size_t>(1, chunkSize);
+    std::string transfer = chunkDigest(payload.data(), payload.size());
+    std::vector<std::string> hashes;
+    for (size_t offset = 0; offset < payload.size(); offset += chunkSize) {
+        hashes.push_back(chunkDigest(payload.data() + offset, std::min(chunkSize, payload.size() - offset)));
+    }
+
+    std::vector<std::vector<uint8_t>> parts;
+    parts.reserve(hashes.size() + 1);
+    chat::Chat2ChunkView manifest;
+    manifest.transfer = transfer;
+    manifest.size = payload.size();
+    manifest.chunks.assign(hashes.begin(), hashes.end());
+    parts.push_back(encodeChunk(manifest));
+
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        size_t offset = i * chunkSize;
+        chat::Chat2ChunkView chunk;
+        chunk.transfer = transfer;
+        chunk.index = static_cast<uint32_t>(i);
+        chunk.data = proto::asView(payload.data() + offset, std::min(chunkSize, payload.size() - offset));
+        parts.push_back(encodeChunk(chunk));
+    }
+    return parts;
+}
+
+ChunkReassembler::ChunkReassembler(const ChunkReassemblerOptions& options) : options_(options) {}
+
+// Manifests are "<hash>.manifest": the content topic on the first line, the
+// serialized Chat2Chunk after it. Chunks are "<chunk digest>.chunk".
+bool ChunkReassembler::open(const std::string& directory) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::error_code ec;
+    fs::create_directories(directory, ec);
+    if (ec) {
+        std::cerr << "Chunked transfer: cannot create " << directory << ": " << ec.message() << std::endl;
+        return false;
+    }
+    directory_ = directory;
+
+    std::vector<fs::path> chunkFiles;
+    for (const fs::directory_entry& entry : fs::directory_iterator(directory, ec)) {
+        if (entry.path().extension() == ".chunk") {
+            chunkFiles.push_back(entry.path());
+            continue;
+        }
+        if (entry.path().extension() != ".manifest") continue;
+
+        std::string contents;
+        size_t newline = std::string::npos;
+        if (readFile(entry.path().string(), contents)) newline = contents.find('\n');
+        chat::Chat2ChunkView manifest;
+        if (newline == std::string::npos || !proto::decode(std::string_view(contents).substr(newline + 1), manifest) ||
+            manifest.transfer.size() != kDigestSize || manifest.chunks.empty()) {
+            removeFile(entry.path().string());
+            continue;
+        }
+        Key key(contents.substr(0, newline), std::string(manifest.transfer));
+        std::vector<std::string> hashes(manifest.chunks.begin(), manifest.chunks.end());
+        if (addManifest(key, contents.substr(newline + 1), manifest.size, hashes) != ChunkResult::Pending) {
+            removeFile(entry.path().string());
+        }
+    }
+
+    // Chunks of transfers that are gone
+    std::set<std::string> referenced;
+    for (const auto& entry : transfers_) {
+        for (const std::string& hash : entry.second.hashes) referenced.insert(toHex(hash) + ".chunk");
+    }
+    for (const fs::path& path : chunkFiles) {
+        if (referenced.count(path.filename().string()) == 0) removeFile(path.string());
+    }
+
+    if (!transfers_.empty()) {
+        std::cout << "Chunked transfer: resuming " << transfers_.size() << " incomplete transfers from "
+                  << directory << std::endl;
+    }
+    return true;
+}
+
+ChunkResult ChunkReassembler::add(const std::string& contentTopic, const uint8_t* data, size_t size,
+                                  std::vector<uint8_t>& payload, std::string& transfer) {
+    chat::Chat2ChunkView chunk;
+    if (!proto::decode(data, size, chunk) || chunk.transfer.size() != kDigestSize) return ChunkResult::Invalid;
+    bool manifest = !chunk.chunks.empty();
+    if (manifest == !chunk.data.empty()) return ChunkResult::Invalid;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    expireLocked(std::chrono::steady_clock::now());
+    Key key(contentTopic, std::string(chunk.transfer));
+    if (done_.count(key) != 0) return ChunkResult::Dropped;
+
+    ChunkResult result;
+    if (manifest) {
+        std::vector<std::string> hashes(chunk.chunks.begin(), chunk.chunks.end());
+        result = addManifest(key, std::string(reinterpret_cast<const char*>(data), size), chunk.size, hashes);
+    } else {
+        result = addChunk(key, chunk.index, std::string(chunk.data));
+    }
+    if (result != ChunkResult::Pending) return result;
+
+    auto it = transfers_.find(key);
+    if (it == transfers_.end() || !it->second.haveManifest || it->second.chunks.size() < it->second.hashes.size()) {
+        return ChunkResult::Pending;
+    }
+    bool ok = finish(it->second, payload);
+    drop(it);
+    if (!ok) {
+        std::cerr << "Chunked transfer: " << toHex(key.second) << " on " << contentTopic
+                  << " doesn't match its digest" << std::endl;
+        return ChunkResult::Invalid;
+    }
+    rememberDone(key);
+    transfer = key.second;
+    return ChunkResult::Complete;
+}
+
+// Called with the lock held
+ChunkResult ChunkReassembler::addManifest(const Key& key, const std::string& encoded, uint64_t size,
+                                          const std::vector<std::string>& hashes) {
+    if (size == 0 || hashes.size() > size) return ChunkResult::Invalid;
+    for (const std::string& hash : hashes) {
+        if (hash.size() != kDigestSize) return ChunkResult::Invalid;
+    }
+    if (size > options_.maxTransferSize) {
+        std::cerr << "Chunked transfer: refusing " << size << " byte transfer on " << key.first << std::endl;
+        return ChunkResult::Dropped;
+    }
+
+    auto it = transfers_.find(key);
+    if (it != transfers_.end() && it->second.haveManifest) {
+        it->second.lastActivity = std::chrono::steady_clock::now();
+        return ChunkResult::Pending;
+    }
+    // The manifest is held as long as its chunks and counts with them
+    if (!makeRoom(encoded.size(), key)) return ChunkResult::Dropped;
+    it = transfers_.find(key);
+    if (it == transfers_.end()) {
+        it = transfers_.emplace(key, Transfer()).first;
+        it->second.contentTopic = key.first;
+        it->second.digest = key.second;
+    }
+    Transfer& transfer = it->second;
+    transfer.lastActivity = std::chrono::steady_clock::now();
+    transfer.bytes += encoded.size();
+    buffered_ += encoded.size();
+    transfer.haveManifest = true;
+    transfer.size = size;
+    transfer.hashes = hashes;
+
+    // Chunks that came first have to match it
+    for (auto chunk = transfer.chunks.begin(); chunk != transfer.chunks.end();) {
+        std::string digest = chunkDigest(chunk->second);
+        if (chunk->first < hashes.size() && digest == hashes[chunk->first]) {
+            ++chunk;
+            continue;
+        }
+        if (!directory_.empty()) removeFile(chunkPath(digest));
+        transfer.bytes -= chunk->second.size();
+        buffered_ -= chunk->second.size();
+        chunk = transfer.chunks.erase(chunk);
+    }
+
+    if (!directory_.empty()) {
+        writeFile(manifestPath(key), key.first + '\n' + encoded);
+        // Chunks kept from before a restart
+        for (uint32_t i = 0; i < hashes.size(); ++i) {
+            std::string data;
+            if (transfer.chunks.count(i) != 0 || !readFile(chunkPath(hashes[i]), data)) continue;
+            if (chunkDigest(data) != hashes[i] || !makeRoom(data.size(), key)) continue;
+            transfer.bytes += data.size();
+            buffered_ += data.size();
+            transfer.chunks.emplace(i, std::move(data));
+        }
+    }
+    return ChunkResult::Pending;
+}
+
+// Called with the lock held
+ChunkResult ChunkReassembler::addChunk(const Key& key, uint32_t index, const std::string& data) {
+    auto it = transfers_.find(key);
+    std::string digest = chunkDigest(data);
+    if (it != transfers_.end()) {
+        Transfer& transfer = it->second;
+        if (transfer.chunks.count(index) != 0) return ChunkResult::Pending;
+        if (transfer.haveManifest && (index >= transfer.hashes.size() || digest != transfer.hashes[index])) {
+            return ChunkResult::Invalid;
+        }
+        if (!transfer.haveManifest && transfer.bytes + data.size() > options_.maxTransferSize) {
+            return ChunkResult::Dropped;
+        }
+    }
+    if (!makeRoom(data.size(), key)) return ChunkResult::Dropped;
+
+    it = transfers_.find(key);
+    if (it == transfers_.end()) {
+        it = transfers_.emplace(key, Transfer()).first;
+        it->second.contentTopic = key.first;
+        it->second.digest = key.second;
+    }
+    Transfer& transfer = it->second;
+    transfer.lastActivity = std::chrono::steady_clock::now();
+    transfer.bytes += data.size();
+    buffered_ += data.size();
+    if (!directory_.empty()) writeFile(chunkPath(digest), data);
+    transfer.chunks.emplace(index, data);
+    return ChunkResult::Pending;
+}
+
+// Called with the lock held
+bool ChunkReassembler::finish(const Transfer& transfer, std::vector<uint8_t>& payload) {
+    payload.clear();
+    payload.reserve(transfer.size);
+    for (const auto& chunk : transfer.chunks) {
+        payload.insert(payload.end(), chunk.second.begin(), chunk.second.end());
+    }
+    return payload.size() == transfer.size && chunkDigest(payload.data(), payload.size()) == transfer.digest;
+}
+
+// Drop the transfers idle longest until bytes more fit, never touching
+// keep. Called with the lock held.
+bool ChunkReassembler::makeRoom(size_t bytes, const Key& keep) {
+    if (bytes > options_.maxBufferedBytes) return false;
+    while (buffered_ + bytes > options_.maxBufferedBytes) {
+        auto victim = transfers_.end();
+        for (auto it = transfers_.begin(); it != transfers_.end(); ++it) {
+            if (it->first == keep) continue;
+            if (victim == transfers_.end() || it->second.lastActivity < victim->second.lastActivity) victim = it;
+        }
+        if (victim == transfers_.end()) return false;
+        std::cerr << "Chunked transfer: dropping incomplete transfer " << toHex(victim->first.second) << " on "
+                  << victim->first.first << " to make room" << std::endl;
+        drop(victim);
+    }
+    return true;
+}
+
+// Called with the lock held
+void ChunkReassembler::drop(std::map<Key, Transfer>::iterator it) {
+    Transfer& transfer = it->second;
+    if (!directory_.empty()) {
+        for (const auto& chunk : transfer.chunks) {
+            removeFile(chunkPath(transfer.haveManifest ? transfer.hashes[chunk.first] : chunkDigest(chunk.second)));
+        }
+        if (transfer.haveManifest) removeFile(manifestPath(it->first));
+    }
+    buffered_ -= transfer.bytes;
+    transfers_.erase(it);
+}
+
+void ChunkReassembler::expire() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    expireLocked(std::chrono::steady_clock::now());
+}
+
+// Called with the lock held
+void ChunkReassembler::expireLocked(std::chrono::steady_clock::time_point now) {
+    for (auto it = transfers_.begin(); it != transfers_.end();) {
+        auto next = std::next(it);
+        if (now - it->second.lastActivity > options_.timeout) {
+            std::cerr << "Chunked transfer: " << toHex(it->first.second) << " on " << it->first.first
+                      << " timed out with " << it->second.chunks.size() << " chunks";
+            if (it->second.haveManifest) std::cerr << " of " << it->second.hashes.size();
+            std::cerr << std::endl;
+            drop(it);
+        }
+        it = next;
+    }
+}
+
+// Called with the lock held
+void ChunkReassembler::rememberDone(const Key& key) {
+    if (!done_.insert(key).second) return;
+    doneOrder_.push_back(key);
+    if (doneOrder_.size() > kDoneTransfers) {
+        done_.erase(doneOrder_.front());
+        doneOrder_.pop_front();
+    }
+}
+
+std::string ChunkReassembler::chunkPath(const std::string& digest) const {
+    return (fs::path(directory_) / (toHex(digest) + ".chunk")).string();
+}
+
+// The same payload may be sent to several channels
+std::string ChunkReassembler::manifestPath(const Key& key) const {
+    return (fs::path(directory_) / (toHex(chunkDigest(key.first + '\n' + key.second)) + ".manifest")).string();
+}
+
+size_t ChunkReassembler::pendingTransfers() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return transfers_.size();
+}
+
+size_t ChunkReassembler::bufferedBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return buffered_;
+}
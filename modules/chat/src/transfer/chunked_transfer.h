@@ -0,0 +1,115 @@
+#ifndef CHUNKED_TRANSFER_H
+#define CHUNKED_TRANSFER_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+struct ChunkReassemblerOptions {
+    size_t maxBufferedBytes = 128 * 1024 * 1024;  // chunks and manifests held for incomplete transfers, over all of them
+    size_t maxTransferSize = 64 * 1024 * 1024;    // larger manifests are refused
+    std::chrono::seconds timeout{600};            // incomplete transfers with no new chunk for this long are dropped
+};
+
+// SHA-256 of data, as 32 raw bytes
+std::string chunkDigest(const uint8_t* data, size_t size);
+
+// Key of the message a transfer completes to, the same on every receiver:
+// "transfer:" and the transfer digest in hex
+std::string transferMessageKey(const std::string& transfer);
+
+// Split payload into serialized Chat2Chunks of at most chunkSize data
+// bytes: the manifest first, then the chunks in order
+std::vector<std::vector<uint8_t>> splitTransfer(const std::vector<uint8_t>& payload, size_t chunkSize);
+
+enum class ChunkResult {
+    Pending,   // kept, the transfer is not complete yet
+    Complete,  // the transfer is complete, its payload was handed out
+    Invalid,   // not a Chat2Chunk, or it doesn't match its manifest
+    Dropped    // no room, too large, or its transfer already completed
+};
+
+// Puts chunked payloads back together.
+//
+// Chunks and manifests may arrive in any order; chunks seen before their
+// manifest are checked against it once it arrives. Every chunk is verified
+// against the SHA-256 in the manifest and the whole payload against the
+// transfer digest, so a transfer never completes with foreign data.
+//
+// Incomplete transfers are bounded: chunks and manifests count against
+// maxBufferedBytes, and when a new one doesn't fit, the transfers that
+// have been idle the longest are dropped to make room. A transfer with no
+// new chunk for timeout is dropped too.
+//
+// With a directory open, manifests and chunks are also written to disk,
+// chunks named by their digest. After a restart, open() picks incomplete
+// transfers up again, and a manifest for chunks already on disk is
+// completed from them without waiting for the chunks to be sent again.
+//
+// All methods are thread-safe.
+class ChunkReassembler {
+public:
+    explicit ChunkReassembler(const ChunkReassemblerOptions& options = ChunkReassemblerOptions());
+
+    ChunkReassembler(const ChunkReassembler&) = delete;
+    ChunkReassembler& operator=(const ChunkReassembler&) = delete;
+
+    // Keep incomplete transfers in directory and resume the ones found there
+    bool open(const std::string& directory);
+
+    // Add a serialized Chat2Chunk received on a channel. On Complete,
+    // payload holds the reassembled payload and transfer its digest.
+    ChunkResult add(const std::string& contentTopic, const uint8_t* data, size_t size,
+                    std::vector<uint8_t>& payload, std::string& transfer);
+
+    // Drop transfers past their timeout; add() does this as it goes
+    void expire();
+
+    size_t pendingTransfers() const;
+    size_t bufferedBytes() const;
+
+private:
+    struct Transfer {
+        std::string contentTopic;
+        std::string digest;
+        bool haveManifest = false;
+        uint64_t size = 0;
+        std::vector<std::string> hashes;         // from the manifest
+        std::map<uint32_t, std::string> chunks;  // received, by index
+        size_t bytes = 0;  // of its chunks and manifest
+        std::chrono::steady_clock::time_point lastActivity;
+    };
+
+    using Key = std::pair<std::string, std::string>;  // content topic, transfer digest
+
+    ChunkResult addManifest(const Key& key, const std::string& encoded, uint64_t size,
+                            const std::vector<std::string>& hashes);
+    ChunkResult addChunk(const Key& key, uint32_t index, const std::string& data);
+    bool finish(const Transfer& transfer, std::vector<uint8_t>& payload);
+    bool makeRoom(size_t bytes, const Key& keep);
+    void drop(std::map<Key, Transfer>::iterator it);
+    void expireLocked(std::chrono::steady_clock::time_point now);
+    void rememberDone(const Key& key);
+    std::string chunkPath(const std::string& digest) const;
+    std::string manifestPath(const Key& key) const;
+
+    const ChunkReassemblerOptions options_;
+
+    mutable std::mutex mutex_;
+    std::string directory_;
+    std::map<Key, Transfer> transfers_;
+    size_t buffered_ = 0;
+
+    // Recently completed transfers, so late or repeated chunks don't start
+    // them over
+    std::set<Key> done_;
+    std::deque<Key> doneOrder_;
+};
+
+#endif // CHUNKED_TRANSFER_H
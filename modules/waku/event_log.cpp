@@ -0,0 +1,157 @@
+#include "event_log.h"
+#include <cstring>
+
+namespace {
+
+const char kMagic[] = "WAKUEVT1";
+const size_t kMagicSize = 8;
+const uint64_t kFlushIntervalNs = 1000000000ULL;
+
+void appendVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+uint64_t zigzag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+int64_t unzigzag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+} // namespace
+
+EventLogWriter::EventLogWriter() : file_(nullptr), lastTimestamp_(0), lastFlush_(0), records_(0) {}
+
+EventLogWriter::~EventLogWriter() {
+    close();
+}
+
+bool EventLogWriter::open(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (file_ != nullptr) {
+        std::fclose(file_);
+    }
+    file_ = std::fopen(path.c_str(), "wb");
+    if (file_ == nullptr) {
+        return false;
+    }
+    lastTimestamp_ = 0;
+    lastFlush_ = 0;
+    records_ = 0;
+    if (std::fwrite(kMagic, 1, kMagicSize, file_) != kMagicSize) {
+        std::fclose(file_);
+        file_ = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void EventLogWriter::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (file_ != nullptr) {
+        std::fclose(file_);
+        file_ = nullptr;
+    }
+}
+
+void EventLogWriter::record(uint64_t timestampNs, int callerRet, const char* data, size_t len) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (file_ == nullptr) {
+        return;
+    }
+    if (data == nullptr) {
+        len = 0;
+    }
+    // Events come from one libwaku thread, but keep deltas from going
+    // negative if the clock steps back
+    if (timestampNs < lastTimestamp_) {
+        timestampNs = lastTimestamp_;
+    }
+    buffer_.clear();
+    appendVarint(buffer_, timestampNs - lastTimestamp_);
+    appendVarint(buffer_, zigzag(callerRet));
+    appendVarint(buffer_, len);
+    std::fwrite(buffer_.data(), 1, buffer_.size(), file_);
+    if (len > 0) {
+        std::fwrite(data, 1, len, file_);
+    }
+    lastTimestamp_ = timestampNs;
+    records_++;
+    if (timestampNs - lastFlush_ >= kFlushIntervalNs) {
+        std::fflush(file_);
+        lastFlush_ = timestampNs;
+    }
+}
+
+uint64_t EventLogWriter::records() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return records_;
+}
+
+EventLogReader::EventLogReader() : file_(nullptr), lastTimestamp_(0) {}
+
+EventLogReader::~EventLogReader() {
+    close();
+}
+
+bool EventLogReader::open(const std::string& path) {
+    close();
+    file_ = std::fopen(path.c_str(), "rb");
+    if (file_ == nullptr) {
+        return false;
+    }
+    char magic[kMagicSize];
+    if (std::fread(magic, 1, kMagicSize, file_) != kMagicSize || std::memcmp(magic, kMagic, kMagicSize) != 0) {
+        close();
+        return false;
+    }
+    lastTimestamp_ = 0;
+    return true;
+}
+
+void EventLogReader::close() {
+    if (file_ != nullptr) {
+        std::fclose(file_);
+        file_ = nullptr;
+    }
+}
+
+bool EventLogReader::readVarint(uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = std::fgetc(file_);
+        if (c == EOF) {
+            return false;
+        }
+        value |= static_cast<uint64_t>(c & 0x7f) << shift;
+        if ((c & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool EventLogReader::next(EventRecord& record) {
+    if (file_ == nullptr) {
+        return false;
+    }
+    uint64_t delta = 0;
+    uint64_t callerRet = 0;
+    uint64_t len = 0;
+    if (!readVarint(delta) || !readVarint(callerRet) || !readVarint(len)) {
+        return false;
+    }
+    record.data.resize(len);
+    if (len > 0 && std::fread(&record.data[0], 1, len, file_) != len) {
+        return false;
+    }
+    lastTimestamp_ += delta;
+    record.timestampNs = lastTimestamp_;
+    record.callerRet = static_cast<int>(unzigzag(callerRet));
+    return true;
+}
@@ -0,0 +1,73 @@
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+// Binary log of raw libwaku events, for replaying real traffic offline.
+//
+// The file starts with the 8 bytes "WAKUEVT1", then one record per event:
+// the time since the previous one in ns, the callerRet (zigzag) and the
+// buffer's length, each a varint, then the buffer's bytes. The first
+// record's time is counted from the Unix epoch.
+
+struct EventRecord {
+    uint64_t timestampNs = 0;  // since the Unix epoch
+    int callerRet = 0;
+    std::string data;
+};
+
+// Appends events as libwaku hands them over; thread-safe. Writes are
+// buffered and flushed at least once a second and on close().
+class EventLogWriter {
+public:
+    EventLogWriter();
+    ~EventLogWriter();
+
+    EventLogWriter(const EventLogWriter&) = delete;
+    EventLogWriter& operator=(const EventLogWriter&) = delete;
+
+    // Creates or truncates path; false if it cannot be written
+    bool open(const std::string& path);
+    void close();
+
+    // Ignored when the log is not open
+    void record(uint64_t timestampNs, int callerRet, const char* data, size_t len);
+
+    uint64_t records() const;
+
+private:
+    mutable std::mutex mutex_;
+    FILE* file_;
+    uint64_t lastTimestamp_;
+    uint64_t lastFlush_;
+    uint64_t records_;
+    std::string buffer_;  // one record, encoded
+};
+
+// Reads a log back, a record at a time
+class EventLogReader {
+public:
+    EventLogReader();
+    ~EventLogReader();
+
+    EventLogReader(const EventLogReader&) = delete;
+    EventLogReader& operator=(const EventLogReader&) = delete;
+
+    // False if path cannot be read or is not an event log
+    bool open(const std::string& path);
+    void close();
+
+    // False at the end of the log, or where it is cut short
+    bool next(EventRecord& record);
+
+private:
+    bool readVarint(uint64_t& value);
+
+    FILE* file_;
+    uint64_t lastTimestamp_;
+};
+
+#endif // EVENT_LOG_H
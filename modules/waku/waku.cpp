@@ -1,6 +1,8 @@
 #include "waku.h"
 #include <QDebug>
 #include <QThread>
+#include <chrono>
+#include <cstdlib>
 #include "lib/libwaku.h"
 
 namespace {
@@ -336,6 +338,35 @@ namespace {
         }
     }
 
+    // Structure to hold filter unsubscribe data
+    struct FilterUnsubscribeData {
+        Waku* waku;
+        WakuFilterUnsubscribeCallback callback;
+    };
+
+    // Static callback for waku_filter_unsubscribe
+    void filter_unsubscribe_callback(int callerRet, const char* msg, size_t len, void* userData) {
+        bool success = (callerRet == RET_OK);
+        QString message;
+        
+        if (success) {
+            message = "Successfully unsubscribed from filter";
+            qDebug() << message;
+        } else {
+            message = msg ? QString::fromUtf8(msg, len) : "Unknown error";
+            qDebug() << "Failed to unsubscribe from filter:" << message;
+        }
+        
+        // Call user callback if provided
+        if (userData) {
+            auto* data = static_cast<FilterUnsubscribeData*>(userData);
+            if (data->callback) {
+                data->callback(success, message);
+            }
+            delete data;
+        }
+    }
+
     // Structure to hold connect data
     struct ConnectData {
         Waku* waku;
@@ -370,11 +401,22 @@ namespace {
     struct EventData {
         Waku* waku;
         WakuEventCallback callback;
+        std::shared_ptr<EventLogWriter> log;
     };
 
+    uint64_t unixNanos() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+
     // Static callback for waku_set_event_callback
     void event_callback(int callerRet, const char* msg, size_t len, void* userData) {
         auto* data = static_cast<EventData*>(userData);
+
+        // Capture the event as libwaku gave it, before anything else
+        if (data && data->log) {
+            data->log->record(unixNanos(), callerRet, msg, len);
+        }
         
         // Only process if callback exists
         if (data && data->callback && msg != nullptr) {
@@ -450,6 +492,16 @@ namespace {
 
 Waku::Waku() : wakuCtx(nullptr) {
     qDebug() << "Waku Plugin initialized!";
+    const char* capturePath = std::getenv("LOGOS_WAKU_CAPTURE");
+    if (capturePath != nullptr && capturePath[0] != '\0') {
+        eventLog = std::make_shared<EventLogWriter>();
+        if (eventLog->open(capturePath)) {
+            qDebug() << "Capturing Waku events to" << capturePath;
+        } else {
+            qDebug() << "Cannot write Waku event capture" << capturePath;
+            eventLog.reset();
+        }
+    }
 }
 
 Waku::~Waku() {
@@ -458,6 +510,10 @@ Waku::~Waku() {
         // Use our new destroyWaku method with a null callback
         destroyWaku(nullptr);
     }
+    if (eventLog) {
+        qDebug() << "Captured" << eventLog->records() << "Waku events";
+        eventLog->close();
+    }
 }
 
 void Waku::initWaku(const QString &cfg, WakuInitCallback callback) {
@@ -856,6 +912,44 @@ void Waku::filterSubscribe(const QString &pubSubTopic, const QString &contentTop
     }
 }
 
+void Waku::filterUnsubscribe(const QString &pubSubTopic, const QString &contentTopics,
+                             WakuFilterUnsubscribeCallback callback) {
+    qDebug() << "Unsubscribing from filter...";
+    if (!wakuCtx) {
+        QString errorMsg = "Waku not initialized";
+        qDebug() << errorMsg;
+        if (callback) {
+            callback(false, errorMsg);
+        }
+        return;
+    }
+
+    // Create filter unsubscribe data for the callback
+    auto* data = new FilterUnsubscribeData{this, callback};
+
+    // Convert QString to UTF-8 C string
+    QByteArray pubSubTopicUtf8 = pubSubTopic.toUtf8();
+    QByteArray contentTopicsUtf8 = contentTopics.toUtf8();
+
+    // Call the waku_filter_unsubscribe function
+    int ret = waku_filter_unsubscribe(
+        wakuCtx,
+        pubSubTopicUtf8.constData(),
+        contentTopicsUtf8.constData(),
+        filter_unsubscribe_callback,
+        data
+    );
+
+    if (ret != RET_OK) {
+        QString errorMsg = "Failed to unsubscribe from filter";
+        qDebug() << errorMsg;
+        if (callback) {
+            callback(false, errorMsg);
+        }
+        delete data;
+    }
+}
+
 void Waku::connectPeer(const QString &peerMultiAddr, unsigned int timeoutMs, 
                       WakuConnectCallback callback) {
     qDebug() << "Connecting to peer...";
@@ -981,7 +1075,7 @@ void Waku::setEventCallback(WakuEventCallback callback) {
     // Create event data to pass to the C callback
     // This needs to persist for the lifetime of the waku node,
     // so we'll let the waku node manage its lifecycle
-    auto* data = new EventData{this, callback};
+    auto* data = new EventData{this, callback, eventLog};
 
     // Set the event callback
     waku_set_event_callback(wakuCtx, event_callback, data);
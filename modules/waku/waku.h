@@ -2,8 +2,13 @@
 
 #include <QtCore/QObject>
 #include <functional>
+#include <memory>
+#include "event_log.h"
 #include "waku_interface.h"
 
+// WakuInterface over libwaku. With LOGOS_WAKU_CAPTURE set to a file path,
+// every raw event libwaku hands over is also written there as an
+// EventLogWriter log, which the waku_sim plugin can replay.
 class Waku : public QObject, public WakuInterface {
     Q_OBJECT
     Q_PLUGIN_METADATA(IID WakuInterface_iid FILE "metadata.json")
@@ -38,6 +43,8 @@ public:
                                      WakuSubscribeCallback callback = nullptr) override;
     Q_INVOKABLE void filterSubscribe(const QString &pubSubTopic, const QString &contentTopics, 
                                    WakuFilterSubscribeCallback callback = nullptr) override;
+    Q_INVOKABLE void filterUnsubscribe(const QString &pubSubTopic, const QString &contentTopics,
+                                     WakuFilterUnsubscribeCallback callback = nullptr) override;
     Q_INVOKABLE void connectPeer(const QString &peerMultiAddr, unsigned int timeoutMs, 
                                 WakuConnectCallback callback = nullptr) override;
     Q_INVOKABLE void storeQuery(const QString &jsonQuery, const QString &peerAddr, 
@@ -57,8 +64,10 @@ private:
     WakuProtectedShardCallback protectedShardCallback;
     WakuSubscribeCallback subscribeCallback;
     WakuFilterSubscribeCallback filterSubscribeCallback;
+    WakuFilterUnsubscribeCallback filterUnsubscribeCallback;
     WakuConnectCallback connectCallback;
     WakuStoreQueryCallback storeQueryCallback;
     WakuDestroyCallback destroyCallback;
     WakuEventCallback eventCallback;
+    std::shared_ptr<EventLogWriter> eventLog;  // null unless capturing
 }; 
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <QtCore/QObject>
+#include <cstdlib>
 #include "../../core/interface.h"
 
 // Callback type definitions
@@ -14,6 +15,7 @@ using WakuPublishCallback = std::function<void(bool success, const QString &mess
 using WakuProtectedShardCallback = std::function<void(bool success, const QString &message)>;
 using WakuSubscribeCallback = std::function<void(bool success, const QString &message)>;
 using WakuFilterSubscribeCallback = std::function<void(bool success, const QString &message)>;
+using WakuFilterUnsubscribeCallback = std::function<void(bool success, const QString &message)>;
 using WakuConnectCallback = std::function<void(bool success, const QString &message)>;
 using WakuStoreQueryCallback = std::function<void(bool success, const QString &message)>;
 using WakuDestroyCallback = std::function<void(bool success, const QString &message)>;
@@ -44,6 +46,8 @@ public:
                                  WakuSubscribeCallback callback = nullptr) = 0;
     virtual void filterSubscribe(const QString &pubSubTopic, const QString &contentTopics, 
                                WakuFilterSubscribeCallback callback = nullptr) = 0;
+    virtual void filterUnsubscribe(const QString &pubSubTopic, const QString &contentTopics,
+                                 WakuFilterUnsubscribeCallback callback = nullptr) = 0;
     virtual void connectPeer(const QString &peerMultiAddr, unsigned int timeoutMs, 
                             WakuConnectCallback callback = nullptr) = 0;
     virtual void storeQuery(const QString &jsonQuery, const QString &peerAddr, 
@@ -52,5 +56,12 @@ public:
     virtual void setEventCallback(WakuEventCallback callback) = 0;
 };
 
+// Name of the plugin to use as the Waku node: "waku", or the one named by
+// LOGOS_WAKU_PLUGIN, e.g. "waku_sim" to run on a simulated network
+inline QString wakuPluginName() {
+    const char* name = std::getenv("LOGOS_WAKU_PLUGIN");
+    return (name != nullptr && name[0] != '\0') ? QString(name) : QString("waku");
+}
+
 #define WakuInterface_iid "com.logos.WakuInterface"
 Q_DECLARE_INTERFACE(WakuInterface, WakuInterface_iid) 
\ No newline at end of file
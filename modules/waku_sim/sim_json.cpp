@@ -0,0 +1,113 @@
+#include "sim_json.h"
+#include <cctype>
+
+namespace {
+
+// String at pos, which is past its opening quote
+std::string stringAt(const std::string& json, size_t pos) {
+    size_t end = json.find('"', pos);
+    return end == std::string::npos ? std::string() : json.substr(pos, end - pos);
+}
+
+// The Waku message as libwaku writes it, in events and, with the store's
+// key names, in store answers
+void appendWakuMessage(std::string& out, const SimMessage& message, bool storeKeys) {
+    out += R"({"payload":")";
+    out += message.payload;
+    out += storeKeys ? R"(","content_topic":")" : R"(","contentTopic":")";
+    out += message.contentTopic;
+    out += R"(","version":1,"timestamp":)";
+    out += std::to_string(message.timestamp);
+    out += R"(,"ephemeral":)";
+    out += message.ephemeral ? "true}" : "false}";
+}
+
+} // namespace
+
+size_t jsonValueStart(const std::string& json, const std::string& key) {
+    size_t pos = json.find("\"" + key + "\"");
+    if (pos == std::string::npos) return pos;
+    pos += key.size() + 2;
+    while (pos < json.size() && std::isspace(static_cast<unsigned char>(json[pos]))) pos++;
+    if (pos >= json.size() || json[pos] != ':') return std::string::npos;
+    pos++;
+    while (pos < json.size() && std::isspace(static_cast<unsigned char>(json[pos]))) pos++;
+    return pos < json.size() ? pos : std::string::npos;
+}
+
+bool jsonString(const std::string& json, const std::string& key, std::string& out) {
+    size_t pos = jsonValueStart(json, key);
+    if (pos == std::string::npos || json[pos] != '"') return false;
+    out = stringAt(json, pos + 1);
+    return true;
+}
+
+bool jsonBool(const std::string& json, const std::string& key, bool& out) {
+    size_t pos = jsonValueStart(json, key);
+    if (pos == std::string::npos) return false;
+    if (json.compare(pos, 4, "true") == 0) {
+        out = true;
+    } else if (json.compare(pos, 5, "false") == 0) {
+        out = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool jsonStringArray(const std::string& json, const std::string& key, std::vector<std::string>& out) {
+    size_t pos = key.empty() ? json.find('[') : jsonValueStart(json, key);
+    if (pos == std::string::npos || json[pos] != '[') return false;
+    size_t end = json.find(']', pos);
+    if (end == std::string::npos) return false;
+    out.clear();
+    for (size_t quote = json.find('"', pos); quote < end; quote = json.find('"', quote)) {
+        std::string value = stringAt(json, quote + 1);
+        quote += value.size() + 2;
+        out.push_back(std::move(value));
+    }
+    return true;
+}
+
+void parseStoreQuery(const std::string& json, SimStoreQuery& query, std::string& requestId) {
+    std::string cursor;
+    jsonString(json, "request_id", requestId);
+    jsonString(json, "pubsub_topic", query.pubsubTopic);
+    jsonStringArray(json, "content_topics", query.contentTopics);
+    jsonNumber(json, "time_start", query.timeStart);
+    jsonNumber(json, "time_end", query.timeEnd);
+    jsonBool(json, "pagination_forward", query.forward);
+    jsonNumber(json, "pagination_limit", query.limit);
+    if (jsonString(json, "pagination_cursor", cursor)) {
+        query.cursor = SimNetwork::parseHash(cursor);
+    }
+}
+
+std::string storeResponseJson(const std::string& requestId, const SimStoreResult& result) {
+    std::string out = R"({"request_id":")" + requestId + R"(","status_code":200,"status_desc":"OK","messages":[)";
+    for (size_t i = 0; i < result.messages.size(); ++i) {
+        const SimMessage& message = *result.messages[i];
+        if (i > 0) out += ',';
+        out += R"({"message_hash":")";
+        out += SimNetwork::hashHex(message.hash);
+        out += R"(","message":)";
+        appendWakuMessage(out, message, true);
+        out += R"(,"pubsub_topic":")";
+        out += message.pubsubTopic;
+        out += R"("})";
+    }
+    out += ']';
+    if (result.cursor != 0) {
+        out += R"(,"pagination_cursor":")" + SimNetwork::hashHex(result.cursor) + "\"";
+    }
+    out += '}';
+    return out;
+}
+
+std::string messageEventJson(const SimMessage& message) {
+    std::string out = R"({"eventType":"message","messageHash":")" + SimNetwork::hashHex(message.hash) +
+                      R"(","pubsubTopic":")" + message.pubsubTopic + R"(","wakuMessage":)";
+    appendWakuMessage(out, message, false);
+    out += '}';
+    return out;
+}
@@ -0,0 +1,48 @@
+#ifndef SIM_JSON_H
+#define SIM_JSON_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "sim_network.h"
+
+// Reading the flat JSON objects handed to a Waku node (configs, messages,
+// store queries) and writing libwaku's events and store answers, without
+// Qt. Fields are found by key, enough for machine-written JSON, and unlike
+// QJsonValue ns timestamps are kept exact. Strings are taken as they are,
+// the ones here have no escapes.
+
+// Start of the value of key, npos if absent
+size_t jsonValueStart(const std::string& json, const std::string& key);
+
+bool jsonString(const std::string& json, const std::string& key, std::string& out);
+bool jsonBool(const std::string& json, const std::string& key, bool& out);
+// Strings of an array, which is the first one in json if key is empty
+bool jsonStringArray(const std::string& json, const std::string& key, std::vector<std::string>& out);
+
+template <typename T>
+bool jsonNumber(const std::string& json, const std::string& key, T& out) {
+    size_t pos = jsonValueStart(json, key);
+    if (pos == std::string::npos) return false;
+    const char* start = json.c_str() + pos;
+    char* end = nullptr;
+    if (json[pos] == '-' || json.find('.', pos) < json.find_first_of(",}", pos)) {
+        double value = std::strtod(start, &end);
+        if (end == start) return false;
+        out = static_cast<T>(value);
+    } else {
+        unsigned long long value = std::strtoull(start, &end, 10);
+        if (end == start) return false;
+        out = static_cast<T>(value);
+    }
+    return true;
+}
+
+// A store query as chat writes it; fields not there keep their defaults
+void parseStoreQuery(const std::string& json, SimStoreQuery& query, std::string& requestId);
+std::string storeResponseJson(const std::string& requestId, const SimStoreResult& result);
+// The message event libwaku hands to its event callback
+std::string messageEventJson(const SimMessage& message);
+
+#endif // SIM_JSON_H
@@ -0,0 +1,544 @@
+#include "sim_network.h"
+#include <algorithm>
+#include <cmath>
+#include "synthetic_history.h"
+
+namespace {
+
+uint64_t splitmix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+uint64_t fnv1a(uint64_t hash, const std::string& text) {
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    // Keep fields apart, so "ab","c" and "a","bc" differ
+    hash ^= 0xff;
+    return hash * 0x100000001b3ULL;
+}
+
+uint64_t msToNs(double ms) {
+    return ms <= 0 ? 0 : static_cast<uint64_t>(ms * 1e6);
+}
+
+// Bytes a message takes on the wire: the payload decoded, its topics and
+// roughly the envelope around them
+uint64_t wireSize(const SimMessage& message) {
+    return message.payload.size() * 3 / 4 + message.contentTopic.size() + message.pubsubTopic.size() + 64;
+}
+
+SimOptions normalized(SimOptions options) {
+    options.nodes = std::max(2u, options.nodes);
+    options.fanout = std::max(1u, options.fanout);
+    options.storeNodes = std::min(std::max(1u, options.storeNodes), options.nodes - 1);
+    options.seenCapacity = std::max<size_t>(1, options.seenCapacity);
+    options.loss = std::min(1.0, std::max(0.0, options.loss));
+    options.timeScale = std::max(0.0, options.timeScale);
+    return options;
+}
+
+const uint32_t kFilterNode = 1;
+
+} // namespace
+
+SimNetwork::SimNetwork(const SimOptions& options)
+    : options_(normalized(options)), nodes_(options_.nodes), rng_(options_.seed) {
+    nodes_[0].allTopics = false;
+    buildMesh();
+}
+
+SimNetwork::~SimNetwork() {
+    stop();
+}
+
+// Every node picks fanout peers at random among those with room left, up to
+// twice fanout as gossipsub's upper bound, so most end up with fanout to
+// 2 * fanout peers
+void SimNetwork::buildMesh() {
+    uint32_t count = size();
+    if (count - 1 <= options_.fanout) {
+        for (uint32_t a = 0; a < count; ++a) {
+            for (uint32_t b = 0; b < count; ++b) {
+                if (a != b) nodes_[a].peers.push_back(b);
+            }
+        }
+        return;
+    }
+    size_t most = 2 * size_t(options_.fanout);
+    for (uint32_t a = 0; a < count; ++a) {
+        std::vector<uint32_t>& mine = nodes_[a].peers;
+        for (size_t tries = 0; mine.size() < options_.fanout && tries < 32 * size_t(options_.fanout); ++tries) {
+            uint32_t b = static_cast<uint32_t>(rng_() % count);
+            std::vector<uint32_t>& theirs = nodes_[b].peers;
+            if (b == a || theirs.size() >= most || std::find(mine.begin(), mine.end(), b) != mine.end()) continue;
+            mine.push_back(b);
+            theirs.push_back(a);
+        }
+    }
+}
+
+void SimNetwork::setReceiver(uint32_t node, Receiver receiver) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (node < size()) nodes_[node].receiver = std::move(receiver);
+}
+
+void SimNetwork::setHistory(std::shared_ptr<const SyntheticHistory> history) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    history_ = std::move(history);
+}
+
+void SimNetwork::relaySubscribe(uint32_t node, const std::string& pubsubTopic) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (node < size() && !nodes_[node].allTopics) nodes_[node].topics.insert(pubsubTopic);
+}
+
+void SimNetwork::relayUnsubscribe(uint32_t node, const std::string& pubsubTopic) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (node < size() && !nodes_[node].allTopics) nodes_[node].topics.erase(pubsubTopic);
+}
+
+void SimNetwork::filterSubscribe(uint32_t node, const std::string& pubsubTopic,
+                                 const std::vector<std::string>& contentTopics) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (node >= size()) return;
+    for (const std::string& contentTopic : contentTopics) {
+        bool known = std::any_of(filters_.begin(), filters_.end(), [&](const FilterSubscription& s) {
+            return s.node == node && s.pubsubTopic == pubsubTopic && s.contentTopic == contentTopic;
+        });
+        if (!known) filters_.push_back(FilterSubscription{node, pubsubTopic, contentTopic});
+    }
+}
+
+// With no content topics, all of node's on the pubsub topic
+void SimNetwork::filterUnsubscribe(uint32_t node, const std::string& pubsubTopic,
+                                   const std::vector<std::string>& contentTopics) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    filters_.erase(std::remove_if(filters_.begin(), filters_.end(), [&](const FilterSubscription& s) {
+        return s.node == node && s.pubsubTopic == pubsubTopic &&
+               (contentTopics.empty() ||
+                std::find(contentTopics.begin(), contentTopics.end(), s.contentTopic) != contentTopics.end());
+    }), filters_.end());
+}
+
+uint64_t SimNetwork::publish(uint32_t node, SimMessage message) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (node >= size() || !relays(nodes_[node], message.pubsubTopic)) return 0;
+    message.hash = hashMessage(message);
+    message.origin = node;
+    message.publishedAt = currentTime();
+    stats_.published++;
+    uint64_t hash = message.hash;
+    // Taken as an arrival from the node itself, so it reaches its own
+    // receiver and every mesh peer
+    push(message.publishedAt, EventKind::Relay, node, node, std::make_shared<const SimMessage>(std::move(message)),
+         nullptr);
+    return hash;
+}
+
+void SimNetwork::storeQuery(uint32_t node, const SimStoreQuery& query, uint64_t timeoutNs, StoreCallback callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (node >= size()) return;
+    stats_.storeQueries++;
+    uint32_t store = 1 + storeTurn_++ % options_.storeNodes;
+    // Tasks run one at a time, so answered needs no lock of its own
+    auto answered = std::make_shared<bool>(false);
+    auto done = std::make_shared<StoreCallback>(std::move(callback));
+    auto reply = [answered, done](bool success, const SimStoreResult& result) {
+        if (*answered) return;
+        *answered = true;
+        if (*done) (*done)(success, result);
+    };
+    uint64_t sent = currentTime();
+    if (timeoutNs != 0) {
+        push(sent + timeoutNs, EventKind::Task, node, node, nullptr, [reply] { reply(false, SimStoreResult()); });
+    }
+    // Request and answer each go over the link when their turn comes
+    push(sent, EventKind::Task, node, node, nullptr, [this, node, store, query, reply] {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t arrival = 0;
+        if (!transmit(node, store, 256, arrival)) return;
+        push(arrival + msToNs(options_.storeDelayMs), EventKind::Task, store, node, nullptr,
+             [this, node, store, query, reply] {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto result = std::make_shared<SimStoreResult>(answer(nodes_[store], query));
+            uint64_t bytes = 64;
+            for (const SimMessagePtr& message : result->messages) bytes += wireSize(*message);
+            uint64_t back = 0;
+            if (!transmit(store, node, bytes, back)) return;
+            push(back, EventKind::Task, node, store, nullptr, [reply, result] { reply(true, *result); });
+        });
+    });
+}
+
+void SimNetwork::schedule(uint64_t delayNs, Task task) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    push(currentTime() + delayNs, EventKind::Task, 0, 0, nullptr, std::move(task));
+}
+
+uint64_t SimNetwork::now() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return currentTime();
+}
+
+SimStats SimNetwork::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+uint64_t SimNetwork::hashMessage(const SimMessage& message) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    hash = fnv1a(hash, message.pubsubTopic);
+    hash = fnv1a(hash, message.contentTopic);
+    hash = fnv1a(hash, message.payload);
+    hash = fnv1a(hash, std::to_string(message.timestamp));
+    // 0 stands for no message
+    return std::max<uint64_t>(1, splitmix(hash));
+}
+
+// Spread to the 32 bytes of a Waku message hash; the first 8 are the hash
+// itself, so parseHash() can read it back
+std::string SimNetwork::hashHex(uint64_t hash) {
+    static const char digits[] = "0123456789abcdef";
+    std::string out = "0x";
+    uint64_t word = hash;
+    for (int w = 0; w < 4; ++w) {
+        for (int shift = 60; shift >= 0; shift -= 4) out += digits[(word >> shift) & 15];
+        word = splitmix(word);
+    }
+    return out;
+}
+
+uint64_t SimNetwork::parseHash(const std::string& hex) {
+    size_t start = hex.compare(0, 2, "0x") == 0 ? 2 : 0;
+    uint64_t hash = 0;
+    for (size_t i = start; i < hex.size() && i < start + 16; ++i) {
+        char c = hex[i];
+        int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (digit < 0) return 0;
+        hash = hash << 4 | uint64_t(digit);
+    }
+    return hash;
+}
+
+// Called with the lock held
+bool SimNetwork::relays(const Node& node, const std::string& pubsubTopic) const {
+    return node.allTopics || node.topics.count(pubsubTopic) != 0;
+}
+
+// Called with the lock held
+bool SimNetwork::filters(uint32_t node, const SimMessage& message) const {
+    return std::any_of(filters_.begin(), filters_.end(), [&](const FilterSubscription& s) {
+        return s.node == node && s.pubsubTopic == message.pubsubTopic && s.contentTopic == message.contentTopic;
+    });
+}
+
+// False if node has seen hash already; called with the lock held
+bool SimNetwork::markSeen(Node& node, uint64_t hash) {
+    if (!node.seen.insert(hash).second) return false;
+    node.seenOrder.push_back(hash);
+    if (node.seenOrder.size() > options_.seenCapacity) {
+        node.seen.erase(node.seenOrder.front());
+        node.seenOrder.pop_front();
+    }
+    return true;
+}
+
+// Fixed for a pair of nodes, the same both ways
+uint64_t SimNetwork::linkLatency(uint32_t a, uint32_t b) const {
+    uint64_t pair = uint64_t(std::min(a, b)) << 32 | std::max(a, b);
+    double unit = static_cast<double>(splitmix(options_.seed ^ splitmix(pair)) >> 11) / 9007199254740992.0;
+    return msToNs(options_.latencyMs + (2 * unit - 1) * options_.latencySpreadMs);
+}
+
+// Send bytes from one node to another at the current time; false if the
+// copy is lost, else its arrival time. Called with the lock held.
+bool SimNetwork::transmit(uint32_t from, uint32_t to, uint64_t bytes, uint64_t& arrival) {
+    stats_.transmissions++;
+    stats_.bytes += bytes;
+    uint64_t departure = now_;
+    if (options_.bandwidth != 0) {
+        Node& sender = nodes_[from];
+        uint64_t sending = static_cast<uint64_t>(static_cast<double>(bytes) * 1e9 / static_cast<double>(options_.bandwidth));
+        departure = std::max(now_, sender.uplinkFree) + sending;
+        sender.uplinkFree = departure;
+    }
+    uint64_t jitter = 0;
+    if (options_.jitterMs > 0) {
+        jitter = msToNs(std::exponential_distribution<double>(1 / options_.jitterMs)(rng_));
+    }
+    if (options_.loss > 0 && std::uniform_real_distribution<double>(0, 1)(rng_) < options_.loss) {
+        stats_.lost++;
+        return false;
+    }
+    arrival = departure + linkLatency(from, to) + jitter;
+    return true;
+}
+
+// Called with the lock held
+uint64_t SimNetwork::currentTime() const {
+    if (!running_ || options_.timeScale == 0) return now_;
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - wallStart_).count();
+    return std::max(now_, simStart_ + static_cast<uint64_t>(elapsed * options_.timeScale));
+}
+
+// Called with the lock held
+void SimNetwork::push(uint64_t time, EventKind kind, uint32_t node, uint32_t from, SimMessagePtr message, Task task) {
+    Event event;
+    event.time = time;
+    event.seq = nextSeq_++;
+    event.kind = kind;
+    event.node = node;
+    event.from = from;
+    event.message = std::move(message);
+    event.task = std::move(task);
+    bool first = events_.empty() || time < events_.top().time;
+    events_.push(std::move(event));
+    if (first) cv_.notify_all();
+}
+
+// Called with the lock held; what is to be called without it goes to calls
+void SimNetwork::handle(Event& event, std::vector<Task>& calls) {
+    switch (event.kind) {
+        case EventKind::Relay:
+            receive(event.node, event.from, event.message, calls);
+            break;
+        case EventKind::Filter: {
+            // Dropped if the node unsubscribed while it was on its way
+            Node& node = nodes_[event.node];
+            if (!filters(event.node, *event.message)) break;
+            stats_.filterPushes++;
+            if (node.receiver) {
+                const Receiver* receiver = &node.receiver;
+                SimMessagePtr message = event.message;
+                calls.push_back([receiver, message] { (*receiver)(message, Delivery::Filter); });
+            }
+            break;
+        }
+        case EventKind::Task:
+            calls.push_back(std::move(event.task));
+            break;
+    }
+}
+
+// A relayed copy of message reached node from a mesh peer; called with the
+// lock held
+void SimNetwork::receive(uint32_t id, uint32_t from, const SimMessagePtr& message, std::vector<Task>& calls) {
+    Node& node = nodes_[id];
+    if (!relays(node, message->pubsubTopic)) return;
+    if (!markSeen(node, message->hash)) {
+        stats_.duplicates++;
+        return;
+    }
+    stats_.received++;
+    if (node.receiver) {
+        const Receiver* receiver = &node.receiver;
+        calls.push_back([receiver, message] { (*receiver)(message, Delivery::Relay); });
+    }
+    if (id >= 1 && id <= options_.storeNodes && !message->ephemeral) keep(node, message);
+    if (id == kFilterNode) {
+        for (const FilterSubscription& subscription : filters_) {
+            if (subscription.node == id || subscription.pubsubTopic != message->pubsubTopic ||
+                subscription.contentTopic != message->contentTopic) {
+                continue;
+            }
+            uint64_t arrival = 0;
+            if (transmit(id, subscription.node, wireSize(*message), arrival)) {
+                push(arrival, EventKind::Filter, subscription.node, id, message, nullptr);
+            }
+        }
+    }
+    for (uint32_t peer : node.peers) {
+        if (peer == from || !relays(nodes_[peer], message->pubsubTopic)) continue;
+        uint64_t arrival = 0;
+        if (transmit(id, peer, wireSize(*message), arrival)) {
+            push(arrival, EventKind::Relay, peer, id, message, nullptr);
+        }
+    }
+}
+
+// Called with the lock held
+void SimNetwork::keep(Node& node, const SimMessagePtr& message) {
+    auto later = [](uint64_t timestamp, const SimMessagePtr& m) { return timestamp < m->timestamp; };
+    if (node.stored.empty() || node.stored.back()->timestamp <= message->timestamp) {
+        node.stored.push_back(message);
+    } else {
+        node.stored.insert(std::upper_bound(node.stored.begin(), node.stored.end(), message->timestamp, later),
+                           message);
+    }
+    if (node.stored.size() > options_.storeCapacity) node.stored.pop_front();
+}
+
+// One page of what node keeps, oldest first either way: the history, then
+// what arrived since. Called with the lock held.
+SimStoreResult SimNetwork::answer(const Node& node, const SimStoreQuery& query) const {
+    auto wanted = [&](const std::string& pubsubTopic, const std::string& contentTopic) {
+        return (query.pubsubTopic.empty() || pubsubTopic == query.pubsubTopic) &&
+               (query.contentTopics.empty() ||
+                std::find(query.contentTopics.begin(), query.contentTopics.end(), contentTopic) !=
+                    query.contentTopics.end());
+    };
+    auto inTime = [&](uint64_t timestamp) {
+        return timestamp >= query.timeStart && (query.timeEnd == 0 || timestamp <= query.timeEnd);
+    };
+
+    // Positions run over the history, then over stored. The history's part
+    // in the time range is [first, last), found without a scan.
+    const SyntheticHistory* history = history_.get();
+    uint64_t historySize = history != nullptr ? history->size() : 0;
+    uint64_t first = 0;
+    uint64_t last = 0;
+    std::vector<bool> historyTopics;  // by topic index, whether the query wants it
+    if (history != nullptr) {
+        first = history->lowerBound(query.timeStart);
+        last = query.timeEnd == 0 ? historySize : history->lowerBound(query.timeEnd + 1);
+        last = std::max(first, last);
+        const SyntheticHistoryOptions& options = history->options();
+        for (const std::string& contentTopic : options.contentTopics) {
+            historyTopics.push_back(wanted(options.pubsubTopic, contentTopic));
+        }
+        if (std::find(historyTopics.begin(), historyTopics.end(), true) == historyTopics.end()) last = first;
+    }
+    uint64_t total = historySize + node.stored.size();
+    auto positionOf = [&](uint64_t step) { return query.forward ? step : total - 1 - step; };
+
+    // Walk in the query's direction, from just past the cursor if it is
+    // still kept
+    uint64_t step = 0;
+    uint64_t index = 0;
+    if (query.cursor != 0) {
+        if (history != nullptr && history->indexOf(query.cursor, index)) {
+            step = (query.forward ? index : total - 1 - index) + 1;
+        } else {
+            for (size_t i = 0; i < node.stored.size(); ++i) {
+                if (node.stored[i]->hash == query.cursor) {
+                    uint64_t position = historySize + i;
+                    step = (query.forward ? position : total - 1 - position) + 1;
+                    break;
+                }
+            }
+        }
+    }
+
+    size_t limit = std::max<uint32_t>(1, query.limit);
+    SimStoreResult result;
+    bool more = false;
+    for (; step < total; ++step) {
+        uint64_t position = positionOf(step);
+        SimMessagePtr message;
+        if (position < historySize) {
+            // Skip to the part of the history in the time range
+            if (position < first) {
+                if (!query.forward) break;
+                step = first - 1;
+                continue;
+            }
+            if (position >= last) {
+                if (query.forward) {
+                    step = historySize - 1;
+                } else {
+                    step = total - last - 1;
+                }
+                continue;
+            }
+            if (!historyTopics[history->topicOf(position)]) continue;
+            if (result.messages.size() == limit) {
+                more = true;
+                break;
+            }
+            result.messages.push_back(std::make_shared<const SimMessage>(history->message(position)));
+            continue;
+        }
+        const SimMessagePtr& kept = node.stored[position - historySize];
+        if (!inTime(kept->timestamp) || !wanted(kept->pubsubTopic, kept->contentTopic)) continue;
+        if (result.messages.size() == limit) {
+            more = true;
+            break;
+        }
+        result.messages.push_back(kept);
+    }
+    if (more) result.cursor = result.messages.back()->hash;
+    if (!query.forward) std::reverse(result.messages.begin(), result.messages.end());
+    return result;
+}
+
+void SimNetwork::start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_) return;
+    running_ = true;
+    stopping_ = false;
+    wallStart_ = std::chrono::steady_clock::now();
+    simStart_ = now_;
+    thread_ = std::thread(&SimNetwork::run, this);
+}
+
+void SimNetwork::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) return;
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+}
+
+void SimNetwork::runUntil(uint64_t untilNs) {
+    drive(untilNs, true);
+}
+
+void SimNetwork::runUntilIdle() {
+    drive(UINT64_MAX, false);
+}
+
+// Take events one at a time, so what their calls publish is ordered as if
+// the thread had taken them; with advance the clock ends at untilNs
+void SimNetwork::drive(uint64_t untilNs, bool advance) {
+    std::vector<Task> calls;
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (running_) return;
+    while (!events_.empty() && events_.top().time <= untilNs) {
+        // Only the payload is moved out, the order fields stay for pop()
+        Event event = std::move(const_cast<Event&>(events_.top()));
+        events_.pop();
+        now_ = std::max(now_, event.time);
+        handle(event, calls);
+        lock.unlock();
+        for (Task& call : calls) call();
+        calls.clear();
+        lock.lock();
+    }
+    if (advance) now_ = std::max(now_, untilNs);
+}
+
+void SimNetwork::run() {
+    std::vector<Task> calls;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        if (events_.empty()) {
+            cv_.wait(lock, [this] { return stopping_ || !events_.empty(); });
+            continue;
+        }
+        uint64_t due = events_.top().time;
+        if (options_.timeScale > 0 && due > currentTime()) {
+            auto wall = wallStart_ + std::chrono::nanoseconds(
+                static_cast<int64_t>(static_cast<double>(due - simStart_) / options_.timeScale));
+            cv_.wait_until(lock, wall);
+            continue;
+        }
+        // Only the payload is moved out, the order fields stay for pop()
+        Event event = std::move(const_cast<Event&>(events_.top()));
+        events_.pop();
+        now_ = std::max(now_, event.time);
+        handle(event, calls);
+        lock.unlock();
+        for (Task& call : calls) call();
+        calls.clear();
+        lock.lock();
+    }
+}
@@ -0,0 +1,229 @@
+#ifndef SIM_NETWORK_H
+#define SIM_NETWORK_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+class SyntheticHistory;
+
+struct SimOptions {
+    uint32_t nodes = 100;           // virtual nodes, the local one included
+    uint32_t fanout = 6;            // mesh peers a node keeps, as gossipsub's D
+    double latencyMs = 40;          // mean one-way latency of a link
+    double latencySpreadMs = 20;    // link latencies spread evenly over the mean +- this
+    double jitterMs = 5;            // added per message, exponential with this mean
+    double loss = 0;                // chance a single transmission is lost
+    uint64_t bandwidth = 0;         // uplink of every node in bytes/s, 0 unlimited
+    uint32_t storeNodes = 1;        // nodes 1..storeNodes keep history and take turns answering queries
+    size_t storeCapacity = 100000;  // messages a store node keeps
+    double storeDelayMs = 0;        // a store node takes to answer a query
+    size_t seenCapacity = 16384;    // message hashes a node remembers to drop duplicates
+    double timeScale = 1;           // simulated seconds per wall second, 0 as fast as possible
+    uint64_t seed = 1;
+};
+
+struct SimMessage {
+    std::string pubsubTopic;
+    std::string contentTopic;
+    std::string payload;  // base64, as it is in the JSON
+    uint64_t timestamp = 0;  // ns
+    bool ephemeral = false;  // not kept by store nodes
+    uint64_t hash = 0;
+    uint32_t origin = 0;     // publishing node
+    uint64_t publishedAt = 0;  // simulated ns
+};
+
+using SimMessagePtr = std::shared_ptr<const SimMessage>;
+
+struct SimStoreQuery {
+    std::string pubsubTopic;  // empty for any
+    std::vector<std::string> contentTopics;  // empty for any
+    uint64_t timeStart = 0;  // ns, by message timestamp
+    uint64_t timeEnd = 0;    // ns, 0 for no end
+    bool forward = true;     // oldest first
+    uint32_t limit = 20;
+    uint64_t cursor = 0;     // hash of the last message of the previous page, 0 for the first
+};
+
+struct SimStoreResult {
+    std::vector<SimMessagePtr> messages;
+    uint64_t cursor = 0;  // pass on for the next page, 0 if there is none
+};
+
+struct SimStats {
+    uint64_t published = 0;
+    uint64_t transmissions = 0;  // message copies sent over links
+    uint64_t lost = 0;           // of those, dropped by the loss model
+    uint64_t duplicates = 0;     // arrived at a node that had seen them
+    uint64_t received = 0;       // first arrivals, the publisher's own included
+    uint64_t filterPushes = 0;
+    uint64_t storeQueries = 0;
+    uint64_t bytes = 0;          // sent over links
+};
+
+// A Waku network simulated in process: virtual nodes joined in a random
+// gossipsub-like mesh, relaying every message to all their mesh peers but
+// the one it came from, and dropping what they have seen. Each copy sent
+// over a link is delayed by the link's latency, a random jitter and, with
+// limited bandwidth, the time it waits on the sender's uplink; it may be
+// lost. Nodes 1..storeNodes keep history; node 1 also serves filter
+// subscriptions, pushing matching messages to subscribers straight over
+// their link.
+//
+// Time is simulated, in ns since the network was created. Events are taken
+// in time order, ties in the order they were scheduled, and all randomness
+// comes from one generator seeded with seed, so the same inputs at the same
+// simulated times give the same run. With timeScale 0 time jumps from one
+// event to the next; otherwise it follows the wall clock, scaled.
+//
+// Either start() a thread taking the events or, without one, drive the
+// network with runUntil()/runUntilIdle(). Receivers and callbacks are called
+// from whichever takes the events, without the network's lock held, so
+// they may call back into the network.
+//
+// All methods are thread-safe.
+class SimNetwork {
+public:
+    enum class Delivery : uint8_t { Relay, Filter };
+
+    using Receiver = std::function<void(const SimMessagePtr& message, Delivery delivery)>;
+    using StoreCallback = std::function<void(bool success, const SimStoreResult& result)>;
+    using Task = std::function<void()>;
+
+    explicit SimNetwork(const SimOptions& options = SimOptions());
+    ~SimNetwork();
+
+    SimNetwork(const SimNetwork&) = delete;
+    SimNetwork& operator=(const SimNetwork&) = delete;
+
+    const SimOptions& options() const { return options_; }
+    uint32_t size() const { return static_cast<uint32_t>(nodes_.size()); }
+    const std::vector<uint32_t>& peers(uint32_t node) const { return nodes_[node].peers; }
+
+    // Called for the messages node gets on the pubsub topics it relays and
+    // the content topics it filters. Set before messages flow.
+    void setReceiver(uint32_t node, Receiver receiver);
+
+    // History every store node has from before the start, older than any
+    // message published; set before queries are made
+    void setHistory(std::shared_ptr<const SyntheticHistory> history);
+
+    // Virtual nodes but the local one, node 0, relay every pubsub topic
+    // from the start; node 0 only those it subscribes to
+    void relaySubscribe(uint32_t node, const std::string& pubsubTopic);
+    void relayUnsubscribe(uint32_t node, const std::string& pubsubTopic);
+    void filterSubscribe(uint32_t node, const std::string& pubsubTopic, const std::vector<std::string>& contentTopics);
+    void filterUnsubscribe(uint32_t node, const std::string& pubsubTopic, const std::vector<std::string>& contentTopics);
+
+    // Publish from node now; the message hash, 0 if node does not relay the
+    // pubsub topic
+    uint64_t publish(uint32_t node, SimMessage message);
+
+    // Ask a store node from node; the answer comes back after the round
+    // trip. If a leg is lost the callback fails after timeoutNs, or is never
+    // called with timeoutNs 0.
+    void storeQuery(uint32_t node, const SimStoreQuery& query, uint64_t timeoutNs, StoreCallback callback);
+
+    // Run task delayNs after now
+    void schedule(uint64_t delayNs, Task task);
+
+    void start();
+    void stop();
+
+    // Take events up to simulated time untilNs, or until none are left;
+    // only without a thread started
+    void runUntil(uint64_t untilNs);
+    void runUntilIdle();
+
+    uint64_t now() const;
+    SimStats stats() const;
+
+    // Hash of a message as it is named in events and store answers
+    static uint64_t hashMessage(const SimMessage& message);
+    static std::string hashHex(uint64_t hash);
+    static uint64_t parseHash(const std::string& hex);
+
+private:
+    enum class EventKind : uint8_t { Relay, Filter, Task };
+
+    struct Event {
+        uint64_t time = 0;
+        uint64_t seq = 0;
+        EventKind kind = EventKind::Task;
+        uint32_t node = 0;
+        uint32_t from = 0;
+        SimMessagePtr message;
+        Task task;
+    };
+
+    struct Later {
+        bool operator()(const Event& a, const Event& b) const {
+            return a.time != b.time ? a.time > b.time : a.seq > b.seq;
+        }
+    };
+
+    struct Node {
+        std::vector<uint32_t> peers;
+        bool allTopics = true;
+        std::set<std::string> topics;  // relayed, if not allTopics
+        std::unordered_set<uint64_t> seen;
+        std::deque<uint64_t> seenOrder;
+        uint64_t uplinkFree = 0;  // simulated ns the uplink is free again
+        Receiver receiver;
+        std::deque<SimMessagePtr> stored;  // store nodes only, by timestamp, then arrival
+    };
+
+    struct FilterSubscription {
+        uint32_t node;
+        std::string pubsubTopic;
+        std::string contentTopic;
+    };
+
+    void buildMesh();
+    bool relays(const Node& node, const std::string& pubsubTopic) const;
+    bool filters(uint32_t node, const SimMessage& message) const;
+    bool markSeen(Node& node, uint64_t hash);
+    uint64_t linkLatency(uint32_t a, uint32_t b) const;
+    bool transmit(uint32_t from, uint32_t to, uint64_t bytes, uint64_t& arrival);
+    uint64_t currentTime() const;
+    void push(uint64_t time, EventKind kind, uint32_t node, uint32_t from, SimMessagePtr message, Task task);
+    void handle(Event& event, std::vector<Task>& calls);
+    void receive(uint32_t node, uint32_t from, const SimMessagePtr& message, std::vector<Task>& calls);
+    void keep(Node& node, const SimMessagePtr& message);
+    SimStoreResult answer(const Node& node, const SimStoreQuery& query) const;
+    void drive(uint64_t untilNs, bool advance);
+    void run();
+
+    const SimOptions options_;
+    std::vector<Node> nodes_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::mt19937_64 rng_;
+    std::priority_queue<Event, std::vector<Event>, Later> events_;
+    uint64_t nextSeq_ = 0;
+    uint64_t now_ = 0;
+    std::vector<FilterSubscription> filters_;
+    std::shared_ptr<const SyntheticHistory> history_;
+    uint32_t storeTurn_ = 0;
+    SimStats stats_;
+    std::thread thread_;
+    bool running_ = false;
+    bool stopping_ = false;
+    std::chrono::steady_clock::time_point wallStart_;
+    uint64_t simStart_ = 0;
+};
+
+#endif // SIM_NETWORK_H
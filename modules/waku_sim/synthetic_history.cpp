@@ -0,0 +1,123 @@
+#include "synthetic_history.h"
+#include <algorithm>
+
+namespace {
+
+uint64_t splitmix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+std::string base64Encode(const std::string& data) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    out.reserve((data.size() + 2) / 3 * 4);
+    for (size_t i = 0; i < data.size(); i += 3) {
+        uint32_t chunk = uint32_t(static_cast<uint8_t>(data[i])) << 16;
+        if (i + 1 < data.size()) chunk |= uint32_t(static_cast<uint8_t>(data[i + 1])) << 8;
+        if (i + 2 < data.size()) chunk |= static_cast<uint8_t>(data[i + 2]);
+        out += alphabet[chunk >> 18 & 63];
+        out += alphabet[chunk >> 12 & 63];
+        out += i + 1 < data.size() ? alphabet[chunk >> 6 & 63] : '=';
+        out += i + 2 < data.size() ? alphabet[chunk & 63] : '=';
+    }
+    return out;
+}
+
+void appendVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+void appendBytes(std::string& out, uint32_t field, const std::string& bytes) {
+    appendVarint(out, field << 3 | 2);
+    appendVarint(out, bytes.size());
+    out += bytes;
+}
+
+const char* const kWords[] = {"the", "waku", "message", "store", "node", "hello", "chat", "is", "on", "relay",
+                              "filter", "peer", "and", "to", "logos", "a", "channel", "history", "ok", "we"};
+
+} // namespace
+
+std::string syntheticChatPayload(uint64_t timestamp, const std::string& nick, const std::string& text) {
+    std::string out;
+    appendVarint(out, 1 << 3);
+    appendVarint(out, timestamp);
+    appendBytes(out, 2, nick);
+    appendBytes(out, 3, text);
+    return base64Encode(out);
+}
+
+SyntheticHistory::SyntheticHistory(const SyntheticHistoryOptions& options)
+    : options_(options), hashKey_(splitmix(options.seed ^ 0x686973746f7279ULL)) {
+    if (options_.contentTopics.empty()) options_.contentTopics.push_back("/toy-chat/2/history/proto");
+    options_.intervalNs = std::max<uint64_t>(2, options_.intervalNs);
+    // Topic t gets a share of 1 / (t + 1)
+    double total = 0;
+    for (size_t t = 0; t < options_.contentTopics.size(); ++t) total += 1.0 / double(t + 1);
+    double sum = 0;
+    for (size_t t = 0; t < options_.contentTopics.size(); ++t) {
+        sum += 1.0 / double(t + 1);
+        topicBounds_.push_back(static_cast<uint32_t>(std::min(4294967295.0, sum / total * 4294967296.0)));
+    }
+    topicBounds_.back() = UINT32_MAX;
+}
+
+// Even spacing plus up to half an interval, so timestamps stay in order
+uint64_t SyntheticHistory::timestamp(uint64_t index) const {
+    uint64_t jitter = splitmix(options_.seed + index * 2) % (options_.intervalNs / 2);
+    return options_.startNs + index * options_.intervalNs + jitter;
+}
+
+size_t SyntheticHistory::topicOf(uint64_t index) const {
+    uint32_t draw = static_cast<uint32_t>(splitmix(options_.seed + index * 2 + 1) >> 32);
+    return static_cast<size_t>(std::lower_bound(topicBounds_.begin(), topicBounds_.end(), draw) - topicBounds_.begin());
+}
+
+// The index, masked, as the hash; 0 stays free for no message
+uint64_t SyntheticHistory::hash(uint64_t index) const {
+    return (index + 1) ^ hashKey_;
+}
+
+bool SyntheticHistory::indexOf(uint64_t hash, uint64_t& index) const {
+    uint64_t value = hash ^ hashKey_;
+    if (value == 0 || value > size()) return false;
+    index = value - 1;
+    return true;
+}
+
+uint64_t SyntheticHistory::lowerBound(uint64_t timestampNs) const {
+    if (timestampNs <= options_.startNs) return 0;
+    uint64_t index = std::min(size(), (timestampNs - options_.startNs) / options_.intervalNs);
+    // Off by at most one from the jitter
+    while (index > 0 && timestamp(index - 1) >= timestampNs) index--;
+    while (index < size() && timestamp(index) < timestampNs) index++;
+    return index;
+}
+
+SimMessage SyntheticHistory::message(uint64_t index) const {
+    SimMessage out;
+    out.pubsubTopic = options_.pubsubTopic;
+    out.contentTopic = options_.contentTopics[topicOf(index)];
+    out.timestamp = timestamp(index);
+    out.hash = hash(index);
+
+    uint64_t state = splitmix(options_.seed ^ (index << 1) ^ 0x5bd1e995ULL);
+    std::string text;
+    text.reserve(options_.textSize + 8);
+    while (text.size() < options_.textSize) {
+        state = splitmix(state);
+        if (!text.empty()) text += ' ';
+        text += kWords[state % (sizeof(kWords) / sizeof(kWords[0]))];
+    }
+    text.resize(options_.textSize);
+    std::string nick = "user" + std::to_string(splitmix(state) % 1000);
+    out.payload = syntheticChatPayload(out.timestamp / 1000000000ULL, nick, text);
+    return out;
+}
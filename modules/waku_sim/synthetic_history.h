@@ -0,0 +1,54 @@
+#ifndef SYNTHETIC_HISTORY_H
+#define SYNTHETIC_HISTORY_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "sim_network.h"
+
+struct SyntheticHistoryOptions {
+    uint64_t messages = 1000000;
+    std::vector<std::string> contentTopics = {"/toy-chat/2/history/proto"};
+    std::string pubsubTopic = "/waku/2/rs/16/32";
+    uint64_t startNs = 0;              // timestamp of the first message
+    uint64_t intervalNs = 1000000000;  // between messages, on average
+    size_t textSize = 100;             // characters of each message
+    uint64_t seed = 1;
+};
+
+// Toy chat Chat2Message with timestamp in seconds, base64 encoded as Waku
+// messages carry it in JSON
+std::string syntheticChatPayload(uint64_t timestamp, const std::string& nick, const std::string& text);
+
+// A store's history of any size that takes no memory: message i is made
+// from the seed and i when asked for. Timestamps grow with i, a little
+// apart from even spacing, so a time is found by arithmetic. Channels are
+// picked with a Zipf-like skew, the first content topic the busiest, as
+// chat traffic tends to be. Message hashes carry their index, so a cursor
+// leads straight back to its place.
+//
+// Thread-safe, it never changes.
+class SyntheticHistory {
+public:
+    explicit SyntheticHistory(const SyntheticHistoryOptions& options = SyntheticHistoryOptions());
+
+    const SyntheticHistoryOptions& options() const { return options_; }
+    uint64_t size() const { return options_.messages; }
+
+    uint64_t timestamp(uint64_t index) const;
+    size_t topicOf(uint64_t index) const;
+    uint64_t hash(uint64_t index) const;
+    SimMessage message(uint64_t index) const;
+
+    // First index with a timestamp at or after timestampNs, size() if none
+    uint64_t lowerBound(uint64_t timestampNs) const;
+    // Index of the message with hash, false if it is none of these
+    bool indexOf(uint64_t hash, uint64_t& index) const;
+
+private:
+    SyntheticHistoryOptions options_;
+    std::vector<uint32_t> topicBounds_;  // cumulative share of each topic, of 2^32
+    uint64_t hashKey_;
+};
+
+#endif // SYNTHETIC_HISTORY_H
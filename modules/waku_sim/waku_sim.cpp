@@ -0,0 +1,437 @@
+#include "waku_sim.h"
+#include <QDebug>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include "../waku/event_log.h"
+#include "sim_json.h"
+#include "synthetic_history.h"
+
+namespace {
+
+const uint32_t kLocalNode = 0;
+
+// Settings of the network, its traffic, its store's history and the event
+// log to replay from a JSON object; keys not there are left as they are
+void readSettings(const std::string& json, SimOptions& options, SimTraffic& traffic,
+                  SyntheticHistoryOptions& history, double& historyIntervalMs, std::string& replayLog) {
+    jsonNumber(json, "nodes", options.nodes);
+    jsonNumber(json, "fanout", options.fanout);
+    jsonNumber(json, "latencyMs", options.latencyMs);
+    jsonNumber(json, "latencySpreadMs", options.latencySpreadMs);
+    jsonNumber(json, "jitterMs", options.jitterMs);
+    jsonNumber(json, "loss", options.loss);
+    jsonNumber(json, "bandwidth", options.bandwidth);
+    jsonNumber(json, "storeNodes", options.storeNodes);
+    jsonNumber(json, "storeCapacity", options.storeCapacity);
+    jsonNumber(json, "storeDelayMs", options.storeDelayMs);
+    jsonNumber(json, "timeScale", options.timeScale);
+    jsonNumber(json, "seed", options.seed);
+    jsonNumber(json, "trafficPerSecond", traffic.perSecond);
+    jsonString(json, "trafficPubsubTopic", traffic.pubsubTopic);
+    jsonStringArray(json, "trafficTopics", traffic.contentTopics);
+    jsonNumber(json, "trafficTextSize", traffic.textSize);
+    jsonNumber(json, "historyMessages", history.messages);
+    jsonStringArray(json, "historyTopics", history.contentTopics);
+    jsonString(json, "historyPubsubTopic", history.pubsubTopic);
+    jsonNumber(json, "historyIntervalMs", historyIntervalMs);
+    jsonNumber(json, "historyTextSize", history.textSize);
+    jsonString(json, "replayLog", replayLog);
+}
+
+uint64_t unixNanos() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+template <typename Callback>
+void fail(const Callback& callback, const QString& message) {
+    qDebug() << message;
+    if (callback) {
+        callback(false, message);
+    }
+}
+
+} // namespace
+
+// A captured event log being fed to the event callback, with the next
+// event read ahead so the gap to it is known
+struct WakuSim::Replay {
+    EventLogReader reader;
+    EventRecord pending;
+    uint64_t fed = 0;
+};
+
+WakuSim::WakuSim() : trafficRng(0), trafficStarted(false), replayStarted(false), epochOffset(0) {}
+
+WakuSim::~WakuSim() {
+    std::shared_ptr<SimNetwork> old;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        old = std::move(network);
+    }
+    if (old) {
+        old->stop();
+    }
+}
+
+std::shared_ptr<SimNetwork> WakuSim::current() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return network;
+}
+
+SimStats WakuSim::stats() const {
+    std::shared_ptr<SimNetwork> net = current();
+    return net ? net->stats() : SimStats();
+}
+
+void WakuSim::initWaku(const QString &cfg, WakuInitCallback callback) {
+    qDebug() << "Initializing simulated Waku network...";
+    SimOptions options;
+    SimTraffic settings;
+    SyntheticHistoryOptions history;
+    history.messages = 0;
+    double historyIntervalMs = 1000;
+    std::string replay;
+    readSettings(cfg.toStdString(), options, settings, history, historyIntervalMs, replay);
+    const char* overrides = std::getenv("LOGOS_WAKU_SIM");
+    if (overrides != nullptr) {
+        readSettings(overrides, options, settings, history, historyIntervalMs, replay);
+    }
+    uint64_t now = unixNanos();
+
+    auto created = std::make_shared<SimNetwork>(options);
+    if (history.messages != 0) {
+        // The history ends where the simulation starts
+        history.seed = options.seed;
+        history.intervalNs = static_cast<uint64_t>(historyIntervalMs * 1e6);
+        history.startNs = now - std::min(now, history.messages * history.intervalNs);
+        created->setHistory(std::make_shared<const SyntheticHistory>(history));
+    }
+    created->setReceiver(kLocalNode, [this](const SimMessagePtr& message, SimNetwork::Delivery) {
+        deliver(message);
+    });
+    std::shared_ptr<SimNetwork> old;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        old = std::move(network);
+        network = created;
+        traffic = settings;
+        trafficRng.seed(options.seed + 1);
+        trafficStarted = false;
+        replayLog = replay;
+        replayStarted = false;
+        epochOffset = now;
+    }
+    if (old) {
+        old->stop();
+    }
+
+    const SimOptions& used = created->options();
+    QString message = QString::fromStdString("Simulated Waku network of " + std::to_string(used.nodes) +
+                                             " nodes, fanout " + std::to_string(used.fanout) + ", seed " +
+                                             std::to_string(used.seed) + ", " + std::to_string(history.messages) +
+                                             " stored messages");
+    qDebug() << message;
+    if (callback) {
+        callback(true, message);
+    }
+}
+
+void WakuSim::getVersion(WakuVersionCallback callback) {
+    if (callback) {
+        callback(QString("waku_sim ") + version());
+    }
+}
+
+void WakuSim::startWaku(WakuStartCallback callback) {
+    std::shared_ptr<SimNetwork> net = current();
+    if (!net) {
+        fail(callback, "Waku not initialized");
+        return;
+    }
+    net->start();
+    // A restart picks up the traffic where it stopped
+    double perSecond = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!trafficStarted && !traffic.contentTopics.empty()) perSecond = traffic.perSecond;
+        trafficStarted = trafficStarted || perSecond > 0;
+    }
+    if (perSecond > 0) {
+        SimNetwork* raw = net.get();
+        net->schedule(static_cast<uint64_t>(1e9 / perSecond), [this, raw] { sendTraffic(raw); });
+    }
+    startReplay(net.get());
+    if (callback) {
+        callback(true, "Waku started successfully");
+    }
+}
+
+void WakuSim::stopWaku(WakuStopCallback callback) {
+    std::shared_ptr<SimNetwork> net = current();
+    if (!net) {
+        fail(callback, "Waku not initialized");
+        return;
+    }
+    net->stop();
+    if (callback) {
+        callback(true, "Waku stopped successfully");
+    }
+}
+
+void WakuSim::createContentTopic(const QString &appName, unsigned int appVersion,
+                                 const QString &contentTopicName, const QString &encoding,
+                                 WakuContentTopicCallback callback) {
+    std::string topic = "/" + appName.toStdString() + "/" + std::to_string(appVersion) + "/" +
+                        contentTopicName.toStdString() + "/" + encoding.toStdString();
+    if (callback) {
+        callback(true, QString::fromStdString(topic));
+    }
+}
+
+void WakuSim::createPubSubTopic(const QString &topicName, WakuPubSubTopicCallback callback) {
+    if (callback) {
+        callback(true, QString::fromStdString("/waku/2/" + topicName.toStdString()));
+    }
+}
+
+void WakuSim::getDefaultPubSubTopic(WakuPubSubTopicCallback callback) {
+    if (callback) {
+        callback(true, "/waku/2/default-waku/proto");
+    }
+}
+
+void WakuSim::relayPublish(const QString &pubSubTopic, const QString &jsonWakuMessage,
+                           unsigned int timeoutMs, WakuPublishCallback callback) {
+    (void)timeoutMs;
+    std::shared_ptr<SimNetwork> net = current();
+    if (!net) {
+        fail(callback, "Waku not initialized");
+        return;
+    }
+    std::string json = jsonWakuMessage.toStdString();
+    SimMessage message;
+    message.pubsubTopic = pubSubTopic.toStdString();
+    if (!jsonString(json, "contentTopic", message.contentTopic) || !jsonString(json, "payload", message.payload)) {
+        fail(callback, "Invalid Waku message");
+        return;
+    }
+    jsonNumber(json, "timestamp", message.timestamp);
+    jsonBool(json, "ephemeral", message.ephemeral);
+    if (message.timestamp == 0) {
+        message.timestamp = epochOffset + net->now();
+    }
+    uint64_t hash = net->publish(kLocalNode, std::move(message));
+    if (hash == 0) {
+        fail(callback, "Not subscribed to pubsub topic " + pubSubTopic);
+        return;
+    }
+    if (callback) {
+        callback(true, QString::fromStdString(SimNetwork::hashHex(hash)));
+    }
+}
+
+void WakuSim::relayAddProtectedShard(int clusterId, int shardId, const QString &publicKey,
+                                     WakuProtectedShardCallback callback) {
+    // Every simulated peer is honest, there is nothing to check
+    (void)clusterId;
+    (void)shardId;
+    (void)publicKey;
+    if (callback) {
+        callback(true, "Protected shard added");
+    }
+}
+
+void WakuSim::relaySubscribe(const QString &pubSubTopic, WakuSubscribeCallback callback) {
+    std::shared_ptr<SimNetwork> net = current();
+    if (!net) {
+        fail(callback, "Waku not initialized");
+        return;
+    }
+    net->relaySubscribe(kLocalNode, pubSubTopic.toStdString());
+    if (callback) {
+        callback(true, "Subscribed to " + pubSubTopic);
+    }
+}
+
+void WakuSim::relayUnsubscribe(const QString &pubSubTopic, WakuSubscribeCallback callback) {
+    std::shared_ptr<SimNetwork> net = current();
+    if (!net) {
+        fail(callback, "Waku not initialized");
+        return;
+    }
+    net->relayUnsubscribe(kLocalNode, pubSubTopic.toStdString());
+    if (callback) {
+        callback(true, "Unsubscribed from " + pubSubTopic);
+    }
+}
+
+void WakuSim::filterSubscribe(const QString &pubSubTopic, const QString &contentTopics,
+                              WakuFilterSubscribeCallback callback) {
+    std::shared_ptr<SimNetwork> net = current();
+    if (!net) {
+        fail(callback, "Waku not initialized");
+        return;
+    }
+    std::vector<std::string> topics;
+    if (!jsonStringArray(contentTopics.toStdString(), std::string(), topics) || topics.empty()) {
+        fail(callback, "Invalid content topics");
+        return;
+    }
+    net->filterSubscribe(kLocalNode, pubSubTopic.toStdString(), topics);
+    if (callback) {
+        callback(true, "Filter subscription successful");
+    }
+}
+
+void WakuSim::filterUnsubscribe(const QString &pubSubTopic, const QString &contentTopics,
+                                WakuFilterUnsubscribeCallback callback) {
+    std::shared_ptr<SimNetwork> net = current();
+    if (!net) {
+        fail(callback, "Waku not initialized");
+        return;
+    }
+    std::vector<std::string> topics;
+    if (!jsonStringArray(contentTopics.toStdString(), std::string(), topics) || topics.empty()) {
+        fail(callback, "Invalid content topics");
+        return;
+    }
+    net->filterUnsubscribe(kLocalNode, pubSubTopic.toStdString(), topics);
+    if (callback) {
+        callback(true, "Filter unsubscription successful");
+    }
+}
+
+void WakuSim::connectPeer(const QString &peerMultiAddr, unsigned int timeoutMs, WakuConnectCallback callback) {
+    // The mesh is built with the network; any peer counts as connected
+    (void)timeoutMs;
+    if (callback) {
+        callback(true, "Connected to " + peerMultiAddr);
+    }
+}
+
+void WakuSim::storeQuery(const QString &jsonQuery, const QString &peerAddr,
+                         unsigned int timeoutMs, WakuStoreQueryCallback callback) {
+    // The store nodes are the simulated ones, whatever peer is named
+    (void)peerAddr;
+    std::shared_ptr<SimNetwork> net = current();
+    if (!net) {
+        fail(callback, "Waku not initialized");
+        return;
+    }
+    SimStoreQuery query;
+    std::string requestId;
+    parseStoreQuery(jsonQuery.toStdString(), query, requestId);
+
+    uint64_t timeoutNs = uint64_t(timeoutMs) * 1000000ULL;
+    net->storeQuery(kLocalNode, query, timeoutNs, [requestId, callback](bool success, const SimStoreResult& result) {
+        if (!success) {
+            fail(callback, "Store query timed out");
+            return;
+        }
+        if (callback) {
+            callback(true, QString::fromStdString(storeResponseJson(requestId, result)));
+        }
+    });
+}
+
+void WakuSim::destroyWaku(WakuDestroyCallback callback) {
+    std::shared_ptr<SimNetwork> old;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        old = std::move(network);
+    }
+    if (!old) {
+        fail(callback, "Waku not initialized");
+        return;
+    }
+    old->stop();
+    if (callback) {
+        callback(true, "Waku destroyed successfully");
+    }
+}
+
+void WakuSim::setEventCallback(WakuEventCallback callback) {
+    std::lock_guard<std::mutex> lock(mutex);
+    eventCallback = std::move(callback);
+}
+
+// A message reached the local node, by relay or filter; both are handed
+// on, as libwaku does
+void WakuSim::deliver(const SimMessagePtr& message) {
+    WakuEventCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        callback = eventCallback;
+    }
+    if (!callback) {
+        return;
+    }
+    callback(QString::fromStdString(messageEventJson(*message)));
+}
+
+// One message of a random virtual peer on a random traffic topic, then the
+// next one after an exponential gap, so the arrivals are Poisson
+void WakuSim::sendTraffic(SimNetwork* net) {
+    SimMessage message;
+    uint32_t sender = 0;
+    std::string text;
+    double gap = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (network.get() != net) return;
+        sender = 1 + static_cast<uint32_t>(trafficRng() % (net->size() - 1));
+        message.pubsubTopic = traffic.pubsubTopic;
+        message.contentTopic = traffic.contentTopics[trafficRng() % traffic.contentTopics.size()];
+        message.timestamp = epochOffset + net->now();
+        text.assign(traffic.textSize, ' ');
+        for (char& c : text) c = static_cast<char>('a' + trafficRng() % 26);
+        gap = std::exponential_distribution<double>(traffic.perSecond)(trafficRng);
+    }
+    message.payload = syntheticChatPayload(message.timestamp / 1000000000ULL, "peer" + std::to_string(sender), text);
+    net->publish(sender, std::move(message));
+    net->schedule(static_cast<uint64_t>(gap * 1e9), [this, net] { sendTraffic(net); });
+}
+
+// Opens the replay log, once, and feeds its first event right away
+void WakuSim::startReplay(SimNetwork* net) {
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (replayStarted || replayLog.empty()) return;
+        replayStarted = true;
+        path = replayLog;
+    }
+    auto replay = std::make_shared<Replay>();
+    if (!replay->reader.open(path) || !replay->reader.next(replay->pending)) {
+        qDebug() << "Cannot replay Waku events from" << QString::fromStdString(path);
+        return;
+    }
+    qDebug() << "Replaying Waku events from" << QString::fromStdString(path);
+    net->schedule(0, [this, net, replay] { feedReplay(net, replay); });
+}
+
+// Hands the pending event to the event callback as libwaku would, then
+// waits as long as the capture did before the next one. The gaps are in
+// simulated time, so timeScale sets the speed: 1 as captured, N times as
+// fast, 0 back to back.
+void WakuSim::feedReplay(SimNetwork* net, const std::shared_ptr<Replay>& replay) {
+    WakuEventCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (network.get() != net) return;
+        callback = eventCallback;
+    }
+    if (callback && !replay->pending.data.empty()) {
+        callback(QString::fromUtf8(replay->pending.data.data(), static_cast<int>(replay->pending.data.size())));
+    }
+    replay->fed++;
+
+    uint64_t timestamp = replay->pending.timestampNs;
+    if (!replay->reader.next(replay->pending)) {
+        qDebug() << "Replayed" << replay->fed << "Waku events";
+        return;
+    }
+    net->schedule(replay->pending.timestampNs - timestamp, [this, net, replay] { feedReplay(net, replay); });
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <QtCore/QObject>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+#include "../waku/waku_interface.h"
+#include "sim_network.h"
+
+// Chat traffic the virtual peers send on their own, to load what runs on
+// top of the simulated node
+struct SimTraffic {
+    double perSecond = 0;  // messages over all peers, 0 none
+    std::string pubsubTopic = "/waku/2/rs/16/32";
+    std::vector<std::string> contentTopics;
+    size_t textSize = 100;  // characters of each message
+};
+
+// WakuInterface over a simulated network: this plugin is node 0 of a
+// SimNetwork, with every other node a virtual peer in the same process.
+// Chat, UIs and benchmarks run against it offline, unchanged, by loading it
+// in place of the waku plugin and setting LOGOS_WAKU_PLUGIN=waku_sim.
+//
+// The network is set up by initWaku() from the keys of its config and of
+// the JSON object in LOGOS_WAKU_SIM, which wins: nodes, fanout, latencyMs,
+// latencySpreadMs, jitterMs, loss, bandwidth, storeNodes, storeCapacity,
+// storeDelayMs, timeScale and seed as in SimOptions; trafficPerSecond,
+// trafficPubsubTopic, trafficTopics and trafficTextSize as in SimTraffic;
+// and historyMessages, historyTopics, historyPubsubTopic, historyIntervalMs
+// and historyTextSize for a SyntheticHistory the store nodes start with,
+// ending when the network starts; and replayLog, the path of an event log
+// the waku plugin captured (LOGOS_WAKU_CAPTURE) whose events are handed to
+// the event callback again from startWaku(), spaced as captured in
+// simulated time. Events and answers come as libwaku's JSON, from the
+// network's thread.
+class WakuSim : public QObject, public WakuInterface {
+    Q_OBJECT
+    Q_PLUGIN_METADATA(IID WakuInterface_iid FILE "metadata.json")
+    Q_INTERFACES(WakuInterface PluginInterface)
+
+public:
+    WakuSim();
+    ~WakuSim();
+
+    // PluginInterface
+    QString name() const override { return "waku_sim"; }
+    QString version() const override { return "0.1.0"; }
+
+    // WakuInterface implementation
+    Q_INVOKABLE void initWaku(const QString &cfg = "{}", WakuInitCallback callback = nullptr) override;
+    Q_INVOKABLE void getVersion(WakuVersionCallback callback = nullptr) override;
+    Q_INVOKABLE void startWaku(WakuStartCallback callback = nullptr) override;
+    Q_INVOKABLE void stopWaku(WakuStopCallback callback = nullptr) override;
+    Q_INVOKABLE void createContentTopic(const QString &appName, unsigned int appVersion,
+                                       const QString &contentTopicName, const QString &encoding,
+                                       WakuContentTopicCallback callback = nullptr) override;
+    Q_INVOKABLE void createPubSubTopic(const QString &topicName,
+                                      WakuPubSubTopicCallback callback = nullptr) override;
+    Q_INVOKABLE void getDefaultPubSubTopic(WakuPubSubTopicCallback callback = nullptr) override;
+    Q_INVOKABLE void relayPublish(const QString &pubSubTopic, const QString &jsonWakuMessage,
+                                 unsigned int timeoutMs, WakuPublishCallback callback = nullptr) override;
+    Q_INVOKABLE void relayAddProtectedShard(int clusterId, int shardId, const QString &publicKey,
+                                          WakuProtectedShardCallback callback = nullptr) override;
+    Q_INVOKABLE void relaySubscribe(const QString &pubSubTopic,
+                                  WakuSubscribeCallback callback = nullptr) override;
+    Q_INVOKABLE void relayUnsubscribe(const QString &pubSubTopic,
+                                     WakuSubscribeCallback callback = nullptr) override;
+    Q_INVOKABLE void filterSubscribe(const QString &pubSubTopic, const QString &contentTopics,
+                                   WakuFilterSubscribeCallback callback = nullptr) override;
+    Q_INVOKABLE void filterUnsubscribe(const QString &pubSubTopic, const QString &contentTopics,
+                                     WakuFilterUnsubscribeCallback callback = nullptr) override;
+    Q_INVOKABLE void connectPeer(const QString &peerMultiAddr, unsigned int timeoutMs,
+                                WakuConnectCallback callback = nullptr) override;
+    Q_INVOKABLE void storeQuery(const QString &jsonQuery, const QString &peerAddr,
+                              unsigned int timeoutMs, WakuStoreQueryCallback callback = nullptr) override;
+    Q_INVOKABLE void destroyWaku(WakuDestroyCallback callback = nullptr) override;
+    Q_INVOKABLE void setEventCallback(WakuEventCallback callback) override;
+
+    // Counters of the whole simulated network
+    SimStats stats() const;
+
+private:
+    std::shared_ptr<SimNetwork> current() const;
+    void deliver(const SimMessagePtr& message);
+    void sendTraffic(SimNetwork* net);
+
+    struct Replay;
+    void startReplay(SimNetwork* net);
+    void feedReplay(SimNetwork* net, const std::shared_ptr<Replay>& replay);
+
+    mutable std::mutex mutex;
+    std::shared_ptr<SimNetwork> network;  // replaced by initWaku() and destroyWaku()
+    SimTraffic traffic;
+    std::mt19937_64 trafficRng;
+    bool trafficStarted;
+    std::string replayLog;  // empty for none
+    bool replayStarted;
+    uint64_t epochOffset;  // ns since the epoch at simulated time 0
+    WakuEventCallback eventCallback;
+};